@@ -110,18 +110,18 @@ tcp_open(const char *ip, int port) //ip, port
 	struct sockaddr_in remote;
 	int fd;
 
-	if ((fd=socket(AF_INET, SOCK_DGRAM, IPPROTO_TCP))==-1) return 0;
+	if ((fd=socket(AF_INET, SOCK_STREAM, IPPROTO_TCP))==-1) return 0;
 
 	memset((char *) &remote, 0, sizeof(remote));
 	remote.sin_family = AF_INET;
 	remote.sin_port = htons(port);
 	remote.sin_addr.s_addr = inet_addr(ip);
 
-	int flags = fcntl(fd, F_GETFL);
-	if(fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) return 0;
+	// connect to the socket, then switch to non-blocking reads
+	if (connect(fd, (struct sockaddr*)&remote, sizeof(remote)) < 0) { close(fd); return 0; }
 
-	// connect to the socket
-	if (connect(fd, (struct sockaddr*)&remote, sizeof(remote)) < 0) return 0;
+	int flags = fcntl(fd, F_GETFL);
+	if(fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) { close(fd); return 0; }
 
 	return fd;
 }
@@ -439,3 +439,63 @@ std::string ecmd_connection::execute(std::string ecmd,int timeout) {
         return std::string();
 }
 
+
+//####################################### Binary ################################################
+
+// Send a binary request to fd and collect the data of all responses until
+// one isn't marked ECMD_BINARY_AGAIN.  Returns the status of the last one.
+static int
+binary_transact(int fd, int opcode, const std::string& args, std::string& data, int timeout)
+{
+    if (args.size() > 255) return -1;
+
+    std::string req;
+    req.push_back((char) ECMD_BINARY_MARK);
+    req.push_back((char) opcode);
+    req.push_back((char) args.size());
+    req += args;
+    if (send(fd, req.data(), req.size(), 0) != (int) req.size()) return -1;
+
+    std::string buf;
+    char chunk[response_buffer_len];
+    struct pollfd pfd = { fd, POLLIN, 0 };
+
+    while (poll(&pfd, 1, timeout) > 0) {
+        int ret = recv(fd, chunk, sizeof(chunk), 0);
+        if (ret <= 0) return -1;
+        buf.append(chunk, ret);
+
+        // take the complete responses, a datagram may hold several
+        while (buf.size() >= 4 && buf.size() >= 4 + (size_t) (unsigned char) buf[3]) {
+            if ((unsigned char) buf[0] != ECMD_BINARY_MARK) return -1;
+            int status = (unsigned char) buf[2];
+            data.append(buf, 4, (unsigned char) buf[3]);
+            buf.erase(0, 4 + (unsigned char) buf[3]);
+            if (status != ECMD_BINARY_AGAIN) return status;
+        }
+    }
+    return -1;
+}
+
+int ecmd_connection::resolve(std::string name, int timeout) {
+    int status;
+    std::string data = execute_binary(ECMD_BINARY_RESOLVE, name, &status, timeout);
+    if (status != ECMD_BINARY_OK || data.size() < 1) return -1;
+    return (unsigned char) data[0];
+}
+
+std::string ecmd_connection::execute_binary(int opcode, std::string args, int *status, int timeout) {
+    std::string data;
+    int fd = 0, ret = -1;
+
+    if (udp.size())
+        fd = udp.front()->fd;
+    else if (tcp.size())
+        fd = tcp.front()->fd;
+
+    if (fd)
+        ret = binary_transact(fd, opcode, args, data, timeout);
+
+    if (status) *status = ret;
+    return data;
+}
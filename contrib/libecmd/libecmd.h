@@ -39,6 +39,7 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA */
 #include <sys/fcntl.h>   /* File control definitions */
 #include <errno.h>   /* Error number definitions */
 #include <termios.h> /* POSIX terminal control definitions */
+#include <poll.h>
 #include <time.h>
 
 #define _BV(bit) (1 << (bit))
@@ -51,6 +52,13 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA */
 
 #define response_buffer_len 500
 
+/* binary requests, see protocols/ecmd/parser.h */
+#define ECMD_BINARY_MARK 0xfe
+#define ECMD_BINARY_RESOLVE 0xff
+#define ECMD_BINARY_OK 0x00
+#define ECMD_BINARY_AGAIN 0x01
+#define ECMD_BINARY_ERROR 0x80
+
 struct usb_esex_device {
     usb_dev_handle *fd;
     struct usb_esex_device* next;
@@ -82,6 +90,9 @@ class ecmd_connection {
     int add_tcp_device(const char* ip, int port);
     int add(std::string conn_string);
     std::string execute(std::string ecmd,int timeout=500);
+    // binary requests (udp and tcp devices only)
+    int resolve(std::string name, int timeout=500);
+    std::string execute_binary(int opcode, std::string args, int *status=0, int timeout=500);
 
     private:
     std::list<usb_esex_device*> usb;
@@ -1,13 +1,17 @@
 #!/usr/bin/perl
 use strict;
+use Time::HiRes qw(time);
 use Ethersex::TFTPd 0.02 qw(%OPCODES);
 
 # change ROOTDIR to your TFTP root directory
 my $rootdir = $ARGV[0];
 
+# largest windowsize granted to clients, 1 disables RFC 7440 windows
+my $maxwindow = $ARGV[1] || 64;
+
 unless(-d $rootdir)
 {
-	print "\nUsage: EthersexTFTPd.pl <rootdir>\n\n";
+	print "\nUsage: EthersexTFTPd.pl <rootdir> [maxwindow]\n\n";
 	exit 1;
 }
 
@@ -33,6 +37,7 @@ my $listener = Ethersex::TFTPd->new
      'Writable' => 0, 
      'Timeout' => 9999, 
      'CallBack' => \&callback, 
+     'MaxWindow' => $maxwindow,
      'debug' => 0, 
      'crypto' => "\x23\x23\x42\x42\x55\x55\x23\x23\x42\x42"
     ) or die Ethersex::TFTPd->error;
@@ -48,9 +53,15 @@ while(my $request = $listener->waitRQ())
 	printf "Received a %s for file '%s'\n", $OPCODES{$request->{'_REQUEST_'}{'OPCODE'}}, $request->{'_REQUEST_'}{'FileName'};
 
 	# process the request
+	my $start = time;
 	if($request->processRQ())
 	{
-		print "OK, transfer completed successfully\n";
+		my $secs = time - $start;
+		my $bytes = -s $request->{'_REQUEST_'}{'FileName'};
+		printf "OK, transfer completed successfully\n";
+		printf "%u bytes in %.2f s (%.1f kB/s), blksize %u, windowsize %u\n",
+		    $bytes, $secs, $secs ? $bytes / $secs / 1024 : 0,
+		    $request->{'BlkSize'}, $request->{'WindowSize'};
 	}
 	else
 	{
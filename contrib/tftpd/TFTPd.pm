@@ -16,6 +16,7 @@ use constant TFTP_MIN_BLKSIZE  => 512;
 use constant TFTP_MAX_BLKSIZE  => 1428;
 use constant TFTP_MIN_TIMEOUT  => 1;
 use constant TFTP_MAX_TIMEOUT  => 60;
+use constant TFTP_MAX_WINDOWSIZE => 64;
 use constant TFTP_DEFAULT_PORT => 69;
 
 use constant TFTP_OPCODE_RRQ   => 1;
@@ -148,6 +149,8 @@ sub new
 			'Writable'    => 0,
 			'CallBack'    => undef,
 			'BlkSize'     => TFTP_MIN_BLKSIZE,
+			'WindowSize'  => 1,
+			'MaxWindow'   => TFTP_MAX_WINDOWSIZE,
 			'Debug'       => 0,
 			%cfg,         # merge user parameters
 			'_UDPSERVER_' => $udpserver
@@ -487,6 +490,23 @@ sub negotiateOPTS
 					$self->{'FileSize'} = $self->{'_REQUEST_'}{'RFC2347'}{$option};
 				}
 			}
+			elsif(uc($option) eq 'WINDOWSIZE')
+			{
+				# Negotiate the window size (RFC 7440), never more than we allow
+				if($self->{'_REQUEST_'}{'RFC2347'}{$option} < 1 or $self->{'MaxWindow'} < 2)
+				{
+					$self->{'_REQUEST_'}{'RFC2347'}{$option} = $self->{'WindowSize'};
+				}
+				else
+				{
+					if($self->{'_REQUEST_'}{'RFC2347'}{$option} > $self->{'MaxWindow'})
+					{
+						$self->{'_REQUEST_'}{'RFC2347'}{$option} = $self->{'MaxWindow'};
+					}
+					$self->{'_RESPONSE_'}{'RFC2347'}{$option} = $self->{'_REQUEST_'}{'RFC2347'}{$option};
+					$self->{'WindowSize'} = $self->{'_RESPONSE_'}{'RFC2347'}{$option};
+				}
+			}
 			elsif(uc($option) eq 'TIMEOUT')
 			{
 				# Negotiate the transfer timeout
@@ -612,6 +632,11 @@ sub sendFILE
 {
 	my $self = shift;
 
+	if($self->{'WindowSize'} > 1)
+	{
+		return($self->sendWINDOW());
+	}
+
 	while(1)
 	{
 		if($self->{'_REQUEST_'}{'LASTACK'} < $self->{'_REQUEST_'}{'LASTBLK'})
@@ -663,6 +688,11 @@ sub recvFILE
 	$self->{'_REQUEST_'}{'LASTBLK'} = 0;
 	$self->{'_REQUEST_'}{'PREVBLK'} = 0;
 
+	if($self->{'WindowSize'} > 1)
+	{
+		return($self->recvWINDOW());
+	}
+
 	while(1)
 	{
 		my $datablk = 0;
@@ -875,6 +905,235 @@ sub sendDATA
 	}
 }
 
+#
+# Usage: $requestOBJ->sendWINDOW();
+# sends WindowSize blocks per ACK, restarting after the acknowledged block
+# return 1 if success or undef if error
+#
+sub sendWINDOW
+{
+	my $self = shift;
+
+	my $udpserver = $self->{'_UDPSERVER_'};
+	my $fh = $self->{'_REQUEST_'}{'_FH_'};
+	my $retry = 0;
+	my $resend = 1;
+	my $block;
+
+	my ($datagram, $opcode, $datain);
+
+	while($self->{'_REQUEST_'}{'LASTACK'} < $self->{'_REQUEST_'}{'LASTBLK'})
+	{
+		if($resend)
+		{
+			# (re)send the window following the last acknowledged block
+			$block = $self->{'_REQUEST_'}{'LASTACK'};
+			seek($fh, $block * $self->{'BlkSize'}, 0);
+
+			while($block < $self->{'_REQUEST_'}{'LASTBLK'} and $block < $self->{'_REQUEST_'}{'LASTACK'} + $self->{'WindowSize'})
+			{
+				my $datablk = '';
+				if(!defined(read($fh, $datablk, $self->{'BlkSize'})))
+				{
+					$LASTERROR = sprintf "Error $! reading file '%s'", $self->{'_REQUEST_'}{'FileName'};
+					return(undef);
+				}
+
+				# encrypt data for ethersex
+				$self->ethersexENCRYPT(\$datablk);
+
+				$block++;
+				if(!$udpserver->send(pack("nna*", TFTP_OPCODE_DATA, $block, $datablk)))
+				{
+					$! = $udpserver->sockopt(SO_ERROR);
+					$LASTERROR = sprintf "Socket SEND error: %s\n", $!;
+					return(undef);
+				}
+			}
+		}
+
+		# vars for IO select
+		my ($rin, $rout, $ein, $eout) = ('', '', '', '');
+		vec($rin, fileno($udpserver), 1) = 1;
+
+		# wait for acknowledge
+		if(select($rout=$rin, undef, $eout=$ein, $self->{'ACKtimeout'}))
+		{
+			# read the message
+			if($udpserver->recv($datagram, TFTP_MAX_BLKSIZE + 4))
+			{
+				# decode the message
+				($opcode, $datain) = unpack("na*", $datagram);
+				if($opcode eq TFTP_OPCODE_ACK)
+				{
+					# message is ACK, the client wants the blocks following it
+					my $lastack = unpack("n", $datain);
+					if($lastack < $self->{'_REQUEST_'}{'LASTACK'} or $lastack > $block)
+					{
+						# stale ACK, keep waiting
+						$resend = 0;
+						next;
+					}
+
+					$self->{'_REQUEST_'}{'PREVACK'} = $self->{'_REQUEST_'}{'LASTACK'};
+					$self->{'_REQUEST_'}{'LASTACK'} = $lastack;
+					$resend = 1;
+					$retry = 0;
+
+					if($self->{'CallBack'})
+					{
+						&{$self->{'CallBack'}}($self);
+					}
+				}
+				elsif($opcode eq TFTP_OPCODE_ERROR)
+				{
+					# message is ERR
+					$LASTERROR = sprintf "TFTP error message: %s", $datain;
+					return(undef);
+				}
+				else
+				{
+					# other messages...
+					$LASTERROR = sprintf "Opcode %d not supported as a reply to DATA\n", $opcode;
+					return(undef);
+				}
+			}
+			else
+			{
+				$! = $udpserver->sockopt(SO_ERROR);
+				$LASTERROR = sprintf "Socket RECV error: %s\n", $!;
+				return(undef);
+			}
+		}
+		else
+		{
+			$LASTERROR = sprintf "Retry %d - timeout occurred on ACK packet %d\n", $retry, $block;
+			$debug and carp($LASTERROR);
+
+			if(++$retry >= $self->{'ACKretries'})
+			{
+				return(undef);
+			}
+			$resend = 1;
+		}
+	}
+
+	# transfer completed
+	return(1);
+}
+
+#
+# Usage: $requestOBJ->recvWINDOW();
+# acknowledges every WindowSize blocks, or the last one in order if a block is lost
+# return 1 if success or undef if error
+#
+sub recvWINDOW
+{
+	my $self = shift;
+
+	my $udpserver = $self->{'_UDPSERVER_'};
+	my $fh = $self->{'_REQUEST_'}{'_FH_'};
+	my $retry = 0;
+	my $received = 0;
+	my $gap = 0;
+
+	my ($datagram, $opcode, $datain, $block, $datablk);
+
+	while(1)
+	{
+		my $ack = 0;
+		my $done = 0;
+
+		# vars for IO select
+		my ($rin, $rout, $ein, $eout) = ('', '', '', '');
+		vec($rin, fileno($udpserver), 1) = 1;
+
+		# wait for data
+		if(select($rout=$rin, undef, $eout=$ein, $self->{'ACKtimeout'}))
+		{
+			# read the message
+			if(!$udpserver->recv($datagram, $self->{'BlkSize'} + 4))
+			{
+				$! = $udpserver->sockopt(SO_ERROR);
+				$LASTERROR = sprintf "Socket RECV error: %s\n", $!;
+				return(undef);
+			}
+
+			# decode the message
+			($opcode, $datain) = unpack("na*", $datagram);
+			if($opcode eq TFTP_OPCODE_ERROR)
+			{
+				# message is ERR
+				$LASTERROR = sprintf "TFTP error message: %s", $datain;
+				return(undef);
+			}
+			elsif($opcode ne TFTP_OPCODE_DATA)
+			{
+				# other messages...
+				$LASTERROR = sprintf "Opcode %d not supported waiting for DATA\n", $opcode;
+				return(undef);
+			}
+
+			($block, $datablk) = unpack("na*", $datain);
+			if($block == $self->{'_REQUEST_'}{'LASTBLK'} + 1)
+			{
+				# next block, write it to file
+				if(!defined(syswrite($fh, $datablk)))
+				{
+					$LASTERROR = sprintf "Error $! writing file '%s'", $self->{'_REQUEST_'}{'FileName'};
+					return(undef);
+				}
+
+				$self->{'_REQUEST_'}{'PREVBLK'} = $self->{'_REQUEST_'}{'LASTBLK'};
+				$self->{'_REQUEST_'}{'LASTBLK'} = $block;
+				$retry = 0;
+				$gap = 0;
+
+				if($self->{'CallBack'})
+				{
+					&{$self->{'CallBack'}}($self);
+				}
+
+				$done = length($datablk) < $self->{'BlkSize'};
+				$ack = $done || ++$received >= $self->{'WindowSize'};
+			}
+			elsif(!$gap)
+			{
+				# a block or our last ACK got lost, have the client go on
+				# after the last block in order (once, until it does)
+				$ack = $gap = 1;
+			}
+		}
+		else
+		{
+			$LASTERROR = sprintf "Timeout occurred on DATA packet %d\n", $self->{'_REQUEST_'}{'LASTBLK'} + 1;
+			$debug and carp($LASTERROR);
+
+			if(++$retry >= $self->{'ACKretries'})
+			{
+				return(undef);
+			}
+			$ack = 1;
+		}
+
+		if($ack)
+		{
+			$received = 0;
+			if(!defined($udpserver->send(pack("nn", TFTP_OPCODE_ACK, $self->{'_REQUEST_'}{'LASTBLK'}))))
+			{
+				$! = $udpserver->sockopt(SO_ERROR);
+				$LASTERROR = sprintf "Socket SEND error: %s\n", $!;
+				return(undef);
+			}
+
+			if($done)
+			{
+				return(1);
+			}
+		}
+	}
+}
+
 #
 # Usage: $requestOBJ->openFILE()
 # returns 1 if file is opened, undef if error
@@ -1212,6 +1471,7 @@ Valid options are:
   Readable   Clients are allowed to read files                        1
   Writable   Clients are allowed to write files                       0
   BlkSize    Minimum blocksize to negotiate for transfers           512
+  MaxWindow  Maximum windowsize to negotiate (RFC 7440)              64
   CallBack   Reference to code executed for each transferred block    -
   Debug      Activates debug mode (verbose)                           0
 
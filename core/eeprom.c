@@ -51,30 +51,159 @@ uint8_t crc_checksum(void *data, uint8_t length)
 
 #ifdef EEPROM_SUPPORT
 
+/* The config lives in two slots.  eeprom_config points to the one with the
+   highest sequence number whose checksum is fine.  Changes are written to
+   the other slot, eeprom_commit() stamps it with the next sequence number
+   and its checksum, only then it replaces the old one.  A power failure
+   before that leaves the old config in place. */
+
+#define EEPROM_CONFIG_SIZE sizeof(struct eeprom_config_t)
+#define EEPROM_CONFIG_SUMMED offsetof(struct eeprom_config_t, chksum)
+#define EEPROM_CONFIG_SEQ offsetof(struct eeprom_config_t, seq)
+
+#define eeprom_config_other() \
+  (eeprom_config == EEPROM_CONFIG_BASE \
+   ? EEPROM_CONFIG_BASE + EEPROM_CONFIG_SIZE : EEPROM_CONFIG_BASE)
+
+#define EEPROM_CONFIG_OPEN 0x01	/* eeprom_config is the slot being written */
+#define EEPROM_CONFIG_CHANGED 0x02 /* the commit has to write a new slot */
+
+uint8_t *eeprom_config = EEPROM_CONFIG_BASE;
+static uint8_t eeprom_config_state;
+
+/* Checksum of the current config, kept up to date as bytes change. */
+static uint16_t eeprom_config_sum;
+
+/* Bytes changed by the last commit, the slots differ only there. */
+static uint8_t eeprom_config_dirty[(EEPROM_CONFIG_SEQ + 7) / 8];
+
+
+/* Fletcher style checksum: the low byte sums up the bytes, the high byte
+   weights them by their position, so a changed byte can be accounted for
+   without reading the others. */
+static uint16_t
+eeprom_config_sum_update (uint16_t sum, uint16_t offset, uint8_t delta)
+{
+    uint8_t s1 = sum, s2 = sum >> 8;
+    s1 += delta;
+    s2 += (uint8_t) (EEPROM_CONFIG_SUMMED - offset) * delta;
+    return s1 | (uint16_t) s2 << 8;
+}
+
+
+static void
+eeprom_config_put (uint16_t offset, uint8_t value)
+{
+    uint8_t old = eeprom_read_byte (eeprom_config + offset);
+    if (old == value)
+	return;
+
+    eeprom_write_byte (eeprom_config + offset, value);
+    eeprom_config_sum = eeprom_config_sum_update (eeprom_config_sum,
+						  offset, value - old);
+    eeprom_config_dirty[offset / 8] |= 1 << (offset % 8);
+    eeprom_config_state |= EEPROM_CONFIG_CHANGED;
+}
+
+
+/* Switch to the other slot, bringing it up to date first. */
+static void
+eeprom_config_begin (void)
+{
+    if (eeprom_config_state & EEPROM_CONFIG_OPEN)
+	return;
+
+    uint8_t *from = eeprom_config;
+    eeprom_config = eeprom_config_other ();
+
+    for (uint16_t i = 0; i < EEPROM_CONFIG_SEQ; i++) {
+	if (!(eeprom_config_dirty[i / 8] & (1 << (i % 8))))
+	    continue;
+
+	uint8_t value = eeprom_read_byte (from + i);
+	if (eeprom_read_byte (eeprom_config + i) != value)
+	    eeprom_write_byte (eeprom_config + i, value);
+    }
+
+    memset (eeprom_config_dirty, 0, sizeof (eeprom_config_dirty));
+    eeprom_config_state |= EEPROM_CONFIG_OPEN;
+}
+
+
 void
-eeprom_write_block_hack(void *dst, const void *src, size_t n)
+eeprom_save_block (uint16_t offset, const void *data, uint8_t len)
 {
-  while (n--) {
-    eeprom_write_byte(&((uint8_t *)dst)[n], ((uint8_t *)src)[n]);
-  }
+    eeprom_config_begin ();
+
+    for (uint8_t i = 0; i < len; i++)
+	eeprom_config_put (offset + i, ((const uint8_t *) data)[i]);
 }
 
 
-uint8_t
-eeprom_get_chksum(void)
+void
+eeprom_commit (void)
 {
-    uint8_t eeprom_crc = 0;
-    uint8_t *p = (uint8_t *)EEPROM_CONFIG_BASE;
+    if (!(eeprom_config_state & EEPROM_CONFIG_OPEN))
+	return;
 
-    for (uint8_t i = 0; i < (sizeof(struct eeprom_config_t) - 1 ); i++) {
-        eeprom_crc = _crc_ibutton_update(eeprom_crc, eeprom_read_byte(p));
-        p++;
+    eeprom_config_put (offsetof (struct eeprom_config_t, magic),
+		       EEPROM_CONFIG_MAGIC);
+
+    if (eeprom_config_state & EEPROM_CONFIG_CHANGED) {
+	/* The sequence number goes up by one, the checksum was written last
+	   and won't match until this slot is complete. */
+	uint8_t seq = eeprom_read_byte (eeprom_config_other ()
+					+ EEPROM_CONFIG_SEQ) + 1;
+	eeprom_config_sum = eeprom_config_sum_update (eeprom_config_sum,
+						      EEPROM_CONFIG_SEQ, 1);
+	eeprom_write_byte (eeprom_config + EEPROM_CONFIG_SEQ, seq);
+	eeprom_write_block (&eeprom_config_sum,
+			    eeprom_config + EEPROM_CONFIG_SUMMED, 2);
     }
+    else
+	/* Nothing changed, both slots hold the same data now. */
+	eeprom_config = eeprom_config_other ();
 
-    return eeprom_crc;
+    eeprom_config_state = 0;
 }
 
 
+void
+eeprom_mount (void)
+{
+    uint16_t sum[2];
+    uint8_t seq[2], valid[2];
+
+    for (uint8_t slot = 0; slot < 2; slot++) {
+	uint8_t *p = EEPROM_CONFIG_BASE + slot * EEPROM_CONFIG_SIZE;
+	uint16_t chksum;
+
+	sum[slot] = 0;
+	for (uint16_t i = 0; i < EEPROM_CONFIG_SUMMED; i++)
+	    sum[slot] = eeprom_config_sum_update (sum[slot], i,
+						  eeprom_read_byte (p + i));
+
+	eeprom_read_block (&chksum, p + EEPROM_CONFIG_SUMMED, 2);
+	seq[slot] = eeprom_read_byte (p + EEPROM_CONFIG_SEQ);
+	valid[slot] = chksum == sum[slot]
+	  && eeprom_read_byte (p + offsetof (struct eeprom_config_t, magic))
+	     == EEPROM_CONFIG_MAGIC;
+    }
+
+    uint8_t slot = valid[1] && (!valid[0] || (int8_t) (seq[1] - seq[0]) > 0);
+    eeprom_config = EEPROM_CONFIG_BASE + slot * EEPROM_CONFIG_SIZE;
+    eeprom_config_sum = sum[slot];
+    eeprom_config_state = 0;
+
+    /* We don't know where the slots differ. */
+    memset (eeprom_config_dirty, 0xff, sizeof (eeprom_config_dirty));
+
+    if (!valid[slot]) {
+	eeprom_config_state = EEPROM_CONFIG_CHANGED;
+	eeprom_init ();
+    }
+}
+
 
 void
 eeprom_init (void)
@@ -118,9 +247,15 @@ eeprom_init (void)
 	eeprom_save (stella_channel_values, v, 10);
 #endif
 
-    eeprom_update_chksum();
+    eeprom_commit();
 }
 
 
 #endif	/* EEPROM_SUPPORT */
 
+/*
+  -- Ethersex META --
+  header(core/eeprom.h)
+  initearly(eeprom_mount)
+*/
+
@@ -73,15 +73,22 @@ struct eeprom_config_t {
 	uint8_t stella_fadestep;
 #endif
 
-    uint8_t crc;
+    /* slot header, see eeprom_commit() */
+    uint8_t magic;
+    uint8_t seq;
+    uint16_t chksum;
 };
 
 
+/* The config is stored twice, the second slot follows the first one. */
 #define EEPROM_CONFIG_BASE  (uint8_t *)0x0000
+#define EEPROM_CONFIG_MAGIC 0xe5
 
 
 uint8_t crc_checksum(void *data, uint8_t length);
-void eeprom_write_block_hack(void *dst, const void *src, size_t n);
+
+/* Slot holding the current config, eeprom_restore reads from here. */
+extern uint8_t *eeprom_config;
 
 /* Reset the EEPROM to sane defaults. */
 void eeprom_reset (void);
@@ -89,11 +96,22 @@ void eeprom_reset (void);
 /* Initialize EEPROM cruft. */
 void eeprom_init (void);
 
-/* Calculate crc value, from config saved in eeprom */
-uint8_t eeprom_get_chksum(void);
+#ifdef EEPROM_SUPPORT
+/* Find the newest valid config slot, initialize EEPROM if there is none. */
+void eeprom_mount (void);
+
+/* Write len bytes to the config at offset, bytes already equal to
+   data aren't written.  Changes become permanent with eeprom_commit. */
+void eeprom_save_block (uint16_t offset, const void *data, uint8_t len);
+
+/* Make the changes since the last commit the current config. */
+void eeprom_commit (void);
+#else
+#define eeprom_mount()
+#endif
 
 #define eeprom_save(dst, data, len) \
-  eeprom_write_block_hack(EEPROM_CONFIG_BASE + offsetof(struct eeprom_config_t, dst), data, len)
+  eeprom_save_block(offsetof(struct eeprom_config_t, dst), data, len)
 
 #define eeprom_save_P(dst,data_pgm,len) \
     do { char data[len]; memcpy_P(data, data_pgm, len); eeprom_save(dst, data, len);} while(0)
@@ -106,7 +124,7 @@ uint8_t eeprom_get_chksum(void);
 
 /* Reads len byte from eeprom at dst into mem */
 #define eeprom_restore(dst, mem, len) \
-  eeprom_read_block(mem, EEPROM_CONFIG_BASE + offsetof(struct eeprom_config_t, dst), len)
+  eeprom_read_block(mem, eeprom_config + offsetof(struct eeprom_config_t, dst), len)
 
 #define eeprom_restore_ip(dst,mem) \
     eeprom_restore(dst, mem, IPADDR_LEN)
@@ -117,9 +135,6 @@ uint8_t eeprom_get_chksum(void);
 #define eeprom_restore_int(dst, mem) \
     eeprom_restore(dst, mem, 2)
 
-/* Update the eeprom crc */
-#define eeprom_update_chksum() eeprom_save_char(crc, eeprom_get_chksum())
-
 
 
 #endif /* _EEPROM_H */
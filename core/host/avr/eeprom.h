@@ -0,0 +1,46 @@
+/*
+ * Copyright (c) 2009 by Christian Dietrich <stettberger@dokucode.de>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License (either version 2 or
+ * version 3) as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * For more information on the GPL, please go to:
+ * http://www.gnu.org/copyleft/gpl.html
+ */
+
+/* The host build keeps the eeprom contents in RAM, they are lost when the
+ * process exits. */
+
+#ifndef _HOST_AVR_EEPROM_H
+#define _HOST_AVR_EEPROM_H
+
+#include <stdint.h>
+#include <string.h>
+#include <avr/io.h>
+
+#define EEMEM
+
+extern uint8_t host_eeprom[E2END + 1];
+
+/* eeprom "pointers" are plain offsets, see EEPROM_CONFIG_BASE */
+#define host_eeprom_ptr(addr) (host_eeprom + ((uintptr_t) (addr) & E2END))
+
+#define eeprom_is_ready() 1
+#define eeprom_busy_wait() do { } while (0)
+
+#define eeprom_read_byte(addr) (*host_eeprom_ptr(addr))
+#define eeprom_write_byte(addr, val) (*host_eeprom_ptr(addr) = (val))
+#define eeprom_read_block(dst, src, n) memcpy((dst), host_eeprom_ptr(src), (n))
+#define eeprom_write_block(src, dst, n) memcpy(host_eeprom_ptr(dst), (src), (n))
+
+#endif /* _HOST_AVR_EEPROM_H */
@@ -0,0 +1,60 @@
+/*
+ * Copyright (c) 2009 by Christian Dietrich <stettberger@dokucode.de>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License (either version 2 or
+ * version 3) as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * For more information on the GPL, please go to:
+ * http://www.gnu.org/copyleft/gpl.html
+ */
+
+/* Minimal <avr/io.h> replacement for the host (Linux) build.  The port
+ * registers are plain variables, so the pinning macros keep working, but
+ * nothing is connected to them. */
+
+#ifndef _HOST_AVR_IO_H
+#define _HOST_AVR_IO_H
+
+#include <stdint.h>
+
+#define _BV(bit) (1 << (bit))
+#define bit_is_set(sfr, bit) ((sfr) & _BV(bit))
+#define bit_is_clear(sfr, bit) (!((sfr) & _BV(bit)))
+#define loop_until_bit_is_set(sfr, bit) do { } while (bit_is_clear(sfr, bit))
+#define loop_until_bit_is_clear(sfr, bit) do { } while (bit_is_set(sfr, bit))
+
+extern volatile uint8_t PORTA, PORTB, PORTC, PORTD, PORTE, PORTF;
+extern volatile uint8_t DDRA, DDRB, DDRC, DDRD, DDRE, DDRF;
+extern volatile uint8_t PINA, PINB, PINC, PIND, PINE, PINF;
+extern volatile uint8_t SREG, MCUSR;
+
+#define PA0 0
+#define PA1 1
+#define PA2 2
+#define PA3 3
+#define PA4 4
+#define PA5 5
+#define PA6 6
+#define PA7 7
+
+/* the reset flags are never set, the host has no reset reasons */
+#define PORF  0
+#define EXTRF 1
+#define BORF  2
+#define WDRF  3
+
+/* size of the emulated eeprom, see core/host/avr/eeprom.h */
+#define E2END 0x7FF
+#define RAMEND 0xFFFF
+
+#endif /* _HOST_AVR_IO_H */
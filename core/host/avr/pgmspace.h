@@ -0,0 +1,115 @@
+/*
+ * Copyright (c) 2009 by Christian Dietrich <stettberger@dokucode.de>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License (either version 2 or
+ * version 3) as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * For more information on the GPL, please go to:
+ * http://www.gnu.org/copyleft/gpl.html
+ */
+
+/* On the host there is only one address space, map all the _P functions
+ * to their plain libc counterparts. */
+
+#ifndef _HOST_AVR_PGMSPACE_H
+#define _HOST_AVR_PGMSPACE_H
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#define PROGMEM
+#define PSTR(s) (s)
+#define PGM_P const char *
+#define PGM_VOID_P const void *
+
+typedef char prog_char;
+typedef unsigned char prog_uchar;
+typedef int8_t prog_int8_t;
+typedef uint8_t prog_uint8_t;
+typedef int16_t prog_int16_t;
+typedef uint16_t prog_uint16_t;
+typedef int32_t prog_int32_t;
+typedef uint32_t prog_uint32_t;
+
+/* pgm_read_word() is used to fetch function and string pointers from
+ * tables, which are wider than 16 bits here; read pointer sized entries
+ * whole and everything else (including void pointers) as 16 bits. */
+static inline uintptr_t
+host_pgm_read_ptr (const void *addr)
+{
+  uintptr_t val;
+  memcpy (&val, addr, sizeof (val));
+  return val;
+}
+
+static inline uint16_t
+host_pgm_read_word (const void *addr)
+{
+  uint16_t val;
+  memcpy (&val, addr, sizeof (val));
+  return val;
+}
+
+#define pgm_read_byte(addr) (*(const uint8_t *)(addr))
+#define pgm_read_word(addr)					\
+  (sizeof (*(addr)) == sizeof (void *)				\
+   ? host_pgm_read_ptr (addr) : host_pgm_read_word (addr))
+#define pgm_read_dword(addr) (*(const uint32_t *)(addr))
+#define pgm_read_byte_near(addr) pgm_read_byte(addr)
+#define pgm_read_word_near(addr) pgm_read_word(addr)
+#define pgm_read_byte_far(addr) pgm_read_byte(addr)
+
+/* the flash page size of the atmega644, see vfs_inline */
+#ifndef SPM_PAGESIZE
+#define SPM_PAGESIZE 256
+#endif
+
+/* Flash addresses given as plain numbers (like the inlined files that
+ * vfs-concat appends to the firmware) index host_flash, which is loaded
+ * from the file named by $ETHERSEX_FLASH. */
+extern uint8_t host_flash[0x10000];
+#define host_flash_ptr(addr) (host_flash + (uint16_t) (addr))
+void host_flash_init (void);
+
+#define memcpy_P memcpy
+#define memcmp_P memcmp
+#define strcpy_P strcpy
+#define strncpy_P strncpy
+#define strcat_P strcat
+#define strcmp_P strcmp
+#define strncmp_P strncmp
+#define strcasecmp_P strcasecmp
+#define strncasecmp_P strncasecmp
+#define strlen_P strlen
+#define strstr_P strstr
+#define strchr_P strchr
+
+/* avr-libc's %S takes a string from flash, which glibc would print as a
+ * wide string; these turn it into %s first, see core/host/host.c */
+int host_printf_P (const char *fmt, ...);
+int host_sprintf_P (char *s, const char *fmt, ...);
+int host_snprintf_P (char *s, size_t n, const char *fmt, ...);
+int host_vsnprintf_P (char *s, size_t n, const char *fmt, va_list ap);
+int host_fprintf_P (FILE *f, const char *fmt, ...);
+
+#define printf_P host_printf_P
+#define sprintf_P host_sprintf_P
+#define snprintf_P host_snprintf_P
+#define sscanf_P sscanf
+#define vsnprintf_P host_vsnprintf_P
+#define fprintf_P host_fprintf_P
+#define fputs_P fputs
+
+#endif /* _HOST_AVR_PGMSPACE_H */
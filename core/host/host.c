@@ -0,0 +1,171 @@
+/*
+ * Copyright (c) 2009 by Christian Dietrich <stettberger@dokucode.de>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License (either version 2 or
+ * version 3) as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * For more information on the GPL, please go to:
+ * http://www.gnu.org/copyleft/gpl.html
+ */
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <avr/pgmspace.h>
+
+#include "config.h"
+#include "core/debug.h"
+
+/* virtual i/o registers, see core/host/avr/io.h */
+volatile uint8_t PORTA, PORTB, PORTC, PORTD, PORTE, PORTF;
+volatile uint8_t DDRA, DDRB, DDRC, DDRD, DDRE, DDRF;
+volatile uint8_t PINA, PINB, PINC, PIND, PINE, PINF;
+volatile uint8_t SREG, MCUSR;
+
+/* emulated eeprom, erased like a fresh chip */
+uint8_t host_eeprom[E2END + 1] = { [0 ... E2END] = 0xFF };
+
+/* emulated flash behind the firmware, see core/host/avr/pgmspace.h */
+uint8_t host_flash[0x10000] = { [0 ... 0xFFFF] = 0xFF };
+
+
+void
+host_flash_init (void)
+{
+  const char *fn = getenv ("ETHERSEX_FLASH");
+  FILE *f;
+  size_t len;
+
+  if (fn == NULL)
+    return;
+
+  if ((f = fopen (fn, "rb")) == NULL) {
+    perror ("host: ETHERSEX_FLASH");
+    exit (EXIT_FAILURE);
+  }
+
+  len = fread (host_flash, 1, sizeof (host_flash), f);
+  fclose (f);
+
+  if (len == 0) {
+    fprintf (stderr, "host: ETHERSEX_FLASH: %s is empty\n", fn);
+    exit (EXIT_FAILURE);
+  }
+
+  debug_printf ("host: loaded %d bytes of flash from %s\n", (int) len, fn);
+}
+
+
+/* Copy the printf format fmt to buf, turning each %S into %s. */
+static void
+host_format_P (char *buf, const char *fmt)
+{
+  while ((*buf ++ = *fmt))
+    {
+      if (*fmt ++ != '%')
+	continue;
+
+      while (*fmt && strchr ("-+ #0123456789.*hlLjzt", *fmt))
+	*buf ++ = *fmt ++;
+
+      if (*fmt == 'S' || *fmt == '%')
+	{
+	  *buf ++ = *fmt == 'S' ? 's' : '%';
+	  fmt ++;
+	}
+    }
+}
+
+
+int
+host_vsnprintf_P (char *s, size_t n, const char *fmt, va_list ap)
+{
+  char f[strlen (fmt) + 1];
+  host_format_P (f, fmt);
+  return vsnprintf (s, n, f, ap);
+}
+
+
+int
+host_snprintf_P (char *s, size_t n, const char *fmt, ...)
+{
+  va_list ap;
+  va_start (ap, fmt);
+  int ret = host_vsnprintf_P (s, n, fmt, ap);
+  va_end (ap);
+  return ret;
+}
+
+
+int
+host_sprintf_P (char *s, const char *fmt, ...)
+{
+  char f[strlen (fmt) + 1];
+  va_list ap;
+
+  host_format_P (f, fmt);
+  va_start (ap, fmt);
+  int ret = vsprintf (s, f, ap);
+  va_end (ap);
+  return ret;
+}
+
+
+int
+host_printf_P (const char *fmt, ...)
+{
+  char f[strlen (fmt) + 1];
+  va_list ap;
+
+  host_format_P (f, fmt);
+  va_start (ap, fmt);
+  int ret = vprintf (f, ap);
+  va_end (ap);
+  return ret;
+}
+
+
+int
+host_fprintf_P (FILE *stream, const char *fmt, ...)
+{
+  char f[strlen (fmt) + 1];
+  va_list ap;
+
+  host_format_P (f, fmt);
+  va_start (ap, fmt);
+  int ret = vfprintf (stream, f, ap);
+  va_end (ap);
+  return ret;
+}
+
+
+void
+debug_init_uart (void)
+{
+  /* line buffering, so the debug output interleaves with tcpdump & co. */
+  setvbuf (stdout, NULL, _IOLBF, 0);
+}
+
+
+int
+debug_uart_put (char d, FILE *stream)
+{
+  return putchar (d);
+}
+
+
+/*
+  -- Ethersex META --
+  header(avr/pgmspace.h)
+  init(host_flash_init)
+*/
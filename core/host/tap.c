@@ -0,0 +1,148 @@
+/*
+ * Copyright (c) 2009 by Christian Dietrich <stettberger@dokucode.de>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License (either version 2 or
+ * version 3) as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * For more information on the GPL, please go to:
+ * http://www.gnu.org/copyleft/gpl.html
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#include <linux/if.h>
+#include <linux/if_tun.h>
+
+#include "config.h"
+#include "core/debug.h"
+#include "network.h"
+#include "core/host/tap.h"
+
+/* wait at most this long for a frame per mainloop round, this keeps the
+   host process from spinning while still serving the timer in time */
+#define TAP_POLL_TIMEOUT_MS 1
+
+static int tap_fd = -1;
+
+
+void
+tap_init (void)
+{
+  struct ifreq ifr;
+  const char *dev = getenv ("ETHERSEX_TAP");
+
+  if (dev == NULL)
+    dev = CONF_TAP_DEVICE;
+
+  tap_fd = open ("/dev/net/tun", O_RDWR);
+  if (tap_fd < 0) {
+    perror ("tap: open /dev/net/tun");
+    exit (EXIT_FAILURE);
+  }
+
+  memset (&ifr, 0, sizeof (ifr));
+  ifr.ifr_flags = IFF_TAP | IFF_NO_PI;
+  strncpy (ifr.ifr_name, dev, IFNAMSIZ - 1);
+
+  if (ioctl (tap_fd, TUNSETIFF, &ifr) < 0) {
+    perror ("tap: TUNSETIFF");
+    exit (EXIT_FAILURE);
+  }
+
+  fcntl (tap_fd, F_SETFL, O_NONBLOCK);
+  debug_printf ("tap: attached to %s\n", ifr.ifr_name);
+}
+
+
+void
+network_process (void)
+{
+  struct pollfd pfd = { .fd = tap_fd, .events = POLLIN };
+
+  if (poll (&pfd, 1, TAP_POLL_TIMEOUT_MS) <= 0)
+    return;
+
+  if (uip_buf_lock ())
+    return;			/* already locked */
+
+  ssize_t len = read (tap_fd, uip_buf, UIP_BUFSIZE);
+  if (len < 14) {
+    if (len < 0 && errno != EAGAIN)
+      perror ("tap: read");
+    uip_buf_unlock ();
+    return;
+  }
+
+  uip_len = len;
+  if (network_frame_wanted (len))
+    network_process_frame ();
+  uip_buf_unlock ();
+}
+
+
+#if !UIP_CONF_IPV6
+/* For testing retransmissions, ETHERSEX_DROP lists the outgoing tcp
+   segments carrying data (counted from 1, comma separated) that are
+   silently dropped, as if they got lost on the wire. */
+static uint8_t
+tap_drop (void)
+{
+  static unsigned long count;
+  const char *list = getenv ("ETHERSEX_DROP");
+  struct uip_tcpip_hdr *hdr = (struct uip_tcpip_hdr *) &uip_buf[UIP_LLH_LEN];
+
+  if (list == NULL || uip_len < UIP_LLH_LEN + UIP_IPTCPH_LEN
+      || ((struct uip_eth_hdr *) uip_buf)->type != HTONS (UIP_ETHTYPE_IP)
+      || hdr->proto != UIP_PROTO_TCP
+      || ((hdr->len[0] << 8) | hdr->len[1])
+	 <= UIP_IPH_LEN + ((hdr->tcpoffset >> 4) << 2))
+    return 0;
+
+  count ++;
+  while (*list) {
+    char *end;
+    if (strtoul (list, &end, 10) == count)
+      return 1;
+    if (*end != ',')
+      break;
+    list = end + 1;
+  }
+  return 0;
+}
+#else
+#define tap_drop() 0
+#endif
+
+
+void
+transmit_packet (void)
+{
+  if (tap_drop ())
+    return;
+
+  if (write (tap_fd, uip_buf, uip_len) < 0)
+    perror ("tap: write");
+}
+
+
+/*
+  -- Ethersex META --
+  header(core/host/tap.h)
+  net_init(tap_init)
+  mainloop(network_process)
+*/
@@ -0,0 +1,38 @@
+/*
+ * Copyright (c) 2009 by Christian Dietrich <stettberger@dokucode.de>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License (either version 2 or
+ * version 3) as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * For more information on the GPL, please go to:
+ * http://www.gnu.org/copyleft/gpl.html
+ */
+#ifndef _HOST_TAP_H
+#define _HOST_TAP_H
+
+/* name of the tap interface to attach to, can be overridden with the
+   ETHERSEX_TAP environment variable at runtime */
+#ifndef CONF_TAP_DEVICE
+#define CONF_TAP_DEVICE "tap0"
+#endif
+
+/* open the tap device, exits the process on failure */
+void tap_init (void);
+
+/* receive and process at most one frame from the tap device */
+void network_process (void);
+
+/* send the frame in uip_buf, this is transmit_packet() on the host */
+void transmit_packet (void);
+
+#endif /* _HOST_TAP_H */
@@ -0,0 +1,65 @@
+/*
+ * Copyright (c) 2009 by Christian Dietrich <stettberger@dokucode.de>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License (either version 2 or
+ * version 3) as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * For more information on the GPL, please go to:
+ * http://www.gnu.org/copyleft/gpl.html
+ */
+
+/* Plain C versions of the avr-libc crc helpers, see the avr-libc manual
+ * for the reference implementations. */
+
+#ifndef _HOST_UTIL_CRC16_H
+#define _HOST_UTIL_CRC16_H
+
+#include <stdint.h>
+
+static inline uint16_t
+_crc16_update(uint16_t crc, uint8_t a)
+{
+  crc ^= a;
+  for (uint8_t i = 0; i < 8; ++i)
+    crc = (crc & 1) ? (crc >> 1) ^ 0xA001 : (crc >> 1);
+  return crc;
+}
+
+static inline uint16_t
+_crc_xmodem_update(uint16_t crc, uint8_t data)
+{
+  crc = crc ^ ((uint16_t) data << 8);
+  for (uint8_t i = 0; i < 8; i++)
+    crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : (crc << 1);
+  return crc;
+}
+
+static inline uint16_t
+_crc_ccitt_update(uint16_t crc, uint8_t data)
+{
+  data ^= crc & 0xff;
+  data ^= data << 4;
+  return ((((uint16_t) data << 8) | (crc >> 8)) ^ (uint8_t) (data >> 4)
+	  ^ ((uint16_t) data << 3));
+}
+
+static inline uint8_t
+_crc_ibutton_update(uint8_t crc, uint8_t data)
+{
+  crc = crc ^ data;
+  for (uint8_t i = 0; i < 8; i++)
+    crc = (crc & 0x01) ? (crc >> 1) ^ 0x8C : (crc >> 1);
+  return crc;
+}
+
+#endif /* _HOST_UTIL_CRC16_H */
@@ -0,0 +1,33 @@
+/*
+ * Copyright (c) 2009 by Christian Dietrich <stettberger@dokucode.de>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License (either version 2 or
+ * version 3) as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * For more information on the GPL, please go to:
+ * http://www.gnu.org/copyleft/gpl.html
+ */
+
+#ifndef _HOST_UTIL_DELAY_H
+#define _HOST_UTIL_DELAY_H
+
+#include <stdint.h>
+#include <unistd.h>
+
+#define _delay_us(us) usleep(us)
+#define _delay_ms(ms) usleep((ms) * 1000UL)
+
+/* four cpu cycles per iteration on the avr */
+#define _delay_loop_2(count) usleep((uint32_t) (count) * 4 * 1000000UL / F_CPU)
+
+#endif /* _HOST_UTIL_DELAY_H */
@@ -22,6 +22,9 @@
  */
 
 #include <avr/io.h>
+#ifdef ARCH_HOST
+#include <time.h>
+#endif
 
 #include "config.h"
 #include "core/periodic.h"
@@ -32,14 +35,41 @@
 uint8_t bootload_delay = CONF_BOOTLOAD_DELAY;
 #endif
 
+#ifdef ARCH_HOST
+/* time of the next 20ms tick, in nanoseconds of the monotonic clock */
+static uint64_t periodic_next_tick;
+
+static uint64_t periodic_host_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+uint8_t periodic_host_expired(void)
+{
+    if (periodic_host_now() < periodic_next_tick)
+        return 0;
+
+    /* advance by exactly one tick, so a slow mainloop round is caught up
+       by the following calls, just like the (sticky) OCF1A flag does */
+    periodic_next_tick += PERIODIC_HOST_TICK_NS;
+    return 1;
+}
+#endif  /* ARCH_HOST */
+
 void periodic_init(void)
 {
+#ifdef ARCH_HOST
+    periodic_next_tick = periodic_host_now() + PERIODIC_HOST_TICK_NS;
+#else
 
     /* init timer1 to expire after ~20ms, with CTC enabled */
     TCCR1B = _BV(WGM12) | _BV(CS12) | _BV(CS10);
     OCR1A = (F_CPU/1024/50);
 
     NTPADJDEBUG ("configured OCR1A to %d\n", OCR1A);
+#endif
 }
 
 /*
@@ -27,5 +27,13 @@
 /* initialize hardware timer */
 void periodic_init(void);
 
+#ifdef ARCH_HOST
+/* length of one periodic tick (20ms), like timer1 on the avr */
+#define PERIODIC_HOST_TICK_NS 20000000ULL
+
+/* returns 1 once for every tick of the monotonic clock that passed */
+uint8_t periodic_host_expired(void);
+#endif
+
 
 #endif /* _PERIODIC_H */
@@ -51,8 +51,8 @@
                         255 - PORTIO_MASK_D   /* port d from pinning.m4 */ \
                        }
 
-/* ATMega64 | ATMega128 */
-#elif defined(_ATMEGA64) || defined(_ATMEGA128)
+/* ATMega64 | ATMega128 | Host (virtual ports) */
+#elif defined(_ATMEGA64) || defined(_ATMEGA128) || defined(_HOST)
 
 
 #define IO_HARD_PORTS 6
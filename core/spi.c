@@ -82,5 +82,22 @@ uint8_t noinline spi_send(uint8_t data)
 
 }
 
+void noinline spi_write_block(const uint8_t *data, uint16_t len)
+{
+    while (len--) {
+        _SPDR0 = *data++;
+        spi_wait_busy();
+    }
+}
+
+void noinline spi_read_block(uint8_t *data, uint16_t len)
+{
+    while (len--) {
+        _SPDR0 = 0;
+        spi_wait_busy();
+        *data++ = _SPDR0;
+    }
+}
+
 #endif /* DATAFLASH_SUPPORT || ENC28J60_SUPPORT || RFM12_SUPPORT 
     || SD_READER_SUPPORT */
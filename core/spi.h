@@ -31,4 +31,8 @@
 void spi_init(void);
 uint8_t noinline spi_send(uint8_t data);
 
+/* transfer len bytes, chip select has to be handled by the caller */
+void noinline spi_write_block(const uint8_t *data, uint16_t len);
+void noinline spi_read_block(uint8_t *data, uint16_t len);
+
 #endif /* _SPI_H */
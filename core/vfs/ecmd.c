@@ -0,0 +1,101 @@
+/*
+ * Copyright (c) 2008,2009 by Stefan Siegl <stesie@brokenpipe.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * For more information on the GPL, please go to:
+ * http://www.gnu.org/copyleft/gpl.html
+ */
+
+#include <avr/pgmspace.h>
+
+#include <stdio.h>
+#include <string.h>
+
+#include "config.h"
+#include "core/vfs/vfs.h"
+
+#include "protocols/ecmd/ecmd-base.h"
+
+#ifndef VFS_TEENSY
+
+int16_t
+parse_cmd_vfs_ls (char *cmd, char *output, uint16_t len)
+{
+  struct vfs_dirent_t ent;
+  const char *dir;
+  char *index;
+
+  /* trick: the first call finds the space before the directory (or the
+     terminating zero) in cmd[0], flag continuing calls there and keep
+     the entry index right behind the terminating zero (see
+     parse_cmd_help) */
+  uint8_t first = cmd[0] != 0x05 && cmd[0] != 0x06;
+  if (first)
+    cmd[0] = cmd[0] ? 0x05 : 0x06;
+
+  if (cmd[0] == 0x06)
+    {
+      dir = "";			/* no directory given */
+      index = cmd + 1;
+    }
+  else
+    {
+      dir = cmd + 1;
+      while (*dir == ' ')
+	dir ++;
+      index = (char *) dir + strlen (dir) + 1;
+    }
+
+  if (first)
+    *index = 0;
+
+  if (vfs_readdir (dir, (uint8_t) (*index) ++, &ent))
+    return ECMD_FINAL_OK;	/* no more entries */
+
+  if (ent.is_dir)
+    return ECMD_AGAIN(snprintf_P(output, len, PSTR("%s/"), ent.name));
+
+  return ECMD_AGAIN(snprintf_P(output, len, PSTR("%-16s %lu"),
+			       ent.name, (unsigned long) ent.size));
+}
+
+
+int16_t
+parse_cmd_vfs_stat (char *cmd, char *output, uint16_t len)
+{
+  struct vfs_stat_t st;
+
+  while (*cmd == ' ')
+    cmd ++;
+
+  if (vfs_stat (cmd, &st))
+    return ECMD_FINAL(snprintf_P(output, len, PSTR("no such file.")));
+
+  return ECMD_FINAL(snprintf_P(output, len, PSTR("%lu %08lx"),
+			       (unsigned long) st.size,
+			       (unsigned long) st.ident));
+}
+
+#endif	/* not VFS_TEENSY */
+
+/*
+  -- Ethersex META --
+  block(VFS)
+  ecmd_ifndef(VFS_TEENSY)
+    ecmd_feature(vfs_ls, "vfs ls", [DIR], List DIR (the top level lists the storage modules).)
+    ecmd_feature(vfs_stat, "vfs stat ", NAME, Show size and identity of the file NAME.)
+  ecmd_endif()
+*/
@@ -21,21 +21,30 @@
 
 #include <stdint.h>
 typedef uint32_t vfs_size_t;
+struct vfs_dirent_t;
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 
 #include "vfs_inline.h"
 
 #define BUFLEN 65535
+#define MAXFILES 255
+
+struct file {
+  union vfs_inline_node_t node;
+  uint8_t *data;
+};
 
 static void
 usage (int exitval)
 {
   fprintf (exitval ? stderr : stdout,
-	   "Usage: vfs-concat IMAGE BLOCKSZ FILE\n"
-	   "Concatenate FILE to existing ethersex IMAGE.\n\n");
+	   "Usage: vfs-concat IMAGE BLOCKSZ FILE...\n"
+	   "Append FILEs with their directory to ethersex IMAGE.\n"
+	   "If FILE.gz exists and is smaller, it is used instead.\n\n");
   exit (exitval);
 }
 
@@ -69,17 +78,88 @@ crc_calc (uint8_t *data, int len)
 }
 
 
+static uint16_t
+crc16_calc (uint8_t *data, int len)
+{
+  uint16_t crc = 0xFFFF;
+  int i, j;
+
+  for (i = 0; i < len; i ++) {
+    crc ^= data[i];
+    for (j = 0; j < 8; j ++)
+      crc = (crc & 1) ? (crc >> 1) ^ 0xA001 : crc >> 1;
+  }
+
+  return crc;
+}
+
+
+static uint8_t *
+read_file (const char *fn, int *len)
+{
+  FILE *f = fopen (fn, "rb");
+  if (f == NULL)
+    return NULL;
+
+  uint8_t *buf = malloc (BUFLEN);
+  if (buf == NULL) {
+    fprintf (stderr, "vfs-concat: malloc failed.\n");
+    exit (1);
+  }
+
+  *len = fread (buf, 1, BUFLEN, f);
+  fclose (f);
+  return buf;
+}
+
+
+static int
+has_suffix (const char *fn, const char *suffix)
+{
+  int l = strlen (fn), sl = strlen (suffix);
+  return l >= sl && strcasecmp (fn + l - sl, suffix) == 0;
+}
+
+
+/* Tell the content type, so httpd needn't sniff the (compressed) data. */
+static char
+content_type (const char *fn, const uint8_t *data, int len)
+{
+  if (fn[0] == VFS_INLINE_XHTML || fn[0] == VFS_INLINE_CSS)
+    return fn[0];		/* httpd's naming convention. */
+
+  if (has_suffix (fn, ".js"))
+    return VFS_INLINE_JS;
+  if (has_suffix (fn, ".txt") || has_suffix (fn, ".c"))
+    return VFS_INLINE_TEXT;
+  if (len >= 4 && memcmp (data, "GIF8", 4) == 0)
+    return VFS_INLINE_GIF;
+  if (len >= 4 && memcmp (data, "\x89PNG", 4) == 0)
+    return VFS_INLINE_PNG;
+  if (len >= 2 && data[0] == 0xFF && data[1] == 0xD8)
+    return VFS_INLINE_JPEG;
+
+  return VFS_INLINE_HTML;
+}
+
+
+static int
+node_cmp (const void *a, const void *b)
+{
+  return strncmp (((const struct file *) a)->node.s.fn,
+		  ((const struct file *) b)->node.s.fn, VFS_INLINE_FNLEN);
+}
+
+
 int
 main (int argc, char **argv)
 {
-  uint8_t buf_image[BUFLEN], buf_file[BUFLEN];
-  int image_len, file_len, pagesz;
-  FILE *f;
-  union vfs_inline_node_t node = { .s = { .fn = "", .len = 0 } };
-  char *ptr;
+  static struct file files[MAXFILES];
+  uint8_t *image;
+  int image_len, pagesz, n = 0, i, j;
 
   if (argc == 2 && strcmp (argv[1], "--help") == 0) usage (0);
-  if (argc != 4) usage (1);
+  if (argc < 4) usage (1);
 
   pagesz = atoi (argv[2]);
   if (pagesz == 0 || pagesz % 2 || pagesz < 64 || pagesz > 256) {
@@ -87,64 +167,124 @@ main (int argc, char **argv)
     return 1;
   }
 
-  if ((f = fopen (argv[1], "rb")) == NULL) {
+  if ((image = read_file (argv[1], &image_len)) == NULL) {
     fprintf (stderr, "vfs-concat: Unable to read %s.\n", argv[1]);
     return 1;
   }
 
-  image_len = fread (buf_image, 1, BUFLEN, f);
-  fclose (f);
-
-
-  char *filename_gz = malloc(strlen(argv[3]) + 3 + 1);
-  if (!filename_gz) {
-    fprintf (stderr, "vfs-concat: malloc failed.\n");
+  if (argc - 3 > MAXFILES) {
+    fprintf (stderr, "vfs-concat: Too many files.\n");
     return 1;
   }
-  strcpy(filename_gz, argv[3]);
-  strcat(filename_gz, ".gz");
 
-  fprintf(stderr,"%s\n", filename_gz);
+  for (i = 3; i < argc; i ++) {
+    struct file *file = &files[n ++];
+    int file_len, gz_len;
+    uint8_t *gz;
+    char *fn, *ptr;
+
+    if ((file->data = read_file (argv[i], &file_len)) == NULL) {
+      fprintf (stderr, "vfs-concat: Unable to read %s.\n", argv[i]);
+      return 1;
+    }
+
+    fn = argv[i];
+    while ((ptr = strchr (fn, '/')))
+      fn = ptr + 1;
+
+    if (strlen (fn) > VFS_INLINE_FNLEN) {
+      fprintf (stderr, "vfs-concat: Filename %s is too long.\n", fn);
+      return 1;
+    }
+
+    strncpy (file->node.s.fn, fn, VFS_INLINE_FNLEN);
+    file->node.s.type = content_type (fn, file->data, file_len);
 
-  if ((f = fopen (filename_gz, "rb")) == NULL) {
-    if ((f = fopen (argv[3], "rb")) == NULL) {
-      fprintf (stderr, "vfs-concat: Unable to read %s.\n", argv[3]);
+    char *filename_gz = malloc (strlen (argv[i]) + 3 + 1);
+    if (!filename_gz) {
+      fprintf (stderr, "vfs-concat: malloc failed.\n");
       return 1;
     }
+    strcpy (filename_gz, argv[i]);
+    strcat (filename_gz, ".gz");
+
+    /* Tiny files grow when compressed, keep them as they are. */
+    if ((gz = read_file (filename_gz, &gz_len)) != NULL
+	&& gz_len < file_len) {
+      free (file->data);
+      file->data = gz;
+      file_len = gz_len;
+      file->node.s.flags |= VFS_INLINE_GZIP;
+    }
+    else
+      free (gz);
+
+    free (filename_gz);
+
+    file->node.s.len = file_len;
+    file->node.s.sum = crc16_calc (file->data, file_len);
+
+    fprintf (stderr, "vfs-concat: %s: %d bytes%s.\n", fn, file_len,
+	     (file->node.s.flags & VFS_INLINE_GZIP) ? " (gzip)" : "");
   }
 
-  free(filename_gz);
+  qsort (files, n, sizeof (*files), node_cmp);
 
-  file_len = fread (buf_file, 1, BUFLEN, f);
-  fclose (f);
+  /* The data follows the magic byte, the file count and the nodes. */
+  int offset = 2 + n * sizeof (union vfs_inline_node_t);
 
-  fprintf (stderr, "vfs-concat: Lengths: image=%d, file=%d\n",
-	   image_len, file_len);
+  for (i = 0; i < n; i ++) {
+    if (i && node_cmp (&files[i - 1], &files[i]) == 0) {
+      fprintf (stderr, "vfs-concat: Filename %.*s is used twice.\n",
+	       VFS_INLINE_FNLEN, files[i].node.s.fn);
+      return 1;
+    }
 
-  fwrite (buf_image, 1, image_len, stdout);
+    /* Store identical files just once. */
+    for (j = 0; j < i; j ++)
+      if (files[j].data
+	  && files[j].node.s.flags == files[i].node.s.flags
+	  && files[j].node.s.len == files[i].node.s.len
+	  && memcmp (files[j].data, files[i].data, files[i].node.s.len) == 0)
+	break;
+
+    if (j < i) {
+      files[i].node.s.offset = files[j].node.s.offset;
+      files[i].data = NULL;
+      continue;
+    }
 
-  while (image_len % pagesz) {
-    putchar (0xFF);
-    image_len ++;
+    files[i].node.s.offset = offset;
+    offset += files[i].node.s.len;
   }
 
-  while ((ptr = strchr (argv[3], '/')))
-    argv[3] = ptr + 1;
+  /* The firmware looks for the files at the next page. */
+  int start = (image_len + pagesz - 1) / pagesz * pagesz;
 
-  if (strlen (argv[3]) > VFS_INLINE_FNLEN) {
-    fprintf (stderr, "vfs-concat: Filename %s is too long.\n", argv[3]);
+  fprintf (stderr, "vfs-concat: Lengths: image=%d, files=%d\n",
+	   image_len, offset);
+
+  if (start + offset > BUFLEN) {
+    fprintf (stderr, "vfs-concat: Files don't fit into 64k.\n");
     return 1;
   }
 
+  fwrite (image, 1, image_len, stdout);
+  while (image_len ++ < start)
+    putchar (0xFF);
 
   putchar (VFS_INLINE_MAGIC);
+  putchar (n);
 
-  strncpy (node.s.fn, argv[3], VFS_INLINE_FNLEN);
-  node.s.len = file_len;
-  node.s.crc = crc_calc (node.raw, sizeof (node) - 1);
+  for (i = 0; i < n; i ++) {
+    union vfs_inline_node_t *node = &files[i].node;
+    node->s.crc = crc_calc (node->raw, sizeof (*node) - 1);
+    fwrite (node, sizeof (*node), 1, stdout);
+  }
 
-  fwrite (&node, sizeof (node), 1, stdout);
-  fwrite (buf_file, 1, file_len, stdout);
+  for (i = 0; i < n; i ++)
+    if (files[i].data)
+      fwrite (files[i].data, 1, files[i].node.s.len, stdout);
 
   return 0;
 }
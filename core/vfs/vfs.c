@@ -20,6 +20,7 @@
  */
 
 #include <avr/pgmspace.h>
+#include <string.h>
 #include "core/debug.h"
 #include "core/vfs/vfs.h"
 #ifndef VFS_TEENSY
@@ -51,15 +52,177 @@ struct vfs_func_t vfs_funcs[] PROGMEM = {
 #endif
 };
 
+/* Identifies a name in the negative cache without storing it: two
+   independent hashes and the length make collisions unlikely enough. */
+struct vfs_name_key_t {
+  uint16_t hash, hash2;
+  uint8_t len;
+};
+
+#if VFS_NEGATIVE_CACHE > 0
+#if VFS_NEGATIVE_TTL > 255
+#error "VFS_NEGATIVE_TTL has to fit into 8 bits"
+#endif
+
+/* Names recently not found, so that requests for missing files don't
+   go to every storage device over and over again. */
+struct vfs_negative_t {
+  struct vfs_name_key_t key;
+  uint8_t types;		/* Bit set for each module missing it. */
+  uint8_t ttl;			/* Seconds to remember. */
+};
+
+static struct vfs_negative_t vfs_negative[VFS_NEGATIVE_CACHE];
+
+static void
+vfs_hash (const char *name, struct vfs_name_key_t *key)
+{
+  uint16_t i;
+
+  key->hash = 0;
+  key->hash2 = 0;
+
+  for (i = 0; name[i]; i ++) {
+    key->hash = key->hash * 31 + name[i];
+    key->hash2 = ((key->hash2 << 5) | (key->hash2 >> 11)) ^ name[i];
+  }
+
+  key->len = i > 255 ? 255 : i;	/* Saturated, the hashes tell apart. */
+}
+
+static struct vfs_negative_t *
+vfs_negative_find (const struct vfs_name_key_t *key)
+{
+  for (uint8_t i = 0; i < VFS_NEGATIVE_CACHE; i ++)
+    if (vfs_negative[i].ttl
+	&& vfs_negative[i].key.hash == key->hash
+	&& vfs_negative[i].key.hash2 == key->hash2
+	&& vfs_negative[i].key.len == key->len)
+      return &vfs_negative[i];
+
+  return NULL;
+}
+
+static uint8_t
+vfs_negative_missing (const struct vfs_name_key_t *key, uint8_t type)
+{
+  struct vfs_negative_t *neg = vfs_negative_find (key);
+  return neg && (neg->types & _BV (type));
+}
+
+static void
+vfs_negative_add (const struct vfs_name_key_t *key, uint8_t type)
+{
+  struct vfs_negative_t *neg = vfs_negative_find (key);
+
+  if (neg == NULL)
+    {
+      /* Replace the entry closest to expiry. */
+      neg = &vfs_negative[0];
+      for (uint8_t i = 1; i < VFS_NEGATIVE_CACHE; i ++)
+	if (vfs_negative[i].ttl < neg->ttl)
+	  neg = &vfs_negative[i];
+
+      neg->key = *key;
+      neg->types = 0;
+    }
+
+  neg->types |= _BV (type);
+  neg->ttl = VFS_NEGATIVE_TTL;
+}
+
+void
+vfs_invalidate (void)
+{
+  for (uint8_t i = 0; i < VFS_NEGATIVE_CACHE; i ++)
+    vfs_negative[i].ttl = 0;
+}
+
+void
+vfs_periodic (void)
+{
+  for (uint8_t i = 0; i < VFS_NEGATIVE_CACHE; i ++)
+    if (vfs_negative[i].ttl)
+      vfs_negative[i].ttl --;
+}
+#else
+static inline void
+vfs_hash (const char *name, struct vfs_name_key_t *key)
+{
+  (void) name;
+  (void) key;
+}
+
+static inline uint8_t
+vfs_negative_missing (const struct vfs_name_key_t *key, uint8_t type)
+{
+  (void) key;
+  (void) type;
+  return 0;
+}
+
+static inline void
+vfs_negative_add (const struct vfs_name_key_t *key, uint8_t type)
+{
+  (void) key;
+  (void) type;
+}
+
+void
+vfs_invalidate (void)
+{
+}
+#endif	/* VFS_NEGATIVE_CACHE > 0 */
+
+/* If NAME starts with "/mod_name/" (or "mod_name/"), strip that and
+   return the module's vfs_type_t, VFS_LAST otherwise. */
+static uint8_t
+vfs_mount (const char **name)
+{
+  const char *path = *name;
+
+  if (*path == '/')
+    path ++;
+
+  for (uint8_t i = 0; i < VFS_LAST; i ++) {
+    const char *mod_name = (const char *) pgm_read_word (&vfs_funcs[i].mod_name);
+    uint8_t len = strlen (mod_name);
+
+    if (strncmp (path, mod_name, len) == 0 && path[len] == '/') {
+      *name = path + len + 1;
+      return i;
+    }
+  }
+
+  return VFS_LAST;
+}
+
 struct vfs_file_handle_t *
 vfs_open (const char *filename)
 {
   struct vfs_file_handle_t *fh = NULL;
   struct vfs_func_t funcs;
 
-  for (uint8_t i = 0; fh == NULL && i < VFS_LAST; i ++) {
+  uint8_t i = vfs_mount (&filename);
+  uint8_t last = VFS_LAST;
+
+  if (i < VFS_LAST)
+    last = i + 1;		/* Just this one. */
+  else
+    i = 0;
+
+  struct vfs_name_key_t key;
+  vfs_hash (filename, &key);
+
+  for (; fh == NULL && i < last; i ++) {
+    if (vfs_negative_missing (&key, i))
+      continue;
+
     memcpy_P(&funcs, &vfs_funcs[i], sizeof(struct vfs_func_t));
     fh = funcs.open (filename);
+
+    if (fh == NULL)
+      vfs_negative_add (&key, i);
   }
 
   return fh;
@@ -71,16 +234,104 @@ vfs_create (const char *name)
   struct vfs_file_handle_t *fh = NULL;
   struct vfs_func_t funcs;
 
-  for (uint8_t i = 0; fh == NULL && i < VFS_LAST; i ++) {
+  uint8_t i = vfs_mount (&name);
+  uint8_t last = VFS_LAST;
+
+  if (i < VFS_LAST)
+    last = i + 1;
+  else
+    i = 0;
+
+  for (; fh == NULL && i < last; i ++) {
     memcpy_P(&funcs, &vfs_funcs[i], sizeof(struct vfs_func_t));
     if (funcs.create)
       fh = funcs.create (name);
   }
 
+  if (fh)
+    vfs_invalidate ();
+
   return fh;
 }
 
-/* flag: 0=read, 1=write, 2=size */
+uint8_t
+vfs_stat (const char *name, struct vfs_stat_t *st)
+{
+  struct vfs_func_t funcs;
+
+  uint8_t i = vfs_mount (&name);
+  uint8_t last = VFS_LAST;
+
+  if (i < VFS_LAST)
+    last = i + 1;
+  else
+    i = 0;
+
+  struct vfs_name_key_t key;
+  vfs_hash (name, &key);
+
+  for (; i < last; i ++) {
+    if (vfs_negative_missing (&key, i))
+      continue;
+
+    memcpy_P(&funcs, &vfs_funcs[i], sizeof(struct vfs_func_t));
+    st->fh_type = i;
+
+    if (funcs.stat) {
+      if (funcs.stat (name, st) == 0)
+	return 0;
+    }
+    else {
+      struct vfs_file_handle_t *fh = funcs.open (name);
+
+      if (fh) {
+	st->size = funcs.size ? funcs.size (fh) : 0;
+	st->ident = funcs.ident ? funcs.ident (fh) : 0;
+	funcs.close (fh);
+	return 0;
+      }
+    }
+
+    vfs_negative_add (&key, i);
+  }
+
+  return 1;			/* No such file. */
+}
+
+uint8_t
+vfs_readdir (const char *dir, uint16_t index, struct vfs_dirent_t *ent)
+{
+  uint8_t i = vfs_mount (&dir);
+
+  if (i == VFS_LAST) {
+    if (*dir == '/')
+      dir ++;
+
+    if (*dir)
+      return 1;			/* Not below a module. */
+
+    /* The top level, list the modules. */
+    if (index >= VFS_LAST)
+      return 1;
+
+    strncpy (ent->name, (const char *) pgm_read_word (&vfs_funcs[index].mod_name),
+	     VFS_NAME_LEN);
+    ent->name[VFS_NAME_LEN] = 0;
+    ent->size = 0;
+    ent->is_dir = 1;
+    return 0;
+  }
+
+  uint8_t (*readdir) (const char *, uint16_t, struct vfs_dirent_t *) =
+    (void *) pgm_read_word (&vfs_funcs[i].readdir);
+
+  if (readdir == NULL)
+    return 1;
+
+  return readdir (dir, index, ent);
+}
+
+/* flag: 0=read, 1=write, 2=size, 3=ident, 4=mtime */
 vfs_size_t
 vfs_read_write_size(uint8_t flag, struct vfs_file_handle_t *handle, void *buf,
                vfs_size_t length)
@@ -96,9 +347,32 @@ vfs_read_write_size(uint8_t flag, struct vfs_file_handle_t *handle, void *buf,
 
   if (flag == 2 && funcs.size)
     return funcs.size(handle);
+
+  if (flag == 3 && funcs.ident)
+    return funcs.ident(handle);
+
+  if (flag == 4 && funcs.mtime)
+    return funcs.mtime(handle);
     return 0;
 }
 
+vfs_size_t
+vfs_pread (struct vfs_file_handle_t *handle, void *buf, vfs_size_t offset,
+	   vfs_size_t length)
+{
+  struct vfs_func_t funcs;
+  memcpy_P(&funcs, &vfs_funcs[handle->fh_type], sizeof(struct vfs_func_t));
+
+  if (funcs.pread)
+    return funcs.pread(handle, buf, offset, length);
+
+  /* Modules that can't seek (dc3840) are read sequentially. */
+  if (funcs.fseek && funcs.fseek(handle, offset, SEEK_SET))
+    return 0;
+
+  return funcs.read ? funcs.read(handle, buf, length) : 0;
+}
+
 /* flag: 0=fseek, 1=truncate, 2=close */
 uint8_t
 vfs_fseek_truncate_close(uint8_t flag, struct vfs_file_handle_t *handle,
@@ -123,3 +397,13 @@ vfs_fseek_truncate_close(uint8_t flag, struct vfs_file_handle_t *handle,
 
 
 #endif	/* not VFS_TEENSY */
+
+/*
+  -- Ethersex META --
+  header(core/vfs/vfs.h)
+  timer(50, `
+#	if !defined(VFS_TEENSY) && VFS_NEGATIVE_CACHE > 0
+	  vfs_periodic()
+#	endif
+')
+*/
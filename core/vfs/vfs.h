@@ -56,6 +56,8 @@ enum vfs_type_t {
 
 /* Forward declarations. */
 struct vfs_file_handle_t;
+struct vfs_dirent_t;
+struct vfs_stat_t;
 
 
 /* VFS-related types. */
@@ -68,6 +70,23 @@ typedef uint16_t vfs_size_t;
 typedef uint32_t vfs_size_t;
 #endif
 
+#define VFS_NAME_LEN 32
+
+/* One entry of a directory listing, see vfs_readdir. */
+struct vfs_dirent_t {
+  char name[VFS_NAME_LEN + 1];
+  vfs_size_t size;
+  uint8_t is_dir;
+};
+
+/* What vfs_stat tells about a file without opening it. */
+struct vfs_stat_t {
+  /* The vfs_type_t of the VFS module the file lives in. */
+  uint8_t fh_type;
+  vfs_size_t size;
+  uint32_t ident;
+};
+
 #include "hardware/storage/dataflash/vfs_df.h"
 #include "hardware/storage/sd_reader/vfs_sd.h"
 #include "core/vfs/vfs_inline.h"
@@ -123,6 +142,31 @@ struct vfs_func_t {
 
   /* Return the size of the file. */
   vfs_size_t (*size) (struct vfs_file_handle_t *);
+
+  /* Return a value that changes whenever the file's content does,
+     e.g. to derive an HTTP ETag from.  Zero if unknown. */
+  uint32_t (*ident) (struct vfs_file_handle_t *);
+
+  /* Fill in size and ident of the file NAME, without allocating a
+     handle.  Return 0 if it exists.  If missing, vfs_stat opens the
+     file instead. */
+  uint8_t (*stat) (const char *name, struct vfs_stat_t *);
+
+  /* Fill in the INDEXth entry of directory DIR ("" being the top
+     level).  Return 0 on success, 1 past the last entry. */
+  uint8_t (*readdir) (const char *dir, uint16_t index,
+		      struct vfs_dirent_t *);
+
+  /* Read up to LENGTH bytes at OFFSET straight to BUF (e.g. uip_appdata),
+     without a separate seek.  Returns the number of bytes read.  If
+     missing, vfs_pread seeks and reads. */
+  vfs_size_t (*pread) (struct vfs_file_handle_t *, void *buf,
+		       vfs_size_t offset, vfs_size_t length);
+
+  /* Return the time of the last modification the way a FAT directory
+     entry has it, (date << 16) | time, which sorts in time order.
+     Zero if unknown. */
+  uint32_t (*mtime) (struct vfs_file_handle_t *);
 };
 
 extern struct vfs_func_t vfs_funcs[];
@@ -132,13 +176,37 @@ extern struct vfs_func_t vfs_funcs[];
 #define SEEK_END 2
 
 /* Generic variant of open that automagically finds the suitable
-   VFS module. */
+   VFS module.  A leading "/mod_name/" (e.g. "/sd/index.html") asks
+   just that module, otherwise all modules are tried in turn. */
 struct vfs_file_handle_t *vfs_open (const char *filename);
 
 /* Generic variante of create, that automatically finds a suitable
    store for the new file. */
 struct vfs_file_handle_t *vfs_create (const char *name);
 
+/* Look up a file like vfs_open does, but only fill in ST.  Return 0
+   if the file exists. */
+uint8_t vfs_stat (const char *name, struct vfs_stat_t *st);
+
+/* Fill in the INDEXth entry of directory DIR.  The top level ("" or
+   "/") lists the modules, "/mod_name/..." the module's directory.
+   Return 0 on success, 1 past the last entry. */
+uint8_t vfs_readdir (const char *dir, uint16_t index,
+		     struct vfs_dirent_t *ent);
+
+/* Read up to LENGTH bytes at OFFSET of the file to BUF, the way
+   protocols fill a packet from a file.  The stream position afterwards
+   is undefined.  Returns the number of bytes read. */
+vfs_size_t vfs_pread (struct vfs_file_handle_t *handle, void *buf,
+		      vfs_size_t offset, vfs_size_t length);
+
+/* Forget about files found missing, call this after creating files
+   without the help of vfs_create. */
+void vfs_invalidate (void);
+
+/* Expire the names remembered as missing, called every second. */
+void vfs_periodic (void);
+
 uint8_t vfs_fseek_truncate_close(uint8_t flag, struct vfs_file_handle_t *handle,
                          vfs_size_t length, uint8_t whence);
 
@@ -146,16 +214,18 @@ vfs_size_t vfs_read_write_size(uint8_t flag, struct vfs_file_handle_t *handle,
                                void *buf, vfs_size_t length);
 
 #define VFS_FUNC(handle,call)	              \
-  ((pgm_read_word(((void *)&(vfs_funcs[(handle)->fh_type].call))))
+  ((void *) pgm_read_word(&(vfs_funcs[(handle)->fh_type].call)))
 
 /* Generation of forwarder functions. */
 
 #define VFS_HAVE_FUNC(handle,call)	              \
-  (pgm_read_word(((void *)&(vfs_funcs[(handle)->fh_type].call))) != 0)
+  (pgm_read_word(&(vfs_funcs[(handle)->fh_type].call)) != 0)
 
 #define vfs_read(handle, buf, len)  vfs_read_write_size(0, handle, buf, len)
 #define vfs_write(handle, buf, len) vfs_read_write_size(1, handle, buf, len)
 #define vfs_size(handle)            vfs_read_write_size(2, handle, NULL, 0)
+#define vfs_ident(handle)           vfs_read_write_size(3, handle, NULL, 0)
+#define vfs_mtime(handle)           vfs_read_write_size(4, handle, NULL, 0)
 
 #define vfs_fseek(handle, offset, whence) \
    vfs_fseek_truncate_close(0, handle, offset, whence)
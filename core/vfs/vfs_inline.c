@@ -22,40 +22,91 @@
 #include <avr/pgmspace.h>
 
 #include <stdlib.h>
+#include <string.h>
 
 #include "core/eeprom.h"
 #include "core/vfs/vfs.h"
 
-struct vfs_file_handle_t *
-vfs_inline_open (const char *filename)
+#ifdef ARCH_HOST
+/* The host keeps the files vfs-concat made in host_flash. */
+#define VFS_INLINE_P(addr) ((PGM_VOID_P) host_flash_ptr (addr))
+#define vfs_inline_base() 0
+#else
+#define VFS_INLINE_P(addr) ((PGM_VOID_P) (addr))
+
+/* The linker tells where the firmware ends, the inlined files start at
+   the next page (see vfs-concat). */
+extern char __data_load_end[];
+
+static uint16_t
+vfs_inline_base (void)
 {
-  uint16_t offset = FLASHEND - SPM_PAGESIZE + 1;
-  for (; offset; offset -= SPM_PAGESIZE) {
-    if (pgm_read_byte (offset) != VFS_INLINE_MAGIC)
-      continue;
+  uint16_t base = (uint16_t) __data_load_end + SPM_PAGESIZE - 1;
+  return base & ~(SPM_PAGESIZE - 1);
+}
+#endif
+
+/* Address of the INDEXth node, following magic byte and file count. */
+#define vfs_inline_node_addr(index) \
+  (vfs_inline_base () + 2 + (index) * sizeof (union vfs_inline_node_t))
 
-    union vfs_inline_node_t node;
-    uint8_t i;
+/* Return the number of inlined files, 0 if there are none. */
+static uint8_t
+vfs_inline_count (void)
+{
+  uint16_t base = vfs_inline_base ();
 
-    for (i = 0; i < sizeof (node); i ++)
-      node.raw[i] = pgm_read_byte (offset + i + 1);
+  if (pgm_read_byte (VFS_INLINE_P (base)) != VFS_INLINE_MAGIC)
+    return 0;
 
-    if (node.s.crc != crc_checksum (node.raw, sizeof (node) - 1))
-      continue;
+  return pgm_read_byte (VFS_INLINE_P (base + 1));
+}
 
-    if (strncmp (node.s.fn, filename, VFS_INLINE_FNLEN))
-      continue;
+/* Read the INDEXth node into NODE, return 0 if it is broken. */
+static uint8_t
+vfs_inline_node (uint8_t index, union vfs_inline_node_t *node)
+{
+  memcpy_P (node->raw, VFS_INLINE_P (vfs_inline_node_addr (index)),
+	    sizeof (*node));
 
-    /* Found file, create a handle. */
-    struct vfs_file_handle_t *fh = malloc (sizeof (struct vfs_file_handle_t));
-    if (fh == NULL)
-      return NULL;
+  return node->s.crc == crc_checksum (node->raw, sizeof (*node) - 1);
+}
 
-    fh->fh_type = VFS_INLINE;
-    fh->u.il.offset = offset + sizeof (union vfs_inline_node_t) + 1;
-    fh->u.il.pos = 0;
-    fh->u.il.len = node.s.len;
-    return fh;
+struct vfs_file_handle_t *
+vfs_inline_open (const char *filename)
+{
+  /* The nodes are sorted by name, bisect. */
+  uint8_t lo = 0, hi = vfs_inline_count ();
+
+  while (lo < hi) {
+    uint8_t mid = (lo + hi) / 2;
+    int cmp = strncmp_P (filename,
+			 (PGM_P) VFS_INLINE_P (vfs_inline_node_addr (mid)),
+			 VFS_INLINE_FNLEN);
+
+    if (cmp < 0)
+      hi = mid;
+    else if (cmp > 0)
+      lo = mid + 1;
+    else {
+      union vfs_inline_node_t node;
+      if (!vfs_inline_node (mid, &node))
+	return NULL;
+
+      /* Found file, create a handle. */
+      struct vfs_file_handle_t *fh = malloc (sizeof (struct vfs_file_handle_t));
+      if (fh == NULL)
+	return NULL;
+
+      fh->fh_type = VFS_INLINE;
+      fh->u.il.offset = vfs_inline_base () + node.s.offset;
+      fh->u.il.pos = 0;
+      fh->u.il.len = node.s.len;
+      fh->u.il.sum = node.s.sum;
+      fh->u.il.flags = node.s.flags;
+      fh->u.il.type = node.s.type;
+      return fh;
+    }
   }
 
   return NULL;			/* File not found. */
@@ -70,15 +121,24 @@ vfs_inline_close (struct vfs_file_handle_t *fh)
 #endif	/* VFS_TEENSY */
 
 vfs_size_t
-vfs_inline_read (struct vfs_file_handle_t *fh, void *buf, vfs_size_t length)
+vfs_inline_pread (struct vfs_file_handle_t *fh, void *buf, vfs_size_t offset,
+		  vfs_size_t length)
 {
-  uint16_t len = fh->u.il.len - fh->u.il.pos;
+  if (offset >= fh->u.il.len)
+    return 0;
+
+  uint16_t len = fh->u.il.len - offset;
   if (length < len) len = length;
 
-  for (uint16_t i = 0; i < len; i ++)
-    ((unsigned char *)buf)[i] =
-      pgm_read_byte (fh->u.il.offset + fh->u.il.pos + i);
+  /* Straight from flash to BUF, i.e. usually into the packet. */
+  memcpy_P (buf, VFS_INLINE_P (fh->u.il.offset + offset), len);
+  return len;
+}
 
+vfs_size_t
+vfs_inline_read (struct vfs_file_handle_t *fh, void *buf, vfs_size_t length)
+{
+  uint16_t len = vfs_inline_pread (fh, buf, fh->u.il.pos, length);
   fh->u.il.pos += len;
   return len;
 }
@@ -120,4 +180,28 @@ vfs_inline_size (struct vfs_file_handle_t *fh)
 {
   return fh->u.il.len;
 }
+
+uint8_t
+vfs_inline_readdir (const char *dir, uint16_t index, struct vfs_dirent_t *ent)
+{
+  union vfs_inline_node_t node;
+
+  if (*dir)
+    return 1;			/* There are no subdirectories. */
+
+  if (index >= vfs_inline_count () || !vfs_inline_node (index, &node))
+    return 1;
+
+  memcpy (ent->name, node.s.fn, VFS_INLINE_FNLEN);
+  ent->name[VFS_INLINE_FNLEN] = 0;
+  ent->size = node.s.len;
+  ent->is_dir = 0;
+  return 0;
+}
 #endif	/* VFS_TEENSY */
+
+uint32_t
+vfs_inline_ident (struct vfs_file_handle_t *fh)
+{
+  return ((uint32_t) fh->u.il.sum << 16) | fh->u.il.len;
+}
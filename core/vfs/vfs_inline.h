@@ -24,23 +24,49 @@
 
 #include <stdlib.h>
 
-#define VFS_INLINE_MAGIC 0x23
+#define VFS_INLINE_MAGIC 0x24
 #define VFS_INLINE_FNLEN 6
 
+/* The inlined files follow the firmware, starting at the next flash
+   page.  vfs-concat writes the magic byte, the number of files and
+   their nodes sorted by name (so they can be bisected), followed by
+   the data of all files.  Files with identical content share it. */
 union vfs_inline_node_t {
   struct __attribute__((__packed__)) {
     char fn[VFS_INLINE_FNLEN];
+    uint16_t offset;		/* Of the data, relative to the magic byte. */
     uint16_t len;
+    uint16_t sum;		/* CRC-16 of the file data. */
+    uint8_t flags;
+    char type;			/* Content type, see below. */
     uint8_t crc;
   } s ;
 
   unsigned char raw[0];
 };
 
+/* The data is gzip'd, vfs-concat only stores it compressed if it
+   gets smaller this way. */
+#define VFS_INLINE_GZIP		0x01
+
+/* Content types vfs-concat tells apart.  X and S are the same as the
+   file name prefixes httpd uses for xhtml and css. */
+#define VFS_INLINE_HTML		'H'
+#define VFS_INLINE_XHTML	'X'
+#define VFS_INLINE_CSS		'S'
+#define VFS_INLINE_JS		'J'
+#define VFS_INLINE_TEXT		'T'
+#define VFS_INLINE_GIF		'G'
+#define VFS_INLINE_PNG		'P'
+#define VFS_INLINE_JPEG		'M'
+
 typedef struct {
   uint16_t offset;		/* Offset in program memory. */
   uint16_t pos;			/* Position in file. */
   uint16_t len;			/* Length of file. */
+  uint16_t sum;			/* CRC-16 of the file data. */
+  uint8_t flags;
+  char type;
 } vfs_file_handle_inline_t;
 
 /* vfs_sd_ Prototypes. */
@@ -48,9 +74,14 @@ struct vfs_file_handle_t *vfs_inline_open (const char *filename);
 void vfs_inline_close (struct vfs_file_handle_t *);
 vfs_size_t vfs_inline_read  (struct vfs_file_handle_t *, void *buf,
 			 vfs_size_t length);
+vfs_size_t vfs_inline_pread (struct vfs_file_handle_t *, void *buf,
+			     vfs_size_t offset, vfs_size_t length);
 vfs_size_t vfs_inline_size (struct vfs_file_handle_t *);
 uint8_t vfs_inline_fseek (struct vfs_file_handle_t *, vfs_size_t offset,
 			  uint8_t whence);
+uint32_t vfs_inline_ident (struct vfs_file_handle_t *);
+uint8_t vfs_inline_readdir (const char *dir, uint16_t index,
+			    struct vfs_dirent_t *);
 
 
 #define VFS_INLINE_FUNCS {		\
@@ -63,6 +94,10 @@ uint8_t vfs_inline_fseek (struct vfs_file_handle_t *, vfs_size_t offset,
     NULL, /* truncate */		\
     NULL, /* create */			\
     vfs_inline_size,			\
+    vfs_inline_ident,			\
+    NULL, /* stat */			\
+    vfs_inline_readdir,			\
+    vfs_inline_pread,			\
   }
 
 #endif	/* VFS_INLINE_H */
@@ -33,13 +33,19 @@
 #undef vfs_fseek
 #undef vfs_truncate
 #undef vfs_size
+#undef vfs_ident
+#undef vfs_mtime
 #undef vfs_rewind
 
 #define vfs_open	vfs_inline_open
 #define vfs_read	vfs_inline_read
+#define vfs_pread	vfs_inline_pread
 #define vfs_close(i)	free(i)
 #define vfs_fseek(fh,p,w)   (((w) == SEEK_SET) ? ((fh)->u.il.pos = (p)) : -1)
 #define vfs_size(fh)	((fh)->u.il.len)
+#define vfs_ident	vfs_inline_ident
+#define vfs_mtime(fh)	0
 #define vfs_rewind(fh)  ((fh)->u.il.pos = 0)
+#define vfs_invalidate()
 
 #endif  /* VFS_TEENSY_H */
@@ -109,6 +109,7 @@ int main(void)
 	else if (bit_is_set(reset_reason, EXTRF)) debug_printf("reset: Extern\n");
 	else debug_printf("reset: Unknown\n");
 	#endif
+	(void) reset_reason;		/* Keep GCC quiet. */
 
 	#ifdef BOOTLOADER_SUPPORT
 	/* disable interrupts */
@@ -143,8 +144,8 @@ int main(void)
 	ADMUX = ADC_REF; //_BV(REFS0) | _BV(REFS1);
 	#endif
 
-	#if defined(RFM12_SUPPORT) || defined(ENC28J60_SUPPORT) \
-	|| defined(DATAFLASH_SUPPORT)
+	#if (defined(RFM12_SUPPORT) || defined(ENC28J60_SUPPORT) \
+	|| defined(DATAFLASH_SUPPORT)) && !defined(ARCH_HOST)
 	spi_init();
 	#endif
 
@@ -181,7 +182,7 @@ int main(void)
 	np_simple_init();
 	#endif
 
-	#ifdef ENC28J60_SUPPORT
+	#if defined(ENC28J60_SUPPORT) && !defined(ARCH_HOST)
 	debug_printf("enc28j60 revision 0x%x\n", read_control_register(REG_EREVID));
 	debug_printf("mac: %02x:%02x:%02x:%02x:%02x:%02x\n",
 			uip_ethaddr.addr[0],
@@ -214,7 +215,13 @@ int main(void)
 	}
 	#endif
 
-	#ifndef BOOTLOAD_SUPPORT
+	#ifdef ARCH_HOST
+		/* there is neither a bootloader nor a watchdog to jump to,
+		   just leave, the wrapper script may restart us */
+		if(status.request_bootloader || status.request_wdreset
+		   || status.request_reset)
+			exit(EXIT_SUCCESS);
+	#elif !defined(BOOTLOAD_SUPPORT)
 		if(status.request_bootloader) {
 			#ifdef CLOCK_CRYSTAL_SUPPORT
 			_TIMSK_TIMER2 &= ~_BV(TOIE2);
@@ -36,27 +36,32 @@
 #define ADC_REF 0
 #endif
 
+static uint16_t
+adc_sample(uint8_t channel)
+{
+  ADMUX = (ADMUX & 0xF0) | channel | ADC_REF;
+  /* Start adc conversion */
+  ADCSRA |= _BV(ADSC);
+  /* Wait for completion of adc */
+  while (ADCSRA & _BV(ADSC)) {}
+  return ADC;
+}
+
 int16_t parse_cmd_adc_get(char *cmd, char *output, uint16_t len)
 {
   uint16_t adc;
-  uint8_t channel;
+  uint8_t channel = 0;
+  uint8_t channels = ADC_CHANNELS;
   uint8_t ret = 0;
   if (cmd[0] && cmd[1]) {
     if ( (cmd[1] - '0') < ADC_CHANNELS) {
-      ADMUX = (ADMUX & 0xF0) | (cmd[1] - '0') | ADC_REF;
-      channel = ADC_CHANNELS;
-      goto adc_out; 
+      channel = cmd[1] - '0';
+      channels = channel + 1;
     } else 
       return ECMD_ERR_PARSE_ERROR;
   }
-  for (channel = 0; channel < ADC_CHANNELS; channel ++) {
-    ADMUX = (ADMUX & 0xF0) | channel | ADC_REF;
-adc_out:
-    /* Start adc conversion */
-    ADCSRA |= _BV(ADSC);
-    /* Wait for completion of adc */
-    while (ADCSRA & _BV(ADSC)) {}
-    adc = ADC;
+  for (; channel < channels; channel ++) {
+    adc = adc_sample(channel);
     output[0] = NIBBLE_TO_HEX((adc >> 8) & 0x0F);
     output[1] = NIBBLE_TO_HEX((adc >> 4) & 0x0F);
     output[2] = NIBBLE_TO_HEX(adc & 0x0F);
@@ -68,8 +73,33 @@ adc_out:
   return ECMD_FINAL(ret);
 }
 
+#ifdef ECMD_BINARY_SUPPORT
+/* args: none for all channels or the channel number,
+   output: the 10 bit values, two bytes each */
+int16_t parse_bin_adc_get(uint8_t *args, uint8_t argc, uint8_t *output,
+                          uint16_t len)
+{
+  uint8_t channel = 0;
+  uint8_t channels = ADC_CHANNELS;
+  uint8_t ret = 0;
+  if (argc) {
+    if (argc > 1 || args[0] >= ADC_CHANNELS)
+      return ECMD_ERR_PARSE_ERROR;
+    channel = args[0];
+    channels = channel + 1;
+  }
+  for (; channel < channels; channel ++) {
+    uint16_t adc = adc_sample(channel);
+    output[ret++] = adc & 0xFF;
+    output[ret++] = adc >> 8;
+  }
+  return ECMD_FINAL(ret);
+}
+#endif
+
 /*
   -- Ethersex META --
   block(Analog/Digital Conversion (ADC))
   ecmd_feature(adc_get, "adc get", [CHANNEL], Get the ADC value in hex of CHANNEL or if no channel set of all channels.)
+  ecmd_binary(adc_get)
 */
@@ -57,7 +57,7 @@ kty_calibrate(uint16_t sensorwert)
   if (R < 2320 && R > 2080){
     calibration = 2200L - R;
     eeprom_save_char (kty_calibration, calibration);
-    eeprom_update_chksum();
+    eeprom_commit();
     return 1;
   }
   return 0;
@@ -48,6 +48,7 @@ uint8_t vfs_dc3840_fseek (struct vfs_file_handle_t *, vfs_size_t offset,
     NULL, /* truncate */		\
     NULL, /* create */			\
     NULL, /* size */			\
+    NULL, /* ident */			\
   }
 
 #endif	/* VFS_DC3840_H */
@@ -34,7 +34,6 @@
 #include "network.h"
 #include "core/spi.h"
 #include "core/bit-macros.h"
-#include "core/eeprom.h"
 
 /* global variables */
 uint8_t enc28j60_current_bank = 0;
@@ -51,6 +50,16 @@ int16_t enc28j60_next_packet_pointer;
 #  define cs_high() PIN_SET(SPI_CS_NET)
 #endif
 
+/* Block transfers keep the chip selected for this many bytes at most.
+   Interrupts are disabled while selected if RFM12 is enabled, so keep
+   the chunks short then.  The buffer pointers auto-increment (and wrap
+   around in the receive buffer), a new chunk just continues. */
+#ifdef RFM12_IP_SUPPORT
+#  define BUFFER_BLOCK_CHUNK 32
+#else
+#  define BUFFER_BLOCK_CHUNK 0xFFFF
+#endif
+
 
 uint8_t read_control_register(uint8_t address)
 {
@@ -101,6 +110,28 @@ uint8_t read_buffer_memory(void)
 
 }
 
+void read_buffer_block(uint8_t *data, uint16_t len)
+{
+
+    while (len) {
+        uint16_t chunk = len > BUFFER_BLOCK_CHUNK ? BUFFER_BLOCK_CHUNK : len;
+
+        /* aquire device */
+        cs_low();
+
+        /* send opcode, then read the whole chunk in one go */
+        spi_send(CMD_RBM);
+        spi_read_block(data, chunk);
+
+        /* release device */
+        cs_high();
+
+        data += chunk;
+        len -= chunk;
+    }
+
+}
+
 void write_control_register(uint8_t address, uint8_t data)
 {
 
@@ -140,6 +171,28 @@ void write_buffer_memory(uint8_t data)
 
 }
 
+void write_buffer_block(const uint8_t *data, uint16_t len)
+{
+
+    while (len) {
+        uint16_t chunk = len > BUFFER_BLOCK_CHUNK ? BUFFER_BLOCK_CHUNK : len;
+
+        /* aquire device */
+        cs_low();
+
+        /* send opcode, then write the whole chunk in one go */
+        spi_send(CMD_WBM);
+        spi_write_block(data, chunk);
+
+        /* release device */
+        cs_high();
+
+        data += chunk;
+        len -= chunk;
+    }
+
+}
+
 void bit_field_modify(uint8_t address, uint8_t mask, uint8_t opcode)
 {
 
@@ -268,9 +321,10 @@ void init_enc28j60(void)
     write_control_register(REG_ERXNDL, LO8(RXBUFFER_END));
     write_control_register(REG_ERXNDH, HI8(RXBUFFER_END));
 
-    /* set transmit buffer start at 4kb */
+    /* set transmit buffer start at 4kb, forget queued frames */
     write_control_register(REG_ETXSTL, LO8(TXBUFFER_START));
     write_control_register(REG_ETXSTH, HI8(TXBUFFER_START));
+    enc28j60_tx_reset();
 
     /* set receive buffer pointer */
     write_control_register(REG_ERXRDPTL, LO8(RXBUFFER_START));
@@ -429,66 +483,6 @@ void dump_debug_registers(void)
 #endif
 
 
-
-
-void
-network_config_load (void)
-{
-    /* load settings from eeprom */
-#ifdef EEPROM_SUPPORT
-  eeprom_restore(mac, uip_ethaddr.addr, 6);
-#else 
-  memcpy_P(uip_ethaddr.addr, PSTR(CONF_ETHERRAPE_MAC), 6);
-#endif
-
-#if defined(BOOTP_SUPPORT)				\
-    || (IPV6_SUPPORT && !defined(IPV6_STATIC_SUPPORT))
-    return;
-
-#else
-
-    uip_ipaddr_t ip;
-    (void) ip;		/* Keep GCC quiet. */
-
-    /* Configure the IP address. */
-#ifdef EEPROM_SUPPORT
-    /* Please Note: ip and &ip are NOT the same (cpp hell) */
-    eeprom_restore_ip(ip, &ip);
-#else
-    set_CONF_ETHERRAPE_IP(&ip);
-#endif
-    uip_sethostaddr(&ip);
-
-
-    /* Configure prefix length (IPv6). */
-#ifdef IPV6_SUPPORT
-    uip_setprefixlen(CONF_ENC_IP6_PREFIX_LEN);
-#endif
-
-
-#ifdef IPV4_SUPPORT
-    /* Configure the netmask (IPv4). */
-#ifdef EEPROM_SUPPORT
-    /* Please Note: ip and &ip are NOT the same (cpp hell) */
-    eeprom_restore_ip(netmask, &ip);
-#else
-    set_CONF_ETHERRAPE_IP4_NETMASK(&ip);
-#endif
-    uip_setnetmask(&ip);
-#endif  /* IPV4_SUPPORT */
-
-    /* Configure the default gateway  */
-#ifdef EEPROM_SUPPORT
-    /* Please Note: ip and &ip are NOT the same (cpp hell) */
-    eeprom_restore_ip(gateway, &ip);
-#else
-    set_CONF_ETHERRAPE_GATEWAY(&ip);
-#endif
-    uip_setdraddr(&ip);
-#endif	/* No autoconfiguration. */
-}
-
-
 /*
   -- Ethersex META --
   header(hardware/ethernet/enc28j60.h)
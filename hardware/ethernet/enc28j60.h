@@ -282,12 +282,27 @@
 #define RXBUFFER_START 0x0000   /* start receive buffer at the beginning */
 #define RXBUFFER_END   0x0FFF   /* end receive buffer at 4kb */
 #define TXBUFFER_START 0x1000   /* start transmit buffer at 4kb */
+#define TXBUFFER_END   0x1FFF   /* end transmit buffer at 8kb */
+
+/* the transmit buffer is split into slots of one frame each: control
+ * byte, frame and the 7 byte status vector written by the controller */
+#define TXBUFFER_SLOT_SIZE (((NET_MAX_FRAME_LENGTH) + 1 + 7 + 0xFF) & ~0xFF)
+#define TXBUFFER_SLOTS     ((TXBUFFER_END + 1 - TXBUFFER_START) / TXBUFFER_SLOT_SIZE)
 
 #define RECEIVE_BUFFER_WRAP(x) ((x) & (RXBUFFER_END))
 
 /* global variables */
 extern int16_t enc28j60_next_packet_pointer;
 
+struct enc28j60_tx_stats_t {
+    uint16_t sent;              /* frames transmitted */
+    uint16_t dropped;           /* frames aborted or not queued */
+    uint8_t queued;             /* frames waiting or being transmitted */
+    uint8_t max_queued;         /* high water mark of queued */
+};
+
+extern struct enc28j60_tx_stats_t enc28j60_tx_stats;
+
 /* do not do timeout while waiting for spi transfer completed */
 /* #define SPI_TIMEOUT */
 
@@ -307,8 +322,10 @@ struct transmit_packet_vector_t {
 /* prototypes */
 uint8_t noinline read_control_register(uint8_t address);
 uint8_t noinline read_buffer_memory(void);
+void noinline read_buffer_block(uint8_t *data, uint16_t len);
 void noinline write_control_register(uint8_t address, uint8_t data);
 void noinline write_buffer_memory(uint8_t data);
+void noinline write_buffer_block(const uint8_t *data, uint16_t len);
 void noinline bit_field_modify(uint8_t address, uint8_t mask, uint8_t opcode);
 void noinline set_read_buffer_pointer(uint16_t address);
 uint16_t noinline get_read_buffer_pointer(void);
@@ -319,8 +336,9 @@ void noinline write_phy(uint8_t address, uint16_t data);
 void noinline reset_controller(void);
 void noinline reset_rx(void);
 void init_enc28j60(void);
+void enc28j60_tx_reset(void);
+void enc28j60_tx_poll(void);
 void noinline switch_bank(uint8_t bank);
-void network_config_load(void);
 
 #ifdef DEBUG_ENC28J60
 void dump_debug_registers(void);
@@ -29,6 +29,7 @@
 #include "protocols/uip/uip.h"
 #include "protocols/uip/parse.h"
 #include "core/eeprom.h"
+#include "hardware/ethernet/enc28j60.h"
 
 #include "protocols/ecmd/ecmd-base.h"
 
@@ -97,7 +98,7 @@ int16_t parse_cmd_mac(char *cmd, char *output, uint16_t len)
 
 	if (ret >= 0) {
 	    eeprom_save(mac, &new_mac, 6);
-	    eeprom_update_chksum();
+	    eeprom_commit();
 	    return ECMD_FINAL_OK;
 	}
 	else
@@ -116,8 +117,23 @@ int16_t parse_cmd_mac(char *cmd, char *output, uint16_t len)
 }
 
 
+int16_t parse_cmd_enc_txstat(char *cmd, char *output, uint16_t len)
+{
+    (void) cmd;
+
+    return ECMD_FINAL(snprintf_P(output, len,
+                                 PSTR("sent %u dropped %u queued %u/%u max %u"),
+                                 enc28j60_tx_stats.sent,
+                                 enc28j60_tx_stats.dropped,
+                                 enc28j60_tx_stats.queued,
+                                 TXBUFFER_SLOTS,
+                                 enc28j60_tx_stats.max_queued));
+}
+
+
 /*
   -- Ethersex META --
   block(Network configuration)
   ecmd_feature(mac, "mac",[xx:xx:xx:xx:xx:xx],Display/Set the MAC address.)
+  ecmd_feature(enc_txstat, "enc txstat",,Display the ENC28J60 transmit queue counters.)
 */
@@ -24,10 +24,8 @@
 #include <avr/pgmspace.h>
 
 #include "network.h"
-#include "protocols/uip/uip_arp.h"
 #include "config.h"
 #include "core/bit-macros.h"
-#include "protocols/uip/uip_router.h"
 
 #include "core/debug.h"
 
@@ -48,6 +46,9 @@ void process_packet(void);
 
 void network_process(void)
 {
+    /* start the next queued frame, if the last one is done */
+    enc28j60_tx_poll();
+
     /* also check packet counter, see errata #6 */
 #   ifdef ENC28J60_REV4_WORKAROUND
     uint8_t pktcnt = read_control_register(REG_EPKTCNT);
@@ -119,15 +120,11 @@ void network_process(void)
     /* packet transmit flag */
     if (EIR & _BV(TXIF)) {
 
-#ifdef DEBUG
-        uint8_t ESTAT = read_control_register(REG_ESTAT);
-
-        if (ESTAT & _BV(TXABRT))
-            debug_printf("net: packet transmit failed\n");
-#endif
         /* clear flags */
         bit_field_clear(REG_EIR, _BV(TXIF));
-        bit_field_clear(REG_ESTAT, _BV(TXABRT) | _BV(LATECOL) );
+
+        /* transmit the next frame from the queue */
+        enc28j60_tx_poll();
     }
 
     /* packet receive flag */
@@ -158,6 +155,13 @@ void network_process(void)
 #endif
 
         bit_field_clear(REG_EIR, _BV(TXERIF));
+
+        /* the transmit logic may stall after an error, see errata #12,
+         * reset it and go on with the next frame */
+        bit_field_set(REG_ECON1, _BV(ECON1_TXRST));
+        bit_field_clear(REG_ECON1, _BV(ECON1_TXRST));
+        bit_field_clear(REG_ECON1, _BV(ECON1_TXRTS));
+        enc28j60_tx_poll();
     }
 
     /* set global interrupt flag */
@@ -175,16 +179,17 @@ void process_packet(void)
     debug_printf("net: packet received\n");
 #   endif
 
-    /* read next packet pointer */
-    set_read_buffer_pointer(enc28j60_next_packet_pointer);
-    enc28j60_next_packet_pointer = read_buffer_memory() | (read_buffer_memory() << 8);
+    /* read next packet pointer and receive status vector */
+    struct {
+        uint16_t next_packet_pointer;
+        struct receive_packet_vector_t rpv;
+    } __attribute__((packed)) header;
 
-    /* read receive status vector */
-    struct receive_packet_vector_t rpv;
-    uint8_t *p = (uint8_t *)&rpv;
+    set_read_buffer_pointer(enc28j60_next_packet_pointer);
+    read_buffer_block((uint8_t *) &header, sizeof(header));
 
-    for (uint8_t i = 0; i < sizeof(struct receive_packet_vector_t); i++)
-        *p++ = read_buffer_memory();
+    enc28j60_next_packet_pointer = header.next_packet_pointer;
+    struct receive_packet_vector_t rpv = header.rpv;
 
     /* decrement rpv received_packet_size by 4, because the 4 byte CRC checksum is counted */
     rpv.received_packet_size -= 4;
@@ -197,83 +202,33 @@ void process_packet(void)
         debug_printf("net: packet too large or too small for an "
 		     "ethernet header: %d\n", rpv.received_packet_size);
 #       endif
-        return;
+        goto skip;
     }
 
-    /* read packet */
-    p = uip_buf;
-    for (uint16_t i = 0; i < rpv.received_packet_size; i++)
-        *p++ = read_buffer_memory();
+    /* read the headers only, frames we don't want are skipped in the
+     * receive buffer without copying the payload over spi */
+    uint16_t peek = rpv.received_packet_size;
+    if (peek > NET_PEEK_LENGTH)
+        peek = NET_PEEK_LENGTH;
 
-    uip_len = rpv.received_packet_size;
+    read_buffer_block(uip_buf, peek);
 
-    /* Set the enc stack active */
-    uip_stack_set_active(STACK_ENC);
-
-    /* process packet */
-    struct uip_eth_hdr *packet = (struct uip_eth_hdr *)&uip_buf;
-    switch (HTONS(packet->type)) {
-
-#       if !UIP_CONF_IPV6
-        /* process arp packet */
-        case UIP_ETHTYPE_ARP:
-#           ifdef DEBUG_NET
-            debug_printf("net: arp packet received\n");
-#           endif
-            uip_arp_arpin();
-
-            /* if there is a packet to send, send it now */
-            if (uip_len > 0)
-                transmit_packet();
-
-            break;
-#       endif /* !UIP_CONF_IPV6 */
-
-#       if UIP_CONF_IPV6
-        /* process ip packet */
-        case UIP_ETHTYPE_IP6:
-#           ifdef DEBUG_NET
-            debug_printf ("net: ip6 packet received\n");
-#           endif
-#       else /* !UIP_CONF_IPV6 */
-        /* process ip packet */
-        case UIP_ETHTYPE_IP:
-#           ifdef DEBUG_NET
-            debug_printf ("net: ip packet received\n");
-#           endif
-            uip_arp_ipin();
-#       endif /* !UIP_CONF_IPV6 */
-
-            router_input(STACK_ENC);
-
-	    /* if there is a packet to send, send it now */
-	    if (uip_len > 0)
-		router_output();
-
-            break;
-#       ifdef DEBUG_UNKNOWN_PACKETS
-        default:
-            /* debug output */
-            debug_printf("net: unknown packet, %02x%02x%02x%02x%02x%02x "
-                         "-> %02x%02x%02x%02x%02x%02x, type 0x%02x%02x\n",
-                         packet->src.addr[0],
-                         packet->src.addr[1],
-                         packet->src.addr[2],
-                         packet->src.addr[3],
-                         packet->src.addr[4],
-                         packet->src.addr[5],
-                         packet->dest.addr[0],
-                         packet->dest.addr[1],
-                         packet->dest.addr[2],
-                         packet->dest.addr[3],
-                         packet->dest.addr[4],
-                         packet->dest.addr[5],
-                         HI8(ntohs(packet->type)),
-                         LO8(ntohs(packet->type)));
-            break;
+    if (!network_frame_wanted(peek)) {
+#       ifdef DEBUG_NET
+        debug_printf("net: packet skipped\n");
 #       endif
+        goto skip;
     }
 
+    /* read the rest of the packet */
+    read_buffer_block(uip_buf + peek, rpv.received_packet_size - peek);
+
+    uip_len = rpv.received_packet_size;
+
+    network_process_frame();
+
+skip:
+
     /* advance receive read pointer, ensuring that an odd value is programmed
      * (next_receive_packet_pointer is always even), see errata #13 */
     if ( (enc28j60_next_packet_pointer - 1) < RXBUFFER_START
@@ -30,36 +30,31 @@
 #include "core/debug.h"
 
 
-void transmit_packet(void)
-{
+struct enc28j60_tx_stats_t enc28j60_tx_stats;
 
-    /* wait for any transmits to end, with timeout */
-    uint8_t timeout = 100;
-    while (read_control_register(REG_ECON1) & _BV(ECON1_TXRTS) && timeout-- > 0);
+/* frame lengths of the transmit buffer slots */
+static uint16_t tx_slot_len[TXBUFFER_SLOTS];
 
-    if (timeout == 0) {
-        debug_printf("net: timeout waiting for TXRTS, aborting transmit!\n");
-        return;
-    }
+/* slot to fill next and slot currently being transmitted */
+static uint8_t tx_head;
+static uint8_t tx_tail;
 
-    uint16_t start_pointer = TXBUFFER_START;
+
+static uint16_t tx_slot_start(uint8_t slot)
+{
+    return TXBUFFER_START + slot * TXBUFFER_SLOT_SIZE;
+}
+
+static void tx_start(void)
+{
+    uint16_t start_pointer = tx_slot_start(tx_tail);
 
     /* set send control registers */
     write_control_register(REG_ETXSTL, LO8(start_pointer));
     write_control_register(REG_ETXSTH, HI8(start_pointer));
 
-    write_control_register(REG_ETXNDL, LO8(start_pointer + uip_len));
-    write_control_register(REG_ETXNDH, HI8(start_pointer + uip_len));
-
-    /* set pointer to beginning of tx buffer */
-    set_write_buffer_pointer(start_pointer);
-
-    /* write override byte */
-    write_buffer_memory(0);
-
-    /* write data */
-    for (uint16_t i = 0; i < uip_len; i++)
-        write_buffer_memory(uip_buf[i]);
+    write_control_register(REG_ETXNDL, LO8(start_pointer + tx_slot_len[tx_tail]));
+    write_control_register(REG_ETXNDH, HI8(start_pointer + tx_slot_len[tx_tail]));
 
 #   ifdef ENC28J60_REV4_WORKAROUND
     /* reset transmit hardware, see errata #12 */
@@ -69,5 +64,76 @@ void transmit_packet(void)
 
     /* transmit packet */
     bit_field_set(REG_ECON1, _BV(ECON1_TXRTS));
+}
+
+void enc28j60_tx_reset(void)
+{
+    tx_head = tx_tail = 0;
+    enc28j60_tx_stats.queued = 0;
+}
+
+void enc28j60_tx_poll(void)
+{
+    if (enc28j60_tx_stats.queued == 0
+            || read_control_register(REG_ECON1) & _BV(ECON1_TXRTS))
+        return;
+
+    /* the frame in the tail slot is done */
+    uint8_t estat = read_control_register(REG_ESTAT);
+    if (estat & _BV(TXABRT)) {
+        enc28j60_tx_stats.dropped++;
+        bit_field_clear(REG_ESTAT, _BV(TXABRT) | _BV(LATECOL));
+#       ifdef DEBUG
+        debug_printf("net: packet transmit failed\n");
+#       endif
+    } else
+        enc28j60_tx_stats.sent++;
+
+    if (++tx_tail == TXBUFFER_SLOTS)
+        tx_tail = 0;
+
+    if (--enc28j60_tx_stats.queued)
+        tx_start();
+}
+
+void transmit_packet(void)
+{
+
+    enc28j60_tx_poll();
+
+    if (enc28j60_tx_stats.queued == TXBUFFER_SLOTS) {
+        /* all slots in use, wait for the running transmit to end, with
+         * timeout */
+        uint8_t timeout = 100;
+        while (read_control_register(REG_ECON1) & _BV(ECON1_TXRTS) && timeout-- > 0);
+
+        enc28j60_tx_poll();
+
+        if (enc28j60_tx_stats.queued == TXBUFFER_SLOTS) {
+            enc28j60_tx_stats.dropped++;
+            debug_printf("net: transmit queue full, aborting transmit!\n");
+            return;
+        }
+    }
+
+    /* set pointer to beginning of the free slot */
+    set_write_buffer_pointer(tx_slot_start(tx_head));
+
+    /* write override byte */
+    write_buffer_memory(0);
+
+    /* write data */
+    write_buffer_block(uip_buf, uip_len);
+
+    tx_slot_len[tx_head] = uip_len;
+    if (++tx_head == TXBUFFER_SLOTS)
+        tx_head = 0;
+
+    if (++enc28j60_tx_stats.queued > enc28j60_tx_stats.max_queued)
+        enc28j60_tx_stats.max_queued = enc28j60_tx_stats.queued;
+
+    /* controller idle, send it right away */
+    if (enc28j60_tx_stats.queued == 1)
+        tx_start();
 
 }
@@ -30,18 +30,36 @@
 
 static uint8_t i2c_24cxx_address;
 
+/* A page write is in progress, the chip won't answer until it's done. */
+static uint8_t i2c_24cxx_busy;
+
 void 
 i2c_24CXX_init(void)
 {
   i2c_24cxx_address = i2c_master_detect(I2C_SLA_24CXX, I2C_SLA_24CXX + 8);
 }
 
+/* Select the chip for writing.  After a write, instead of waiting for
+   the worst case write cycle time, poll until it acknowledges again. */
+static uint8_t
+i2c_24CXX_select(void)
+{
+  uint16_t polls = i2c_24cxx_busy ? 500 : 1;
+  while (polls--) {
+    if (i2c_master_select(i2c_24cxx_address, TW_WRITE)) {
+      i2c_24cxx_busy = 0;
+      return 1;
+    }
+  }
+  return 0;
+}
+
 uint8_t 
 i2c_24CXX_set_addr(uint16_t addr)
 {
   uint8_t ret;
 
-  if (! i2c_master_select(i2c_24cxx_address, TW_WRITE)) { ret = 0; goto end; }
+  if (! i2c_24CXX_select()) { ret = 0; goto end; }
 
   TWDR = (addr >> 8) & 0xff;
   if (i2c_master_transmit() != TW_MT_DATA_ACK) { ret = 0; goto end; }
@@ -82,8 +100,9 @@ end:
 
 }
 
-uint8_t 
-i2c_24CXX_write_block(uint16_t addr, uint8_t *ptr, uint8_t len)
+/* Write LEN bytes within one page of the chip. */
+static uint8_t
+i2c_24CXX_write_page(uint16_t addr, uint8_t *ptr, uint8_t len)
 {
   uint8_t ret;
   if (!i2c_24CXX_set_addr(addr)) { ret = 0; goto end; }
@@ -97,16 +116,34 @@ end:
   TWCR=((1<<TWEN)|(1<<TWINT)|(1<<TWSTO));     // Stopbedingung senden
   while (!(TWCR & (1<<TWSTO)));               // warten bis TWI fertig
 
-  /* Here we start to do the polling of the write cycle */
-  uint16_t polls = 500;
-  while (polls--) {
-    if (i2c_master_select(i2c_24cxx_address, TW_WRITE)) {
-      break;
-    }
+  /* The write cycle runs while we do something else, the next access
+     polls for its end. */
+  i2c_24cxx_busy = 1;
+  return ret;
+}
+
+uint8_t 
+i2c_24CXX_write_block(uint16_t addr, uint8_t *ptr, uint8_t len)
+{
+  uint8_t done = 0;
+
+  /* The chip's address counter wraps around at the end of a page, so
+     split the block up.  Chunks the chip already holds aren't written,
+     this saves a write cycle and wear on every rewrite. */
+  while (done < len) {
+    uint8_t chunk = I2C_24CXX_PAGE_SIZE - (addr & (I2C_24CXX_PAGE_SIZE - 1));
+    if (chunk > len - done)
+      chunk = len - done;
+
+    if (!i2c_24CXX_compare_block(addr, ptr + done, chunk)
+	&& i2c_24CXX_write_page(addr, ptr + done, chunk) != chunk)
+      return 0;
+
+    addr += chunk;
+    done += chunk;
   }
 
-  i2c_master_stop();
-  return ret;
+  return done;
 }
 
 uint8_t 
@@ -136,7 +173,7 @@ i2c_24CXX_compare_block(uint16_t addr, uint8_t *ptr, uint8_t len)
   }
 
   /* recv one byte and do not ack */
-  if (i2c_master_transmit() != TW_MR_DATA_NACK) {goto end; }
+  if (i2c_master_transmit() != TW_MR_DATA_NACK) {ret = 0; goto end; }
   if (ptr[ret] != TWDR) {ret = 0; goto end;}
 
   ret = 1;
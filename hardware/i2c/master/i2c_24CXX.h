@@ -25,6 +25,10 @@
 
 #define I2C_SLA_24CXX 80
 
+#ifndef I2C_24CXX_PAGE_SIZE
+#define I2C_24CXX_PAGE_SIZE 32
+#endif
+
 void i2c_24CXX_init(void);
 uint8_t i2c_24CXX_set_addr(uint16_t addr);
 
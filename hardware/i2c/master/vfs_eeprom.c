@@ -37,15 +37,127 @@
 #endif
 
 
-#define vfs_eeprom_read_page(page, data, len) i2c_24CXX_read_block(page * SFS_PAGE_SIZE, data, len)
-#define vfs_eeprom_read_slice(page, offset, data, len) i2c_24CXX_read_block(page * SFS_PAGE_SIZE + offset , data, len)
-#define vfs_eeprom_write_page(page, data, len) i2c_24CXX_write_block(page * SFS_PAGE_SIZE, data, len)
-#define vfs_eeprom_write_slice(page, offset, data, len) i2c_24CXX_write_block(page * SFS_PAGE_SIZE + offset , data, len)
+#if VFS_EEPROM_CACHE_PAGES > 0
+/* Pages written to are kept in RAM, so the several small writes that
+   e.g. saving a file does to the same page become a single one. */
+static struct {
+  vfs_eeprom_inode_t page;	/* 0xffff if unused */
+  uint8_t stamp;		/* value of vfs_eeprom_clock on last use */
+  uint8_t dirty_start, dirty_end; /* dirty bytes, start >= end if clean */
+  uint8_t data[SFS_PAGE_SIZE];
+} vfs_eeprom_cache[VFS_EEPROM_CACHE_PAGES];
+
+static uint8_t vfs_eeprom_clock;
+
+static uint8_t
+vfs_eeprom_cache_find(vfs_eeprom_inode_t page)
+{
+  uint8_t i;
+  for (i = 0; i < VFS_EEPROM_CACHE_PAGES; i++)
+    if (vfs_eeprom_cache[i].page == page)
+      break;
+
+  return i;
+}
+
+static uint8_t
+vfs_eeprom_cache_writeback(uint8_t i)
+{
+  uint8_t start = vfs_eeprom_cache[i].dirty_start;
+  uint8_t end = vfs_eeprom_cache[i].dirty_end;
+
+  if (start < end
+      && !i2c_24CXX_write_block(vfs_eeprom_cache[i].page * SFS_PAGE_SIZE + start,
+                                vfs_eeprom_cache[i].data + start, end - start))
+    return 0;
+
+  vfs_eeprom_cache[i].dirty_start = SFS_PAGE_SIZE;
+  vfs_eeprom_cache[i].dirty_end = 0;
+  return 1;
+}
+
+void
+vfs_eeprom_flush(void)
+{
+  for (uint8_t i = 0; i < VFS_EEPROM_CACHE_PAGES; i++)
+    if (vfs_eeprom_cache_writeback(i))
+      vfs_eeprom_cache[i].page = 0xffff;
+}
+
+static uint8_t
+vfs_eeprom_page_read(vfs_eeprom_inode_t page, uint8_t offset, void *data,
+                     uint8_t len)
+{
+  uint8_t i = vfs_eeprom_cache_find(page);
+  if (i == VFS_EEPROM_CACHE_PAGES)
+    return i2c_24CXX_read_block(page * SFS_PAGE_SIZE + offset, data, len);
+
+  vfs_eeprom_cache[i].stamp = vfs_eeprom_clock++;
+  memcpy(data, vfs_eeprom_cache[i].data + offset, len);
+  return len;
+}
+
+static uint8_t
+vfs_eeprom_page_write(vfs_eeprom_inode_t page, uint8_t offset, void *data,
+                      uint8_t len)
+{
+  uint8_t i = vfs_eeprom_cache_find(page);
+
+  if (i == VFS_EEPROM_CACHE_PAGES) {
+    /* Replace the page used least recently. */
+    i = 0;
+    for (uint8_t j = 1; j < VFS_EEPROM_CACHE_PAGES; j++)
+      if ((uint8_t) (vfs_eeprom_clock - vfs_eeprom_cache[j].stamp)
+          > (uint8_t) (vfs_eeprom_clock - vfs_eeprom_cache[i].stamp))
+        i = j;
+
+    if (!vfs_eeprom_cache_writeback(i))
+      return 0;
+
+    vfs_eeprom_cache[i].page = 0xffff;
+    if (len < SFS_PAGE_SIZE
+        && i2c_24CXX_read_block(page * SFS_PAGE_SIZE, vfs_eeprom_cache[i].data,
+                                SFS_PAGE_SIZE) != SFS_PAGE_SIZE)
+      return 0;
+
+    vfs_eeprom_cache[i].page = page;
+  }
+
+  vfs_eeprom_cache[i].stamp = vfs_eeprom_clock++;
+  memcpy(vfs_eeprom_cache[i].data + offset, data, len);
+  if (offset < vfs_eeprom_cache[i].dirty_start)
+    vfs_eeprom_cache[i].dirty_start = offset;
+  if (offset + len > vfs_eeprom_cache[i].dirty_end)
+    vfs_eeprom_cache[i].dirty_end = offset + len;
+
+  return len;
+}
+#else
+#define vfs_eeprom_page_read(page, offset, data, len) i2c_24CXX_read_block(page * SFS_PAGE_SIZE + offset , data, len)
+#define vfs_eeprom_page_write(page, offset, data, len) i2c_24CXX_write_block(page * SFS_PAGE_SIZE + offset , data, len)
+#endif	/* VFS_EEPROM_CACHE_PAGES > 0 */
+
+#define vfs_eeprom_read_page(page, data, len) vfs_eeprom_page_read(page, 0, data, len)
+#define vfs_eeprom_read_slice(page, offset, data, len) vfs_eeprom_page_read(page, offset, data, len)
+#define vfs_eeprom_write_page(page, data, len) vfs_eeprom_page_write(page, 0, data, len)
+#define vfs_eeprom_write_slice(page, offset, data, len) vfs_eeprom_page_write(page, offset, data, len)
+
+/* Where to look for a free page next.  Pages are handed out round
+   robin, so rewriting a file moves its data to other pages each time
+   instead of wearing out the same ones. */
+static vfs_eeprom_inode_t vfs_eeprom_next_free = 1;
 
 void
 vfs_eeprom_init(void)
 {
   unsigned char buf[SFS_PAGE_SIZE];
+#if VFS_EEPROM_CACHE_PAGES > 0
+  for (uint8_t i = 0; i < VFS_EEPROM_CACHE_PAGES; i++) {
+    vfs_eeprom_cache[i].page = 0xffff;
+    vfs_eeprom_cache[i].dirty_start = SFS_PAGE_SIZE;
+    vfs_eeprom_cache[i].dirty_end = 0;
+  }
+#endif
   vfs_eeprom_read_page(0, buf, sizeof(struct vfs_eeprom_page_superblock));
 
   /* Page 0  is the superblock */
@@ -63,12 +175,11 @@ vfs_eeprom_init(void)
     sb->version = SFS_VERSION;
     sb->next_page = 0;
     sb->next_file = 0;
-    vfs_eeprom_write_page(0, buf, sizeof(struct vfs_eeprom_page_superblock));
-    memset(buf, 0, 2);
+    i2c_24CXX_write_block(0, buf, sizeof(struct vfs_eeprom_page_superblock));
     vfs_eeprom_inode_t count = 1;
     while (count < SFS_PAGE_COUNT) {
       wdt_kick();
-      vfs_eeprom_write_page(count, buf, 1);
+      i2c_24CXX_write_byte(count * SFS_PAGE_SIZE, 0);
       vfs_eeprom_debug("clear page %d\n", count);
       count++;
     }
@@ -87,21 +198,23 @@ vfs_eeprom_init(void)
 }
 
 static vfs_eeprom_inode_t
-vfs_eeprom_find_free_page(vfs_eeprom_inode_t suggested)
+vfs_eeprom_find_free_page(void)
 {
   unsigned char buf[1];
 
-  vfs_eeprom_inode_t tmp = suggested;
+  vfs_eeprom_inode_t tmp = vfs_eeprom_next_free;
 
   while(1) {
     if (!vfs_eeprom_read_page(tmp, buf, 1)) return 0;
     if (buf[0] != SFS_MAGIC_SUPERBLOCK && buf[0] != SFS_MAGIC_FILE && buf[0] != SFS_MAGIC_DATA) {
       vfs_eeprom_debug("found empty page at %d\n", tmp);
+      vfs_eeprom_next_free = tmp + 1;
+      if (vfs_eeprom_next_free >= SFS_PAGE_COUNT) vfs_eeprom_next_free = 1;
       return tmp; /* yeah we have found a empty page */
     }
     tmp ++;
-    if (tmp >= SFS_PAGE_COUNT) tmp = 0;
-    if (tmp == suggested) return 0; /* 0 is the superblock, always so this indicates an error */
+    if (tmp >= SFS_PAGE_COUNT) tmp = 1;
+    if (tmp == vfs_eeprom_next_free) return 0; /* 0 is the superblock, always so this indicates an error */
   }
 }
 
@@ -147,7 +260,7 @@ vfs_eeprom_create(const char * filename)
   struct vfs_eeprom_page_data *data = (struct vfs_eeprom_page_data *) buf;
 
   if (inode == 0) {
-    inode = vfs_eeprom_find_free_page(inode);
+    inode = vfs_eeprom_find_free_page();
     if (inode == 0) {
       vfs_eeprom_debug("no space left on device\n");
       return NULL;
@@ -209,6 +322,7 @@ vfs_eeprom_close(struct vfs_file_handle_t *handle)
 {
   if (handle)
     free(handle);
+  vfs_eeprom_flush();
 }
 
 vfs_size_t
@@ -369,7 +483,7 @@ vfs_eeprom_write(struct vfs_file_handle_t *handle, void *data, vfs_size_t len)
     pages_needed = 0;
 
   while(pages_needed--) {
-    vfs_eeprom_inode_t new_node = vfs_eeprom_find_free_page(last_page + 1);
+    vfs_eeprom_inode_t new_node = vfs_eeprom_find_free_page();
     if (new_node == 0) {
       vfs_eeprom_debug("no space left on device\n");
       return 0;
@@ -398,13 +512,18 @@ vfs_eeprom_write(struct vfs_file_handle_t *handle, void *data, vfs_size_t len)
       copy_len = sizeof(data_page->data) - write_offset;
 
     vfs_eeprom_debug("write; copy %d byte to page %d at %d\n", copy_len, write_page, write_offset);
-    data_page->page_len = write_offset + copy_len;
+    /* Overwriting within the file mustn't make the page shorter */
+    if (data_page->page_len < write_offset + copy_len)
+      data_page->page_len = write_offset + copy_len;
     vfs_eeprom_debug("%d, %d, %d, %d\n", write_page, 4 + write_offset, 
                     data_page->page_len, copy_len);
 
-    vfs_eeprom_write_slice(write_page, 4 + write_offset, 
-                    data, copy_len);
-    vfs_eeprom_write_slice(write_page, 3, &data_page->page_len, 1);
+    /* Length and data in one slice.  It may span several chip pages,
+       the driver writes each in a cycle of its own and skips the
+       ones that didn't change (the data before write_offset). */
+    memcpy(data_page->data + write_offset, data, copy_len);
+    vfs_eeprom_write_slice(write_page, 3, &data_page->page_len,
+                    1 + write_offset + copy_len);
     write_offset = 0;
     write_page = data_page->next_page;
     /* Read the next page */
@@ -418,6 +537,7 @@ vfs_eeprom_write(struct vfs_file_handle_t *handle, void *data, vfs_size_t len)
 
 /*
   -- Ethersex META --
-  hardware/i2c/master/vfs_eeprom.h)
+  header(hardware/i2c/master/vfs_eeprom.h)
   initearly(vfs_eeprom_init)
+  timer(50, vfs_eeprom_flush())
 */
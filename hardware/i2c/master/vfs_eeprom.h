@@ -72,6 +72,13 @@ typedef struct {
 } vfs_file_handle_eeprom_t;
 
 
+void vfs_eeprom_init(void);
+#if VFS_EEPROM_CACHE_PAGES > 0
+/* Write cached pages back to the EEPROM and forget them. */
+void vfs_eeprom_flush(void);
+#else
+#define vfs_eeprom_flush()
+#endif
 struct vfs_file_handle_t * vfs_eeprom_open(const char * filename);
 void vfs_eeprom_close(struct vfs_file_handle_t *handle);
 vfs_size_t vfs_eeprom_write(struct vfs_file_handle_t *handle, void *buf, vfs_size_t len);
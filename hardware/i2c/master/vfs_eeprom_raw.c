@@ -57,6 +57,9 @@ vfs_eeprom_raw_read (struct vfs_file_handle_t *fh, void *buf, vfs_size_t length)
   if (fh->u.ee_raw.end) return 0;
   if (length > SFS_PAGE_SIZE) 
     length = SFS_PAGE_SIZE;
+#ifdef VFS_EEPROM_SUPPORT
+  vfs_eeprom_flush();		/* The filesystem may have pages cached. */
+#endif
   length = i2c_24CXX_read_block(fh->u.ee_raw.inode * SFS_PAGE_SIZE, buf, length);
   return length;
 }
@@ -66,6 +69,9 @@ vfs_eeprom_raw_write (struct vfs_file_handle_t *fh, void *buf, vfs_size_t length
 {
   if (length > SFS_PAGE_SIZE) 
     length = SFS_PAGE_SIZE;
+#ifdef VFS_EEPROM_SUPPORT
+  vfs_eeprom_flush();
+#endif
   length = i2c_24CXX_write_block(fh->u.ee_raw.inode * SFS_PAGE_SIZE, buf, length);
   return length;
 }
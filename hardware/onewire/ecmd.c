@@ -325,6 +325,72 @@ int16_t parse_cmd_onewire_convert(char *cmd, char *output, uint16_t len)
 }
 
 
+#ifdef ECMD_BINARY_SUPPORT
+/* args: the 8 byte rom code,
+   output: the temperature in 1/256 degrees, two bytes */
+int16_t parse_bin_onewire_get(uint8_t *args, uint8_t argc, uint8_t *output,
+                              uint16_t len)
+{
+    struct ow_rom_code_t rom;
+
+    if (argc != sizeof(rom.bytewise))
+        return ECMD_ERR_PARSE_ERROR;
+    memcpy(rom.bytewise, args, sizeof(rom.bytewise));
+
+    if (!ow_temp_sensor(&rom))
+        return ECMD_ERR_PARSE_ERROR;
+
+    /* disable interrupts */
+    uint8_t sreg = SREG;
+    cli();
+
+    struct ow_temp_scratchpad_t sp;
+    int8_t ret = ow_temp_read_scratchpad(&rom, &sp);
+
+    /* re-enable interrupts */
+    SREG = sreg;
+
+    if (ret != 1)
+        return ECMD_ERR_READ_ERROR;
+
+    uint16_t temp = ow_temp_normalize(&rom, &sp);
+    output[0] = LO8(temp);
+    output[1] = HI8(temp);
+
+    return ECMD_FINAL(2);
+}
+
+
+/* args: none or the 8 byte rom code */
+int16_t parse_bin_onewire_convert(uint8_t *args, uint8_t argc,
+                                  uint8_t *output, uint16_t len)
+{
+    struct ow_rom_code_t rom, *romptr = NULL;
+
+    if (argc == sizeof(rom.bytewise)) {
+        memcpy(rom.bytewise, args, sizeof(rom.bytewise));
+        romptr = &rom;
+    } else if (argc)
+        return ECMD_ERR_PARSE_ERROR;
+
+    /* disable interrupts */
+    uint8_t sreg = SREG;
+    cli();
+
+    int8_t ret = ow_temp_start_convert_wait(romptr);
+
+    SREG = sreg;
+
+    if (ret == 1)
+        return ECMD_FINAL_OK;
+    else if (ret == -1)
+        return ECMD_ERR_READ_ERROR;
+    else
+        return ECMD_ERR_PARSE_ERROR;
+}
+#endif /* ECMD_BINARY_SUPPORT */
+
+
 /*
   -- Ethersex META --
   block(Dallas 1-wire)
@@ -332,5 +398,7 @@ int16_t parse_cmd_onewire_convert(char *cmd, char *output, uint16_t len)
     ecmd_feature(onewire_list, "1w list",,Return a list of the connected onewire devices)
   ecmd_endif()
   ecmd_feature(onewire_get, "1w get", DEVICE, Return temperature value of onewire DEVICE (provide 64-bit ID as 16-hex-digits))
+  ecmd_binary(onewire_get)
   ecmd_feature(onewire_convert, "1w convert", [DEVICE], Trigger temperature conversion of either DEVICE or all connected devices)
+  ecmd_binary(onewire_convert)
 */
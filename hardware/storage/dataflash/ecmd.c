@@ -28,6 +28,7 @@
 #include "config.h"
 #include "hardware/storage/dataflash/df.h"
 #include "hardware/storage/dataflash/fs.h"
+#include "core/vfs/vfs.h"
 
 #include "protocols/ecmd/ecmd-base.h"
 
@@ -100,6 +101,8 @@ parse_cmd_fs_mkfile (char *cmd, char *output, uint16_t len)
   if (ret != FS_OK)
     return ECMD_FINAL(snprintf_P(output, len, PSTR("fs_create: returned 0x%02x"), ret));
 
+  vfs_invalidate ();		/* VFS may remember it as missing. */
+
   fs_inode_t i = fs_get_inode (&fs, cmd);
   return ECMD_FINAL(snprintf_P(output, len, PSTR("fs_create: inode 0x%04x"), i));
 }
@@ -139,6 +142,18 @@ parse_cmd_fs_truncate (char *cmd, char *output, uint16_t len)
 }
 
 
+int16_t
+parse_cmd_fs_sync (char *cmd, char *output, uint16_t len)
+{
+  (void) cmd;
+  (void) output;
+  (void) len;
+
+  fs_status_t ret = fs_commit (&fs);
+  return (ret == FS_OK) ? ECMD_FINAL_OK : ECMD_ERR_WRITE_ERROR;
+}
+
+
 #ifdef DEBUG_FS
 int16_t
 parse_cmd_fs_inspect_node (char *cmd, char *output, uint16_t len)
@@ -179,6 +194,7 @@ parse_cmd_fs_inspect_inode (char *cmd, char *output, uint16_t len)
   ecmd_feature(fs_mkfile, "fs mkfile ", NAME, Create a new file NAME.)
   ecmd_feature(fs_remove, "fs remove ", NAME, Delete the file NAME.)
   ecmd_feature(fs_truncate, "fs truncate ", NAME LEN, Truncate the file NAME to LEN bytes.)
+  ecmd_feature(fs_sync, "fs sync",, Write buffered data and pending changes to the dataflash.)
 
   ecmd_ifdef(DEBUG_FS)
     ecmd_feature(fs_inspect_node, "fs inspect node ", NODE, Inspect NODE and dump to serial.)
@@ -131,10 +131,11 @@ fs_status_t fs_init(void)
 
     printf("initalizing filesystem...\n");
     fs.chip = NULL;
-
-    /* keep address of last free page, so that we can start searching for the
-     * next free page at this address to provide wear-levelling */
-    fs.last_free = 0;
+    fs.fresh_count = 0;
+    fs.obsolete_count = 0;
+    fs.age = 0;
+    fs.append_file = 0xffff;
+    fs.append_state = 0;
 
     /* init free pages storage:
      * buffer 2 in dataflash is used as the free pages storage, each byte
@@ -154,6 +155,16 @@ fs_status_t fs_init(void)
         return ret;
     }
 
+    /* load the inodetable of the root node */
+    df_flash_read(fs.chip, fs.root, fs.inodetable, FS_ROOTNODE_INODETABLE_OFFSET,
+                  sizeof(fs.inodetable));
+
+    /* keep address of last free page, so that we can start searching for the
+     * next free page at this address to provide wear-levelling.  The root
+     * node was the last page written, so continue right after it instead
+     * of starting over at page 0 on every boot. */
+    fs.last_free = fs.root;
+
     /* mark used pages */
     fs_mark_used(&fs, fs.root);
 
@@ -168,6 +179,8 @@ fs_status_t fs_init(void)
     if (node == NULL)
         return FS_MEM;
 
+    uint8_t dangling = 0;
+
     printf("fs: nodes in root:\r\n");
     for (uint8_t i = 0; i < FS_NODES_IN_ROOT; i++) {
 
@@ -198,11 +211,29 @@ fs_status_t fs_init(void)
 		page = fs_page (&fs, pagedata.next_inode);
 		printf ("\t... continues in page 0x%04x (inode 0x%04x)\n",
 			page, pagedata.next_inode);
+
+		/* power was lost while a write extended this file */
+		if (page == 0xffff)
+		    dangling = 1;
 	    }
         }
 
     }
 
+    /* cut dangling chains off at the last readable page, now that all used
+     * pages are known and fs_truncate() can allocate safely */
+    if (dangling) {
+        for (uint8_t i = 0; i < FS_NODES_IN_ROOT; i++) {
+
+            df_flash_read(fs.chip, fs.root, node, FS_ROOTNODE_NODETABLE_OFFSET + i * sizeof(fs_node_t), sizeof(fs_node_t));
+
+            if (node->unused == 0)
+                fs_truncate(&fs, node->inode, fs_size(&fs, node->inode));
+        }
+
+        fs_commit(&fs);
+    }
+
     /* free temporarily buffer */
     free(node);
 
@@ -273,7 +304,8 @@ fs_inode_t fs_get_inode(fs_t *fs, const char *file)
                       FS_ROOTNODE_NODETABLE_OFFSET+(index++) * sizeof(fs_node_t),
                       sizeof(fs_node_t));
 
-        if (strncmp(node->name, file, FS_FILENAME) == 0) {
+        /* the terminating node may still carry the name of a removed file */
+        if (!node->unused && strncmp(node->name, file, FS_FILENAME) == 0) {
             inode = node->inode;
             break;
         }
@@ -292,6 +324,10 @@ fs_size_t fs_read(fs_t *fs, fs_inode_t inode, void *buf, fs_size_t offset, fs_si
 
     assert(length > 0);
 
+    /* data appended to this file may still be in BUF1 */
+    if (inode == fs->append_file && fs_flush(fs) != FS_OK)
+        return 0;
+
     fs_size_t read = 0;
 
     /* load first page address */
@@ -351,7 +387,7 @@ fs_size_t fs_read(fs_t *fs, fs_inode_t inode, void *buf, fs_size_t offset, fs_si
         if (length+offset <= page.size) {
 
             printf("\tlast page (but not eof), length %d, offset %d\n", length, offset);
-            df_flash_read(fs->chip, pagenum, b, FS_DATA_OFFSET+offset, length+offset);
+            df_flash_read(fs->chip, pagenum, b, FS_DATA_OFFSET+offset, length);
             read += length;
             return read;
 
@@ -387,231 +423,272 @@ fs_size_t fs_read(fs_t *fs, fs_inode_t inode, void *buf, fs_size_t offset, fs_si
 
 }
 
-fs_status_t fs_write(fs_t *fs, fs_inode_t inode, void *buf, fs_size_t offset, fs_size_t length)
+fs_inode_t fs_walk(fs_t *fs, fs_inode_t inode, fs_size_t *offset)
 {
 
-    printf("fs_write, inode %d, offset %ld, length %ld\n",
-	   inode, offset, length);
+    /* the tail of a streamed file may not have been written yet */
+    if (inode == fs->append_file && fs_flush(fs) != FS_OK)
+        return 0xffff;
 
-    df_page_t pagenum, old_pagenum;
     fs_page_t page;
 
-    /* check if this file contained data before */
-    if ( (pagenum = fs_page(fs, inode)) != 0xffff) {
+    /* all but the last page are full, skip them without reading data */
+    while (*offset >= FS_DATASIZE) {
 
-        /* while the current position is below the requested offset, seek */
-        while (offset > FS_DATASIZE) {
+        df_page_t pagenum = fs_page(fs, inode);
 
-            printf("\toffset > FS_DATASIZE, searching for next page\n");
+        if (pagenum == 0xffff)
+            return 0xffff;
 
-            /* find next page */
-            df_flash_read(fs->chip, pagenum, &page, FS_STRUCTURE_OFFSET, sizeof(fs_page_t));
+        df_flash_read(fs->chip, pagenum, &page, FS_STRUCTURE_OFFSET, sizeof(fs_page_t));
 
-            if (page.eof) {
-                printf(" ************************* BAD SEEK *******************************\n");
-                return FS_BADSEEK;
-            }
+        /* offset is beyond eof, fs_read will return 0 */
+        if (page.eof)
+            break;
 
-            inode = page.next_inode;
-            pagenum = fs_page(fs, inode);
-            printf("\tnext inode is %d, next page is %d\n", page.next_inode, pagenum);
+        inode = page.next_inode;
+        *offset -= FS_DATASIZE;
 
-            offset -= FS_DATASIZE;
-        }
+    }
 
-        old_pagenum = pagenum;
-        uint8_t eof = 0;
+    return inode;
 
-        do {
-            printf("\tlength > 0 (%ld), old page is %d\n",
-		   length, old_pagenum);
+}
 
-            /* allocate new page */
-            if ( (pagenum = fs_new_page(fs)) == 0xffff)
-                return FS_BADPAGE;
+fs_status_t fs_write(fs_t *fs, fs_inode_t inode, void *buf, fs_size_t offset, fs_size_t length)
+{
 
-            printf("\tnew allocated page is %d\n", pagenum);
+    printf("fs_write, inode %d, offset %ld, length %ld\n",
+	   inode, offset, length);
 
-            /* update inode */
-            fs_status_t ret = fs_update_inodetable(fs, inode, pagenum);
+    uint8_t *b = (uint8_t *)buf;
+    fs_page_t page;
 
-            if (ret != FS_OK)
-                return ret;
+    /* BUF1 is needed below, write out appended data first */
+    fs_status_t ret = (inode == fs->append_file) ? fs_append_close(fs) : fs_flush(fs);
 
-            if (length+offset > FS_DATASIZE) {
+    if (ret != FS_OK)
+        return ret;
 
-                printf("\t\tlength+offset > FS_DATASIZE\n");
+    /* check if this file contained data before */
+    df_page_t pagenum = fs_page(fs, inode);
 
-                /* load old page into buffer */
-                df_buf_load(fs->chip, DF_BUF1, old_pagenum);
-                df_wait(fs->chip);
+    if (pagenum == 0xffff && offset != 0)
+        return FS_BADSEEK;
 
-                /* load structure */
-                df_buf_read(fs->chip, DF_BUF1, &page, FS_STRUCTURE_OFFSET, sizeof(fs_page_t));
+    /* while the current position is below the requested offset, seek */
+    while (pagenum != 0xffff && offset > FS_DATASIZE) {
 
-                /* remember if original file ended in this page */
-                if (page.eof) {
-                    printf("\t\toriginal file ended here\r\n");
-                    eof = 1;
-                }
+        printf("\toffset > FS_DATASIZE, searching for next page\n");
 
-                if (!page.eof)
-                    /* save old pagenum */
-                    old_pagenum = fs_page(fs, page.next_inode);
+        /* find next page */
+        df_flash_read(fs->chip, pagenum, &page, FS_STRUCTURE_OFFSET, sizeof(fs_page_t));
 
-                page.unused = 0;
-                page.eof = 0;
-                page.root = 0;
-                page.size = FS_DATASIZE;
-                page.next_inode = fs_new_inode(fs);
-                inode = page.next_inode;
+        if (page.eof) {
+            printf(" ************************* BAD SEEK *******************************\n");
+            return FS_BADSEEK;
+        }
 
-                if (page.next_inode == 0xffff)
-                    return FS_BADINODE;
+        inode = page.next_inode;
+        pagenum = fs_page(fs, inode);
+        printf("\tnext inode is %d, next page is %d\n", page.next_inode, pagenum);
 
-                printf("\t\tnext inode is %d\n", page.next_inode);
+        offset -= FS_DATASIZE;
+    }
 
-                /* save structure */
-                df_buf_write(fs->chip, DF_BUF1, &page, FS_STRUCTURE_OFFSET, sizeof(fs_page_t));
+    while (1) {
 
-                printf("fs: writing1 into page 0x%04x\r\n", pagenum);
+        df_size_t n = FS_DATASIZE - offset;
+        if (length < n)
+            n = length;
 
-		if (FS_DATASIZE - offset) {
-		    /* write data */
-		    df_buf_write(fs->chip, DF_BUF1, buf, FS_DATA_OFFSET+offset,
-				 FS_DATASIZE-offset);
-		    length -= (FS_DATASIZE-offset);
-		}
+        /* pick the page to write to, this may commit and thereby use BUF1 */
+        df_page_t new_pagenum = fs_cow_page(fs, pagenum);
 
-		df_buf_save(fs->chip, DF_BUF1, pagenum);
-		df_wait(fs->chip);
+        if (new_pagenum == 0xffff)
+            return FS_BADPAGE;
 
-            } else {
+        printf("\twriting %d bytes at offset %ld, page %d -> %d\n",
+               n, offset, pagenum, new_pagenum);
 
-                printf("\t\tlength+offset <= FS_DATASIZE, length 0x%04lx, "
-		       "offset 0x%04lx, eof %d, old page 0x%04x\n",
-		       length, offset, eof, old_pagenum);
+        /* load old page into buffer */
+        if (pagenum != 0xffff) {
+            df_buf_load(fs->chip, DF_BUF1, pagenum);
+            df_wait(fs->chip);
+            df_buf_read(fs->chip, DF_BUF1, &page, FS_STRUCTURE_OFFSET, sizeof(fs_page_t));
+        } else {
+            /* new file content */
+            page.eof = 1;
+            page.size = 0;
+        }
 
-                /* load old page into buffer */
-                df_buf_load(fs->chip, DF_BUF1, old_pagenum);
-                df_wait(fs->chip);
+        page.unused = 0;
+        page.root = 0;
 
-                /* load structure */
-                df_buf_read(fs->chip, DF_BUF1, &page, FS_STRUCTURE_OFFSET, sizeof(fs_page_t));
-                page.unused = 0;
-		if (eof)
-		    page.eof = 1;
-                page.root = 0;
+        if (length > n) {
+            /* the data continues in the next page, if the original file
+             * ended here, append a new inode */
+            if (page.eof) {
+                fs_inode_t next_inode = fs_new_inode(fs, inode);
 
-		printf(", page.size: 0x%04x\r\n", page.size);
+                if (next_inode == 0xffff)
+                    return FS_BADINODE;
 
-                if (eof || length+offset > page.size) {
-                    page.size = length+offset;
-                    printf("\t\tpage size must be updated to 0x%04x\r\n",
-		           page.size);
-                }
+                page.eof = 0;
+                page.next_inode = next_inode;
+            }
 
-                printf("\t\tnew page length is %d\n", page.size);
+            page.size = FS_DATASIZE;
+        } else if (offset + n > page.size)
+            page.size = offset + n;
 
-                /* save structure */
-                df_buf_write(fs->chip, DF_BUF1, &page, FS_STRUCTURE_OFFSET, sizeof(fs_page_t));
+        /* save structure and data */
+        df_buf_write(fs->chip, DF_BUF1, &page, FS_STRUCTURE_OFFSET, sizeof(fs_page_t));
+        if (n)
+            df_buf_write(fs->chip, DF_BUF1, b, FS_DATA_OFFSET+offset, n);
+        df_buf_save(fs->chip, DF_BUF1, new_pagenum);
+        df_wait(fs->chip);
 
-                printf("fs: writing2 into page 0x%04x\r\n", pagenum);
+        /* point the inode to the page only after it has been written */
+        if (new_pagenum != pagenum) {
+            ret = fs_update_inodetable(fs, inode, new_pagenum);
 
-                /* write data */
-                df_buf_write(fs->chip, DF_BUF1, buf, FS_DATA_OFFSET+offset, length);
-                df_buf_save(fs->chip, DF_BUF1, pagenum);
-                df_wait(fs->chip);
+            if (ret != FS_OK)
+                return ret;
 
-                length = 0;
+            if (pagenum != 0xffff)
+                fs_release(fs, pagenum);
+        }
 
-            }
+        length -= n;
+        b += n;
 
-            offset = 0;
-        } while (length > 0);
+        if (length == 0)
+            break;
 
-        printf("done writing\n");
+        inode = page.next_inode;
+        pagenum = fs_page(fs, inode);
+        offset = 0;
+    }
 
-        return FS_OK;
+    printf("done writing\n");
 
-    } else {
-
-        /* check for valid offset */
-        if (offset != 0)
-            return FS_BADSEEK;
+    /* the root node version is only bumped on commit, let the version
+     * change anyway, so vfs_df_ident notices the new content */
+    fs->version++;
 
-        page.unused = 0;
-        page.root = 0;
+    return FS_OK;
 
-        printf("creating new file content, inode %d\n", inode);
+}
 
-        do {
 
-            /* allocate new page */
-            pagenum = fs_new_page(fs);
-            if (pagenum == 0xffff)
-                return FS_BADPAGE;
 
-            printf("\tusing page %d\n", pagenum);
+fs_status_t fs_append(fs_t *fs, fs_inode_t inode, void *buf, fs_size_t length)
+{
 
-            /* update inode */
-            fs_status_t ret = fs_update_inodetable(fs, inode, pagenum);
+    uint8_t *b = (uint8_t *)buf;
 
-            if (ret != FS_OK)
-                return ret;
+    /* start a new stream at the end of this file */
+    if (inode != fs->append_file) {
 
-            /* write data to buffer */
-            if (length > FS_DATASIZE) {
+        fs_status_t ret = fs_append_close(fs);
 
-                /* allocate next inode */
-                page.eof = 0;
-                page.root = 0;
-                page.next_inode = fs_new_inode(fs);
-                inode = page.next_inode;
+        if (ret != FS_OK)
+            return ret;
 
-                printf("\t next_inode %d\n", page.next_inode);
+        fs_page_t page;
+        fs_inode_t last = inode;
+        fs_size_t size = 0;
+        df_page_t pagenum = fs_page(fs, inode);
 
-                if (page.next_inode == 0xffff)
-                    return FS_BADINODE;
+        page.size = 0;
 
-                page.size = FS_DATASIZE;
+        while (pagenum != 0xffff) {
+            df_flash_read(fs->chip, pagenum, &page, FS_STRUCTURE_OFFSET, sizeof(fs_page_t));
+            size += page.size;
 
-                /* write structure */
-                df_buf_write(fs->chip, DF_BUF1, &page, FS_STRUCTURE_OFFSET, sizeof(fs_page_t));
+            if (page.eof)
+                break;
 
-                /* write data */
-                df_buf_write(fs->chip, DF_BUF1, buf, FS_DATA_OFFSET, FS_DATASIZE);
-                length -= FS_DATASIZE;
+            /* if the next inode is missing, the stream puts it back */
+            last = page.next_inode;
+            pagenum = fs_page(fs, last);
+            page.size = 0;
+        }
 
-            } else {
+        printf("fs_append: inode %d ends in inode %d, %d bytes used, size %ld\n",
+               inode, last, page.size, size);
 
-                /* mark last page */
-                page.eof = 1;
-                page.size = length;
-                page.root = 0;
+        fs->append_file = inode;
+        fs->append_inode = last;
+        fs->append_size = page.size;
+        fs->append_offset = size;
+        fs->append_state = 0;
+    }
 
-                /* write structure */
-                df_buf_write(fs->chip, DF_BUF1, &page, FS_STRUCTURE_OFFSET, sizeof(fs_page_t));
+    while (length > 0) {
 
-                /* write data */
-                df_buf_write(fs->chip, DF_BUF1, buf, FS_DATA_OFFSET, length);
-                length = 0;
+        /* get the last page into BUF1, unless somebody else used it */
+        if (!(fs->append_state & FS_APPEND_LOADED)) {
+            df_page_t pagenum = fs_page(fs, fs->append_inode);
 
+            if (pagenum != 0xffff) {
+                df_buf_load(fs->chip, DF_BUF1, pagenum);
+                df_wait(fs->chip);
             }
 
-            /* program page */
-            df_buf_save(fs->chip, DF_BUF1, pagenum);
-            df_wait(fs->chip);
+            fs->append_state |= FS_APPEND_LOADED;
+        }
+
+        /* the last page is full, write it and continue in a new inode */
+        if (fs->append_size == FS_DATASIZE) {
+            fs_inode_t next_inode = fs_new_inode(fs, fs->append_inode);
+
+            if (next_inode == 0xffff)
+                return FS_BADINODE;
+
+            fs_status_t ret = fs_append_save(fs, next_inode);
+
+            if (ret != FS_OK)
+                return ret;
+
+            /* the full page points to the new inode, so it
+             * has to be written out, even without data */
+            fs->append_inode = next_inode;
+            fs->append_size = 0;
+            fs->append_state = FS_APPEND_LOADED | FS_APPEND_DIRTY;
+        }
+
+        df_size_t n = FS_DATASIZE - fs->append_size;
+        if (length < n)
+            n = length;
 
-        } while (length > 0);
+        df_buf_write(fs->chip, DF_BUF1, b, FS_DATA_OFFSET + fs->append_size, n);
 
+        fs->append_size += n;
+        fs->append_offset += n;
+        fs->append_state |= FS_APPEND_DIRTY;
+
+        length -= n;
+        b += n;
     }
 
+    /* see fs_write */
+    fs->version++;
+
     return FS_OK;
 
 }
 
+fs_status_t fs_flush(fs_t *fs)
+{
 
+    if (!(fs->append_state & FS_APPEND_DIRTY))
+        return FS_OK;
+
+    return fs_append_save(fs, 0xffff);
+
+}
 
 fs_status_t noinline fs_truncate(fs_t *fs, fs_inode_t inode, fs_size_t length)
 {
@@ -620,6 +697,15 @@ fs_status_t noinline fs_truncate(fs_t *fs, fs_inode_t inode, fs_size_t length)
     df_page_t pagenum;
     fs_page_t page;
 
+    /* BUF1 is needed below, write out appended data first */
+    fs_status_t ret = (inode == fs->append_file) ? fs_append_close (fs)
+						  : fs_flush (fs);
+    if (ret != FS_OK)
+	return ret;
+
+    /* see fs_write, this also makes fs_walk users start over */
+    fs->version++;
+
     pagenum = fs_page (fs, inode);
     if (pagenum == 0xffff)
 	return FS_OK;		/* File hasn't contained data before. */
@@ -664,50 +750,45 @@ fs_status_t noinline fs_truncate(fs_t *fs, fs_inode_t inode, fs_size_t length)
 	return FS_BADSEEK;
     }
 
-    if (length == page.size) {
+    if (length == page.size && page.eof) {
 	printf ("length == page.size -> nothing to do.\n");
 	return FS_OK;
     }
 
-    df_page_t new_pagenum;
-    uint8_t found_eof;
-    do {
-	if ((new_pagenum = fs_new_page (fs)) == 0xffff)
-	    return FS_BADPAGE;
-
-	printf ("\tnew allocated page is %d\n", new_pagenum);
+    /* pages after this one are dropped */
+    fs_inode_t tail = page.eof ? 0xffff : page.next_inode;
 
-	/* update inode */
-	fs_status_t ret = fs_update_inodetable (fs, inode, new_pagenum);
+    df_page_t new_pagenum = fs_cow_page (fs, pagenum);
+    if (new_pagenum == 0xffff)
+	return FS_BADPAGE;
 
-	if (ret != FS_OK)
-	    return ret;
+    printf ("\tnew page is %d\n", new_pagenum);
 
-	/* Load the old page into buffer. */
-	df_buf_load (fs->chip, DF_BUF1, pagenum);
-	df_wait (fs->chip);
+    /* Load the old page into buffer. */
+    df_buf_load (fs->chip, DF_BUF1, pagenum);
+    df_wait (fs->chip);
 
-	/* Load the structure. */
-	df_flash_read (fs->chip, pagenum, &page, FS_STRUCTURE_OFFSET,
-		       sizeof (fs_page_t));
+    page.size = length;
+    page.eof = 1;
 
-	if ((found_eof = page.eof)) {
-	    printf ("\tThe file ended here.\n");
-	}
+    /* Save the updated structure data to buffer and save the page. */
+    df_buf_write (fs->chip, DF_BUF1, &page, FS_STRUCTURE_OFFSET,
+		  sizeof (fs_page_t));
+    df_buf_save (fs->chip, DF_BUF1, new_pagenum);
+    df_wait (fs->chip);
 
-	page.size = length;
-	page.eof = 1;
-
-	length = 0;
+    if (new_pagenum != pagenum) {
+	/* update inode */
+	ret = fs_update_inodetable (fs, inode, new_pagenum);
 
-	/* Save the updated structure data to buffer and save the page. */
-	df_buf_write (fs->chip, DF_BUF1, &page, FS_STRUCTURE_OFFSET,
-		      sizeof (fs_page_t));
-	df_buf_save (fs->chip, DF_BUF1, new_pagenum);
-	df_wait (fs->chip);
+	if (ret != FS_OK)
+	    return ret;
 
-    } while (0); /* (found_eof == 0); FIXME */
+	fs_release (fs, pagenum);
+    }
 
+    if (tail != 0xffff)
+	return fs_release_chain (fs, tail);
 
     return FS_OK;
 }
@@ -715,6 +796,12 @@ fs_status_t noinline fs_truncate(fs_t *fs, fs_inode_t inode, fs_size_t length)
 fs_status_t fs_create(fs_t *fs, const char *name)
 {
 
+    /* the root node is modified in BUF1, write out appended data first */
+    fs_status_t ret = fs_flush(fs);
+
+    if (ret != FS_OK)
+        return ret;
+
     /* search for a place for this filename in the table */
     fs_index_t index = 0, i = 0, max = 0;
     fs_node_t *node = malloc(sizeof(fs_node_t));
@@ -762,7 +849,7 @@ fs_status_t fs_create(fs_t *fs, const char *name)
     strncpy(node->name, name, FS_FILENAME);
     node->unused = 0;
     node->file = 1;
-    node->inode = fs_new_inode(fs);
+    node->inode = fs_new_inode(fs, 0xffff);
 
     if (node->inode == 0xffff) {
         free(node);
@@ -813,6 +900,12 @@ fs_status_t fs_create(fs_t *fs, const char *name)
 fs_status_t fs_remove(fs_t *fs, char *name)
 {
 
+    /* the file may be the one appended to, and BUF1 is needed anyway */
+    fs_status_t ret = fs_append_close(fs);
+
+    if (ret != FS_OK)
+        return ret;
+
     /* search for this filename in the nodetable */
     fs_index_t index = 0xffff, i = 0, max = 0;
     fs_inode_t inode = 0xffff;
@@ -897,19 +990,23 @@ fs_status_t fs_remove(fs_t *fs, char *name)
     free(node);
 
     /* increment version and update checksum */
-    fs_status_t ret = fs_increment(fs);
+    ret = fs_increment(fs);
 
     if (ret != FS_OK)
         return ret;
 
-    /* remove inode */
-    return fs_update_inodetable(fs, inode, 0xffff);
+    /* the file is gone from the root node, remove its inodes and pages */
+    return fs_release_chain(fs, inode);
 
 }
 
 fs_size_t fs_size(fs_t *fs, fs_inode_t inode)
 {
 
+    /* the size of the file appended to is known, and partly in BUF1 */
+    if (inode == fs->append_file)
+        return fs->append_offset;
+
     fs_size_t size = 0;
 
     /* allocate space */
@@ -924,10 +1021,10 @@ fs_size_t fs_size(fs_t *fs, fs_inode_t inode)
         /* extract page */
         df_page_t pagenum = fs_page(fs, inode);
 
-        /* if this inode is empty, this file is either corrupt or empty */
+        /* if this inode is empty, this file is either empty or was cut
+         * short, only count what can be read */
         if (pagenum == 0xffff) {
-            printf("fs: invalid next inode, return size 0\r\n");
-            size = 0;
+            printf("fs: invalid next inode, return size %ld\r\n", size);
             break;
         }
 
@@ -1060,7 +1157,7 @@ fs_status_t fs_format(fs_t *fs)
 
     /* write pages */
     for (uint8_t i = 0; i < 16; i++) {
-        root->inodetable[i] = i+1;
+        root->inodetable[i] = fs->inodetable[i] = i+1;
         df_buf_save(fs->chip, DF_BUF1, i+1);
         df_wait(fs->chip);
     }
@@ -1104,6 +1201,10 @@ fs_status_t fs_format(fs_t *fs)
 
     /* set global pointers */
     fs->root = 0;
+    fs->fresh_count = 0;
+    fs->obsolete_count = 0;
+    fs->append_file = 0xffff;
+    fs->append_state = 0;
 
     /* free temporary buffer */
     free(node);
@@ -1115,27 +1216,235 @@ fs_status_t fs_format(fs_t *fs)
 df_page_t fs_new_page(fs_t *fs)
 {
 
-    df_page_t page = (fs->last_free + 1) % DF_PAGES;
+    df_page_t page = fs->last_free;
 
     /* sequentially check pages, until a free one can be found */
-    while (fs_used(fs, page) && page != fs->last_free)
+    for (uint16_t i = 0; i < DF_PAGES; i++) {
         page = (page + 1) % DF_PAGES;
 
-    // printf("last free page %d, new free page %d\n", fs->last_free, page);
+        /* skip eight used pages at once */
+        if (page % 8 == 0 && i + 8 <= DF_PAGES) {
+            uint8_t b;
+            df_buf_read(fs->chip, DF_BUF2, &b, page/8, 1);
+
+            if (b == 0) {
+                page += 7;
+                i += 7;
+                continue;
+            }
+        }
+
+        if (!fs_used(fs, page)) {
+            // printf("last free page %d, new free page %d\n", fs->last_free, page);
+
+            /* free page is found */
+            fs_mark_used(fs, page);
+            fs->last_free = page;
+
+            return page;
+        }
+    }
+
+    /* no free page could be found */
+    return 0xffff;
+
+}
+
+df_page_t fs_fresh_page(fs_t *fs)
+{
+
+    df_page_t page = fs_new_page(fs);
 
-    if (page == fs->last_free)
-        /* no free page could be found */
+    if (page != 0xffff && fs_keep_fresh(fs, page) != FS_OK) {
+        fs_mark_free(fs, page);
         return 0xffff;
-    else {
-        /* free page is found */
-        fs->last_free = page;
+    }
+
+    return page;
+
+}
+
+uint8_t fs_is_fresh(fs_t *fs, df_page_t page)
+{
+
+    for (uint8_t i = 0; i < fs->fresh_count; i++)
+        if (fs->fresh[i] == page)
+            return 1;
+
+    return 0;
+
+}
+
+fs_status_t fs_keep_fresh(fs_t *fs, df_page_t page)
+{
+
+    /* only a limited number of uncommitted pages can be remembered */
+    if (fs->fresh_count == FS_BATCH_PAGES) {
+        fs_status_t ret = fs_commit(fs);
+
+        if (ret != FS_OK)
+            return ret;
+    }
 
+    fs->fresh[fs->fresh_count++] = page;
+
+    return FS_OK;
+
+}
+
+df_page_t fs_cow_page(fs_t *fs, df_page_t page)
+{
+
+    /* a page the root node does not reference yet can be
+     * overwritten, without breaking the committed filesystem */
+    if (fs_is_fresh(fs, page))
         return page;
+
+    return fs_fresh_page(fs);
+
+}
+
+void fs_release(fs_t *fs, df_page_t page)
+{
+
+    /* pages written since the last commit are not referenced
+     * by the root node, so they are free right away */
+    for (uint8_t i = 0; i < fs->fresh_count; i++) {
+        if (fs->fresh[i] == page) {
+            fs->fresh[i] = fs->fresh[--fs->fresh_count];
+            fs_mark_free(fs, page);
+            return;
+        }
+    }
+
+    if (fs->obsolete_count < FS_BATCH_PAGES) {
+        fs->obsolete[fs->obsolete_count++] = page;
+        return;
+    }
+
+    /* no more room, commit, so the page is no longer referenced */
+    if (fs_commit(fs) == FS_OK)
+        fs_mark_free(fs, page);
+
+}
+
+fs_status_t fs_release_chain(fs_t *fs, fs_inode_t inode)
+{
+
+    while (1) {
+
+        df_page_t pagenum = fs_page(fs, inode);
+
+        if (pagenum == 0xffff)
+            return FS_OK;
+
+        fs_page_t page;
+        df_flash_read(fs->chip, pagenum, &page, FS_STRUCTURE_OFFSET, sizeof(fs_page_t));
+
+        printf("fs: releasing inode %d, page %d\n", inode, pagenum);
+
+        fs_status_t ret = fs_update_inodetable(fs, inode, 0xffff);
+
+        if (ret != FS_OK)
+            return ret;
+
+        fs_release(fs, pagenum);
+
+        if (page.eof)
+            return FS_OK;
+
+        inode = page.next_inode;
     }
 
 }
 
-fs_inode_t fs_new_inode(fs_t *fs)
+fs_status_t fs_append_save(fs_t *fs, fs_inode_t next_inode)
+{
+
+    fs_page_t page;
+
+    page.unused = 0;
+    page.root = 0;
+    page.reserved = 0;
+    page.eof = (next_inode == 0xffff);
+    page.next_inode = next_inode;
+    page.size = fs->append_size;
+
+    df_page_t pagenum = fs_page(fs, fs->append_inode);
+    df_page_t new_pagenum = pagenum;
+
+    /* committing uses BUF1, so only take a page here, and remember
+     * it as fresh (which might commit) after BUF1 has been written */
+    if (pagenum == 0xffff || !fs_is_fresh(fs, pagenum)) {
+        new_pagenum = fs_new_page(fs);
+
+        if (new_pagenum == 0xffff)
+            return FS_BADPAGE;
+    }
+
+    printf("fs: saving appended inode %d, %d bytes, page %d -> %d\n",
+           fs->append_inode, page.size, pagenum, new_pagenum);
+
+    df_buf_write(fs->chip, DF_BUF1, &page, FS_STRUCTURE_OFFSET, sizeof(fs_page_t));
+    df_buf_save(fs->chip, DF_BUF1, new_pagenum);
+    df_wait(fs->chip);
+
+    fs->append_state = 0;
+
+    if (new_pagenum == pagenum)
+        return FS_OK;
+
+    fs_status_t ret = fs_keep_fresh(fs, new_pagenum);
+
+    if (ret != FS_OK)
+        return ret;
+
+    ret = fs_update_inodetable(fs, fs->append_inode, new_pagenum);
+
+    if (ret != FS_OK)
+        return ret;
+
+    if (pagenum != 0xffff)
+        fs_release(fs, pagenum);
+
+    return FS_OK;
+
+}
+
+fs_status_t fs_append_close(fs_t *fs)
+{
+
+    fs_status_t ret = fs_flush(fs);
+
+    fs->append_file = 0xffff;
+    fs->append_state = 0;
+
+    return ret;
+
+}
+
+static uint8_t fs_inode_referenced(fs_t *fs, fs_inode_t inode)
+{
+
+    fs_node_t node;
+
+    for (fs_index_t i = 0; ; i++) {
+        df_flash_read(fs->chip,
+                fs->root,
+                &node,
+                FS_ROOTNODE_NODETABLE_OFFSET+i*sizeof(fs_node_t),
+                sizeof(fs_node_t));
+
+        if (node.unused)
+            return 0;
+
+        if (node.inode == inode)
+            return 1;
+    }
+
+}
+
+fs_inode_t fs_new_inode(fs_t *fs, fs_inode_t reserved)
 {
 
     /* sequentially check inodes, until a free one can be found */
@@ -1150,9 +1459,13 @@ fs_inode_t fs_new_inode(fs_t *fs)
 
             df_flash_read(fs->chip, page, &inode, FS_DATA_OFFSET + j * sizeof(fs_inode_t), sizeof(fs_inode_t));
 
-            /* if this inode is unused, return the index */
-            if (inode.unused)
-                return i*FS_INODES_PER_TABLE+j;
+            fs_inode_t candidate = i*FS_INODES_PER_TABLE+j;
+
+            /* if this inode is unused, return the index (empty files
+             * own an inode without a page, so skip those too) */
+            if (inode.unused && candidate != reserved
+                    && !fs_inode_referenced(fs, candidate))
+                return candidate;
         }
     }
 
@@ -1164,11 +1477,7 @@ fs_inode_t fs_new_inode(fs_t *fs)
 df_page_t fs_inodetable(fs_t *fs, uint8_t tableid)
 {
 
-    df_page_t page;
-
-    df_flash_read(fs->chip, fs->root, &page,
-            FS_ROOTNODE_INODETABLE_OFFSET + (tableid * sizeof(fs_inodetable_node_t)),
-            sizeof(fs_inodetable_node_t));
+    df_page_t page = fs->inodetable[tableid];
 
 #ifdef DEBUG_FS_INODETABLE
     printf("inodetable(%02x): root 0x%04x, page 0x%04x\n", tableid, fs->root, page);
@@ -1258,12 +1567,16 @@ fs_status_t fs_increment(fs_t *fs)
 
     fs_root_t *root = malloc(sizeof(fs_root_t));
 
+    if (root == NULL)
+        return FS_MEM;
+
     /* read root structure */
     df_buf_read(fs->chip, DF_BUF1, root, FS_STRUCTURE_OFFSET, sizeof(fs_root_t));
 
-    /* update version */
+    /* update version and inodetable */
     fs->version++;
     root->version = fs->version;
+    memcpy(root->inodetable, fs->inodetable, sizeof(root->inodetable));
 
     /* write root node to buffer */
     df_buf_write(fs->chip, DF_BUF1, root, FS_STRUCTURE_OFFSET, sizeof(fs_root_t));
@@ -1288,6 +1601,16 @@ fs_status_t fs_increment(fs_t *fs)
     df_buf_save(fs->chip, DF_BUF1, page);
     df_wait(fs->chip);
 
+    /* the old root node and the pages it referenced, but the new one
+     * does not, are free now */
+    fs_mark_free(fs, fs->root);
+    for (uint8_t i = 0; i < fs->obsolete_count; i++)
+        fs_mark_free(fs, fs->obsolete[i]);
+
+    fs->obsolete_count = 0;
+    fs->fresh_count = 0;
+    fs->age = 0;
+
     fs->root = page;
 
     free(root);
@@ -1295,61 +1618,87 @@ fs_status_t fs_increment(fs_t *fs)
 
 }
 
+fs_status_t fs_commit(fs_t *fs)
+{
+
+    /* the root node is built in BUF1, and appended data should
+     * make it into this commit anyway */
+    fs_status_t ret = fs_flush(fs);
+
+    if (ret != FS_OK)
+        return ret;
+
+    if (fs->fresh_count == 0 && fs->obsolete_count == 0)
+        return FS_OK;
+
+    printf("fs: committing %d new and %d replaced pages\n",
+           fs->fresh_count, fs->obsolete_count);
+
+    /* load root node into BUF1 */
+    df_buf_load(fs->chip, DF_BUF1, fs->root);
+    df_wait(fs->chip);
+
+    /* increment version, update inodetable and checksum */
+    return fs_increment(fs);
+
+}
+
+void fs_periodic(void)
+{
+
+    if (fs.fresh_count == 0 && fs.obsolete_count == 0
+            && !(fs.append_state & FS_APPEND_DIRTY))
+        return;
+
+    if (++fs.age >= FS_COMMIT_DELAY)
+        fs_commit(&fs);
+
+}
+
 fs_status_t fs_update_inodetable(fs_t *fs, fs_inode_t inode, df_page_t page)
 {
 
     // printf("updating inodetable %d -> %d\n", inode, page);
 
-    /* allocate new page for the inodetable */
-    df_page_t new_page = fs_new_page(fs);
+    uint8_t tableid = inode / FS_INODES_PER_TABLE;
+    df_page_t old_page = fs_inodetable(fs, tableid);
+
+    /* allocate new page for the inodetable, unless it has not
+     * been committed yet */
+    df_page_t new_page = fs_cow_page(fs, old_page);
 
-    if ( new_page == 0xffff)
+    if (new_page == 0xffff)
         return FS_BADPAGE;
 
     // printf("new inodetable will live in page %d\n", new_page);
 
-    fs_inodetable_node_t *node = malloc(sizeof(fs_inodetable_node_t));
-
-    if (node == NULL)
-        return FS_MEM;
+    fs_inodetable_node_t node;
 
     if (page == 0xffff)
-        node->unused = 1;
+        node.unused = 1;
     else {
-        node->unused = 0;
-        node->page = page;
+        node.unused = 0;
+        node.page = page;
     }
 
-    // printf("inodetable %d lives in page %d, writing new inodetable to page %d\n", inode / FS_INODES_PER_TABLE, fs_inodetable(fs, inode / FS_INODES_PER_TABLE), new_page);
-
-    // printf("inode index %d\n", inode % FS_INODES_PER_TABLE);
-
     /* load inodetable into BUF1, update inode, write inodetable */
-    df_buf_load(fs->chip, DF_BUF1, fs_inodetable(fs, inode / FS_INODES_PER_TABLE));
+    df_buf_load(fs->chip, DF_BUF1, old_page);
     df_wait(fs->chip);
     df_buf_write(fs->chip,
                  DF_BUF1,
-                 node,
+                 &node,
                  FS_DATA_OFFSET + (inode % FS_INODES_PER_TABLE) * sizeof(fs_inodetable_node_t),
                  sizeof(fs_inodetable_node_t));
     df_buf_save(fs->chip, DF_BUF1, new_page);
     df_wait(fs->chip);
 
-    free(node);
-
-    /* load root node into BUF1 */
-    df_buf_load(fs->chip, DF_BUF1, fs->root);
-    df_wait(fs->chip);
-
-    /* write inodetable address */
-    df_buf_write(fs->chip,
-                 DF_BUF1,
-                 &new_page,
-                 FS_ROOTNODE_INODETABLE_OFFSET+ (inode / FS_INODES_PER_TABLE) *sizeof(df_page_t),
-                 sizeof(df_page_t));
+    /* the root node picks up the new address on the next commit */
+    if (new_page != old_page) {
+        fs->inodetable[tableid] = new_page;
+        fs_release(fs, old_page);
+    }
 
-    /* increment version and update checksum */
-    return fs_increment(fs);
+    return FS_OK;
 
 }
 
@@ -1435,5 +1784,6 @@ fs_inspect_inode(fs_t *fs, fs_inode_t p)
   -- Ethersex META --
   header(hardware/storage/dataflash/fs.h)
   init(fs_init)
+  timer(50, fs_periodic())
 */
 
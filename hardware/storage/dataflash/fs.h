@@ -44,6 +44,20 @@
 
 #define FS_FILENAME 6
 
+/* number of pages written or replaced before the root node is committed */
+#define FS_BATCH_PAGES 8
+
+/* seconds to wait before committing pending changes to the root node */
+#ifdef DATAFLASH_COMMIT_DELAY
+#define FS_COMMIT_DELAY DATAFLASH_COMMIT_DELAY
+#else
+#define FS_COMMIT_DELAY 5
+#endif
+
+/* state of the append stream, see fs_append() */
+#define FS_APPEND_LOADED 0x01 /* BUF1 holds the last page of the stream */
+#define FS_APPEND_DIRTY 0x02 /* BUF1 holds data not written to flash yet */
+
 #define noinline __attribute__((noinline))
 
 /* structs */
@@ -69,6 +83,23 @@ typedef struct {
     df_page_t root;
     fs_version_t version;
     df_page_t last_free;
+    /* working copy of the root node's inodetable, committed by fs_increment */
+    df_page_t inodetable[FS_ROOTNODE_INODETABLE_SIZE];
+    /* pages written since the last commit, these may be rewritten in place */
+    df_page_t fresh[FS_BATCH_PAGES];
+    uint8_t fresh_count;
+    /* pages replaced since the last commit, freed once it is done */
+    df_page_t obsolete[FS_BATCH_PAGES];
+    uint8_t obsolete_count;
+    /* seconds since the first uncommitted change */
+    uint8_t age;
+    /* file appended to by fs_append (0xffff if none), the inode of its last
+     * page, the bytes in that page and the size of the whole file */
+    fs_inode_t append_file;
+    fs_inode_t append_inode;
+    uint16_t append_size;
+    fs_size_t append_offset;
+    uint8_t append_state;
 } fs_t;
 
 /* prototypes */
@@ -79,17 +110,37 @@ fs_status_t noinline fs_init(void);
 fs_status_t noinline fs_list(fs_t *fs, char *dir, char *buf, fs_index_t index);
 fs_inode_t noinline fs_get_inode(fs_t *fs, const char *file);
 fs_size_t noinline fs_read(fs_t *fs, fs_inode_t inode, void *buf, fs_size_t offset, fs_size_t length);
+/* follow the chain from inode over the pages before *offset, return the inode of
+ * the page *offset lies in and leave the offset within that page in *offset.
+ * the result stays valid as long as fs->version doesn't change */
+fs_inode_t noinline fs_walk(fs_t *fs, fs_inode_t inode, fs_size_t *offset);
 fs_status_t noinline fs_write(fs_t *fs, fs_inode_t inode, void *buf, fs_size_t offset, fs_size_t length);
 fs_status_t noinline fs_truncate(fs_t *fs, fs_inode_t inode, fs_size_t length);
 fs_status_t noinline fs_create(fs_t *fs, const char *name);
 fs_status_t noinline fs_remove(fs_t *fs, char *name);
 fs_size_t noinline fs_size(fs_t *fs, fs_inode_t inode);
+/* append to the end of a file, data is collected in BUF1 until a page is full */
+fs_status_t noinline fs_append(fs_t *fs, fs_inode_t inode, void *buf, fs_size_t length);
+/* write data collected by fs_append to flash */
+fs_status_t noinline fs_flush(fs_t *fs);
+/* write pending inodetable changes to a new root node */
+fs_status_t noinline fs_commit(fs_t *fs);
+/* commit pending changes once they are FS_COMMIT_DELAY seconds old */
+void fs_periodic(void);
 
 /* local */
 fs_status_t noinline fs_scan(fs_t *fs); /* scan for the root node */
 fs_status_t noinline fs_format(fs_t *fs); /* format filesystem and create new root node in page 0 */
-df_page_t noinline fs_new_page(fs_t *fs); /* return an empty (=unused) page or 0xffff if none could be found */
-fs_inode_t noinline fs_new_inode(fs_t *fs); /* return an empty (=unused) inode or 0xffff if none could be found */
+df_page_t noinline fs_new_page(fs_t *fs); /* return an empty (=unused) page and mark it used, or 0xffff if none could be found */
+df_page_t noinline fs_fresh_page(fs_t *fs); /* like fs_new_page, but remember the page as uncommitted */
+uint8_t noinline fs_is_fresh(fs_t *fs, df_page_t page); /* check if this page was written since the last commit */
+fs_status_t noinline fs_keep_fresh(fs_t *fs, df_page_t page); /* remember page as uncommitted, commit first if there is no room */
+df_page_t noinline fs_cow_page(fs_t *fs, df_page_t page); /* return the page to write the new contents of this page to */
+void noinline fs_release(fs_t *fs, df_page_t page); /* free page as soon as the root node no longer references it */
+fs_status_t noinline fs_release_chain(fs_t *fs, fs_inode_t inode); /* clear inodes and release pages from inode to eof */
+fs_status_t noinline fs_append_save(fs_t *fs, fs_inode_t next_inode); /* write the last page of the append stream from BUF1, link next_inode unless 0xffff */
+fs_status_t noinline fs_append_close(fs_t *fs); /* flush and forget the append stream */
+fs_inode_t noinline fs_new_inode(fs_t *fs, fs_inode_t reserved); /* return an empty (=unused) inode other than reserved or 0xffff if none could be found */
 df_page_t noinline fs_inodetable(fs_t *fs, uint8_t tableid); /* return the page this inodetable lives in */
 df_page_t noinline fs_page(fs_t *fs, fs_inode_t inode); /* get the page this inode points to */
 void noinline fs_mark(fs_t *fs, df_page_t page, uint8_t free); /* mark page as used or free (cache in BUF2) */
@@ -98,8 +149,8 @@ void noinline fs_mark(fs_t *fs, df_page_t page, uint8_t free); /* mark page as u
 uint8_t noinline fs_used(fs_t *fs, df_page_t page); /* check if this page is used */
 uint8_t noinline fs_find(fs_t *fs, char *name); /* search for this name, return nodes[] index */
 uint8_t noinline fs_crc(fs_t *fs, uint8_t crc, df_buf_t buf, df_size_t offset, df_size_t length); /* calculate crc in buffer */
-fs_status_t noinline fs_increment(fs_t *fs); /* update version and crc of root node in BUF1, write BUF1 to a free page and update global pointer */
-fs_status_t noinline fs_update_inodetable(fs_t *fs, fs_inode_t inode, df_page_t page); /* update inodetable and root node */
+fs_status_t noinline fs_increment(fs_t *fs); /* update version, inodetable and crc of root node in BUF1, write BUF1 to a free page and update global pointer */
+fs_status_t noinline fs_update_inodetable(fs_t *fs, fs_inode_t inode, df_page_t page); /* update inodetable, root node follows on the next commit */
 
 void fs_inspect_node(fs_t *fs, uint16_t p);
 void fs_inspect_inode(fs_t *fs, uint16_t p);
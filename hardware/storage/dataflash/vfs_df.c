@@ -38,6 +38,9 @@ vfs_df_open (const char *filename)
   fh->fh_type = VFS_DF;
   fh->u.df.inode = i;
   fh->u.df.offset = 0;
+  fh->u.df.cur_inode = i;
+  fh->u.df.cur_base = 0;
+  fh->u.df.cur_version = fs.version;
 
   return fh;
 }
@@ -45,13 +48,48 @@ vfs_df_open (const char *filename)
 void
 vfs_df_close (struct vfs_file_handle_t *fh)
 {
+  /* Don't leave the changes waiting for the commit timer. */
+  fs_commit (&fs);
   free (fh);
 }
 
+vfs_size_t
+vfs_df_pread (struct vfs_file_handle_t *fh, void *buf, vfs_size_t offset,
+	      vfs_size_t length)
+{
+  /* Start at the page read from last time, unless the file changed
+     or we're asked to go back.  Sending a file chunk by chunk this
+     way doesn't walk the whole chain for every chunk. */
+  if (fh->u.df.cur_version != fs.version || offset < fh->u.df.cur_base)
+    {
+      fh->u.df.cur_inode = fh->u.df.inode;
+      fh->u.df.cur_base = 0;
+    }
+
+  fs_size_t rel = offset - fh->u.df.cur_base;
+  fs_inode_t i = fs_walk (&fs, fh->u.df.cur_inode, &rel);
+
+  if (i == 0xffff)
+    {
+      fh->u.df.cur_inode = fh->u.df.inode;	/* Start over next time. */
+      fh->u.df.cur_base = 0;
+      return 0;
+    }
+
+  fh->u.df.cur_inode = i;
+  fh->u.df.cur_base = offset - rel;
+  fh->u.df.cur_version = fs.version;
+
+  if (length == 0)
+    return 0;
+
+  return fs_read (&fs, i, buf, rel, length);
+}
+
 vfs_size_t
 vfs_df_read (struct vfs_file_handle_t *fh, void *buf, vfs_size_t length)
 {
-  vfs_size_t ret = fs_read (&fs, fh->u.df.inode, buf, fh->u.df.offset, length);
+  vfs_size_t ret = vfs_df_pread (fh, buf, fh->u.df.offset, length);
 
   /* Read was successful, update offset. */
   if (ret > 0) fh->u.df.offset += ret;
@@ -62,7 +100,14 @@ vfs_df_read (struct vfs_file_handle_t *fh, void *buf, vfs_size_t length)
 vfs_size_t
 vfs_df_write (struct vfs_file_handle_t *fh, void *buf, vfs_size_t length)
 {
-  fs_status_t i = fs_write (&fs, fh->u.df.inode, buf, fh->u.df.offset, length);
+  fs_status_t i;
+
+  /* Writes to the end of the file are collected in the dataflash's
+     buffer and programmed a page at a time. */
+  if (fh->u.df.offset == fs_size (&fs, fh->u.df.inode))
+    i = fs_append (&fs, fh->u.df.inode, buf, length);
+  else
+    i = fs_write (&fs, fh->u.df.inode, buf, fh->u.df.offset, length);
 
   if (i == FS_OK)
     {
@@ -135,3 +180,45 @@ vfs_df_size (struct vfs_file_handle_t *fh)
 {
   return fs_size (&fs, fh->u.df.inode);
 }
+
+static uint32_t
+vfs_df_inode_ident (fs_inode_t inode)
+{
+  /* The root node version is bumped on every write, so it changes
+     whenever any file does.  Mix in the inode's page, which changes
+     on every write to the file's first page. */
+  return fs.version ^ ((uint32_t) fs_page (&fs, inode) << 16);
+}
+
+uint32_t
+vfs_df_ident (struct vfs_file_handle_t *fh)
+{
+  return vfs_df_inode_ident (fh->u.df.inode);
+}
+
+uint8_t
+vfs_df_stat (const char *name, struct vfs_stat_t *st)
+{
+  fs_inode_t i = fs_get_inode (&fs, name);
+
+  if (i == 0xffff)
+    return 1;			/* No such file. */
+
+  st->size = fs_size (&fs, i);
+  st->ident = vfs_df_inode_ident (i);
+  return 0;
+}
+
+uint8_t
+vfs_df_readdir (const char *dir, uint16_t index, struct vfs_dirent_t *ent)
+{
+  if (*dir)
+    return 1;			/* There are no subdirectories. */
+
+  if (fs_list (&fs, NULL, ent->name, index) != FS_OK)
+    return 1;
+
+  ent->size = fs_size (&fs, fs_get_inode (&fs, ent->name));
+  ent->is_dir = 0;
+  return 0;
+}
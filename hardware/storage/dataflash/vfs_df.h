@@ -29,6 +29,11 @@ typedef struct {
   fs_inode_t inode;
   fs_size_t offset;
 
+  /* Page last read from: its inode, the file offset it starts at and
+     the fs version the two are valid for. */
+  fs_inode_t cur_inode;
+  fs_size_t cur_base;
+  fs_version_t cur_version;
 } vfs_file_handle_df_t;
 
 /* vfs_df_ Prototypes. */
@@ -43,6 +48,12 @@ uint8_t vfs_df_fseek (struct vfs_file_handle_t *, vfs_size_t offset,
 uint8_t vfs_df_truncate (struct vfs_file_handle_t *, vfs_size_t length);
 struct vfs_file_handle_t *vfs_df_create (const char *name);
 vfs_size_t vfs_df_size (struct vfs_file_handle_t *);
+uint32_t vfs_df_ident (struct vfs_file_handle_t *);
+uint8_t vfs_df_stat (const char *name, struct vfs_stat_t *);
+uint8_t vfs_df_readdir (const char *dir, uint16_t index,
+			struct vfs_dirent_t *);
+vfs_size_t vfs_df_pread (struct vfs_file_handle_t *, void *buf,
+			 vfs_size_t offset, vfs_size_t length);
 
 
 #define VFS_DF_FUNCS {				\
@@ -55,6 +66,10 @@ vfs_size_t vfs_df_size (struct vfs_file_handle_t *);
     vfs_df_truncate,				\
     vfs_df_create,				\
     vfs_df_size,				\
+    vfs_df_ident,				\
+    vfs_df_stat,				\
+    vfs_df_readdir,				\
+    vfs_df_pread,				\
   }
 
 #endif	/* VFS_DF_H */
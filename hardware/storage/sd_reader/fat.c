@@ -83,6 +83,12 @@
 #define FAT32_CLUSTER_LAST_MAX 0x0fffffff
 
 #define FAT_DIRENTRY_DELETED 0xe5
+#define FAT_CLUSTER_COUNT_UNKNOWN ((cluster_t) -1)
+
+#define FAT_FSINFO_SIGNATURE_LEAD 0x41615252
+#define FAT_FSINFO_SIGNATURE_STRUCT 0x61417272
+#define FAT_FSINFO_OFFSET_STRUCT 0x1e4
+
 #define FAT_DIRENTRY_LFNLAST (1 << 6)
 #define FAT_DIRENTRY_LFNSEQMASK ((1 << 6) - 1)
 
@@ -150,6 +156,7 @@ struct fat_header_struct
     offset_t root_dir_offset;
 #if FAT_FAT32_SUPPORT
     cluster_t root_dir_cluster;
+    offset_t fsinfo_offset;
 #endif
 };
 
@@ -157,6 +164,17 @@ struct fat_fs_struct
 {
     struct partition_struct* partition;
     struct fat_header_struct header;
+    /* where to start searching for free clusters */
+    cluster_t cluster_free;
+    /* number of free clusters, FAT_CLUSTER_COUNT_UNKNOWN if not counted yet */
+    cluster_t cluster_free_count;
+    /* set when the count above stems from a scan of the FAT by us,
+     * the one taken over from the fsinfo sector is only a hint */
+    uint8_t cluster_free_counted;
+#if FAT_FAT32_SUPPORT && FAT_WRITE_SUPPORT
+    /* set when the fsinfo sector does not match the above */
+    uint8_t fsinfo_dirty;
+#endif
 };
 
 struct fat_dir_struct
@@ -172,6 +190,10 @@ struct fat_read_dir_callback_arg
     struct fat_dir_entry_struct* dir_entry;
     uintptr_t bytes_read;
     uint8_t finished;
+    /* checksum of the short name the lfn entries belong to */
+    uint8_t lfn_checksum;
+    /* set while the lfn entries read so far are consistent */
+    uint8_t lfn_valid;
 };
 
 struct fat_usage_count_callback_arg
@@ -180,6 +202,18 @@ struct fat_usage_count_callback_arg
     uintptr_t buffer_size;
 };
 
+#if FAT_CACHE_SIZE
+/* A window of the FAT, so following a cluster chain does not read
+ * a whole card block for each 2 or 4 byte entry.
+ */
+static struct
+{
+    const struct fat_fs_struct* fs;
+    offset_t offset;
+    uint8_t data[FAT_CACHE_SIZE];
+} fat_cache;
+#endif
+
 #if !USE_DYNAMIC_MEMORY
 static struct fat_fs_struct fat_fs_handles[FAT_FS_COUNT];
 static struct fat_file_struct fat_file_handles[FAT_FILE_COUNT];
@@ -187,10 +221,18 @@ static struct fat_dir_struct fat_dir_handles[FAT_DIR_COUNT];
 #endif
 
 static uint8_t fat_read_header(struct fat_fs_struct* fs);
+static uint8_t fat_read_entry(const struct fat_fs_struct* fs, offset_t offset, uint8_t* buffer, uint8_t length);
 static cluster_t fat_get_next_cluster(const struct fat_fs_struct* fs, cluster_t cluster_num);
+#if FAT_EXTENT_COUNT
+static void fat_add_file_cluster(struct fat_file_struct* fd, cluster_t index, cluster_t cluster_num);
+static cluster_t fat_get_file_cluster(struct fat_file_struct* fd, cluster_t index, cluster_t cluster_prev);
+#endif
 static offset_t fat_cluster_offset(const struct fat_fs_struct* fs, cluster_t cluster_num);
 static uint8_t fat_dir_entry_read_callback(uint8_t* buffer, offset_t offset, void* p);
-static uint8_t fat_interpret_dir_entry(struct fat_dir_entry_struct* dir_entry, const uint8_t* raw_entry);
+static uint8_t fat_interpret_dir_entry(struct fat_read_dir_callback_arg* arg, const uint8_t* raw_entry);
+#if FAT_FAT32_SUPPORT
+static void fat_read_fsinfo(struct fat_fs_struct* fs);
+#endif
 
 static uint8_t fat_get_fs_free_16_callback(uint8_t* buffer, offset_t offset, void* p);
 #if FAT_FAT32_SUPPORT
@@ -198,12 +240,14 @@ static uint8_t fat_get_fs_free_32_callback(uint8_t* buffer, offset_t offset, voi
 #endif
 
 #if FAT_WRITE_SUPPORT
-static cluster_t fat_append_clusters(const struct fat_fs_struct* fs, cluster_t cluster_num, cluster_t count);
-static uint8_t fat_free_clusters(const struct fat_fs_struct* fs, cluster_t cluster_num);
-static uint8_t fat_terminate_clusters(const struct fat_fs_struct* fs, cluster_t cluster_num);
+static uint8_t fat_write_entry(const struct fat_fs_struct* fs, offset_t offset, const uint8_t* buffer, uint8_t length);
+static cluster_t fat_append_clusters(struct fat_fs_struct* fs, cluster_t cluster_num, cluster_t count);
+static uint8_t fat_free_clusters(struct fat_fs_struct* fs, cluster_t cluster_num);
+static uint8_t fat_terminate_clusters(struct fat_fs_struct* fs, cluster_t cluster_num);
+static void fat_count_free(struct fat_fs_struct* fs, cluster_t cluster_num, uint8_t freed);
 static uint8_t fat_clear_cluster(const struct fat_fs_struct* fs, cluster_t cluster_num);
 static uintptr_t fat_clear_cluster_callback(uint8_t* buffer, offset_t offset, void* p);
-static offset_t fat_find_offset_for_dir_entry(const struct fat_fs_struct* fs, const struct fat_dir_struct* parent, const struct fat_dir_entry_struct* dir_entry);
+static offset_t fat_find_offset_for_dir_entry(struct fat_fs_struct* fs, const struct fat_dir_struct* parent, const struct fat_dir_entry_struct* dir_entry);
 static uint8_t fat_write_dir_entry(const struct fat_fs_struct* fs, struct fat_dir_entry_struct* dir_entry);
 #if FAT_DATETIME_SUPPORT
 static void fat_set_file_modification_date(struct fat_dir_entry_struct* dir_entry, uint16_t year, uint8_t month, uint8_t day);
@@ -250,6 +294,10 @@ struct fat_fs_struct* fat_open(struct partition_struct* partition)
 #endif
 
     memset(fs, 0, sizeof(*fs));
+#if FAT_CACHE_SIZE
+    if(fat_cache.fs == fs)
+        fat_cache.fs = 0;
+#endif
 
     fs->partition = partition;
     if(!fat_read_header(fs))
@@ -280,6 +328,15 @@ void fat_close(struct fat_fs_struct* fs)
     if(!fs)
         return;
 
+#if FAT_WRITE_SUPPORT
+    fat_sync(fs);
+#endif
+
+#if FAT_CACHE_SIZE
+    if(fat_cache.fs == fs)
+        fat_cache.fs = 0;
+#endif
+
 #if USE_DYNAMIC_MEMORY
     free(fs);
 #else
@@ -305,7 +362,7 @@ uint8_t fat_read_header(struct fat_fs_struct* fs)
 
     /* read fat parameters */
 #if FAT_FAT32_SUPPORT
-    uint8_t buffer[37];
+    uint8_t buffer[39];
 #else
     uint8_t buffer[25];
 #endif
@@ -324,6 +381,7 @@ uint8_t fat_read_header(struct fat_fs_struct* fs)
 #if FAT_FAT32_SUPPORT
     uint32_t sectors_per_fat32 = ltoh32(*((uint32_t*) &buffer[0x19]));
     uint32_t cluster_root_dir = ltoh32(*((uint32_t*) &buffer[0x21]));
+    uint16_t sector_fsinfo = ltoh16(*((uint16_t*) &buffer[0x25]));
 #endif
 
     if(sector_count == 0)
@@ -404,12 +462,182 @@ uint8_t fat_read_header(struct fat_fs_struct* fs)
                                       (offset_t) fat_copies * sectors_per_fat32 * bytes_per_sector;
 
         header->root_dir_cluster = cluster_root_dir;
+
+        if(sector_fsinfo > 0 && sector_fsinfo < reserved_sectors)
+            header->fsinfo_offset = partition_offset + (offset_t) sector_fsinfo * bytes_per_sector;
     }
 #endif
 
+    fs->cluster_free = 2;
+    fs->cluster_free_count = FAT_CLUSTER_COUNT_UNKNOWN;
+    fs->cluster_free_counted = 0;
+#if FAT_FAT32_SUPPORT
+    if(header->fsinfo_offset)
+        fat_read_fsinfo(fs);
+#endif
+
     return 1;
 }
 
+#if DOXYGEN || FAT_FAT32_SUPPORT
+/**
+ * \ingroup fat_fs
+ * Reads the free cluster count and hint from the FAT32 fsinfo sector.
+ *
+ * Both values are only taken over if they look sane, the fsinfo
+ * sector is not more than a hint left by the last writer.
+ *
+ * \param[in] fs The filesystem on which to operate.
+ */
+void fat_read_fsinfo(struct fat_fs_struct* fs)
+{
+    uint32_t fsinfo[3];
+    offset_t fsinfo_offset = fs->header.fsinfo_offset;
+    if(!fs->partition->device_read(fsinfo_offset, (uint8_t*) fsinfo, 4) ||
+       fsinfo[0] != HTOL32(FAT_FSINFO_SIGNATURE_LEAD) ||
+       !fs->partition->device_read(fsinfo_offset + FAT_FSINFO_OFFSET_STRUCT, (uint8_t*) fsinfo, sizeof(fsinfo)) ||
+       fsinfo[0] != HTOL32(FAT_FSINFO_SIGNATURE_STRUCT))
+    {
+        fs->header.fsinfo_offset = 0;
+        return;
+    }
+
+    cluster_t cluster_max = fs->header.fat_size / 4;
+    uint32_t free_count = ltoh32(fsinfo[1]);
+    uint32_t next_free = ltoh32(fsinfo[2]);
+    if(free_count < cluster_max - 2)
+        fs->cluster_free_count = free_count;
+    if(next_free >= 2 && next_free < cluster_max)
+        fs->cluster_free = next_free;
+}
+#endif
+
+#if DOXYGEN || FAT_WRITE_SUPPORT
+/**
+ * \ingroup fat_fs
+ * Writes the free cluster count and hint back to the FAT32 fsinfo sector.
+ *
+ * Call this before the card is removed. For FAT16 filesystems this is
+ * a no-op, they do not store such information.
+ *
+ * \param[in] fs The filesystem on which to operate.
+ * \returns 0 on failure, 1 on success.
+ * \see fat_close
+ */
+uint8_t fat_sync(struct fat_fs_struct* fs)
+{
+    if(!fs)
+        return 0;
+
+#if FAT_FAT32_SUPPORT
+    if(fs->fsinfo_dirty)
+    {
+        uint32_t fsinfo[2];
+        fsinfo[0] = htol32(fs->cluster_free_count == FAT_CLUSTER_COUNT_UNKNOWN ? 0xffffffff : fs->cluster_free_count);
+        fsinfo[1] = htol32(fs->cluster_free);
+        if(!fs->partition->device_write(fs->header.fsinfo_offset + FAT_FSINFO_OFFSET_STRUCT + 4, (uint8_t*) fsinfo, sizeof(fsinfo)))
+            return 0;
+
+        fs->fsinfo_dirty = 0;
+    }
+#endif
+
+    return 1;
+}
+
+/**
+ * \ingroup fat_fs
+ * Keeps track of a cluster being allocated or freed.
+ *
+ * Until the next fat_sync(), the free cluster count in the fsinfo
+ * sector is marked as unknown. So a card removed without syncing
+ * does not leave a wrong count behind.
+ *
+ * \param[in] fs The filesystem on which to operate.
+ * \param[in] cluster_num The cluster allocated or freed.
+ * \param[in] freed 1 if the cluster was freed, 0 if it was allocated.
+ */
+void fat_count_free(struct fat_fs_struct* fs, cluster_t cluster_num, uint8_t freed)
+{
+    if(fs->cluster_free_count != FAT_CLUSTER_COUNT_UNKNOWN)
+        fs->cluster_free_count += freed ? 1 : -1;
+
+    if(freed && cluster_num < fs->cluster_free)
+        fs->cluster_free = cluster_num;
+
+#if FAT_FAT32_SUPPORT
+    if(fs->header.fsinfo_offset && !fs->fsinfo_dirty)
+    {
+        uint32_t unknown = 0xffffffff;
+        fs->partition->device_write(fs->header.fsinfo_offset + FAT_FSINFO_OFFSET_STRUCT + 4, (uint8_t*) &unknown, sizeof(unknown));
+        fs->fsinfo_dirty = 1;
+    }
+#endif
+}
+#endif
+
+/**
+ * \ingroup fat_fs
+ * Reads a FAT entry, going through the FAT cache if enabled.
+ *
+ * \param[in] fs The filesystem on which to operate.
+ * \param[in] offset The device offset of the entry.
+ * \param[out] buffer The buffer into which to write the entry.
+ * \param[in] length The size of the entry, 2 or 4 bytes.
+ * \returns 0 on failure, 1 on success.
+ */
+uint8_t fat_read_entry(const struct fat_fs_struct* fs, offset_t offset, uint8_t* buffer, uint8_t length)
+{
+#if FAT_CACHE_SIZE
+    /* the FAT is sector aligned, so an entry never crosses the window */
+    offset_t window = offset & ~((offset_t) FAT_CACHE_SIZE - 1);
+    if(fat_cache.fs != fs || fat_cache.offset != window)
+    {
+        fat_cache.fs = 0;
+        if(!fs->partition->device_read(window, fat_cache.data, FAT_CACHE_SIZE))
+            return 0;
+
+        fat_cache.fs = fs;
+        fat_cache.offset = window;
+    }
+
+    memcpy(buffer, fat_cache.data + (uint16_t) (offset - window), length);
+    return 1;
+#else
+    return fs->partition->device_read(offset, buffer, length);
+#endif
+}
+
+#if DOXYGEN || FAT_WRITE_SUPPORT
+/**
+ * \ingroup fat_fs
+ * Writes a FAT entry, keeping the FAT cache up to date.
+ *
+ * \param[in] fs The filesystem on which to operate.
+ * \param[in] offset The device offset of the entry.
+ * \param[in] buffer The new entry.
+ * \param[in] length The size of the entry, 2 or 4 bytes.
+ * \returns 0 on failure, 1 on success.
+ */
+uint8_t fat_write_entry(const struct fat_fs_struct* fs, offset_t offset, const uint8_t* buffer, uint8_t length)
+{
+    uint8_t ok = fs->partition->device_write(offset, buffer, length);
+
+#if FAT_CACHE_SIZE
+    offset_t window = offset & ~((offset_t) FAT_CACHE_SIZE - 1);
+    if(fat_cache.fs == fs && fat_cache.offset == window)
+    {
+        if(ok)
+            memcpy(fat_cache.data + (uint16_t) (offset - window), buffer, length);
+        else
+            fat_cache.fs = 0;
+    }
+#endif
+
+    return ok;
+}
+#endif
+
 /**
  * \ingroup fat_fs
  * Retrieves the next following cluster of a given cluster.
@@ -432,7 +660,7 @@ cluster_t fat_get_next_cluster(const struct fat_fs_struct* fs, cluster_t cluster
     {
         /* read appropriate fat entry */
         uint32_t fat_entry;
-        if(!fs->partition->device_read(fs->header.fat_offset + cluster_num * sizeof(fat_entry), (uint8_t*) &fat_entry, sizeof(fat_entry)))
+        if(!fat_read_entry(fs, fs->header.fat_offset + cluster_num * sizeof(fat_entry), (uint8_t*) &fat_entry, sizeof(fat_entry)))
             return 0;
 
         /* determine next cluster from fat */
@@ -449,7 +677,7 @@ cluster_t fat_get_next_cluster(const struct fat_fs_struct* fs, cluster_t cluster
     {
         /* read appropriate fat entry */
         uint16_t fat_entry;
-        if(!fs->partition->device_read(fs->header.fat_offset + cluster_num * sizeof(fat_entry), (uint8_t*) &fat_entry, sizeof(fat_entry)))
+        if(!fat_read_entry(fs, fs->header.fat_offset + cluster_num * sizeof(fat_entry), (uint8_t*) &fat_entry, sizeof(fat_entry)))
             return 0;
 
         /* determine next cluster from fat */
@@ -465,6 +693,106 @@ cluster_t fat_get_next_cluster(const struct fat_fs_struct* fs, cluster_t cluster
     return cluster_num;
 }
 
+#if DOXYGEN || FAT_EXTENT_COUNT
+/**
+ * \ingroup fat_file
+ * Remembers the cluster following the runs of a file known so far.
+ *
+ * Runs are recorded in file order without gaps, until all
+ * FAT_EXTENT_COUNT slots are used.
+ *
+ * \param[in] fd The file descriptor of the file.
+ * \param[in] index The number of the cluster within the file, counted from zero.
+ * \param[in] cluster_num The cluster on disk.
+ */
+void fat_add_file_cluster(struct fat_file_struct* fd, cluster_t index, cluster_t cluster_num)
+{
+    struct fat_extent_struct* extent = fd->extents + fd->extent_count - 1;
+
+    if(fd->extent_count)
+    {
+        if(extent->index + extent->count != index)
+            return;
+        if(extent->cluster + extent->count == cluster_num)
+        {
+            ++extent->count;
+            return;
+        }
+    }
+    else if(index)
+    {
+        return;
+    }
+
+    if(fd->extent_count >= FAT_EXTENT_COUNT)
+        return;
+
+    ++extent;
+    ++fd->extent_count;
+    extent->index = index;
+    extent->cluster = cluster_num;
+    extent->count = 1;
+}
+
+/**
+ * \ingroup fat_file
+ * Determines the cluster holding a given part of a file.
+ *
+ * The file descriptor remembers the runs of contiguous clusters
+ * found so far, the cluster chain is only followed beyond them.
+ *
+ * \param[in] fd The file descriptor of the file.
+ * \param[in] index The number of the cluster within the file, counted from zero.
+ * \param[in] cluster_prev The cluster before \c index if known, 0 otherwise.
+ * \returns 0 if the file is shorter, the cluster number on success.
+ */
+cluster_t fat_get_file_cluster(struct fat_file_struct* fd, cluster_t index, cluster_t cluster_prev)
+{
+    struct fat_extent_struct* extent = fd->extents;
+    uint8_t i;
+    for(i = 0; i < fd->extent_count; ++i, ++extent)
+    {
+        if(index < extent->index + extent->count)
+            return extent->cluster + (index - extent->index);
+    }
+
+    /* continue at the end of the last run known, or where we are */
+    cluster_t cluster_num;
+    cluster_t cluster_index;
+    if(cluster_prev)
+    {
+        cluster_index = index - 1;
+        cluster_num = cluster_prev;
+    }
+    else if(fd->extent_count)
+    {
+        --extent;
+        cluster_index = extent->index + extent->count - 1;
+        cluster_num = extent->cluster + extent->count - 1;
+    }
+    else
+    {
+        cluster_num = fd->dir_entry.cluster;
+        if(!cluster_num)
+            return 0;
+
+        cluster_index = 0;
+        fat_add_file_cluster(fd, 0, cluster_num);
+    }
+
+    while(cluster_index < index)
+    {
+        cluster_num = fat_get_next_cluster(fd->fs, cluster_num);
+        if(!cluster_num)
+            return 0;
+
+        fat_add_file_cluster(fd, ++cluster_index, cluster_num);
+    }
+
+    return cluster_num;
+}
+#endif
+
 #if DOXYGEN || FAT_WRITE_SUPPORT
 /**
  * \ingroup fat_fs
@@ -477,13 +805,11 @@ cluster_t fat_get_next_cluster(const struct fat_fs_struct* fs, cluster_t cluster
  * \param[in] count The number of clusters to allocate.
  * \returns 0 on failure, the number of the first new cluster on success.
  */
-cluster_t fat_append_clusters(const struct fat_fs_struct* fs, cluster_t cluster_num, cluster_t count)
+cluster_t fat_append_clusters(struct fat_fs_struct* fs, cluster_t cluster_num, cluster_t count)
 {
     if(!fs)
         return 0;
 
-    device_read_t device_read = fs->partition->device_read;
-    device_write_t device_write = fs->partition->device_write;
     offset_t fat_offset = fs->header.fat_offset;
     cluster_t count_left = count;
     cluster_t cluster_next = 0;
@@ -499,18 +825,36 @@ cluster_t fat_append_clusters(const struct fat_fs_struct* fs, cluster_t cluster_
 #endif
         cluster_max = fs->header.fat_size / sizeof(fat_entry16);
 
-    for(cluster_t cluster_new = 2; cluster_new < cluster_max; ++cluster_new)
+    if(fs->cluster_free_count != FAT_CLUSTER_COUNT_UNKNOWN && fs->cluster_free_count < count)
     {
+        /* do not bother searching if we know it is in vain */
+        if(fs->cluster_free_counted)
+            return 0;
+
+        /* the count from fsinfo may be stale, search anyway */
+        fs->cluster_free_count = FAT_CLUSTER_COUNT_UNKNOWN;
+    }
+
+    /* start searching where the last search stopped, wrapping around at the end */
+    cluster_t cluster_new = fs->cluster_free;
+    if(cluster_new < 2 || cluster_new >= cluster_max)
+        cluster_new = 2;
+    cluster_t i;
+    for(i = 2; i < cluster_max; ++i, ++cluster_new)
+    {
+        if(cluster_new >= cluster_max)
+            cluster_new = 2;
+
 #if FAT_FAT32_SUPPORT
         if(is_fat32)
         {
-            if(!device_read(fat_offset + cluster_new * sizeof(fat_entry32), (uint8_t*) &fat_entry32, sizeof(fat_entry32)))
+            if(!fat_read_entry(fs, fat_offset + cluster_new * sizeof(fat_entry32), (uint8_t*) &fat_entry32, sizeof(fat_entry32)))
                 return 0;
         }
         else
 #endif
         {
-            if(!device_read(fat_offset + cluster_new * sizeof(fat_entry16), (uint8_t*) &fat_entry16, sizeof(fat_entry16)))
+            if(!fat_read_entry(fs, fat_offset + cluster_new * sizeof(fat_entry16), (uint8_t*) &fat_entry16, sizeof(fat_entry16)))
                 return 0;
         }
 
@@ -527,7 +871,7 @@ cluster_t fat_append_clusters(const struct fat_fs_struct* fs, cluster_t cluster_
             else
                 fat_entry32 = htol32(cluster_next);
 
-            if(!device_write(fat_offset + cluster_new * sizeof(fat_entry32), (uint8_t*) &fat_entry32, sizeof(fat_entry32)))
+            if(!fat_write_entry(fs, fat_offset + cluster_new * sizeof(fat_entry32), (uint8_t*) &fat_entry32, sizeof(fat_entry32)))
                 break;
         }
         else
@@ -543,14 +887,17 @@ cluster_t fat_append_clusters(const struct fat_fs_struct* fs, cluster_t cluster_
             else
                 fat_entry16 = htol16((uint16_t) cluster_next);
 
-            if(!device_write(fat_offset + cluster_new * sizeof(fat_entry16), (uint8_t*) &fat_entry16, sizeof(fat_entry16)))
+            if(!fat_write_entry(fs, fat_offset + cluster_new * sizeof(fat_entry16), (uint8_t*) &fat_entry16, sizeof(fat_entry16)))
                 break;
         }
 
+        fat_count_free(fs, cluster_new, 0);
+
         cluster_next = cluster_new;
         if(--count_left == 0)
             break;
     }
+    fs->cluster_free = cluster_new + 1;
 
     do
     {
@@ -567,7 +914,7 @@ cluster_t fat_append_clusters(const struct fat_fs_struct* fs, cluster_t cluster_
             {
                 fat_entry32 = htol32(cluster_next);
 
-                if(!device_write(fat_offset + cluster_num * sizeof(fat_entry32), (uint8_t*) &fat_entry32, sizeof(fat_entry32)))
+                if(!fat_write_entry(fs, fat_offset + cluster_num * sizeof(fat_entry32), (uint8_t*) &fat_entry32, sizeof(fat_entry32)))
                     break;
             }
             else
@@ -575,7 +922,7 @@ cluster_t fat_append_clusters(const struct fat_fs_struct* fs, cluster_t cluster_
             {
                 fat_entry16 = htol16((uint16_t) cluster_next);
 
-                if(!device_write(fat_offset + cluster_num * sizeof(fat_entry16), (uint8_t*) &fat_entry16, sizeof(fat_entry16)))
+                if(!fat_write_entry(fs, fat_offset + cluster_num * sizeof(fat_entry16), (uint8_t*) &fat_entry16, sizeof(fat_entry16)))
                     break;
             }
         }
@@ -587,6 +934,14 @@ cluster_t fat_append_clusters(const struct fat_fs_struct* fs, cluster_t cluster_
     /* No space left on device or writing error.
      * Free up all clusters already allocated.
      */
+    if(i == cluster_max)
+    {
+        /* the whole FAT has been searched, the clusters we got were
+         * all that were free
+         */
+        fs->cluster_free_count = 0;
+        fs->cluster_free_counted = 1;
+    }
     fat_free_clusters(fs, cluster_next);
 
     return 0;
@@ -611,7 +966,7 @@ cluster_t fat_append_clusters(const struct fat_fs_struct* fs, cluster_t cluster_
  * \returns 0 on failure, 1 on success.
  * \see fat_terminate_clusters
  */
-uint8_t fat_free_clusters(const struct fat_fs_struct* fs, cluster_t cluster_num)
+uint8_t fat_free_clusters(struct fat_fs_struct* fs, cluster_t cluster_num)
 {
     if(!fs || cluster_num < 2)
         return 0;
@@ -623,7 +978,7 @@ uint8_t fat_free_clusters(const struct fat_fs_struct* fs, cluster_t cluster_num)
         uint32_t fat_entry;
         while(cluster_num)
         {
-            if(!fs->partition->device_read(fat_offset + cluster_num * sizeof(fat_entry), (uint8_t*) &fat_entry, sizeof(fat_entry)))
+            if(!fat_read_entry(fs, fat_offset + cluster_num * sizeof(fat_entry), (uint8_t*) &fat_entry, sizeof(fat_entry)))
                 return 0;
 
             /* get next cluster of current cluster before freeing current cluster */
@@ -642,7 +997,8 @@ uint8_t fat_free_clusters(const struct fat_fs_struct* fs, cluster_t cluster_num)
 
             /* free cluster */
             fat_entry = HTOL32(FAT32_CLUSTER_FREE);
-            fs->partition->device_write(fat_offset + cluster_num * sizeof(fat_entry), (uint8_t*) &fat_entry, sizeof(fat_entry));
+            if(fat_write_entry(fs, fat_offset + cluster_num * sizeof(fat_entry), (uint8_t*) &fat_entry, sizeof(fat_entry)))
+                fat_count_free(fs, cluster_num, 1);
 
             /* We continue in any case here, even if freeing the cluster failed.
              * The cluster is lost, but maybe we can still free up some later ones.
@@ -657,7 +1013,7 @@ uint8_t fat_free_clusters(const struct fat_fs_struct* fs, cluster_t cluster_num)
         uint16_t fat_entry;
         while(cluster_num)
         {
-            if(!fs->partition->device_read(fat_offset + cluster_num * sizeof(fat_entry), (uint8_t*) &fat_entry, sizeof(fat_entry)))
+            if(!fat_read_entry(fs, fat_offset + cluster_num * sizeof(fat_entry), (uint8_t*) &fat_entry, sizeof(fat_entry)))
                 return 0;
 
             /* get next cluster of current cluster before freeing current cluster */
@@ -676,7 +1032,8 @@ uint8_t fat_free_clusters(const struct fat_fs_struct* fs, cluster_t cluster_num)
 
             /* free cluster */
             fat_entry = HTOL16(FAT16_CLUSTER_FREE);
-            fs->partition->device_write(fat_offset + cluster_num * sizeof(fat_entry), (uint8_t*) &fat_entry, sizeof(fat_entry));
+            if(fat_write_entry(fs, fat_offset + cluster_num * sizeof(fat_entry), (uint8_t*) &fat_entry, sizeof(fat_entry)))
+                fat_count_free(fs, cluster_num, 1);
 
             /* We continue in any case here, even if freeing the cluster failed.
              * The cluster is lost, but maybe we can still free up some later ones.
@@ -703,7 +1060,7 @@ uint8_t fat_free_clusters(const struct fat_fs_struct* fs, cluster_t cluster_num)
  * \returns 0 on failure, 1 on success.
  * \see fat_free_clusters
  */
-uint8_t fat_terminate_clusters(const struct fat_fs_struct* fs, cluster_t cluster_num)
+uint8_t fat_terminate_clusters(struct fat_fs_struct* fs, cluster_t cluster_num)
 {
     if(!fs || cluster_num < 2)
         return 0;
@@ -716,14 +1073,14 @@ uint8_t fat_terminate_clusters(const struct fat_fs_struct* fs, cluster_t cluster
     if(fs->partition->type == PARTITION_TYPE_FAT32)
     {
         uint32_t fat_entry = HTOL32(FAT32_CLUSTER_LAST_MAX);
-        if(!fs->partition->device_write(fs->header.fat_offset + cluster_num * sizeof(fat_entry), (uint8_t*) &fat_entry, sizeof(fat_entry)))
+        if(!fat_write_entry(fs, fs->header.fat_offset + cluster_num * sizeof(fat_entry), (uint8_t*) &fat_entry, sizeof(fat_entry)))
             return 0;
     }
     else
 #endif
     {
         uint16_t fat_entry = HTOL16(FAT16_CLUSTER_LAST_MAX);
-        if(!fs->partition->device_write(fs->header.fat_offset + cluster_num * sizeof(fat_entry), (uint8_t*) &fat_entry, sizeof(fat_entry)))
+        if(!fat_write_entry(fs, fs->header.fat_offset + cluster_num * sizeof(fat_entry), (uint8_t*) &fat_entry, sizeof(fat_entry)))
             return 0;
     }
 
@@ -843,7 +1200,7 @@ uint8_t fat_get_dir_entry_of_path(struct fat_fs_struct* fs, const char* path, st
         {
             /* check if we have found the next hierarchy */
             if((strlen(dir_entry->long_name) != length_to_sep ||
-                strncmp(path, dir_entry->long_name, length_to_sep) != 0))
+                strncasecmp(path, dir_entry->long_name, length_to_sep) != 0))
                 continue;
 
             fat_close_dir(dd);
@@ -912,6 +1269,9 @@ struct fat_file_struct* fat_open_file(struct fat_fs_struct* fs, const struct fat
     fd->fs = fs;
     fd->pos = 0;
     fd->pos_cluster = dir_entry->cluster;
+#if FAT_EXTENT_COUNT
+    fd->extent_count = 0;
+#endif
 
     return fd;
 }
@@ -977,6 +1337,11 @@ intptr_t fat_read_file(struct fat_file_struct* fd, uint8_t* buffer, uintptr_t bu
 
         if(fd->pos)
         {
+#if FAT_EXTENT_COUNT
+            cluster_num = fat_get_file_cluster(fd, fd->pos / cluster_size, 0);
+            if(!cluster_num)
+                return -1;
+#else
             uint32_t pos = fd->pos;
             while(pos >= cluster_size)
             {
@@ -985,6 +1350,7 @@ intptr_t fat_read_file(struct fat_file_struct* fd, uint8_t* buffer, uintptr_t bu
                 if(!cluster_num)
                     return -1;
             }
+#endif
         }
     }
     
@@ -1009,7 +1375,12 @@ intptr_t fat_read_file(struct fat_file_struct* fd, uint8_t* buffer, uintptr_t bu
         if(first_cluster_offset + copy_length >= cluster_size)
         {
             /* we are on a cluster boundary, so get the next cluster */
+#if FAT_EXTENT_COUNT
+            if(fd->pos < fd->dir_entry.file_size &&
+               (cluster_num = fat_get_file_cluster(fd, fd->pos / cluster_size, cluster_num)))
+#else
             if((cluster_num = fat_get_next_cluster(fd->fs, cluster_num)))
+#endif
             {
                 first_cluster_offset = 0;
             }
@@ -1208,8 +1579,11 @@ uint8_t fat_seek_file(struct fat_file_struct* fd, int32_t* offset, uint8_t whenc
        )
         return 0;
 
-    fd->pos = new_pos;
-    fd->pos_cluster = 0;
+    if(new_pos != fd->pos)
+    {
+        fd->pos = new_pos;
+        fd->pos_cluster = 0;
+    }
 
     *offset = (int32_t) new_pos;
     return 1;
@@ -1303,6 +1677,11 @@ uint8_t fat_resize_file(struct fat_file_struct* fd, uint32_t size)
 
     } while(0);
 
+#if FAT_EXTENT_COUNT
+    /* the runs known may reach beyond the new end of the chain */
+    fd->extent_count = 0;
+#endif
+
     /* correct file position */
     if(size < fd->pos)
     {
@@ -1424,7 +1803,7 @@ uint8_t fat_read_dir(struct fat_dir_struct* dd, struct fat_dir_entry_struct* dir
     {
         /* read directory entries up to the cluster border */
         uint16_t cluster_left = cluster_size - cluster_offset;
-        uint32_t pos = cluster_offset;
+        offset_t pos = cluster_offset;
         if(cluster_num == 0)
             pos += header->root_dir_offset;
         else
@@ -1502,7 +1881,7 @@ uint8_t fat_dir_entry_read_callback(uint8_t* buffer, offset_t offset, void* p)
     if(!dir_entry->entry_offset)
         dir_entry->entry_offset = offset;
     
-    switch(fat_interpret_dir_entry(dir_entry, buffer))
+    switch(fat_interpret_dir_entry(arg, buffer))
     {
         case 0: /* failure */
         {
@@ -1533,32 +1912,69 @@ uint8_t fat_dir_entry_read_callback(uint8_t* buffer, offset_t offset, void* p)
  * entry is a traditional 8.3 style one. It contains all
  * other information like size, cluster, date and time.
  * 
- * \param[in,out] dir_entry The directory entry to fill.
+ * The lfn entries are only used if their checksum matches the
+ * 8.3 entry and the long name fits into the directory entry.
+ * Otherwise the file shows up with its 8.3 name, so it can
+ * still be opened under a unique name.
+ *
+ * \param[in,out] arg The read state, including the directory entry to fill.
  * \param[in] raw_entry A pointer to 32 bytes of raw data.
  * \returns 0 on failure, 1 on success and 2 if the
  *          directory entry is complete.
  */
-uint8_t fat_interpret_dir_entry(struct fat_dir_entry_struct* dir_entry, const uint8_t* raw_entry)
+uint8_t fat_interpret_dir_entry(struct fat_read_dir_callback_arg* arg, const uint8_t* raw_entry)
 {
+    struct fat_dir_entry_struct* dir_entry = arg->dir_entry;
     if(!dir_entry || !raw_entry || !raw_entry[0])
         return 0;
 
     char* long_name = dir_entry->long_name;
     if(raw_entry[11] == 0x0f)
     {
+        if(raw_entry[0] & FAT_DIRENTRY_LFNLAST)
+        {
+            arg->lfn_checksum = raw_entry[13];
+            arg->lfn_valid = 1;
+        }
+        else if(raw_entry[13] != arg->lfn_checksum)
+        {
+            arg->lfn_valid = 0;
+        }
+
         /* Lfn supports unicode, but we do not, for now.
-         * So we assume pure ascii and read only every
-         * second byte.
+         * So we take characters up to 0xff as they are
+         * and replace the others.
          */
-        uint16_t char_offset = ((raw_entry[0] & 0x3f) - 1) * 13;
+        uint16_t char_offset = ((raw_entry[0] & FAT_DIRENTRY_LFNSEQMASK) - 1) * 13;
         const uint8_t char_mapping[] = { 1, 3, 5, 7, 9, 14, 16, 18, 20, 22, 24, 28, 30 };
-        for(uint8_t i = 0; i <= 12 && char_offset + i < sizeof(dir_entry->long_name) - 1; ++i)
-            long_name[char_offset + i] = raw_entry[char_mapping[i]];
+        for(uint8_t i = 0; i <= 12; ++i)
+        {
+            const uint8_t* raw_char = &raw_entry[char_mapping[i]];
+            char c = raw_char[0];
+            if(raw_char[1])
+                c = (raw_char[0] & raw_char[1]) == 0xff ? '\0' : '_'; /* padding or not representable */
+
+            if(char_offset + i < sizeof(dir_entry->long_name) - 1)
+                long_name[char_offset + i] = c;
+            else if(c)
+                arg->lfn_valid = 0; /* too long */
+        }
 
         return 1;
     }
     else
     {
+        if(long_name[0] != '\0')
+        {
+            /* check the lfn entries really belong to this entry */
+            uint8_t checksum = 0;
+            for(uint8_t i = 0; i < 11; ++i)
+                checksum = ((checksum & 1) << 7) + (checksum >> 1) + raw_entry[i];
+
+            if(!arg->lfn_valid || checksum != arg->lfn_checksum)
+                memset(long_name, 0, sizeof(dir_entry->long_name));
+        }
+
         /* if we do not have a long name, take the short one */
         if(long_name[0] == '\0')
         {
@@ -1631,7 +2047,7 @@ uint8_t fat_interpret_dir_entry(struct fat_dir_entry_struct* dir_entry, const ui
  * \param[in] dir_entry The directory entry for which to search space.
  * \returns 0 on failure, a device offset on success.
  */
-offset_t fat_find_offset_for_dir_entry(const struct fat_fs_struct* fs, const struct fat_dir_struct* parent, const struct fat_dir_entry_struct* dir_entry)
+offset_t fat_find_offset_for_dir_entry(struct fat_fs_struct* fs, const struct fat_dir_struct* parent, const struct fat_dir_entry_struct* dir_entry)
 {
     if(!fs || !dir_entry)
         return 0;
@@ -1938,7 +2354,8 @@ uint8_t fat_write_dir_entry(const struct fat_fs_struct* fs, struct fat_dir_entry
  */
 uint8_t fat_create_file(struct fat_dir_struct* parent, const char* file, struct fat_dir_entry_struct* dir_entry)
 {
-    if(!parent || !file || !file[0] || !dir_entry)
+    if(!parent || !file || !file[0] || !dir_entry ||
+       strlen(file) >= sizeof(dir_entry->long_name))
     {
 	SDDEBUG ("fat_create_file: invalid parameters.\n");
         return 0;
@@ -1950,7 +2367,7 @@ uint8_t fat_create_file(struct fat_dir_struct* parent, const char* file, struct
         if(!fat_read_dir(parent, dir_entry))
             break;
 
-        if(strcmp(file, dir_entry->long_name) == 0)
+        if(strcasecmp(file, dir_entry->long_name) == 0)
         {
             fat_reset_dir(parent);
 	    SDDEBUG ("fat_create_file: file exists.\n");
@@ -2057,13 +2474,14 @@ uint8_t fat_delete_file(struct fat_fs_struct* fs, struct fat_dir_entry_struct* d
  */
 uint8_t fat_create_dir(struct fat_dir_struct* parent, const char* dir, struct fat_dir_entry_struct* dir_entry)
 {
-    if(!parent || !dir || !dir[0] || !dir_entry)
+    if(!parent || !dir || !dir[0] || !dir_entry ||
+       strlen(dir) >= sizeof(dir_entry->long_name))
         return 0;
 
     /* check if the file or directory already exists */
     while(fat_read_dir(parent, dir_entry))
     {
-        if(strcmp(dir, dir_entry->long_name) == 0)
+        if(strcasecmp(dir, dir_entry->long_name) == 0)
         {
             fat_reset_dir(parent);
             return 0;
@@ -2258,14 +2676,21 @@ offset_t fat_get_fs_size(const struct fat_fs_struct* fs)
  * \note As the FAT filesystem is cluster based, this function does not
  *       return continuous values but multiples of the cluster size.
  *
+ * The FAT is scanned only if the count is neither known from the
+ * FAT32 fsinfo sector nor from an earlier call.
+ *
  * \param[in] fs The filesystem on which to operate.
  * \returns 0 on failure, the free filesystem space in bytes otherwise.
  */
-offset_t fat_get_fs_free(const struct fat_fs_struct* fs)
+offset_t fat_get_fs_free(struct fat_fs_struct* fs)
 {
     if(!fs)
         return 0;
 
+    /* the count is known from fsinfo or an earlier call */
+    if(fs->cluster_free_count != FAT_CLUSTER_COUNT_UNKNOWN)
+        return (offset_t) fs->cluster_free_count * fs->header.cluster_size;
+
     uint8_t fat[32];
     struct fat_usage_count_callback_arg count_arg;
     count_arg.cluster_count = 0;
@@ -2299,6 +2724,8 @@ offset_t fat_get_fs_free(const struct fat_fs_struct* fs)
         fat_size -= length;
     }
 
+    fs->cluster_free_count = count_arg.cluster_count;
+    fs->cluster_free_counted = 1;
     return (offset_t) count_arg.cluster_count * fs->header.cluster_size;
 }
 
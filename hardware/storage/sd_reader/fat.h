@@ -71,8 +71,8 @@ struct fat_dir_struct;
  */
 struct fat_dir_entry_struct
 {
-    /** The file's name, truncated to 31 characters. */
-    char long_name[32];
+    /** The file's name, or its 8.3 name if the long one does not fit. */
+    char long_name[FAT_LONG_NAME_LENGTH];
     /** The file's attributes. Mask of the FAT_ATTRIB_* constants. */
     uint8_t attributes;
 #if FAT_DATETIME_SUPPORT
@@ -89,16 +89,34 @@ struct fat_dir_entry_struct
     offset_t entry_offset;
 };
 
+#if FAT_EXTENT_COUNT
+/** A run of contiguous clusters within a file. */
+struct fat_extent_struct
+{
+    /** The number of the run's first cluster within the file. */
+    cluster_t index;
+    /** The run's first cluster on disk. */
+    cluster_t cluster;
+    /** The number of clusters in the run. */
+    cluster_t count;
+};
+#endif
+
 struct fat_file_struct
 {
     struct fat_fs_struct* fs;
     struct fat_dir_entry_struct dir_entry;
     offset_t pos;
     cluster_t pos_cluster;
+#if FAT_EXTENT_COUNT
+    struct fat_extent_struct extents[FAT_EXTENT_COUNT];
+    uint8_t extent_count;
+#endif
 };
 
 struct fat_fs_struct* fat_open(struct partition_struct* partition);
 void fat_close(struct fat_fs_struct* fs);
+uint8_t fat_sync(struct fat_fs_struct* fs);
 
 struct fat_file_struct* fat_open_file(struct fat_fs_struct* fs, const struct fat_dir_entry_struct* dir_entry);
 void fat_close_file(struct fat_file_struct* fd);
@@ -123,7 +141,7 @@ void fat_get_file_modification_time(const struct fat_dir_entry_struct* dir_entry
 uint8_t fat_get_dir_entry_of_path(struct fat_fs_struct* fs, const char* path, struct fat_dir_entry_struct* dir_entry);
 
 offset_t fat_get_fs_size(const struct fat_fs_struct* fs);
-offset_t fat_get_fs_free(const struct fat_fs_struct* fs);
+offset_t fat_get_fs_free(struct fat_fs_struct* fs);
 
 extern struct fat_fs_struct* fat_fs;
 extern struct fat_dir_struct* sd_cwd;
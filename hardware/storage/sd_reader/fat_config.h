@@ -49,9 +49,15 @@ extern "C"
  * \ingroup fat_config
  * Controls FAT32 support.
  *
- * Set to 1 to enable FAT32 support.
+ * Set to 1 to enable FAT32 support. FAT16 filesystems are still
+ * recognized at runtime. SDHC cards always come with FAT32, so
+ * SD_RAW_SDHC implies this.
  */
-#define FAT_FAT32_SUPPORT SD_RAW_SDHC
+#if defined(SD_FAT32_SUPPORT) || SD_RAW_SDHC
+#define FAT_FAT32_SUPPORT 1
+#else
+#define FAT_FAT32_SUPPORT 0
+#endif
 
 /**
  * \ingroup fat_config
@@ -74,6 +80,23 @@ extern "C"
 /* forward declaration for the above */
 void get_datetime(uint16_t* year, uint8_t* month, uint8_t* day, uint8_t* hour, uint8_t* min, uint8_t* sec);
 
+/**
+ * \ingroup fat_config
+ * Number of cluster runs remembered per file handle.
+ *
+ * Seeking only follows the cluster chain beyond the runs already
+ * known, instead of from the start of the file.  Set to 0 to disable.
+ */
+#define FAT_EXTENT_COUNT 4
+
+/**
+ * \ingroup fat_config
+ * Size in bytes of the FAT cache window.
+ *
+ * Must be a power of two not larger than 512.  Set to 0 to disable.
+ */
+#define FAT_CACHE_SIZE 32
+
 /**
  * \ingroup fat_config
  * Maximum number of filesystem handles.
@@ -84,13 +107,28 @@ void get_datetime(uint16_t* year, uint8_t* month, uint8_t* day, uint8_t* hour, u
  * \ingroup fat_config
  * Maximum number of file handles.
  */
+#ifndef FAT_FILE_COUNT
 #define FAT_FILE_COUNT 1
+#endif
 
 /**
  * \ingroup fat_config
  * Maximum number of directory handles.
  */
+#ifndef FAT_DIR_COUNT
 #define FAT_DIR_COUNT 2
+#endif
+
+/**
+ * \ingroup fat_config
+ * Size of the file name buffer of directory entries.
+ *
+ * Long file names which do not fit are replaced by their 8.3 name.
+ * Each file and directory handle holds one such buffer.
+ */
+#ifndef FAT_LONG_NAME_LENGTH
+#define FAT_LONG_NAME_LENGTH 32
+#endif
 
 /**
  * @}
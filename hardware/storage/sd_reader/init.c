@@ -63,4 +63,5 @@ sd_try_init (void)
 	    }
 #	    endif
   ')
+  timer(250, sd_raw_sync())
 */
@@ -145,23 +145,57 @@
 #define SD_RAW_SPEC_SDHC 2
 
 #if !SD_RAW_SAVE_RAM
-/* static data buffer for acceleration */
-static uint8_t raw_block[512];
-/* offset where the data within raw_block lies on the card */
-static offset_t raw_block_address;
-#if SD_RAW_WRITE_BUFFERING
-/* flag to remember if raw_block was written to the card */
-static uint8_t raw_block_written;
+/* static data buffers for acceleration, used as a write-back cache */
+static uint8_t raw_block[SD_RAW_CACHE_BLOCKS][512];
+/* offsets where the data within raw_block lies on the card */
+static offset_t raw_block_address[SD_RAW_CACHE_BLOCKS];
+/* number of accesses to other blocks since a block was last used */
+static uint8_t raw_block_age[SD_RAW_CACHE_BLOCKS];
+#if SD_RAW_WRITE_SUPPORT
+/* flags to remember if raw_block still has to be written to the card */
+static uint8_t raw_block_dirty[SD_RAW_CACHE_BLOCKS];
+#endif
 #endif
+
+#if SD_RAW_MULTIBLOCK
+/* set while a multiple block read is in progress */
+static uint8_t raw_streaming;
+/* offset of the block the card is going to send next */
+static offset_t raw_stream_address;
 #endif
 
 /* card type state */
 static uint8_t sd_raw_card_type;
 
+/* argument of block read and write commands */
+#if SD_RAW_SDHC
+#define sd_raw_block_arg(block_address) \
+    (sd_raw_card_type & (1 << SD_RAW_SPEC_SDHC) ? (block_address) / 512 : (block_address))
+#else
+#define sd_raw_block_arg(block_address) (block_address)
+#endif
+
+#include "core/spi.h"
+#define sd_raw_send_byte(b) spi_send(b)
+#define sd_raw_rec_byte() spi_send(0xff)
+
 /* private helper functions */
 //static void sd_raw_send_byte(uint8_t b);
 //static uint8_t sd_raw_rec_byte();
 static uint8_t sd_raw_send_command(uint8_t command, uint32_t arg);
+static uint8_t sd_raw_read_block(offset_t block_address, uint8_t* buffer, uint16_t block_offset, uint16_t read_length);
+#if SD_RAW_MULTIBLOCK
+static void sd_raw_stop();
+#else
+#define sd_raw_stop()
+#endif
+#if !SD_RAW_SAVE_RAM
+static uint8_t sd_raw_cache_find(offset_t block_address);
+static uint8_t sd_raw_cache_load(offset_t block_address, uint8_t read);
+#endif
+#if SD_RAW_WRITE_SUPPORT
+static uint8_t sd_raw_flush(uint8_t i);
+#endif
 
 /**
  * \ingroup sd_raw
@@ -199,6 +233,9 @@ uint8_t sd_raw_init()
 
     /* initialization procedure */
     sd_raw_card_type = 0;
+#if SD_RAW_MULTIBLOCK
+    raw_streaming = 0;
+#endif
     
 #if 0
     if(!sd_raw_available()) {
@@ -332,11 +369,15 @@ uint8_t sd_raw_init()
 
 #if !SD_RAW_SAVE_RAM
     /* the first block is likely to be accessed first, so precache it here */
-    raw_block_address = (offset_t) -1;
-#if SD_RAW_WRITE_BUFFERING
-    raw_block_written = 1;
+    for(uint8_t i = 0; i < SD_RAW_CACHE_BLOCKS; ++i)
+    {
+        raw_block_address[i] = (offset_t) -1;
+        raw_block_age[i] = 0xff;
+#if SD_RAW_WRITE_SUPPORT
+        raw_block_dirty[i] = 0;
 #endif
-    if(!sd_raw_read(0, raw_block, sizeof(raw_block)))
+    }
+    if(sd_raw_cache_load(0, 1) >= SD_RAW_CACHE_BLOCKS)
         return 0;
 #endif
 
@@ -399,10 +440,6 @@ uint8_t sd_raw_rec_byte()
 }
 #endif
 
-#include "core/spi.h"
-#define sd_raw_send_byte(b) spi_send(b)
-#define sd_raw_rec_byte() spi_send(0xff)
-
 /**
  * \ingroup sd_raw
  * Send a command to the memory card which responses with a R1 response (and possibly others).
@@ -436,18 +473,204 @@ uint8_t sd_raw_send_command(uint8_t command, uint32_t arg)
            sd_raw_send_byte(0xff);
            break;
     }
+
+    /* a stop command is followed by a stuff byte */
+    if(command == CMD_STOP_TRANSMISSION)
+        sd_raw_rec_byte();
     
-    /* receive response */
+    /* receive response, it always has the msb cleared */
     for(uint8_t i = 0; i < 10; ++i)
     {
         response = sd_raw_rec_byte();
-        if(response != 0xff)
+        if(!(response & 0x80))
             break;
     }
 
     return response;
 }
 
+/**
+ * \ingroup sd_raw
+ * Reads a single block from the card.
+ *
+ * When multiple block transfers are enabled, the card is asked for all
+ * blocks from \c block_address onwards.  Reading the next block then
+ * just picks up the data the card sends anyway, no command needed.
+ * The card keeps the transfer state while it is deselected, so the
+ * SPI bus remains free for other devices in between.
+ *
+ * \param[in] block_address The offset of the block, a multiple of 512.
+ * \param[out] buffer The buffer into which to write the data.
+ * \param[in] block_offset The offset of the data of interest within the block.
+ * \param[in] read_length The number of bytes to read.
+ * \returns 0 on failure, 1 on success.
+ */
+uint8_t sd_raw_read_block(offset_t block_address, uint8_t* buffer, uint16_t block_offset, uint16_t read_length)
+{
+#if SD_RAW_MULTIBLOCK
+    uint8_t command = CMD_READ_MULTIPLE_BLOCK;
+    if(raw_streaming && raw_stream_address == block_address)
+        command = 0; /* the card is already on its way */
+    else
+        sd_raw_stop();
+#else
+    uint8_t command = CMD_READ_SINGLE_BLOCK;
+#endif
+
+    /* address card */
+    select_card();
+
+    /* send block request */
+    if(command && sd_raw_send_command(command, sd_raw_block_arg(block_address)))
+    {
+        unselect_card();
+        return 0;
+    }
+
+#if SD_RAW_MULTIBLOCK
+    raw_streaming = 0;
+#endif
+
+    /* wait for data block (start byte 0xfe) */
+#ifdef SD_READ_TIMEOUT
+    uint16_t timeout = 20000;
+
+    while(sd_raw_rec_byte() != 0xfe && timeout > 0)
+        timeout --;
+
+    if (timeout == 0) {
+        SDDEBUG ("read timeout reached!\n");
+        unselect_card();
+        return 0;
+    }
+#else
+    while(sd_raw_rec_byte() != 0xfe);
+#endif
+
+    /* read byte block */
+    if(read_length == 512)
+    {
+        for(uint16_t i = 0; i < 512; ++i)
+            *buffer++ = sd_raw_rec_byte();
+    }
+    else
+    {
+        uint16_t read_to = block_offset + read_length;
+        for(uint16_t i = 0; i < 512; ++i)
+        {
+            uint8_t b = sd_raw_rec_byte();
+            if(i >= block_offset && i < read_to)
+                *buffer++ = b;
+        }
+    }
+
+    /* read crc16 */
+    sd_raw_rec_byte();
+    sd_raw_rec_byte();
+
+    /* deaddress card */
+    unselect_card();
+
+    /* let card some time to finish */
+    sd_raw_rec_byte();
+
+#if SD_RAW_MULTIBLOCK
+    raw_streaming = 1;
+    raw_stream_address = block_address + 512;
+#endif
+
+    return 1;
+}
+
+#if DOXYGEN || SD_RAW_MULTIBLOCK
+/**
+ * \ingroup sd_raw
+ * Ends a multiple block read, if one is in progress.
+ *
+ * This has to be done before sending any other command to the card.
+ */
+void sd_raw_stop()
+{
+    if(!raw_streaming)
+        return;
+    raw_streaming = 0;
+
+    select_card();
+    sd_raw_send_command(CMD_STOP_TRANSMISSION, 0);
+
+    /* wait while card is busy */
+    while(sd_raw_rec_byte() != 0xff);
+
+    unselect_card();
+    sd_raw_rec_byte();
+}
+#endif
+
+#if !SD_RAW_SAVE_RAM
+/**
+ * \ingroup sd_raw
+ * Looks up a block in the cache.
+ *
+ * \param[in] block_address The offset of the block, a multiple of 512.
+ * \returns The cache slot, or SD_RAW_CACHE_BLOCKS if the block is not cached.
+ */
+uint8_t sd_raw_cache_find(offset_t block_address)
+{
+    uint8_t i;
+    for(i = 0; i < SD_RAW_CACHE_BLOCKS; ++i)
+    {
+        if(raw_block_address[i] == block_address)
+            break;
+    }
+
+    return i;
+}
+
+/**
+ * \ingroup sd_raw
+ * Makes sure a block is in the cache.
+ *
+ * If the block is not cached yet, it replaces the least recently
+ * used one, which is written to the card first if necessary.
+ *
+ * \param[in] block_address The offset of the block, a multiple of 512.
+ * \param[in] read Zero if the block is going to be overwritten completely.
+ * \returns The cache slot, or SD_RAW_CACHE_BLOCKS on failure.
+ */
+uint8_t sd_raw_cache_load(offset_t block_address, uint8_t read)
+{
+    uint8_t i = sd_raw_cache_find(block_address);
+    if(i >= SD_RAW_CACHE_BLOCKS)
+    {
+        i = 0;
+        for(uint8_t j = 1; j < SD_RAW_CACHE_BLOCKS; ++j)
+        {
+            if(raw_block_age[j] > raw_block_age[i])
+                i = j;
+        }
+
+#if SD_RAW_WRITE_SUPPORT
+        if(raw_block_dirty[i] && !sd_raw_flush(i))
+            return SD_RAW_CACHE_BLOCKS;
+#endif
+
+        raw_block_address[i] = (offset_t) -1;
+        if(read && !sd_raw_read_block(block_address, raw_block[i], 0, 512))
+            return SD_RAW_CACHE_BLOCKS;
+        raw_block_address[i] = block_address;
+    }
+
+    for(uint8_t j = 0; j < SD_RAW_CACHE_BLOCKS; ++j)
+    {
+        if(raw_block_age[j] < 0xff)
+            ++raw_block_age[j];
+    }
+    raw_block_age[i] = 0;
+
+    return i;
+}
+#endif
+
 /**
  * \ingroup sd_raw
  * Reads raw data from the card.
@@ -472,85 +695,30 @@ uint8_t sd_raw_read(offset_t offset, uint8_t* buffer, uintptr_t length)
         if(read_length > length)
             read_length = length;
         
-#if !SD_RAW_SAVE_RAM
-        /* check if the requested data is cached */
-        if(block_address != raw_block_address)
-#endif
-        {
-#if SD_RAW_WRITE_BUFFERING
-            if(!sd_raw_sync())
-                return 0;
-#endif
-
-            /* address card */
-            select_card();
-
-            /* send single block request */
-#if SD_RAW_SDHC
-            if(sd_raw_send_command(CMD_READ_SINGLE_BLOCK, (sd_raw_card_type & (1 << SD_RAW_SPEC_SDHC) ? block_address / 512 : block_address)))
-#else
-            if(sd_raw_send_command(CMD_READ_SINGLE_BLOCK, block_address))
-#endif
-            {
-                unselect_card();
-                return 0;
-            }
-
-            /* wait for data block (start byte 0xfe) */
-#ifdef SD_READ_TIMEOUT
-	    uint16_t timeout = 20000;
-
-            while(sd_raw_rec_byte() != 0xfe && timeout > 0)
-		timeout --;
-
-	    if (timeout == 0) {
-		SDDEBUG ("read timeout reached!\n");
-                unselect_card();
-                return 0;
-	    }
-#else
-            while(sd_raw_rec_byte() != 0xfe);
-#endif
-
 #if SD_RAW_SAVE_RAM
-            /* read byte block */
-            uint16_t read_to = block_offset + read_length;
-            for(uint16_t i = 0; i < 512; ++i)
-            {
-                uint8_t b = sd_raw_rec_byte();
-                if(i >= block_offset && i < read_to)
-                    *buffer++ = b;
-            }
+        if(!sd_raw_read_block(block_address, buffer, block_offset, read_length))
+            return 0;
 #else
-            /* read byte block */
-            uint8_t* cache = raw_block;
-            for(uint16_t i = 0; i < 512; ++i)
-                *cache++ = sd_raw_rec_byte();
-            raw_block_address = block_address;
-
-            memcpy(buffer, raw_block + block_offset, read_length);
-            buffer += read_length;
-#endif
-            
-            /* read crc16 */
-            sd_raw_rec_byte();
-            sd_raw_rec_byte();
-            
-            /* deaddress card */
-            unselect_card();
-
-            /* let card some time to finish */
-            sd_raw_rec_byte();
+        /* check if the requested data is cached, whole blocks
+         * which are not are read directly and not cached
+         */
+        uint8_t i = sd_raw_cache_find(block_address);
+        if(i >= SD_RAW_CACHE_BLOCKS && read_length == 512)
+        {
+            if(!sd_raw_read_block(block_address, buffer, 0, 512))
+                return 0;
         }
-#if !SD_RAW_SAVE_RAM
         else
         {
-            /* use cached data */
-            memcpy(buffer, raw_block + block_offset, read_length);
-            buffer += read_length;
+            i = sd_raw_cache_load(block_address, 1);
+            if(i >= SD_RAW_CACHE_BLOCKS)
+                return 0;
+
+            memcpy(buffer, raw_block[i] + block_offset, read_length);
         }
 #endif
 
+        buffer += read_length;
         length -= read_length;
         offset += read_length;
     }
@@ -603,6 +771,8 @@ uint8_t sd_raw_read_interval(offset_t offset, uint8_t* buffer, uintptr_t interva
 
     return 1;
 #else
+    sd_raw_stop();
+
     /* address card */
     select_card();
 
@@ -717,76 +887,104 @@ uint8_t sd_raw_write(offset_t offset, const uint8_t* buffer, uintptr_t length)
         /* Merge the data to write with the content of the block.
          * Use the cached block if available.
          */
-        if(block_address != raw_block_address)
-        {
-#if SD_RAW_WRITE_BUFFERING
-            if(!sd_raw_sync())
-                return 0;
-#endif
+        uint8_t i = sd_raw_cache_load(block_address, block_offset || write_length < 512);
+        if(i >= SD_RAW_CACHE_BLOCKS)
+            return 0;
 
-            if(block_offset || write_length < 512)
-            {
-                if(!sd_raw_read(block_address, raw_block, sizeof(raw_block)))
-                    return 0;
-            }
-            raw_block_address = block_address;
-        }
+        memcpy(raw_block[i] + block_offset, buffer, write_length);
+        raw_block_dirty[i] = 1;
 
-        if(buffer != raw_block)
-        {
-            memcpy(raw_block + block_offset, buffer, write_length);
+#if !SD_RAW_WRITE_BUFFERING
+        if(!sd_raw_flush(i))
+            return 0;
+#endif
 
-#if SD_RAW_WRITE_BUFFERING
-            raw_block_written = 0;
+        buffer += write_length;
+        offset += write_length;
+        length -= write_length;
+    }
+
+    return 1;
+}
 
-            if(length == write_length)
-                return 1;
+/**
+ * \ingroup sd_raw
+ * Writes a cached block to the card.
+ *
+ * With multiple block transfers enabled, all dirty blocks adjoining
+ * it on the card are written along with it in a single transfer.
+ *
+ * \param[in] i The cache slot of the block.
+ * \returns 0 on failure, 1 on success.
+ */
+uint8_t sd_raw_flush(uint8_t i)
+{
+    offset_t block_address = raw_block_address[i];
+    uint8_t count = 1;
+
+#if SD_RAW_MULTIBLOCK
+    /* find the first and count the dirty blocks in a row */
+    while((i = sd_raw_cache_find(block_address - 512)) < SD_RAW_CACHE_BLOCKS && raw_block_dirty[i])
+        block_address -= 512;
+    while((i = sd_raw_cache_find(block_address + (offset_t) count * 512)) < SD_RAW_CACHE_BLOCKS && raw_block_dirty[i])
+        ++count;
 #endif
-        }
 
-        /* address card */
-        select_card();
+    sd_raw_stop();
 
-        /* send single block request */
-#if SD_RAW_SDHC
-        if(sd_raw_send_command(CMD_WRITE_SINGLE_BLOCK, (sd_raw_card_type & (1 << SD_RAW_SPEC_SDHC) ? block_address / 512 : block_address)))
-#else
-        if(sd_raw_send_command(CMD_WRITE_SINGLE_BLOCK, block_address))
-#endif
-        {
-            unselect_card();
-            return 0;
-        }
+    /* address card */
+    select_card();
+
+    /* send block write request */
+    if(sd_raw_send_command(count > 1 ? CMD_WRITE_MULTIPLE_BLOCK : CMD_WRITE_SINGLE_BLOCK, sd_raw_block_arg(block_address)))
+    {
+        unselect_card();
+        return 0;
+    }
+
+    uint8_t ok = 1;
+    for(uint8_t n = 0; n < count; ++n)
+    {
+        i = sd_raw_cache_find(block_address + (offset_t) n * 512);
 
         /* send start byte */
-        sd_raw_send_byte(0xfe);
+        sd_raw_send_byte(count > 1 ? 0xfc : 0xfe);
 
         /* write byte block */
-        uint8_t* cache = raw_block;
-        for(uint16_t i = 0; i < 512; ++i)
+        uint8_t* cache = raw_block[i];
+        for(uint16_t j = 0; j < 512; ++j)
             sd_raw_send_byte(*cache++);
 
         /* write dummy crc16 */
         sd_raw_send_byte(0xff);
         sd_raw_send_byte(0xff);
 
-        /* wait while card is busy */
+        /* check data response, wait while card is busy */
+        uint8_t response = sd_raw_rec_byte();
         while(sd_raw_rec_byte() != 0xff);
-        sd_raw_rec_byte();
 
-        /* deaddress card */
-        unselect_card();
+        if((response & 0x1f) != DR_STATUS_ACCEPTED)
+        {
+            ok = 0;
+            break;
+        }
 
-        buffer += write_length;
-        offset += write_length;
-        length -= write_length;
+        raw_block_dirty[i] = 0;
+    }
 
-#if SD_RAW_WRITE_BUFFERING
-        raw_block_written = 1;
-#endif
+    if(count > 1)
+    {
+        /* send stop token, wait while card is busy */
+        sd_raw_send_byte(0xfd);
+        sd_raw_rec_byte();
+        while(sd_raw_rec_byte() != 0xff);
     }
+    sd_raw_rec_byte();
 
-    return 1;
+    /* deaddress card */
+    unselect_card();
+
+    return ok;
 }
 #endif
 
@@ -857,16 +1055,36 @@ uint8_t sd_raw_write_interval(offset_t offset, uint8_t* buffer, uintptr_t length
 uint8_t sd_raw_sync()
 {
 #if SD_RAW_WRITE_BUFFERING
-    if(raw_block_written)
-        return 1;
-    if(!sd_raw_write(raw_block_address, raw_block, sizeof(raw_block)))
-        return 0;
-    raw_block_written = 1;
+    for(uint8_t i = 0; i < SD_RAW_CACHE_BLOCKS; ++i)
+    {
+        if(raw_block_dirty[i] && !sd_raw_flush(i))
+            return 0;
+    }
 #endif
     return 1;
 }
 #endif
 
+/**
+ * \ingroup sd_raw
+ * Checks whether the card still responds.
+ *
+ * Unlike reading, this cannot be answered from the cache.
+ *
+ * \returns 0 if the card does not respond, 1 if it does.
+ */
+uint8_t sd_raw_ping()
+{
+    sd_raw_stop();
+
+    select_card();
+    uint8_t response = sd_raw_send_command(CMD_SEND_STATUS, 0);
+    sd_raw_rec_byte(); /* second byte of the R2 response */
+    unselect_card();
+
+    return response == 0;
+}
+
 #if 0
 /**
  * \ingroup sd_raw
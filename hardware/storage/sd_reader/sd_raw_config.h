@@ -64,9 +64,41 @@ extern "C"
  * Controls support for SDHC cards.
  *
  * Set to 1 to support so-called SDHC memory cards, i.e. SD
- * cards with more than 2 gigabytes of memory.
+ * cards with more than 2 gigabytes of memory. The card type
+ * is detected at runtime, but card offsets become 64 bits wide.
  */
+#ifdef SD_RAW_SDHC_SUPPORT
+#define SD_RAW_SDHC 1
+#else
 #define SD_RAW_SDHC 0
+#endif
+
+/**
+ * \ingroup sd_raw_config
+ * Controls multiple block transfers.
+ *
+ * Set to 1 to read consecutive blocks with a single multiple block
+ * read command and to write adjoining buffered blocks with a single
+ * multiple block write command, set to 0 to transfer every block on
+ * its own.
+ */
+#ifdef SD_RAW_MULTIBLOCK_SUPPORT
+#define SD_RAW_MULTIBLOCK 1
+#else
+#define SD_RAW_MULTIBLOCK 0
+#endif
+
+/**
+ * \ingroup sd_raw_config
+ * Number of blocks kept in the read and write cache.
+ *
+ * Each block takes 512 bytes of static RAM.
+ *
+ * \note This option has no effect when SD_RAW_SAVE_RAM is 1.
+ */
+#ifndef SD_RAW_CACHE_BLOCKS
+#define SD_RAW_CACHE_BLOCKS 1
+#endif
 
 /**
  * @}
@@ -94,6 +126,9 @@ extern "C"
 #undef SD_RAW_WRITE_BUFFERING
 #define SD_RAW_WRITE_BUFFERING 0
 #endif
+#if SD_RAW_CACHE_BLOCKS < 1
+#error "SD_RAW_CACHE_BLOCKS must be at least 1"
+#endif
 
 
 #ifdef DEBUG_SD_READER
@@ -51,6 +51,7 @@ vfs_sd_try_open_rootnode (void)
   }
 
   SDDEBUG ("SD-Card initialized and root node opened.\n");
+  vfs_invalidate ();		/* Maybe another card than before. */
   return 0;			/* Jippie, we're set. */
 }
 
@@ -61,7 +62,7 @@ vfs_sd_open_in (struct fat_dir_struct *parent, const char *filename)
 
   struct fat_dir_entry_struct filep;
   while (fat_read_dir (parent, &filep)) {
-    if (strcmp (filep.long_name, filename))
+    if (strcasecmp (filep.long_name, filename))
       continue;
 
     if (filep.attributes & FAT_ATTRIB_DIR)
@@ -69,9 +70,15 @@ vfs_sd_open_in (struct fat_dir_struct *parent, const char *filename)
 
     /* Got it :) */
     struct fat_file_struct *inode = fat_open_file (vfs_sd_fat, &filep);
+    if (inode == NULL)
+      return NULL;		/* All file handles in use. */
+
     struct vfs_file_handle_t *fh = malloc (sizeof (struct vfs_file_handle_t));
     if (fh == NULL)
-      return NULL;
+      {
+	fat_close_file (inode);
+	return NULL;
+      }
 
     fh->fh_type = VFS_SD;
     fh->u.sd = inode;
@@ -87,6 +94,8 @@ vfs_sd_close (struct vfs_file_handle_t *fh)
 {
   fat_close_file (fh->u.sd);
   free (fh);
+  fat_sync (vfs_sd_fat);
+  sd_raw_sync ();
 }
 
 vfs_size_t
@@ -202,7 +211,8 @@ vfs_sd_mkdir_recursive (const char *path)
 
   while (fat_read_dir (dir, &handle))
     {
-      if (strncmp (handle.long_name, path, l))
+      if (strlen (handle.long_name) != l
+	  || strncasecmp (handle.long_name, path, l))
 	continue;		/* Mismatch. */
 
       /* Found directory, recurse. */
@@ -251,6 +261,90 @@ vfs_sd_size (struct vfs_file_handle_t *fh)
   return fh->u.sd->dir_entry.file_size;
 }
 
+static uint32_t
+vfs_sd_entry_ident (struct fat_dir_entry_struct *de)
+{
+#if FAT_DATETIME_SUPPORT
+  return (((uint32_t) de->modification_date << 16)
+	  | de->modification_time) ^ de->file_size;
+#else
+  (void) de;
+  return 0;			/* Without timestamps we can't tell. */
+#endif
+}
+
+uint32_t
+vfs_sd_ident (struct vfs_file_handle_t *fh)
+{
+  return vfs_sd_entry_ident (&fh->u.sd->dir_entry);
+}
+
+uint32_t
+vfs_sd_mtime (struct vfs_file_handle_t *fh)
+{
+#if FAT_DATETIME_SUPPORT
+  struct fat_dir_entry_struct *de = &fh->u.sd->dir_entry;
+  return ((uint32_t) de->modification_date << 16) | de->modification_time;
+#else
+  (void) fh;
+  return 0;
+#endif
+}
+
+uint8_t
+vfs_sd_stat (const char *name, struct vfs_stat_t *st)
+{
+  struct fat_dir_entry_struct entry;
+
+  /* Only the directory entry is needed, no need to take one of the
+     few file handles. */
+  if (!vfs_sd_fat
+      || !fat_get_dir_entry_of_path (vfs_sd_fat, name, &entry)
+      || (entry.attributes & FAT_ATTRIB_DIR))
+    return 1;
+
+  st->size = entry.file_size;
+  st->ident = vfs_sd_entry_ident (&entry);
+  return 0;
+}
+
+uint8_t
+vfs_sd_readdir (const char *dir, uint16_t index, struct vfs_dirent_t *ent)
+{
+  if (!vfs_sd_rootnode)
+    return 1;
+
+  struct fat_dir_struct *dd = vfs_sd_rootnode;
+  if (*dir && (dd = vfs_sd_chdir (dir)) == NULL)
+    return 1;
+
+  fat_reset_dir (dd);
+
+  struct fat_dir_entry_struct entry;
+  uint8_t ret = 1;
+
+  while (fat_read_dir (dd, &entry)) {
+    if (strcmp (entry.long_name, ".") == 0
+	|| strcmp (entry.long_name, "..") == 0)
+      continue;
+
+    if (index --)
+      continue;
+
+    strncpy (ent->name, entry.long_name, VFS_NAME_LEN);
+    ent->name[VFS_NAME_LEN] = 0;
+    ent->size = entry.file_size;
+    ent->is_dir = (entry.attributes & FAT_ATTRIB_DIR) != 0;
+    ret = 0;
+    break;
+  }
+
+  if (dd != vfs_sd_rootnode)
+    fat_close_dir (dd);
+
+  return ret;
+}
+
 #ifdef SD_PING_READ
 uint8_t
 vfs_sd_ping (void)
@@ -260,11 +354,10 @@ vfs_sd_ping (void)
     return 1;
 
   uint8_t result = 0;
-  unsigned char buf[5];
 
+  /* Reading would be answered from the block cache, ask the card. */
   SDDEBUG ("performing sd_ping ...\n");
-  if (sd_raw_read (0, buf, 5) == 0) result = 1;
-  if (sd_raw_read (512, buf, 5) == 0) result = 1;
+  if (sd_raw_ping () == 0) result = 1;
 
   SDDEBUG ("ping result: %d\n", result);
   return result;
@@ -40,6 +40,11 @@ uint8_t vfs_sd_fseek (struct vfs_file_handle_t *, vfs_size_t offset,
 uint8_t vfs_sd_truncate (struct vfs_file_handle_t *, vfs_size_t length);
 struct vfs_file_handle_t *vfs_sd_create (const char *name);
 vfs_size_t vfs_sd_size (struct vfs_file_handle_t *);
+uint32_t vfs_sd_ident (struct vfs_file_handle_t *);
+uint32_t vfs_sd_mtime (struct vfs_file_handle_t *);
+uint8_t vfs_sd_stat (const char *name, struct vfs_stat_t *);
+uint8_t vfs_sd_readdir (const char *dir, uint16_t index,
+			struct vfs_dirent_t *);
 uint8_t vfs_sd_mkdir_recursive (const char *path);
 
 
@@ -53,6 +58,11 @@ uint8_t vfs_sd_mkdir_recursive (const char *path);
     vfs_sd_truncate,				\
     vfs_sd_create,				\
     vfs_sd_size,				\
+    vfs_sd_ident,				\
+    vfs_sd_stat,				\
+    vfs_sd_readdir,				\
+    NULL, /* pread */				\
+    vfs_sd_mtime,				\
   }
 
 struct fat_dir_struct *vfs_sd_rootnode;
@@ -39,6 +39,8 @@
 #include "protocols/uip/uip_zbus.h"
 #include "services/tftp/tftp.h"
 #include "hardware/ethernet/enc28j60.h"
+#include "protocols/uip/uip_router.h"
+#include "core/bit-macros.h"
 
 #ifdef BOOTLOADER_SUPPORT
 extern uint8_t bootload_delay;
@@ -79,19 +81,7 @@ network_init(void)
 #   ifdef ENC28J60_SUPPORT
     uip_stack_set_active(STACK_ENC);
 
-    /* use uip buffer as generic space here, since when this function is called,
-     * no network packets will be processed */
-
-#ifdef EEPROM_SUPPORT
-    /* use global network packet buffer for configuration */
-    uint8_t checksum = eeprom_get_chksum();
-    uint8_t saved_checksum;
-    eeprom_restore_char(crc, &saved_checksum);
-
-
-    if (checksum != saved_checksum)
-      eeprom_init();
-#endif
+    /* the eeprom config has been checked by eeprom_mount already */
 
 #ifdef ENC28J60_SUPPORT
     network_config_load();
@@ -125,7 +115,9 @@ network_init(void)
     ethersex_meta_netinit();
 
 #   ifdef ENC28J60_SUPPORT
+#   ifndef ARCH_HOST
     init_enc28j60();
+#   endif
 #   if UIP_CONF_IPV6
     uip_neighbor_init();
 #   else
@@ -135,6 +127,233 @@ network_init(void)
 
 }
 
+
+#ifdef ENC28J60_SUPPORT
+/* Dispatch the ethernet frame in uip_buf (uip_len bytes) to the arp
+   or ip layer.  Called by the ethernet drivers after receiving a frame. */
+void
+network_process_frame(void)
+{
+    /* Set the enc stack active */
+    uip_stack_set_active(STACK_ENC);
+
+    /* process packet */
+    struct uip_eth_hdr *packet = (struct uip_eth_hdr *)&uip_buf;
+    switch (HTONS(packet->type)) {
+
+#       if !UIP_CONF_IPV6
+        /* process arp packet */
+        case UIP_ETHTYPE_ARP:
+#           ifdef DEBUG_NET
+            debug_printf("net: arp packet received\n");
+#           endif
+            uip_arp_arpin();
+
+            /* if there is a packet to send, send it now */
+            if (uip_len > 0)
+                transmit_packet();
+
+            break;
+#       endif /* !UIP_CONF_IPV6 */
+
+#       if UIP_CONF_IPV6
+        /* process ip packet */
+        case UIP_ETHTYPE_IP6:
+#           ifdef DEBUG_NET
+            debug_printf ("net: ip6 packet received\n");
+#           endif
+#       else /* !UIP_CONF_IPV6 */
+        /* process ip packet */
+        case UIP_ETHTYPE_IP:
+#           ifdef DEBUG_NET
+            debug_printf ("net: ip packet received\n");
+#           endif
+            uip_arp_ipin();
+#       endif /* !UIP_CONF_IPV6 */
+
+            router_input(STACK_ENC);
+
+	    /* if there is a packet to send, send it now */
+	    if (uip_len > 0)
+		router_output();
+
+            break;
+#       ifdef DEBUG_UNKNOWN_PACKETS
+        default:
+            /* debug output */
+            debug_printf("net: unknown packet, %02x%02x%02x%02x%02x%02x "
+                         "-> %02x%02x%02x%02x%02x%02x, type 0x%02x%02x\n",
+                         packet->src.addr[0],
+                         packet->src.addr[1],
+                         packet->src.addr[2],
+                         packet->src.addr[3],
+                         packet->src.addr[4],
+                         packet->src.addr[5],
+                         packet->dest.addr[0],
+                         packet->dest.addr[1],
+                         packet->dest.addr[2],
+                         packet->dest.addr[3],
+                         packet->dest.addr[4],
+                         packet->dest.addr[5],
+                         HI8(ntohs(packet->type)),
+                         LO8(ntohs(packet->type)));
+            break;
+#       endif
+    }
+}
+
+
+/* Look at the headers of a received frame (the first len bytes of it are
+   in uip_buf) and decide whether the rest of it is worth reading.  Only
+   frames uip would drop anyway are refused, i.e. arp traffic for other
+   hosts, ip packets for other hosts and udp datagrams (especially
+   broadcasts) without a listening connection. */
+uint8_t
+network_frame_wanted(uint16_t len)
+{
+    struct uip_eth_hdr *packet = (struct uip_eth_hdr *)&uip_buf;
+
+    uip_stack_set_active(STACK_ENC);
+
+    switch (HTONS(packet->type)) {
+
+#       if !UIP_CONF_IPV6
+        case UIP_ETHTYPE_ARP:
+#           if defined(RFM12_ARP_PROXY) || defined(ZBUS_ARP_PROXY) \
+                || defined(USB_ARP_PROXY)
+            return 1;
+#           else
+            /* target ip address of the arp request or reply */
+            if (len < NET_PEEK_ARP_LENGTH)
+                return 0;
+            return uip_ipaddr_cmp(&uip_buf[NET_PEEK_ARP_LENGTH - 4],
+                                  uip_hostaddr);
+#           endif
+
+        case UIP_ETHTYPE_IP:
+#           ifndef IP_FORWARDING_SUPPORT
+            if (len < UIP_LLH_LEN + UIP_IPH_LEN)
+                return 0;
+
+            /* not configured yet, e.g. waiting for dhcp */
+            if (uip_ipaddr_cmp(uip_hostaddr, all_zeroes_addr))
+                return 1;
+
+            struct uip_udpip_hdr *ip =
+                (struct uip_udpip_hdr *)&uip_buf[UIP_LLH_LEN];
+
+#           if UIP_UDP
+            /* unfragmented udp without ip options, check the port */
+            if (ip->proto == UIP_PROTO_UDP && ip->vhl == 0x45
+                    && (ip->ipoffset[0] & 0x3f) == 0 && ip->ipoffset[1] == 0) {
+                if (len < UIP_LLH_LEN + UIP_IPUDPH_LEN)
+                    return 0;
+
+                uint8_t c;
+                for (c = 0; c < UIP_UDP_CONNS; c++)
+                    if (uip_udp_conns[c].lport == ip->destport)
+                        break;
+                if (c == UIP_UDP_CONNS)
+                    return 0;
+
+                /* multicast (224.0.0.0/4) to a bound port, e.g. mdns-sd
+                   listening on mdns_address */
+                if ((uip_ipaddr1(ip->destipaddr) & 0xf0) == 0xe0)
+                    return 1;
+
+#               if UIP_BROADCAST
+                if (uip_ipaddr_cmp(ip->destipaddr, all_ones_addr)
+                    || (ip->destipaddr[0] == (uip_hostaddr[0] | ~uip_netmask[0])
+                     && ip->destipaddr[1] == (uip_hostaddr[1] | ~uip_netmask[1])))
+                    return 1;
+#               endif
+            }
+#           endif /* UIP_UDP */
+
+#           ifdef ROUTER_SUPPORT
+            /* addressed to any of our stacks */
+            uint8_t wanted = router_find_stack(NULL) != 255;
+            uip_stack_set_active(STACK_ENC);
+            return wanted;
+#           else
+            return uip_ipaddr_cmp(ip->destipaddr, uip_hostaddr);
+#           endif
+#           endif /* !IP_FORWARDING_SUPPORT */
+
+#       else /* UIP_CONF_IPV6 */
+        case UIP_ETHTYPE_IP6:
+#       endif /* !UIP_CONF_IPV6 */
+            (void) len;
+            return 1;
+
+        default:
+#           ifdef DEBUG_UNKNOWN_PACKETS
+            return 1;
+#           else
+            return 0;
+#           endif
+    }
+}
+
+
+void
+network_config_load (void)
+{
+    /* load settings from eeprom */
+#ifdef EEPROM_SUPPORT
+  eeprom_restore(mac, uip_ethaddr.addr, 6);
+#else 
+  memcpy_P(uip_ethaddr.addr, PSTR(CONF_ETHERRAPE_MAC), 6);
+#endif
+
+#if defined(BOOTP_SUPPORT)				\
+    || (IPV6_SUPPORT && !defined(IPV6_STATIC_SUPPORT))
+    return;
+
+#else
+
+    uip_ipaddr_t ip;
+    (void) ip;		/* Keep GCC quiet. */
+
+    /* Configure the IP address. */
+#ifdef EEPROM_SUPPORT
+    /* Please Note: ip and &ip are NOT the same (cpp hell) */
+    eeprom_restore_ip(ip, &ip);
+#else
+    set_CONF_ETHERRAPE_IP(&ip);
+#endif
+    uip_sethostaddr(&ip);
+
+
+    /* Configure prefix length (IPv6). */
+#ifdef IPV6_SUPPORT
+    uip_setprefixlen(CONF_ENC_IP6_PREFIX_LEN);
+#endif
+
+
+#ifdef IPV4_SUPPORT
+    /* Configure the netmask (IPv4). */
+#ifdef EEPROM_SUPPORT
+    /* Please Note: ip and &ip are NOT the same (cpp hell) */
+    eeprom_restore_ip(netmask, &ip);
+#else
+    set_CONF_ETHERRAPE_IP4_NETMASK(&ip);
+#endif
+    uip_setnetmask(&ip);
+#endif  /* IPV4_SUPPORT */
+
+    /* Configure the default gateway  */
+#ifdef EEPROM_SUPPORT
+    /* Please Note: ip and &ip are NOT the same (cpp hell) */
+    eeprom_restore_ip(gateway, &ip);
+#else
+    set_CONF_ETHERRAPE_GATEWAY(&ip);
+#endif
+    uip_setdraddr(&ip);
+#endif	/* No autoconfiguration. */
+}
+#endif	/* ENC28J60_SUPPORT */
+
 /*
   -- Ethersex META --
   header(network.h)
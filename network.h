@@ -40,6 +40,21 @@ void network_process(void);
 /* send a packet placed in the global buffer */
 void transmit_packet(void);
 
+/* hand a received ethernet frame in the global buffer to uip */
+void network_process_frame(void);
+
+/* number of bytes the ethernet drivers read ahead to decide whether a
+   frame is wanted at all: ethernet + arp, or ethernet + ip + udp header */
+#define NET_PEEK_ARP_LENGTH 42
+#define NET_PEEK_LENGTH     (UIP_LLH_LEN + UIP_IPUDPH_LEN)
+
+/* check the first len bytes of a received frame in the global buffer,
+   returns zero if the frame can be dropped without reading the rest */
+uint8_t network_frame_wanted(uint16_t len);
+
+/* load mac and ip configuration of the ethernet stack */
+void network_config_load(void);
+
 static inline uint8_t enc28j60_txstart(void)
 {
   uint8_t retval;
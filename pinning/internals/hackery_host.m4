@@ -0,0 +1,5 @@
+#define _HOST
+
+/* Host (Linux) build, see core/host/.  There is no bootloader and no
+   hardware timer, the periodic tick comes from the monotonic clock. */
+#define BOOTLOADER_SECTION 0
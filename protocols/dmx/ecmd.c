@@ -24,6 +24,7 @@
 #include "config.h"
 #include "core/debug.h"
 #include "protocols/dmx/dmx.h"
+#include "protocols/ecmd/ecmd-base.h"
 
 
 int16_t
@@ -50,6 +51,32 @@ parse_cmd_dmx_set6chan(char *cmd, char *output, uint16_t len)
   return 0;
 }
 
+#ifdef ECMD_BINARY_SUPPORT
+/* args: start channel (two bytes) and the 6 values */
+int16_t
+parse_bin_dmx_set6chan(uint8_t *args, uint8_t argc, uint8_t *output,
+                       uint16_t len)
+{
+  (void) output;
+  (void) len;
+
+  if (argc != 2 + 6)
+    return ECMD_ERR_PARSE_ERROR;
+
+  uint16_t startchan = args[0] | (args[1] << 8);
+  if (startchan+6 > 512)
+    return ECMD_ERR_PARSE_ERROR;
+
+  if (dmx_txlen < startchan + 6)
+    dmx_txlen = startchan + 6;
+
+  dmx_prg = 0;
+  dmx_set_chan_x(startchan, 6, args + 2);
+  dmx_index = 0;
+  return ECMD_FINAL_OK;
+}
+#endif
+
 int16_t
 parse_cmd_dmx_fade(char *cmd, char *output, uint16_t len)
 {
@@ -63,5 +90,6 @@ parse_cmd_dmx_fade(char *cmd, char *output, uint16_t len)
   -- Ethersex META --
   block(DMX)
   ecmd_feature(dmx_set6chan, "dmx set6chan ")
+  ecmd_binary(dmx_set6chan)
   ecmd_feature(dmx_fade, "dmx fade")
 */
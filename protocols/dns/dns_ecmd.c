@@ -50,7 +50,7 @@ int16_t parse_cmd_dns_server(char *cmd, char *output, uint16_t len)
 	resolv_conf(&dnsaddr);
 
 	eeprom_save(dns_server, &dnsaddr, IPADDR_LEN);
-	eeprom_update_chksum();
+	eeprom_commit();
 	return ECMD_FINAL_OK;
     }
     else {
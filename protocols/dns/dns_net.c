@@ -47,4 +47,5 @@ void dns_net_main(void)
   -- Ethersex META --
   header(protocols/dns/resolv.h)
   net_init(resolv_init)
+  timer(50, resolv_expire())
 */
@@ -65,6 +65,7 @@
 
 #include "resolv.h"
 #include "protocols/uip/uip.h"
+#include "protocols/uip/uip_router.h"
 #include "dns_net.h"
 #include "core/debug.h"
 #include "core/eeprom.h"
@@ -77,7 +78,26 @@
 #endif /* NULL */
 
 /** \internal The maximum number of retries when asking for a name. */
-#define MAX_RETRIES 8
+#define MAX_RETRIES 5
+
+/** \internal Polls (of 200ms) to wait for the first answer, doubled
+    with every retry. */
+#define INITIAL_TIMEOUT 2
+
+/** \internal Seconds to keep an answer at least, even if its TTL is
+    shorter. */
+#define MIN_TTL 10
+
+/** \internal Seconds before expiry a looked up answer is refreshed in
+    the background, at most a quarter of its TTL. */
+#define REFRESH_TTL 30
+
+/** \internal Seconds to remember names that couldn't be resolved. */
+#ifdef CONF_DNS_NEGATIVE_TTL
+#define NEGATIVE_TTL CONF_DNS_NEGATIVE_TTL
+#else
+#define NEGATIVE_TTL 30
+#endif
 
 /** \internal The DNS message header. */
 struct dns_hdr {
@@ -123,6 +143,9 @@ struct namemap {
   u8_t retries;
   u8_t seqno;
   u8_t err;
+  u8_t id;        /* upper byte of the query id, the lower is the index */
+  u16_t ttl;      /* seconds the address (or error) is valid for */
+  u8_t refresh;   /* ttl below which a lookup asks again */
   char name[32];
   uip_ipaddr_t ipaddr;
   resolv_found_callback_t callback;
@@ -151,6 +174,8 @@ static struct namemap names[RESOLV_ENTRIES];
 
 static u8_t seqno;
 
+static u8_t queryid;
+
 static uip_udp_conn_t *resolv_conn = NULL;
 
 
@@ -184,9 +209,35 @@ parse_name(unsigned char *query)
   return query + 1;
 }
 /*---------------------------------------------------------------------------*/
+/** \internal
+ * Give up on a name.  If an earlier answer is still valid it is kept,
+ * otherwise the failure is remembered for NEGATIVE_TTL seconds.
+ */
+/*---------------------------------------------------------------------------*/
+static void
+resolv_failed(struct namemap *namemapptr)
+{
+  resolv_found_callback_t callback = namemapptr->callback;
+  namemapptr->callback = NULL;
+
+  if(namemapptr->ttl) {
+    /* refresh failed, keep using what we have */
+    namemapptr->state = STATE_DONE;
+    if (callback)
+      callback(namemapptr->name, (uip_ipaddr_t *)namemapptr->ipaddr);
+    return;
+  }
+
+  namemapptr->state = STATE_ERROR;
+  namemapptr->ttl = NEGATIVE_TTL;
+  if (callback)
+    callback(namemapptr->name, NULL);
+}
+/*---------------------------------------------------------------------------*/
 /** \internal
  * Runs through the list of names to see if there are any that have
- * not yet been queried and, if so, sends out a query.
+ * not yet been queried or whose answer is overdue and, if so, sends
+ * out a query.  Queries for several names are sent in one go.
  */
 /*---------------------------------------------------------------------------*/
 void
@@ -200,17 +251,22 @@ resolv_periodic(void)
 
   for(i = 0; i < RESOLV_ENTRIES; ++i) {
     namemapptr = &names[i];
+    if(namemapptr->state == STATE_ERROR && namemapptr->callback) {
+      /* Asked for a name we know doesn't resolve. */
+      resolv_found_callback_t callback = namemapptr->callback;
+      namemapptr->callback = NULL;
+      callback(namemapptr->name, NULL);
+      continue;
+    }
     if(namemapptr->state == STATE_NEW ||
        namemapptr->state == STATE_ASKING) {
       if(namemapptr->state == STATE_ASKING) {
 	if(--namemapptr->tmr == 0) {
 	  if(++namemapptr->retries == MAX_RETRIES) {
-	    namemapptr->state = STATE_ERROR;
-            if (namemapptr->callback)
-              namemapptr->callback(namemapptr->name, NULL);
+	    resolv_failed(namemapptr);
 	    continue;
 	  }
-	  namemapptr->tmr = namemapptr->retries;
+	  namemapptr->tmr = INITIAL_TIMEOUT << namemapptr->retries;
 	} else {
 	  /*	  printf("Timer %d\n", namemapptr->tmr);*/
 	  /* Its timer has not run out, so we move on to next
@@ -219,12 +275,13 @@ resolv_periodic(void)
 	}
       } else {
 	namemapptr->state = STATE_ASKING;
-	namemapptr->tmr = 1;
+	namemapptr->tmr = INITIAL_TIMEOUT;
 	namemapptr->retries = 0;
+	namemapptr->id = ++queryid;
       }
       hdr = (struct dns_hdr *)uip_appdata;
       memset(hdr, 0, sizeof(struct dns_hdr));
-      hdr->id = htons(i);
+      hdr->id = htons((namemapptr->id << 8) | i);
       hdr->flags1 = DNS_FLAG1_RD;
       hdr->flags2 = DNS_FLAG2_NON_AUTH_OK;
       hdr->numquestions = HTONS(1);
@@ -249,7 +306,11 @@ resolv_periodic(void)
 	memcpy_P(query, endquery, 5);
       }
       uip_udp_send((unsigned char)(query + 5 - (char *)uip_appdata));
-      break;
+
+      /* push it out, there may be more to ask for */
+      uip_process(UIP_UDP_SEND_CONN);
+      router_output();
+      uip_slen = 0;
     }
   }
 }
@@ -266,7 +327,9 @@ resolv_newdata(void)
   struct dns_hdr *hdr;
   static u8_t nquestions, nanswers;
   static u8_t i;
+  static u16_t ttl;
   register struct namemap *namemapptr;
+  resolv_found_callback_t callback;
 
   hdr = (struct dns_hdr *)uip_appdata;
   /*  printf("ID %d\n", htons(hdr->id));
@@ -279,22 +342,19 @@ resolv_newdata(void)
       htons(hdr->numextrarr));
   */
 
-  /* The ID in the DNS header should be our entry into the name
-     table. */
-  i = htons(hdr->id);
+  /* The lower byte of the ID in the DNS header should be our entry
+     into the name table, the upper one must match the query. */
+  i = htons(hdr->id) & 0xff;
   namemapptr = &names[i];
   if(i < RESOLV_ENTRIES &&
-     namemapptr->state == STATE_ASKING) {
+     namemapptr->state == STATE_ASKING &&
+     namemapptr->id == htons(hdr->id) >> 8) {
 
-    /* This entry is now finished. */
-    namemapptr->state = STATE_DONE;
     namemapptr->err = hdr->flags2 & DNS_FLAG2_ERR_MASK;
 
     /* Check for error. If so, call callback to inform. */
     if(namemapptr->err != 0 || hdr->numanswers == 0) {
-      namemapptr->state = STATE_ERROR;
-      if (namemapptr->callback)
-        namemapptr->callback(namemapptr->name, NULL);
+      resolv_failed(namemapptr);
       return;
     }
 
@@ -307,6 +367,7 @@ resolv_newdata(void)
        checked agains the name in the question, to be sure that they
        match. */
     nameptr = (char *)parse_name((unsigned char *)uip_appdata + 12) + 4;
+    ttl = 0xffff;
 
     while(nanswers > 0) {
       /* The first byte in the answer resource record determines if it
@@ -325,6 +386,11 @@ resolv_newdata(void)
 	     htons(ans->type), htons(ans->class), (htons(ans->ttl[0])
 	     << 16) | htons(ans->ttl[1]), htons(ans->len));*/
 
+      /* The address is valid as long as all records leading to it
+	 (i.e. CNAMEs) are. */
+      if(ans->ttl[0] == 0 && htons(ans->ttl[1]) < ttl)
+	ttl = htons(ans->ttl[1]);
+
       /* Check for IP address type and Internet class. Others are
 	 discarded. */
       if(ans->type == HTONS(DNS_RECORD_ADDR_TYPE) &&
@@ -346,22 +412,61 @@ resolv_newdata(void)
 	namemapptr->ipaddr[1] = ans->ipaddr[1];
 #endif /* !UIP_CONF_IPV6 */
 
-        if (namemapptr->callback)
-          namemapptr->callback(namemapptr->name, (uip_ipaddr_t *)namemapptr->ipaddr);
+	/* This entry is now finished. */
+	namemapptr->state = STATE_DONE;
+	namemapptr->ttl = ttl < MIN_TTL ? MIN_TTL : ttl;
+	namemapptr->refresh = namemapptr->ttl / 4 < REFRESH_TTL
+	  ? namemapptr->ttl / 4 : REFRESH_TTL;
+
+	callback = namemapptr->callback;
+	namemapptr->callback = NULL;
+        if (callback)
+          callback(namemapptr->name, (uip_ipaddr_t *)namemapptr->ipaddr);
 	return;
       } else {
 	nameptr = nameptr + 10 + htons(ans->len);
       }
       --nanswers;
     }
+
+    /* No address among the answers. */
+    resolv_failed(namemapptr);
   }
 
 }
 
+/*---------------------------------------------------------------------------*/
+/** \internal
+ * Find the entry of a name.
+ *
+ * \return The entry or NULL if the name isn't in the table.
+ */
+/*---------------------------------------------------------------------------*/
+static struct namemap *
+resolv_find(const char *name)
+{
+  static u8_t i;
+  struct namemap *nameptr;
+
+  for(i = 0; i < RESOLV_ENTRIES; ++i) {
+    nameptr = &names[i];
+    if(nameptr->state != STATE_UNUSED &&
+       strcmp(name, nameptr->name) == 0) {
+      return nameptr;
+    }
+  }
+  return NULL;
+}
 /*---------------------------------------------------------------------------*/
 /**
  * Queues a name so that a question for the name will be sent out.
  *
+ * If the name is already being asked for, the running query is used,
+ * unless another callback waits for it.  If it is known not to resolve,
+ * the callback is called on the next poll without asking again.  Names
+ * too long for the table are refused, the callback is called with NULL
+ * right away.
+ *
  * \param name The hostname that is to be queried.
  */
 /*---------------------------------------------------------------------------*/
@@ -370,17 +475,46 @@ resolv_query(const char *name, resolv_found_callback_t callback)
 {
   static u8_t i;
   static u8_t lseq, lseqi;
-  register struct namemap *nameptr = NULL;
+  struct namemap *pending;
+  register struct namemap *nameptr;
+
+  /* Don't ask for a truncated name, that would be a different host. */
+  if(strlen(name) >= sizeof(nameptr->name)) {
+    if(callback)
+      callback((char *)name, NULL);
+    return;
+  }
 
+  nameptr = resolv_find(name);
+  if(nameptr != NULL &&
+     (callback == NULL || nameptr->callback == NULL ||
+      nameptr->callback == callback)) {
+    if(callback)
+      nameptr->callback = callback;
+    if(nameptr->state == STATE_DONE)
+      nameptr->state = STATE_NEW;   /* refresh, keep the address meanwhile */
+    nameptr->seqno = seqno++;
+    return;
+  }
+
+  /* Someone else waits for the name, ask again in an entry of our own. */
+  pending = nameptr;
   lseq = lseqi = 0;
 
+  /* Take an unused entry, else the least recently used one, preferring
+     those no query is running for. */
   for(i = 0; i < RESOLV_ENTRIES; ++i) {
     nameptr = &names[i];
     if(nameptr->state == STATE_UNUSED) {
       break;
     }
-    if(seqno - nameptr->seqno > lseq) {
-      lseq = seqno - nameptr->seqno;
+    if(nameptr == pending)
+      continue;
+    u8_t age = seqno - nameptr->seqno;
+    if(nameptr->state == STATE_DONE || nameptr->state == STATE_ERROR)
+      age |= 0x80;
+    if(age > lseq) {
+      lseq = age;
       lseqi = i;
     }
   }
@@ -394,6 +528,7 @@ resolv_query(const char *name, resolv_found_callback_t callback)
 
   strcpy(nameptr->name, name);
   nameptr->state = STATE_NEW;
+  nameptr->ttl = 0;
   nameptr->seqno = seqno;
   nameptr->callback = callback;
   ++seqno;
@@ -405,7 +540,8 @@ resolv_query(const char *name, resolv_found_callback_t callback)
  * \note This function only looks in the internal array of known
  * hostnames, it does not send out a query for the hostname if none
  * was found. The function resolv_query() can be used to send a query
- * for a hostname.
+ * for a hostname.  Addresses about to expire are refreshed in the
+ * background though.
  *
  * \return A pointer to a 4-byte representation of the hostname's IP
  * address, or NULL if the hostname was not found in the array of
@@ -414,20 +550,39 @@ resolv_query(const char *name, resolv_found_callback_t callback)
 /*---------------------------------------------------------------------------*/
 uip_ipaddr_t *
 resolv_lookup(const char *name)
+{
+  struct namemap *nameptr = resolv_find(name);
+
+  /* A query may be running to refresh a still valid address. */
+  if(nameptr == NULL || nameptr->state == STATE_ERROR || nameptr->ttl == 0)
+    return NULL;
+
+  if(nameptr->state == STATE_DONE && nameptr->ttl <= nameptr->refresh)
+    nameptr->state = STATE_NEW;
+
+  nameptr->seqno = seqno++;
+  return (uip_ipaddr_t *)nameptr->ipaddr;
+}
+/*---------------------------------------------------------------------------*/
+/**
+ * Age the known hostnames, called once a second.
+ */
+/*---------------------------------------------------------------------------*/
+void
+resolv_expire(void)
 {
   static u8_t i;
   struct namemap *nameptr;
 
-  /* Walk through the list to see if the name is in there. If it is
-     not, we return NULL. */
   for(i = 0; i < RESOLV_ENTRIES; ++i) {
     nameptr = &names[i];
-    if(nameptr->state == STATE_DONE &&
-       strcmp(name, nameptr->name) == 0) {
-      return (uip_ipaddr_t *)nameptr->ipaddr;
+    if(nameptr->ttl == 0 || --nameptr->ttl)
+      continue;
+    if(nameptr->state == STATE_DONE || nameptr->state == STATE_ERROR) {
+      nameptr->state = STATE_UNUSED;
+      nameptr->callback = NULL;
     }
   }
-  return NULL;
 }
 /*---------------------------------------------------------------------------*/
 /**
@@ -478,7 +633,8 @@ resolv_init(void)
   resolv_conf(&dnsserver);
 
   for(i = 0; i < RESOLV_ENTRIES; ++i) {
-    names[i].state = STATE_DONE;
+    names[i].state = STATE_UNUSED;
+    names[i].ttl = 0;
   }
 
 }
@@ -68,6 +68,7 @@ uip_ipaddr_t *resolv_getserver(void);
 void resolv_init(void);
 uip_ipaddr_t *resolv_lookup(const char *name);
 void resolv_query(const char *name, resolv_found_callback_t callback);
+void resolv_expire(void);
 
 #endif /* __RESOLV_H__ */
 
@@ -1,7 +1,7 @@
 dnl This m4 script uses quite a few divert levels, these are essentially:
 dnl   1: function prototypes
 dnl   2: char array in program space
-dnl   3: the function list
+dnl   3: the function list, sorted by command name (see _ecmd_table)
 dnl   4: function list trailer
 dnl   5: (optional) function implementations 
 dnl
@@ -45,41 +45,118 @@ divert(2)dnl
 /* Char array definitions follow */
 divert(3)dnl
 
-/* Definition of function pointer array follows */
+/* Definition of function pointer array follows, sorted by name */
 const struct ecmd_command_t PROGMEM ecmd_cmds[] = {
 divert(-1)dnl
 
+dnl ecmd_parse_command does a binary search on ecmd_cmds[], therefore the
+dnl entries are not written out as they come.  Each one is remembered
+dnl together with the condition of the ecmd_ifdef blocks around it and
+dnl put into _ecmd_at_0 ... _ecmd_at_<_ecmd_count - 1> in order of the
+dnl names.  Once all input is read, _ecmd_table writes every entry with
+dnl its own #if, the order stays intact whatever the preprocessor drops.
+dnl Entries with the same name go in front of each other, the parser picks
+dnl the last one (i.e. the one declared first).
+
+define(`_ecmd_count', 0)
+define(`_ecmd_serial', 0)
+define(`_ecmd_cond', `')
+
+dnl Characters allowed in command names in byte order, the closing quote
+dnl of the C string stands for the terminating NUL.
+define(`_ecmd_chars',
+  `" !$%&*+-./0123456789:;<=>?@ABCDEFGHIJKLMNOPQRSTUVWXYZ[\]^_abcdefghijklmnopqrstuvwxyz{|}~')
+
+dnl _ecmd_ord(N, POS): order of the character at POS in the name of entry N
+define(`_ecmd_ord', `index(defn(`_ecmd_chars'),
+  substr(defn(`_ecmd_key_$1'), `$2', 1))')
+
+dnl _ecmd_less(N, M): 1 if the name of entry N sorts before the one of M
+define(`_ecmd_less', `_ecmd_less_at(`$1', `$2', 1)')
+define(`_ecmd_less_at', `_ecmd_less_ord(`$1', `$2', `$3',
+  _ecmd_ord(`$1', `$3'), _ecmd_ord(`$2', `$3'))')
+define(`_ecmd_less_ord', `ifelse(`$4', `$5', `ifelse(`$4', `0', `0',
+  `_ecmd_less_at(`$1', `$2', incr(`$3'))')', `eval(`$4 < $5')')')
+
+dnl _ecmd_search(N, LO, HI): first position in LO ... HI whose entry
+dnl doesn't sort before entry N
+define(`_ecmd_search', `ifelse(`$2', `$3', `$2',
+  `_ecmd_search_mid(`$1', `$2', `$3', eval(`($2 + $3) / 2'))')')
+define(`_ecmd_search_mid', `ifelse(_ecmd_less(defn(`_ecmd_at_$4'), `$1'), 1,
+  `_ecmd_search(`$1', incr(`$4'), `$3')',
+  `_ecmd_search(`$1', `$2', `$4')')')
+
+dnl _ecmd_insert(N): move the entries from the position of entry N on up
+dnl by one and put it there
+define(`_ecmd_insert', `_ecmd_place(`$1', _ecmd_search(`$1', 0, _ecmd_count))')
+define(`_ecmd_place', `_ecmd_shift(_ecmd_count, `$2')dnl
+define(`_ecmd_at_$2', `$1')define(`_ecmd_count', incr(_ecmd_count))')
+define(`_ecmd_shift', `ifelse(`$1', `$2', `',
+  `define(`_ecmd_at_$1', defn(`_ecmd_at_'decr(`$1')))_ecmd_shift(decr(`$1'), `$2')')')
+
+dnl _ecmd_and(A, B): C expression for A && B, either may be empty
+define(`_ecmd_and', `ifelse(`$1', `', ``$2'', `$2', `', ``$1'', ``$1 && $2'')')
+
 define(`ecmd_feature', `dnl
 divert(1)int16_t parse_cmd_$1 (char *cmd, char *output, uint16_t len);
 divert(2)const char PROGMEM ecmd_$1_text[] = $2;
-divert(3)	{ ecmd_$1_text, parse_cmd_$1 },
-divert(-1)')
+divert(-1)define(`_ecmd_serial', incr(_ecmd_serial))dnl
+define(`_ecmd_func_'_ecmd_serial, `$1')dnl
+define(`_ecmd_key_'_ecmd_serial, `$2')dnl
+define(`_ecmd_cond_'_ecmd_serial, defn(`_ecmd_cond'))dnl
+define(`_ecmd_bin_'_ecmd_serial, `NULL')dnl
+_ecmd_insert(_ecmd_serial)')
+
+dnl ecmd_binary(FUNC): parse_bin_FUNC handles binary requests for the
+dnl command declared last
+define(`ecmd_binary', `dnl
+divert(1)int16_t parse_bin_$1 (uint8_t *args, uint8_t argc, uint8_t *output, uint16_t len);
+divert(-1)define(`_ecmd_bin_'_ecmd_serial, `parse_bin_$1')')
+
+dnl _ecmd_push(TEST, ELSE-TEST): enter a conditional block
+define(`_ecmd_push', `dnl
+pushdef(`_ecmd_parent', defn(`_ecmd_cond'))dnl
+pushdef(`_ecmd_else_test', `$2')dnl
+pushdef(`_ecmd_cond', _ecmd_and(defn(`_ecmd_parent'), `$1'))')
 
 define(`ecmd_ifdef', `dnl
 divert(1)#ifdef $1
 divert(2)#ifdef $1
-divert(3)#ifdef $1
-divert(-1)')
+divert(-1)_ecmd_push(`defined($1)', `!defined($1)')')
 
 define(`ecmd_ifndef', `dnl
 divert(1)#ifndef $1
 divert(2)#ifndef $1
-divert(3)#ifndef $1
-divert(-1)')
+divert(-1)_ecmd_push(`!defined($1)', `defined($1)')')
 
 define(`ecmd_else', `dnl
 divert(1)#else
 divert(2)#else
-divert(3)#else
-divert(-1)')
+divert(-1)define(`_ecmd_cond',
+  _ecmd_and(defn(`_ecmd_parent'), defn(`_ecmd_else_test')))')
 
 define(`ecmd_endif', `divert(1)#endif
 divert(2)#endif
-divert(3)#endif
+divert(-1)popdef(`_ecmd_cond')popdef(`_ecmd_else_test')popdef(`_ecmd_parent')')
+
+dnl _ecmd_table(POS): write the entries from position POS on
+define(`_ecmd_table', `ifelse(`$1', _ecmd_count, `',
+  `_ecmd_entry(defn(`_ecmd_at_$1'))_ecmd_table(incr(`$1'))')')
+define(`_ecmd_entry', `divert(3)dnl
+ifelse(defn(`_ecmd_cond_$1'), `', `', `#if 'defn(`_ecmd_cond_$1')
+)dnl
+	{ ecmd_`'defn(`_ecmd_func_$1')`'_text, parse_cmd_`'defn(`_ecmd_func_$1'),
+	  ECMD_BINARY(defn(`_ecmd_bin_$1')) },
+ifelse(defn(`_ecmd_cond_$1'), `', `', `#endif
+')dnl
 divert(-1)')
+m4wrap(`_ecmd_table(0)')
 
 divert(4)dnl
-        { NULL, NULL }
+        { NULL, NULL, ECMD_BINARY(NULL) }
 };
+
+const uint8_t PROGMEM ecmd_cmds_count =
+  sizeof (ecmd_cmds) / sizeof (ecmd_cmds[0]) - 1;
 divert(-1)dnl
 dnl yippie, we're done!
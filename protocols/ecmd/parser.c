@@ -40,6 +40,62 @@
 #define xstr(s) str(s)
 #define str(s) #s
 
+/* Compare the first n characters of cmd to name, like strcmp. */
+static int8_t
+ecmd_compare(const char *cmd, PGM_P name, uint8_t n)
+{
+    int ret = strncmp_P(cmd, name, n);
+    if (ret == 0 && pgm_read_byte(name + n))
+        return -1;		/* name goes on, cmd is a prefix of it */
+    return ret < 0 ? -1 : ret > 0;
+}
+
+/* Find the command with the longest name cmd starts with.
+ *
+ * Such a name sorts before cmd and after every shorter one, so it is
+ * the last entry not after cmd if that is a prefix of cmd at all.  If
+ * it isn't, the name we are looking for can't be longer than what the
+ * entry has in common with cmd, so search again for just that part. */
+static const struct ecmd_command_t *
+ecmd_lookup(const char *cmd)
+{
+    uint8_t n = strnlen(cmd, 255);
+
+    while (n) {
+        uint8_t lo = 0, hi = pgm_read_byte(&ecmd_cmds_count);
+
+        /* find the first entry after the first n characters of cmd */
+        while (lo < hi) {
+            uint8_t mid = (lo + hi) / 2;
+            if (ecmd_compare(cmd, (PGM_P)pgm_read_word(&ecmd_cmds[mid].name),
+                             n) < 0)
+                hi = mid;
+            else
+                lo = mid + 1;
+        }
+
+        if (lo == 0)
+            break;		/* everything sorts after cmd */
+
+        PGM_P name = (PGM_P)pgm_read_word(&ecmd_cmds[lo - 1].name);
+
+#ifdef DEBUG_ECMD
+        debug_printf("closest match: \"%S\"\n", name);
+#endif
+
+        uint8_t i = 0;
+        while (i < n && cmd[i] == pgm_read_byte(name + i))
+            i ++;
+
+        if (pgm_read_byte(name + i) == 0)
+            return &ecmd_cmds[lo - 1];	/* name is a prefix of cmd */
+
+        n = i;
+    }
+
+    return NULL;
+}
+
 int16_t ecmd_parse_command(char *cmd, char *output, uint16_t len)
 {
 
@@ -74,37 +130,12 @@ int16_t ecmd_parse_command(char *cmd, char *output, uint16_t len)
 
     int ret = -1;
 
-    char *text = NULL;
     int16_t (*func)(char*, char*, uint16_t) = NULL;
-    uint8_t pos = 0;
-
-    while (1) {
-        /* load pointer to text */
-        text = (char *)pgm_read_word(&ecmd_cmds[pos].name);
-
-#ifdef DEBUG_ECMD
-        debug_printf("loaded text addres %p: \n", text);
-#endif
-
-        /* return if we reached the end of the array */
-        if (text == NULL)
-            break;
-
-#ifdef DEBUG_ECMD
-        debug_printf("text is: \"%S\"\n", text);
-#endif
-
-        /* else compare texts */
-        if (memcmp_P(cmd, text, strlen_P(text)) == 0) {
-#ifdef DEBUG_ECMD
-            debug_printf("found match\n");
-#endif
-            cmd += strlen_P(text);
-            func = (void *)pgm_read_word(&ecmd_cmds[pos].func);
-            break;
-        }
+    const struct ecmd_command_t *c = ecmd_lookup(cmd);
 
-        pos++;
+    if (c != NULL) {
+        cmd += strlen_P((PGM_P)pgm_read_word(&c->name));
+        func = (void *)pgm_read_word(&c->func);
     }
 
 #ifdef DEBUG_ECMD
@@ -129,6 +160,87 @@ int16_t ecmd_parse_command(char *cmd, char *output, uint16_t len)
     return ret;
 }
 
+#ifdef ECMD_BINARY_SUPPORT
+/* Find the command called exactly name, ECMD_BINARY_RESOLVE if none. */
+static uint8_t
+ecmd_resolve(const char *name)
+{
+    uint8_t n = strnlen(name, 255);
+    uint8_t lo = 0, hi = pgm_read_byte(&ecmd_cmds_count);
+
+    while (lo < hi) {
+        uint8_t mid = (lo + hi) / 2;
+        if (ecmd_compare(name, (PGM_P)pgm_read_word(&ecmd_cmds[mid].name),
+                         n) < 0)
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+
+    if (lo && ecmd_compare(name, (PGM_P)pgm_read_word(&ecmd_cmds[lo - 1].name),
+                           n) == 0)
+        return lo - 1;
+
+    return ECMD_BINARY_RESOLVE;
+}
+
+int16_t ecmd_parse_binary(char *cmd, char *output, uint16_t len)
+{
+    uint8_t opcode = cmd[1];
+    uint8_t *args = (uint8_t *) cmd + ECMD_BINARY_HEADER;
+    uint8_t *data = (uint8_t *) output + ECMD_BINARY_RESPONSE;
+    int16_t ret = ECMD_ERR_PARSE_ERROR;
+
+    len -= ECMD_BINARY_RESPONSE;
+    if (len > 255)
+        len = 255;
+
+#ifdef DEBUG_ECMD
+    debug_printf("called ecmd_parse_binary %d\n", opcode);
+#endif
+
+    if (opcode == ECMD_BINARY_RESOLVE) {
+        uint8_t i = ecmd_resolve((char *) args);
+        if (i != ECMD_BINARY_RESOLVE) {
+            data[0] = i;
+            data[1] = pgm_read_word(&ecmd_cmds[i].binary) != 0;
+            ret = 2;
+        }
+    }
+    else if (opcode < pgm_read_byte(&ecmd_cmds_count)) {
+        int16_t (*binary)(uint8_t*, uint8_t, uint8_t*, uint16_t) =
+            (void *)pgm_read_word(&ecmd_cmds[opcode].binary);
+
+        if (binary)
+            ret = binary(args, cmd[2], data, len);
+        else {
+            /* no binary handler, arguments and output are text */
+            int16_t (*func)(char*, char*, uint16_t) =
+                (void *)pgm_read_word(&ecmd_cmds[opcode].func);
+            ret = func((char *) args, (char *) data, len);
+        }
+    }
+
+    uint8_t status = ECMD_BINARY_OK;
+    if (is_ECMD_AGAIN(ret)) {
+        status = ECMD_BINARY_AGAIN;
+        ret = ECMD_AGAIN(ret);
+    }
+    else if (is_ECMD_ERR(ret)) {
+        status = ECMD_BINARY_ERROR | -ret;
+        ret = 0;
+    }
+
+    output[0] = ECMD_BINARY_MARK;
+    output[1] = opcode;
+    output[2] = status;
+    output[3] = ret;
+    ret += ECMD_BINARY_RESPONSE;
+
+    return status == ECMD_BINARY_AGAIN ? ECMD_AGAIN(ret) : ECMD_FINAL(ret);
+}
+#endif /* ECMD_BINARY_SUPPORT */
+
 #ifndef DISABLE_REBOOT_SUPPORT
 int16_t parse_cmd_bootloader(char *cmd, char *output, uint16_t len)
 {
@@ -230,11 +342,11 @@ int16_t parse_cmd_d(char *cmd, char *output, uint16_t len)
 
     while (*cmd == ' ') cmd ++;
 
-    uint16_t temp;
+    unsigned int temp;
     if (sscanf_P (cmd, PSTR("%x"), &temp) != 1)
       return ECMD_ERR_PARSE_ERROR;
 
-    unsigned char *ptr = (void *) temp;
+    unsigned char *ptr = (void *) (uintptr_t) temp;
     for (int i = 0; i < 16; i ++)
       sprintf_P (output + (i << 1), PSTR("%02x"), * (ptr ++));
 
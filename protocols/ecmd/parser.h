@@ -30,13 +30,48 @@
  *        output bytes: ECMD_AGAIN(ret) */
 int16_t ecmd_parse_command(char *cmd, char *output, uint16_t len);
 
+#ifdef ECMD_BINARY_SUPPORT
+/* Binary requests start with ECMD_BINARY_MARK, which no text command
+ * does, and carry the command as index into ecmd_cmds[]:
+ *
+ *   request:  ECMD_BINARY_MARK, opcode, argc, args[argc]
+ *   response: ECMD_BINARY_MARK, opcode, status, len, data[len]
+ *
+ * ECMD_BINARY_RESOLVE takes a command name as argument and responds
+ * with its opcode and a byte that is 1 if the command has a binary
+ * handler.  Other commands get the arguments as text and respond with
+ * the text output.  Values wider than a byte are little endian. */
+#define ECMD_BINARY_MARK	0xfe
+#define ECMD_BINARY_RESOLVE	0xff
+#define ECMD_BINARY_HEADER	3
+#define ECMD_BINARY_RESPONSE	4
+
+#define ECMD_BINARY_OK		0x00	/* last response to a request */
+#define ECMD_BINARY_AGAIN	0x01	/* more responses follow */
+#define ECMD_BINARY_ERROR	0x80	/* or'ed with -ECMD_ERR_..., no data */
+
+/* The request at cmd must be followed by three bytes that are zero on
+ * the first call (see parse_cmd_help).  Returns the length of the
+ * response, ECMD_AGAIN(length) if there are more responses to come. */
+int16_t ecmd_parse_binary(char *cmd, char *output, uint16_t len);
+
+#define ECMD_BINARY(func)	func
+#else
+#define ECMD_BINARY(func)
+#endif
+
 /* struct for storing commands */
 struct ecmd_command_t {
     PGM_P name;
     int16_t (*func)(char*, char*, uint16_t);
+#ifdef ECMD_BINARY_SUPPORT
+    int16_t (*binary)(uint8_t*, uint8_t, uint8_t*, uint16_t);
+#endif
 };
 
-/* automatically generated via meta system */
+/* automatically generated via meta system, sorted by name and
+ * terminated by a NULL entry that ecmd_cmds_count doesn't count */
 extern const struct ecmd_command_t PROGMEM ecmd_cmds[];
+extern const uint8_t PROGMEM ecmd_cmds_count;
 
 #endif /* _ECMD_PARSER_H */
@@ -39,8 +39,7 @@
 int16_t 
 vfs_fgets(struct vfs_file_handle_t *handle, char *line, vfs_size_t pos){
     uint8_t i = 0;
-    vfs_fseek(handle, pos, SEEK_SET);
-    vfs_size_t readlen = vfs_read(handle, line, ECMD_INPUTBUF_LENGTH - 1);
+    vfs_size_t readlen = vfs_pread(handle, line, pos, ECMD_INPUTBUF_LENGTH - 1);
 
     line[ECMD_INPUTBUF_LENGTH - 1] = 0;
     SCRIPTDEBUG("fgets (%i) : %s\n", readlen, line);
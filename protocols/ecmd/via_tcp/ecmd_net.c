@@ -34,186 +34,275 @@
 
 #define BUF ((struct uip_udpip_hdr *) (uip_appdata - UIP_IPUDPH_LEN))
 
-/* module local prototypes */
-void newdata(void);
+/* Commands may keep their state right behind the command line across
+ * ECMD_AGAIN calls (see parse_cmd_help), so the terminating zero is
+ * followed by two more bytes of the input buffer that stay ours. */
+#define ECMD_NET_SCRATCH 3
+
+/* input we accept at most, the rest stays with the client */
+#define ECMD_NET_INPUT (ECMD_TCP_BUFFER_LEN - ECMD_NET_SCRATCH)
+
+#if ECMD_TCP_BUFFER_LEN < ECMD_OUTPUTBUF_LENGTH || ECMD_TCP_BUFFER_LEN > 255
+#  error "ECMD_TCP_BUFFER_LEN must be between 50 and 255"
+#endif
 
 void ecmd_net_init()
 {
   /* Without teensy support we use tcp */
     uip_listen(HTONS(ECMD_TCP_PORT), ecmd_net_main);
+    uip_listen_window(HTONS(ECMD_TCP_PORT), ECMD_NET_INPUT);
 }
 
-void newdata(void)
+static void
+ecmd_net_receive(struct ecmd_connection_state_t *state)
 {
-    struct ecmd_connection_state_t *state = &uip_conn->appstate.ecmd;
-
-    uint16_t diff = ECMD_INPUTBUF_LENGTH - state->in_len;
-    if (diff > 0) {
-        int cplen;
-
-        if (uip_datalen() <= diff)
-            cplen = uip_datalen();
-        else
-            cplen = diff;
-
-        memcpy(state->inbuf + state->in_len, uip_appdata, cplen);
-        state->in_len += cplen;
+    char *data = uip_appdata;
+    uint16_t len = uip_datalen();
+
+    if (state->overlong) {
+        /* drop the rest of a line that didn't fit */
+        char *lf = memchr(data, '\n', len);
+        if (lf == NULL)
+            return;
+
+        state->overlong = 0;
+        len -= lf + 1 - data;
+        data = lf + 1;
+    }
 
+    uint16_t cplen = ECMD_NET_INPUT - state->in_len;
+    if (len > cplen) {
+        /* The client sent more than our window, hand back the rest. */
 #ifdef DEBUG_ECMD_NET
-        debug_printf("copied %d bytes\n", cplen);
+        debug_printf("buffer full, holding back %d bytes\n", len - cplen);
 #endif
-    } else {
+        uip_unread(len - cplen);
+        uip_stop();
+        len = cplen;
+    }
+
+    memcpy(state->inbuf + state->in_len, data, len);
+    state->in_len += len;
+
 #ifdef DEBUG_ECMD_NET
-        debug_printf("buffer full\n");
+    debug_printf("copied %d bytes\n", len);
 #endif
-    }
+}
 
-    char *lf = memchr(state->inbuf, '\n', state->in_len);
+/* Make the next complete line the running command, return 0 if there
+ * is none yet. */
+static uint8_t
+ecmd_net_next_line(struct ecmd_connection_state_t *state)
+{
+    char *lf;
+    uint8_t len, next;
+
+#ifdef ECMD_BINARY_SUPPORT
+    if ((uint8_t) state->inbuf[0] == ECMD_BINARY_MARK) {
+        /* binary request, its header tells the length */
+        if (state->in_len < ECMD_BINARY_HEADER)
+            return 0;
+
+        uint16_t frame = ECMD_BINARY_HEADER + (uint8_t) state->inbuf[2];
+        if (frame > ECMD_NET_INPUT) {
+            /* we can't ever take it, there is no way to resync */
+            state->in_len = 0;
+            uip_abort();
+            return 0;
+        }
+        if (state->in_len < frame)
+            return 0;
 
-    if (lf != NULL ||
-        memchr(uip_appdata, '\n', uip_datalen()) != NULL) {
+        len = next = frame;
+        goto found;
+    }
+#endif
 
-#ifdef DEBUG_ECMD_NET
-        debug_printf("calling parser\n");
+    lf = memchr(state->inbuf, '\n', state->in_len);
+    if (lf != NULL) {
+        len = lf - state->inbuf;
+        next = len + 1;
+    } else if (state->in_len == ECMD_NET_INPUT) {
+        /* line too long, parse what we have and drop the rest */
+        len = next = state->in_len;
+        state->overlong = 1;
+    } else
+        return 0;
+
+#ifdef ECMD_BINARY_SUPPORT
+  found:
+#endif
+    /* move the following lines behind the scratch bytes */
+    memmove(state->inbuf + len + ECMD_NET_SCRATCH, state->inbuf + next,
+            state->in_len - next);
+    memset(state->inbuf + len, 0, ECMD_NET_SCRATCH);
+    state->in_len += len + ECMD_NET_SCRATCH - next;
+    state->cmd_len = len + ECMD_NET_SCRATCH;
+
+#ifdef ECMD_BINARY_SUPPORT
+    if ((uint8_t) state->inbuf[0] == ECMD_BINARY_MARK)
+        return 1;
 #endif
 
-        if (lf)
-            *lf = '\0';
-        else
-            state->inbuf[ECMD_INPUTBUF_LENGTH-1] = '\0';
+    /* kill \r */
+    while (len--)
+        if (state->inbuf[len] == '\r')
+            state->inbuf[len] = '\0';
+
+    return 1;
+}
+
+/* Run the received lines one after another, as long as there is room for
+ * their output.  Several responses go into one segment this way. */
+static void
+ecmd_net_process(struct ecmd_connection_state_t *state)
+{
+    while (ECMD_TCP_BUFFER_LEN - state->out_len >= ECMD_OUTPUTBUF_LENGTH) {
+        if (!state->parse_again) {
+            if (state->close_requested) {
+                /* ignore everything after the last command */
+                state->in_len = 0;
+                break;
+            }
 
-        /* kill \r */
-        int l;
-        for (l = 0; l < ECMD_INPUTBUF_LENGTH; l++)
-          if (state->inbuf[l] == '\r')
-            state->inbuf[l] = '\0';
+            if (!ecmd_net_next_line(state))
+                break;
+        }
+
+#ifdef ECMD_BINARY_SUPPORT
+        if ((uint8_t) state->inbuf[0] == ECMD_BINARY_MARK) {
+            int16_t l = ecmd_parse_binary(state->inbuf,
+                                          state->outbuf + state->out_len,
+                                          ECMD_OUTPUTBUF_LENGTH);
+            state->parse_again = is_ECMD_AGAIN(l);
+            if (state->parse_again) {
+                if (state->outbuf[state->out_len + 3] == 0)
+                    break;      /* nothing yet, try again on next poll */
+                state->out_len += ECMD_AGAIN(l);
+                continue;
+            }
+
+            state->out_len += l;
+            goto done;
+        }
+#endif
 
         /* if the first character is ! close the connection after the last
          * byte is sent
          */
         uint8_t skip = 0;
         if (state->inbuf[0] == '!') {
-          skip = 1;
-          state->close_requested = 1;
+            skip = 1;
+            state->close_requested = 1;
         }
 
+#ifdef DEBUG_ECMD_NET
+        debug_printf("calling parser\n");
+#endif
 
-        /* parse command and write output to state->outbuf, reserving at least
-         * one byte for the terminating \n */
-        l = ecmd_parse_command(state->inbuf + skip,
-                                    state->outbuf,
-                                    ECMD_OUTPUTBUF_LENGTH-1);
+        /* parse command and write output behind the pending responses,
+         * reserving at least one byte for the terminating \n */
+        int16_t l = ecmd_parse_command(state->inbuf + skip,
+                                       state->outbuf + state->out_len,
+                                       ECMD_OUTPUTBUF_LENGTH - 1);
 
 #ifdef DEBUG_ECMD_NET
         debug_printf("parser returned %d\n", l);
 #endif
 
         /* check if the parse has to be called again */
-        if (is_ECMD_AGAIN(l)) {
-#ifdef DEBUG_ECMD_NET
-            debug_printf("parser needs to be called again\n");
-#endif
-
-            state->parse_again = 1;
+        state->parse_again = is_ECMD_AGAIN(l);
+        if (state->parse_again)
             l = ECMD_AGAIN(l);
+
+        if (l > 0) {
+            state->outbuf[state->out_len + l] = '\n';
+            state->out_len += l + 1;
         }
 
-#ifdef DEBUG_ECMD_NET
-        debug_printf("parser really returned %d\n", l);
+        if (state->parse_again) {
+            if (l <= 0)
+                break;          /* nothing yet, try again on next poll */
+            continue;
+        }
+
+#ifdef ECMD_BINARY_SUPPORT
+      done:
 #endif
+        /* command done, drop it */
+        state->in_len -= state->cmd_len;
+        memmove(state->inbuf, state->inbuf + state->cmd_len, state->in_len);
+        state->cmd_len = 0;
+    }
+}
 
-        if (l > 0) {
-            state->outbuf[l++] = '\n';
-            state->out_len = l;
-        }
+static void
+ecmd_net_send(struct ecmd_connection_state_t *state)
+{
+    /* Windowed connections send after the data in flight, all others
+       (and retransmissions) start at the first unacknowledged byte. */
+    if (uip_rexmit() || !uip_windowed(uip_conn)) {
+        if (uip_outstanding(uip_conn) && !uip_rexmit())
+            return;             /* wait for the acknowledgement */
+        state->out_sent = 0;
+    }
 
-        if (!state->parse_again) {
+    uint16_t len = state->out_len - state->out_sent;
+    if (len > uip_mss())
+        len = uip_mss();
+
+    if (len > 0) {
 #ifdef DEBUG_ECMD_NET
-            debug_printf("clearing buffer\n");
+        debug_printf("sending %d bytes\n", len);
 #endif
-            memset(state->inbuf, 0, ECMD_INPUTBUF_LENGTH);
-            state->in_len = 0;
-        }
-    }
+        uip_send(state->outbuf + state->out_sent, len);
+        state->out_sent += len;
+    } else if (state->out_len == 0 && state->close_requested
+               && !state->parse_again)
+        uip_close();
 }
 
 void ecmd_net_main(void)
 {
     struct ecmd_connection_state_t *state = &uip_conn->appstate.ecmd;
 
-    if (!uip_poll()) {
-#ifdef DEBUG_ECMD_NET
-        debug_printf("ecmd_net_main()\n");
-#endif
-    }
+    if (uip_aborted() || uip_timedout() || uip_closed())
+        return;
 
     if(uip_connected()) {
 #ifdef DEBUG_ECMD_NET
         debug_printf("new connection\n");
 #endif
-        state->in_len = 0;
-        state->out_len = 0;
-        state->parse_again = 0;
-        state->close_requested = 0;
-        memset(state->inbuf, 0, ECMD_INPUTBUF_LENGTH);
+        memset(state, 0, sizeof(*state));
+
+        /* Responses may use several segments in flight. */
+        uip_window_enable();
     }
 
     if(uip_acked()) {
-        state->out_len = 0;
+        uint16_t acked = uip_acked_len();
 
-        if (state->parse_again) {
-#ifdef DEBUG_ECMD_NET
-            debug_printf("transmission done, calling parser again\n");
-#endif
-            /* if the first character is ! close the connection after the last
-             * byte is sent
-             */
-            uint8_t skip = 0;
-            if (state->inbuf[0] == '!') {
-              skip = 1;
-              state->close_requested = 1;
-            }
+        state->out_len -= acked;
+        memmove(state->outbuf, state->outbuf + acked, state->out_len);
+        state->out_sent = state->out_sent > acked ? state->out_sent - acked : 0;
+    }
 
-            /* parse command and write output to state->outbuf, reserving at least
-             * one byte for the terminating \n */
-            int l = ecmd_parse_command(state->inbuf + skip,
-                    state->outbuf,
-                    ECMD_OUTPUTBUF_LENGTH-1);
-
-            /* check if the parse has to be called again */
-            if (is_ECMD_AGAIN(l)) {
-                state->parse_again = 1;
-                l = ECMD_AGAIN(l);
-            } else {
-                state->parse_again = 0;
-                /* We have to clear the input buffer */
-                state->in_len = 0;
-            }
+    if(uip_newdata())
+        ecmd_net_receive(state);
 
-            if (l > 0) {
-                state->outbuf[l++] = '\n';
-                state->out_len = l;
-            }
-        }
-    }
+    ecmd_net_process(state);
+    if (uip_aborted())
+        return;
 
-    if(uip_newdata()) {
-        newdata();
-    }
+    /* Only let the client send what fits into the input buffer. */
+    if (state->in_len < ECMD_NET_INPUT) {
+        uip_conn->wnd = ECMD_NET_INPUT - state->in_len;
+        if (uip_stopped(uip_conn))
+            uip_restart();      /* tell the client about the new window */
+    } else
+        uip_stop();
 
-    if(uip_rexmit() ||
-            uip_newdata() ||
-            uip_acked() ||
-            uip_connected() ||
-            uip_poll()) {
-        if (state->out_len > 0) {
-#ifdef DEBUG_ECMD_NET
-            debug_printf("sending %d bytes\n", state->out_len);
-#endif
-            uip_send(state->outbuf, state->out_len);
-        } else if (state->close_requested)
-          uip_close();
-    }
+    ecmd_net_send(state);
 }
 
 /*
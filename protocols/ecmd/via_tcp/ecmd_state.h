@@ -25,13 +25,23 @@
 #define ECMD_INPUTBUF_LENGTH  50
 #define ECMD_OUTPUTBUF_LENGTH 50
 
+/* size of the receive and the send buffer of a tcp connection */
+#ifndef ECMD_TCP_BUFFER_LEN
+#define ECMD_TCP_BUFFER_LEN 100
+#endif
+
 struct ecmd_connection_state_t {
-    char inbuf[ECMD_INPUTBUF_LENGTH];
+    /* received lines, the running command comes first */
+    char inbuf[ECMD_TCP_BUFFER_LEN];
     uint8_t in_len;
-    char outbuf[ECMD_OUTPUTBUF_LENGTH];
+    uint8_t cmd_len;
+    /* responses not acknowledged yet, the first out_sent bytes are in flight */
+    char outbuf[ECMD_TCP_BUFFER_LEN];
     uint8_t out_len;
+    uint8_t out_sent;
     uint8_t parse_again;
     uint8_t close_requested;
+    uint8_t overlong;
 };
 
 #endif /* ECMD_STATE_H */
@@ -44,10 +44,40 @@ void uecmd_net_init() {
 	uip_udp_bind (uecmd_conn, HTONS(ECMD_UDP_PORT));
 }
 
-void uecmd_net_main() {
-	if (!uip_newdata ())
-		return;
+#ifdef ECMD_BINARY_SUPPORT
+static void uecmd_net_binary() {
+	uint16_t frame = ECMD_BINARY_HEADER + ((uint8_t *)uip_appdata)[2];
 
+	uip_slen = 0;
+	if (uip_datalen() < ECMD_BINARY_HEADER || uip_datalen() < frame)
+		return;			/* truncated request, ignore */
+
+	/* copy the request followed by the zeroed scratch bytes */
+	char cmd[frame + 3];
+	memcpy(cmd, uip_appdata, frame);
+	memset(cmd + frame, 0, 3);
+
+	/* one datagram takes as many responses as fit in */
+	while (UIP_BUFSIZE - UIP_IPUDPH_LEN - uip_slen >= ECMD_OUTPUTBUF_LENGTH) {
+		int16_t len = ecmd_parse_binary(cmd,
+						((char *)uip_appdata) + uip_slen,
+						(UIP_BUFSIZE - UIP_IPUDPH_LEN) - uip_slen);
+		if (is_ECMD_FINAL(len)) {
+			uip_slen += len;
+			break;
+		}
+		if (((char *)uip_appdata)[uip_slen + 3] == 0) {
+			/* nothing more to say, finish with an empty response */
+			((char *)uip_appdata)[uip_slen + 2] = ECMD_BINARY_OK;
+			uip_slen += ECMD_BINARY_RESPONSE;
+			break;
+		}
+		uip_slen += ECMD_AGAIN(len);
+	}
+}
+#endif
+
+static void uecmd_net_text() {
 	char *p = (char *)uip_appdata;
 
 	/* Add \0 to the data and remove \n from the data */
@@ -77,6 +107,21 @@ void uecmd_net_main() {
 		if (real_len == len || len == 0)
 			break;
 	}
+}
+
+void uecmd_net_main() {
+	if (!uip_newdata ())
+		return;
+
+#ifdef ECMD_BINARY_SUPPORT
+	if (((uint8_t *)uip_appdata)[0] == ECMD_BINARY_MARK)
+		uecmd_net_binary();
+	else
+#endif
+		uecmd_net_text();
+
+	if (uip_slen == 0)
+		return;
 
 	/* Sent data out */
 
@@ -49,7 +49,7 @@ int16_t parse_cmd_ip(char *cmd, char *output, uint16_t len)
 	    return ECMD_ERR_PARSE_ERROR;
 
         eeprom_save(ip, &hostaddr, IPADDR_LEN);
-        eeprom_update_chksum();
+        eeprom_commit();
 
         return ECMD_FINAL_OK;
     }
@@ -79,7 +79,7 @@ int16_t parse_cmd_netmask(char *cmd, char *output, uint16_t len)
 	    return ECMD_ERR_PARSE_ERROR;
 
         eeprom_save(netmask, &netmask, IPADDR_LEN);
-        eeprom_update_chksum();
+        eeprom_commit();
 
         return ECMD_FINAL_OK;
     }
@@ -109,7 +109,7 @@ int16_t parse_cmd_gw(char *cmd, char *output, uint16_t len)
 	    return ECMD_ERR_PARSE_ERROR;
 
         eeprom_save(gateway, &gwaddr, IPADDR_LEN);
-        eeprom_update_chksum();
+        eeprom_commit();
 
         return ECMD_FINAL_OK;
     }
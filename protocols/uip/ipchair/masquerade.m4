@@ -38,7 +38,6 @@ CHAIR(MASQUERADE)
 
   dnl Override the source IP address with the one assigned to the Ethersex.
   REWRITE_SRCADDR(enc_stack_hostaddr)
-  REWRITE_CHKSUM_IP()
 POLICY(ACCEPT)
 
 
@@ -103,6 +102,5 @@ POLICY(DEMASQUERADE)
 
 CHAIR(DEMASQUERADE)
   REWRITE_DESTADDR(ipchair_masq_peer_addr)
-  REWRITE_CHKSUM_IP()
 POLICY(ACCEPT)
 
@@ -21,8 +21,10 @@ dnl
 
 dnl  Some macros that you might find useful if you're rewriting packets.
 
-define(`REWRITE_SRCADDR', `uip_ipaddr_copy(BUF->srcipaddr, $1);');
-define(`REWRITE_DESTADDR', `uip_ipaddr_copy(BUF->destipaddr, $1);');
+dnl  The address rewrites patch the IP and TCP/UDP checksums incrementally,
+dnl  REWRITE_CHKSUM_IP is only needed after touching other header fields.
+define(`REWRITE_SRCADDR', `uip_rewrite_ipaddr(BUF->srcipaddr, $1);');
+define(`REWRITE_DESTADDR', `uip_rewrite_ipaddr(BUF->destipaddr, $1);');
 
 define(`REWRITE_CHKSUM_IP', `dnl
 #ifndef IPV6_SUPPORT
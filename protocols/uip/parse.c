@@ -45,7 +45,8 @@ int16_t print_ipaddr(uip_ipaddr_t *addr, char *output, uint16_t len)
 }
 
 
-#if !defined(DISABLE_IPCONF_SUPPORT) || defined(NTP_SUPPORT) || defined(DNS_SUPPORT)
+#if !defined(DISABLE_IPCONF_SUPPORT) || defined(NTP_SUPPORT) || defined(DNS_SUPPORT) \
+  || defined(ROUTER_SUPPORT)
 /* parse an ip address at cmd, write result to ptr */
 int8_t parse_ip(char *cmd, uip_ipaddr_t *ptr)
 {
@@ -87,6 +88,6 @@ int8_t parse_ip(char *cmd, uip_ipaddr_t *ptr)
 
     return -1;
 }
-#endif /* !DISABLE_IPCONF_SUPPORT || NTP_SUPPORT || DNS_SUPPORT */
+#endif /* !DISABLE_IPCONF_SUPPORT || NTP_SUPPORT || DNS_SUPPORT || ROUTER */
 
 
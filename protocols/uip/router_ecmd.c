@@ -0,0 +1,147 @@
+/*
+ * Copyright (c) 2008 by Stefan Siegl <stesie@brokenpipe.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * For more information on the GPL, please go to:
+ * http://www.gnu.org/copyleft/gpl.html
+ */
+
+#include <string.h>
+#include <stdlib.h>
+#include <avr/pgmspace.h>
+
+#include "config.h"
+#include "protocols/uip/uip.h"
+#include "protocols/uip/uip_router.h"
+#include "protocols/uip/parse.h"
+
+#include "protocols/ecmd/ecmd-base.h"
+
+/* Names of the stacks, in the order of the enum in uip-conf.h */
+static const char router_stack_names[] PROGMEM =
+#ifdef RFM12_IP_SUPPORT
+  "rfm12\0"
+#endif
+#ifdef ZBUS_SUPPORT
+  "zbus\0"
+#endif
+#ifdef OPENVPN_SUPPORT
+  "openvpn\0"
+#endif
+#ifdef USB_NET_SUPPORT
+  "usb\0"
+#endif
+#ifdef ENC28J60_SUPPORT
+  "enc\0"
+#endif
+  ;
+
+static const char *
+router_stack_name(uint8_t stack)
+{
+  const char *p = router_stack_names;
+  while (stack --)
+    p += strlen_P(p) + 1;
+  return p;
+}
+
+
+/* Parse "PREFIX/LEN" at cmd, return pointer behind it or NULL. */
+static char *
+router_parse_prefix(char *cmd, uip_ipaddr_t *prefix, uint8_t *prefix_len)
+{
+  while (*cmd == ' ')
+    cmd ++;
+
+  char *slash = strchr(cmd, '/');
+  if (slash == NULL)
+    return NULL;
+
+  *slash = 0;
+  if (parse_ip(cmd, prefix))
+    return NULL;
+
+  *prefix_len = strtoul(slash + 1, &cmd, 10);
+  return cmd;
+}
+
+
+int16_t parse_cmd_route(char *cmd, char *output, uint16_t len)
+{
+  /* trick: use bytes on cmd as "connection specific static variables" */
+  if (cmd[0] != 23) {		/* indicator flag: real invocation:  0 */
+    cmd[0] = 23;		/*                 continuing call: 23 */
+    cmd[1] = 0;			/* table entry */
+  }
+
+  struct router_route *route = router_route_get(cmd[1]);
+  if (route == NULL)
+    return ECMD_FINAL_OK;
+
+  uint16_t n = print_ipaddr(&route->prefix, output, len);
+  n += snprintf_P(output + n, len - n, PSTR("/%u %S%S"), route->prefix_len,
+		  router_stack_name(route->stack),
+		  route->flags == ROUTE_STATIC ? PSTR(" static")
+		  : route->flags == ROUTE_DEFAULT ? PSTR(" default")
+		  : PSTR(""));
+
+  cmd[1] ++;
+  return ECMD_AGAIN(n);
+}
+
+
+int16_t parse_cmd_route_add(char *cmd, char *output, uint16_t len)
+{
+  uip_ipaddr_t prefix;
+  uint8_t prefix_len, stack;
+
+  cmd = router_parse_prefix(cmd, &prefix, &prefix_len);
+  if (cmd == NULL)
+    return ECMD_ERR_PARSE_ERROR;
+
+  while (*cmd == ' ')
+    cmd ++;
+
+  for (stack = 0; stack < STACK_LEN; stack ++)
+    if (strcmp_P(cmd, router_stack_name(stack)) == 0)
+      break;
+
+  if (router_route_add(&prefix, prefix_len, stack))
+    return ECMD_ERR_PARSE_ERROR;
+
+  return ECMD_FINAL_OK;
+}
+
+
+int16_t parse_cmd_route_del(char *cmd, char *output, uint16_t len)
+{
+  uip_ipaddr_t prefix;
+  uint8_t prefix_len;
+
+  if (router_parse_prefix(cmd, &prefix, &prefix_len) == NULL
+      || router_route_del(&prefix, prefix_len))
+    return ECMD_ERR_PARSE_ERROR;
+
+  return ECMD_FINAL_OK;
+}
+
+/*
+  -- Ethersex META --
+  block(Network configuration)
+  ecmd_feature(route_add, "route add", PREFIX/LEN STACK, Add a static route of PREFIX/LEN via the named STACK.)
+  ecmd_feature(route_del, "route del", PREFIX/LEN, Delete the static route of PREFIX/LEN.)
+  ecmd_feature(route, "route",, Display the routing table.)
+*/
@@ -124,7 +124,12 @@ typedef unsigned short uip_stats_t;
 #endif
 
 #define UIP_ARCH_ADD32           0
-#define UIP_ARCH_CHKSUM          0
+#ifdef ARCH_HOST
+#  define UIP_ARCH_CHKSUM        0
+#else
+/* chksum() in assembler, see uip_chksum_avr.S */
+#  define UIP_ARCH_CHKSUM        1
+#endif
 
 #define RFM12_LLH_LEN            2
 
@@ -86,6 +86,7 @@
 #include "protocols/zbus/zbus.h"
 #include "core/debug.h"
 #include "hardware/radio/rfm12/rfm12.h"
+#include "uip_router.h"
 
 #if UIP_CONF_IPV6
 #include "uip_neighbor.h"
@@ -156,6 +157,8 @@ u16_t uip_urglen, uip_surglen;
 #endif /* UIP_URGDATA > 0 */
 
 u16_t uip_len, uip_slen;
+u16_t uip_ackedlen;             /* Number of bytes the last received
+				   acknowledgement covered. */
                              /* The uip_len is either 8 or 16 bits,
 				depending on the maximum packet
 				size. */
@@ -294,38 +297,48 @@ uip_add32(u8_t *op32, u16_t op16)
 }
 #endif /* ! UIP_ARCH_ADD32 && UIP_TCP*/
 
-#if ! UIP_ARCH_CHKSUM
+#if UIP_ARCH_CHKSUM
+/* Implemented in assembler, see uip_chksum_avr.S */
+extern u16_t uip_arch_chksum(u16_t sum, const u8_t *data, u16_t len);
+#define chksum(sum, data, len) uip_arch_chksum((sum), (data), (len))
+#else /* UIP_ARCH_CHKSUM */
 /*---------------------------------------------------------------------------*/
 static u16_t
 noinline chksum(u16_t sum, const u8_t *data, u16_t len)
 {
-  u16_t t;
-  const u8_t *dataptr;
-  const u8_t *last_byte;
-
-  dataptr = data;
-  last_byte = data + len - 1;
-
-  while(dataptr < last_byte) {	/* At least two more bytes */
-    t = (dataptr[0] << 8) + dataptr[1];
-    sum += t;
-    if(sum < t) {
-      sum++;		/* carry */
-    }
+  /* Sum up the big endian 16-bit words in a 32-bit accumulator, the
+     carries pile up in the upper half and are folded back in once at
+     the end instead of being tested after every single addition. */
+  uint32_t acc = sum;
+  const u8_t *dataptr = data;
+
+  while(len >= 8) {
+    acc += ((u16_t)dataptr[0] << 8) | dataptr[1];
+    acc += ((u16_t)dataptr[2] << 8) | dataptr[3];
+    acc += ((u16_t)dataptr[4] << 8) | dataptr[5];
+    acc += ((u16_t)dataptr[6] << 8) | dataptr[7];
+    dataptr += 8;
+    len -= 8;
+  }
+
+  while(len >= 2) {
+    acc += ((u16_t)dataptr[0] << 8) | dataptr[1];
     dataptr += 2;
+    len -= 2;
   }
 
-  if(dataptr == last_byte) {
-    t = (dataptr[0] << 8) + 0;
-    sum += t;
-    if(sum < t) {
-      sum++;		/* carry */
-    }
+  if(len) {
+    acc += (u16_t)dataptr[0] << 8;
+  }
+
+  while(acc >> 16) {
+    acc = (acc & 0xffff) + (acc >> 16);
   }
 
   /* Return sum in host byte order. */
-  return sum;
+  return acc;
 }
+#endif /* UIP_ARCH_CHKSUM */
 /*---------------------------------------------------------------------------*/
 #if 0
 static u16_t
@@ -399,7 +412,57 @@ uip_udpchksum(void)
   return upper_layer_chksum(UIP_PROTO_UDP);
 }
 #endif /* UIP_UDP_CHECKSUMS && UIP_UDP*/
-#endif /* UIP_ARCH_CHKSUM */
+/*---------------------------------------------------------------------------*/
+void
+uip_chksum_adjust(u16_t *chksum, const void *oldval, const void *newval,
+		  u8_t len)
+{
+  /* RFC 1624, eqn. 3: HC' = ~(~HC + ~m + m'), word by word.  The one's
+     complement sum doesn't care about byte order, as long as checksum
+     and data are in the same one. */
+  const u16_t *o = oldval;
+  const u16_t *n = newval;
+  uint32_t acc = (u16_t) ~*chksum;
+
+  for(; len >= 2; len -= 2) {
+    acc += (u16_t) ~*o++;
+    acc += *n++;
+  }
+
+  while(acc >> 16) {
+    acc = (acc & 0xffff) + (acc >> 16);
+  }
+
+  *chksum = ~acc;
+}
+/*---------------------------------------------------------------------------*/
+void
+uip_rewrite_ipaddr(u16_t *addr, const u16_t *newaddr)
+{
+#if !UIP_CONF_IPV6
+  uip_chksum_adjust(&BUF->ipchksum, addr, newaddr, sizeof(uip_ipaddr_t));
+#endif /* !UIP_CONF_IPV6 */
+
+  /* The addresses are part of the TCP/UDP pseudo header as well. */
+  if(BUF->proto == UIP_PROTO_TCP) {
+    uip_chksum_adjust(&BUF->tcpchksum, addr, newaddr, sizeof(uip_ipaddr_t));
+  }
+  else if(BUF->proto == UIP_PROTO_UDP && UDPBUF->udpchksum != 0) {
+    uip_chksum_adjust(&UDPBUF->udpchksum, addr, newaddr,
+		      sizeof(uip_ipaddr_t));
+    if(UDPBUF->udpchksum == 0) {
+      UDPBUF->udpchksum = 0xffff;
+    }
+  }
+#if UIP_CONF_IPV6
+  else if(BUF->proto == UIP_PROTO_ICMP6) {
+    uip_chksum_adjust(&ICMPBUF->icmpchksum, addr, newaddr,
+		      sizeof(uip_ipaddr_t));
+  }
+#endif /* UIP_CONF_IPV6 */
+
+  uip_ipaddr_copy(addr, newaddr);
+}
 /*---------------------------------------------------------------------------*/
 void
 uip_init(void)
@@ -492,6 +555,9 @@ uip_connect(uip_ipaddr_t *ripaddr, u16_t rport, uip_conn_callback_t callback)
   conn->sa = 0;
   conn->sv = 16;   /* Initial value of the RTT variance. */
   conn->wnd = 0; /* unset the personal window size for this connection */
+#ifdef TCP_WINDOW_SUPPORT
+  conn->snd_wnd = UIP_TCP_MSS;
+#endif
   conn->lport = htons(lastport);
   conn->rport = rport;
 
@@ -592,6 +658,18 @@ uip_listen(u16_t port, uip_conn_callback_t callback)
     if(uip_listenports[c].port == 0) {
       uip_listenports[c].port = port;
       uip_listenports[c].callback = callback;
+      uip_listenports[c].wnd = 0;
+      return;
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+uip_listen_window(u16_t port, u16_t wnd)
+{
+  for(c = 0; c < UIP_LISTENPORTS; ++c) {
+    if(uip_listenports[c].port == port) {
+      uip_listenports[c].wnd = wnd;
       return;
     }
   }
@@ -609,6 +687,23 @@ uip_add_rcv_nxt(u16_t n)
   uip_conn->rcv_nxt[2] = uip_acc32[2];
   uip_conn->rcv_nxt[3] = uip_acc32[3];
 }
+
+void
+uip_unread(u16_t n)
+{
+  u16_t lo = ((u16_t)uip_conn->rcv_nxt[2] << 8) | uip_conn->rcv_nxt[3];
+  u16_t hi = ((u16_t)uip_conn->rcv_nxt[0] << 8) | uip_conn->rcv_nxt[1];
+
+  if(lo < n) {
+    --hi;
+  }
+  lo -= n;
+
+  uip_conn->rcv_nxt[0] = hi >> 8;
+  uip_conn->rcv_nxt[1] = hi & 0xff;
+  uip_conn->rcv_nxt[2] = lo >> 8;
+  uip_conn->rcv_nxt[3] = lo & 0xff;
+}
 #endif
 /*---------------------------------------------------------------------------*/
 u8_t uip_ipaddr_prefixlencmp(uip_ip6addr_t _a, uip_ip6addr_t _b, u8_t prefix);
@@ -647,6 +742,40 @@ uip_ipaddr_prefixlencmp(uip_ip6addr_t _a, uip_ip6addr_t _b, u8_t prefix)
 }
 #endif /* UIP_MULTI_STACK */
 /*---------------------------------------------------------------------------*/
+#ifdef TCP_WINDOW_SUPPORT
+static uint32_t
+uip_seq32(const u8_t *seq)
+{
+  return ((uint32_t)seq[0] << 24) | ((uint32_t)seq[1] << 16)
+    | ((u16_t)seq[2] << 8) | seq[3];
+}
+
+/* Set the mss of a windowed connection to the amount of new data that
+   may be sent right now, limited by the window of the remote host and
+   by TCP_WINDOW_SEGMENTS full segments in flight. */
+static u16_t
+uip_window_mss(uip_conn_t *conn)
+{
+  u16_t limit = TCP_WINDOW_SEGMENTS * conn->initialmss;
+  if(conn->snd_wnd < limit) {
+    limit = conn->snd_wnd;
+  }
+
+  if(limit == 0 && conn->len == 0) {
+    /* Zero window, probe with a full segment like uip does. */
+    conn->mss = conn->initialmss;
+  } else if(limit > conn->len) {
+    conn->mss = limit - conn->len;
+    if(conn->mss > conn->initialmss) {
+      conn->mss = conn->initialmss;
+    }
+  } else {
+    conn->mss = 0;
+  }
+  return conn->mss;
+}
+#endif /* TCP_WINDOW_SUPPORT */
+/*---------------------------------------------------------------------------*/
 void
 uip_process(u8_t flag)
 {
@@ -665,8 +794,14 @@ uip_process(u8_t flag)
      particular connection. */
   if(flag == UIP_POLL_REQUEST) {
     if((uip_connr->tcpstateflags & UIP_TS_MASK) == UIP_ESTABLISHED &&
+#ifdef TCP_WINDOW_SUPPORT
+       (uip_windowed(uip_connr) ? uip_window_mss(uip_connr) :
+	!uip_outstanding(uip_connr))) {
+#else
        !uip_outstanding(uip_connr)) {
+#endif
 	uip_flags = UIP_POLL;
+	uip_slen = 0;
 	UIP_APPCALL();
 	goto appsend;
     }
@@ -768,6 +903,17 @@ uip_process(u8_t flag)
 #endif /* UIP_ACTIVE_OPEN */
 
 	  case UIP_ESTABLISHED:
+#ifdef TCP_WINDOW_SUPPORT
+	    if(uip_windowed(uip_connr)) {
+	      /* Go back to the first unacknowledged byte, the
+		 application sends everything from there again. */
+	      uip_connr->len = 0;
+	      uip_window_mss(uip_connr);
+	      uip_flags = UIP_REXMIT;
+	      UIP_APPCALL();
+	      goto appsend;
+	    }
+#endif /* TCP_WINDOW_SUPPORT */
 	    /* In the ESTABLISHED state, we call upon the application
                to do the actual retransmit after which we jump into
                the code for sending out the packet (the apprexmit
@@ -784,6 +930,12 @@ uip_process(u8_t flag)
 
 	  }
 	}
+#ifdef TCP_WINDOW_SUPPORT
+	/* The remote window might have opened meanwhile. */
+	if(uip_windowed(uip_connr)) {
+	  uip_connr->tcpstateflags |= UIP_WINDOW_POLL;
+	}
+#endif
       } else if((uip_connr->tcpstateflags & UIP_TS_MASK) == UIP_ESTABLISHED) {
 	/* If there was no need for a retransmission, we poll the
            application for new data. */
@@ -1299,10 +1451,11 @@ ip_check_end:
   }
   uip_conn = uip_connr;
 
-  /* Set callback to the given value in uip_listenports */
+  /* Set callback and window to the given values in uip_listenports */
   for(c = 0; c < UIP_LISTENPORTS; ++c)
     if(tmp16 == uip_listenports[c].port) {
       uip_conn->callback = uip_listenports[c].callback;
+      uip_connr->wnd = uip_listenports[c].wnd;
       break;
     }
 
@@ -1315,7 +1468,9 @@ ip_check_end:
   uip_connr->sa = 0;
   uip_connr->sv = 4;
   uip_connr->nrtx = 0;
-  uip_connr->wnd = 0; /* unset the personal window size for this connection */
+#ifdef TCP_WINDOW_SUPPORT
+  uip_connr->snd_wnd = UIP_TCP_MSS;
+#endif
   uip_connr->lport = BUF->destport;
   uip_connr->rport = BUF->srcport;
   uip_ipaddr_copy(uip_connr->ripaddr, BUF->srcipaddr);
@@ -1384,11 +1539,18 @@ ip_check_end:
 #endif /* UIP_ACTIVE_OPEN */
 
   /* We send out the TCP Maximum Segment Size option with our
-     SYNACK. */
+     SYNACK.  Connections with a small window of their own announce
+     half of it, the remote host would otherwise wait for the whole
+     window to open up before it sends a segment smaller than the
+     MSS. */
+  tmp16 = UIP_TCP_MSS;
+  if(uip_connr->wnd && uip_connr->wnd / 2 < tmp16) {
+    tmp16 = uip_connr->wnd / 2;
+  }
   BUF->optdata[0] = TCP_OPT_MSS;
   BUF->optdata[1] = TCP_OPT_MSS_LEN;
-  BUF->optdata[2] = (UIP_TCP_MSS) / 256;
-  BUF->optdata[3] = (UIP_TCP_MSS) & 255;
+  BUF->optdata[2] = tmp16 >> 8;
+  BUF->optdata[3] = tmp16 & 255;
   uip_len = UIP_IPTCPH_LEN + TCP_OPT_MSS_LEN;
   BUF->tcpoffset = ((UIP_TCPH_LEN + TCP_OPT_MSS_LEN) / 4) << 4;
   goto tcp_send;
@@ -1435,9 +1597,22 @@ ip_check_end:
      the outstanding data, calculate RTT estimations, and reset the
      retransmission timer. */
   if((BUF->flags & TCP_ACK) && uip_outstanding(uip_connr)) {
-    uip_add32(uip_connr->snd_nxt, uip_connr->len);
+#ifdef TCP_WINDOW_SUPPORT
+    /* Windowed connections accept an acknowledgement for any part of
+       the data sent so far.  After a retransmission this may cover
+       more than what is in flight again, if the remote host kept the
+       segments following the lost one. */
+    if(uip_windowed(uip_connr)) {
+      uint32_t acked = uip_seq32(BUF->ackno) - uip_seq32(uip_connr->snd_nxt);
+      tmp16 = acked <= uip_seq32(uip_connr->snd_max)
+	- uip_seq32(uip_connr->snd_nxt) ? acked : 0;
+    } else
+#endif
+    tmp16 = uip_connr->len;
+    uip_add32(uip_connr->snd_nxt, tmp16);
 
-    if(BUF->ackno[0] == uip_acc32[0] &&
+    if(tmp16 != 0 &&
+       BUF->ackno[0] == uip_acc32[0] &&
        BUF->ackno[1] == uip_acc32[1] &&
        BUF->ackno[2] == uip_acc32[2] &&
        BUF->ackno[3] == uip_acc32[3]) {
@@ -1469,7 +1644,21 @@ ip_check_end:
       uip_connr->timer = uip_connr->rto;
 
       /* Reset length of outstanding data. */
-      uip_connr->len = 0;
+      uip_ackedlen = tmp16;
+#ifdef TCP_WINDOW_SUPPORT
+      /* After a retransmission the acknowledgement may go beyond the
+	 data in flight. */
+      if(tmp16 > uip_connr->len) {
+	tmp16 = uip_connr->len;
+      }
+#endif
+      uip_connr->len -= tmp16;
+
+#ifdef TCP_WINDOW_SUPPORT
+      if(uip_windowed(uip_connr)) {
+	uip_connr->nrtx = 0;
+      }
+#endif
     }
 
   }
@@ -1636,11 +1825,20 @@ ip_check_end:
        "persistent timer" and uses the retransmission mechanim.
     */
     tmp16 = ((u16_t)BUF->wnd[0] << 8) + (u16_t)BUF->wnd[1];
+#ifdef TCP_WINDOW_SUPPORT
+    uip_connr->snd_wnd = tmp16;
+#endif
     if(tmp16 > uip_connr->initialmss ||
        tmp16 == 0) {
       tmp16 = uip_connr->initialmss;
     }
     uip_connr->mss = tmp16;
+#ifdef TCP_WINDOW_SUPPORT
+    /* Poll from the main loop again once there is room to send. */
+    if(uip_windowed(uip_connr) && uip_window_mss(uip_connr)) {
+      uip_connr->tcpstateflags |= UIP_WINDOW_POLL;
+    }
+#endif
 
     /* If this packet constitutes an ACK for outstanding data (flagged
        by the UIP_ACKDATA flag, we should call the application since it
@@ -1684,6 +1882,12 @@ ip_check_end:
       }
 
       if(uip_flags & UIP_CLOSE) {
+#ifdef TCP_WINDOW_SUPPORT
+	/* The FIN has to wait until everything is acknowledged. */
+	if(uip_windowed(uip_connr) && uip_outstanding(uip_connr)) {
+	  goto drop;
+	}
+#endif
 	uip_slen = 0;
 	uip_connr->len = 1;
 	uip_connr->tcpstateflags = UIP_FIN_WAIT_1;
@@ -1692,6 +1896,23 @@ ip_check_end:
 	goto tcp_send_nodata;
       }
 
+#ifdef TCP_WINDOW_SUPPORT
+      /* Windowed connections append new data to the data in flight,
+	 as far as the window allows. */
+      if(uip_windowed(uip_connr)) {
+	if(uip_slen > uip_connr->mss) {
+	  uip_slen = uip_connr->mss;
+	}
+	if(uip_slen > 0) {
+	  uip_connr->len += uip_slen;
+	} else {
+	  /* Nothing more to send, don't poll from the main loop. */
+	  uip_connr->tcpstateflags &= ~UIP_WINDOW_POLL;
+	}
+	goto apprexmit;
+      }
+#endif /* TCP_WINDOW_SUPPORT */
+
       /* If uip_slen > 0, the application has data to be sent. */
       if(uip_slen > 0) {
 
@@ -1732,7 +1953,8 @@ ip_check_end:
          packet had new data in it, we must send out a packet. */
       if(uip_slen > 0 && uip_connr->len > 0) {
 	/* Add the length of the IP and TCP headers. */
-	uip_len = uip_connr->len + UIP_TCPIP_HLEN;
+	uip_len = (uip_windowed(uip_connr) ? uip_slen : uip_connr->len)
+	  + UIP_TCPIP_HLEN;
 	/* We always set the ACK flag in response packets. */
 	BUF->flags = TCP_ACK | TCP_PSH;
 	/* Send the packet. */
@@ -1838,6 +2060,30 @@ ip_check_end:
   BUF->seqno[2] = uip_connr->snd_nxt[2];
   BUF->seqno[3] = uip_connr->snd_nxt[3];
 
+#ifdef TCP_WINDOW_SUPPORT
+  if(uip_windowed(uip_connr)) {
+    /* The data in flight goes in front of the data of this segment
+       (all of it, if there is none). */
+    uip_add32(uip_connr->snd_nxt, uip_connr->len - (uip_len - UIP_IPH_LEN
+				    - ((BUF->tcpoffset >> 4) << 2)));
+    BUF->seqno[0] = uip_acc32[0];
+    BUF->seqno[1] = uip_acc32[1];
+    BUF->seqno[2] = uip_acc32[2];
+    BUF->seqno[3] = uip_acc32[3];
+
+    /* Remember the end of the data in flight, if it is the highest
+       sequence number sent so far. */
+    if(uip_connr->len > uip_seq32(uip_connr->snd_max)
+       - uip_seq32(uip_connr->snd_nxt)) {
+      uip_add32(uip_connr->snd_nxt, uip_connr->len);
+      uip_connr->snd_max[0] = uip_acc32[0];
+      uip_connr->snd_max[1] = uip_acc32[1];
+      uip_connr->snd_max[2] = uip_acc32[2];
+      uip_connr->snd_max[3] = uip_acc32[3];
+    }
+  }
+#endif
+
   BUF->proto = UIP_PROTO_TCP;
 
   BUF->srcport  = uip_connr->lport;
@@ -1924,12 +2170,49 @@ uip_send(const void *data, int len)
     }
   }
 }
+/*---------------------------------------------------------------------------*/
+#ifdef TCP_WINDOW_SUPPORT
+void
+uip_window_process(void)
+{
+  uip_conn_t *conn;
+
+  /* One more segment for each windowed connection that may send. */
+  for(conn = &uip_conns[0]; conn <= &uip_conns[UIP_CONNS - 1]; ++conn) {
+    if(!(conn->tcpstateflags & UIP_WINDOW_POLL)) {
+      continue;
+    }
+
+    /* A full window stays full until the next acknowledgement, which
+       arms the flag again, as does the periodic timer. */
+    if((conn->tcpstateflags & UIP_TS_MASK) != UIP_ESTABLISHED ||
+       uip_window_mss(conn) == 0) {
+      conn->tcpstateflags &= ~UIP_WINDOW_POLL;
+      continue;
+    }
+
+    if(uip_buf_lock()) {
+      return;			/* already locked */
+    }
+
+    uip_stack_set_active(conn->stack);
+    uip_poll_conn(conn);
+
+    /* if this generated a packet, send it now */
+    if(uip_len > 0) {
+      router_output();
+    }
+    uip_buf_unlock();
+  }
+}
+#endif /* TCP_WINDOW_SUPPORT */
 /** @} */
 
 /*
   -- Ethersex META --
   header(protocols/uip/uip.h)
   header(protocols/uip/uip_router.h)
+  mainloop(uip_window_process)
   timer(10, ` 
 #       if UIP_CONNS <= 255
             uint8_t i;
@@ -80,10 +80,14 @@ typedef void (*uip_conn_callback_t)(void);
  *
  * callback is an place for an application to store an callback, this callback
  * ist automatically copied to a new uip_conn
+ *
+ * wnd is the receive window new connections start with, see
+ * uip_listen_window()
  */
 struct uip_listen_port {
   u16_t port;
   uip_conn_callback_t callback;
+  u16_t wnd;
 };
 
 
@@ -102,6 +106,15 @@ struct uip_listen_port {
  * parameters in uIP such as IP addresses.
  */
 
+#ifdef ROUTER_SUPPORT
+/* Addresses take part in routing, the router rebuilds its routing
+   table before the next lookup, if one of them has changed. */
+extern u8_t router_table_dirty;
+#define uip_addr_changed()  (router_table_dirty = 1)
+#else
+#define uip_addr_changed()  do { } while(0)
+#endif
+
 /**
  * Set the IP address of this host.
  *
@@ -124,7 +137,10 @@ struct uip_listen_port {
  *
  * \hideinitializer
  */
-#define uip_sethostaddr(addr) uip_ipaddr_copy(uip_hostaddr, (addr))
+#define uip_sethostaddr(addr) do {			\
+    uip_ipaddr_copy(uip_hostaddr, (addr));		\
+    uip_addr_changed();					\
+  } while(0)
 
 /**
  * Get the IP address of this host.
@@ -156,7 +172,10 @@ struct uip_listen_port {
  *
  * \hideinitializer
  */
-#define uip_setdraddr(addr) uip_ipaddr_copy(uip_draddr, (addr))
+#define uip_setdraddr(addr) do {			\
+    uip_ipaddr_copy(uip_draddr, (addr));		\
+    uip_addr_changed();					\
+  } while(0)
 
 /**
  * Set the netmask.
@@ -168,9 +187,15 @@ struct uip_listen_port {
  *
  * \hideinitializer
  */
-#define uip_setnetmask(addr) uip_ipaddr_copy(uip_netmask, (addr))
+#define uip_setnetmask(addr) do {			\
+    uip_ipaddr_copy(uip_netmask, (addr));		\
+    uip_addr_changed();					\
+  } while(0)
 
-#define uip_setprefixlen(len)  (uip_prefix_len = (len))
+#define uip_setprefixlen(len) do {			\
+    uip_prefix_len = (len);				\
+    uip_addr_changed();					\
+  } while(0)
 
 
 /**
@@ -362,6 +387,13 @@ void uip_setipid(u16_t id);
 #define uip_poll_conn(conn) do { uip_conn = conn; \
                                  uip_process(UIP_POLL_REQUEST); } while (0)
 
+/* Let windowed connections fill their window, called from the main loop. */
+#ifdef TCP_WINDOW_SUPPORT
+void uip_window_process(void);
+#else
+#define uip_window_process()
+#endif
+
 
 #if UIP_UDP
 /**
@@ -477,6 +509,23 @@ extern u8_t uip_buf[UIP_BUFSIZE+2];
  */
 void uip_listen(u16_t port, uip_conn_callback_t callback);
 
+/**
+ * Set the receive window of new connections to a listening port.
+ *
+ * The window is advertised from the SYNACK on, so that the remote
+ * host never sends more than the application can take, not even
+ * right after the connection has been set up.  The MSS announced is
+ * limited to half of the window, so that the remote host can send on
+ * while the application still holds some of the data.  A window of 0
+ * stands for UIP_RECEIVE_WINDOW, which is the default.  The
+ * application may change it later on through uip_conn->wnd.
+ *
+ * \param port A 16-bit port number in network byte order.
+ *
+ * \param wnd The receive window in bytes.
+ */
+void uip_listen_window(u16_t port, u16_t wnd);
+
 /**
  * Stop listening to the specified port.
  *
@@ -628,6 +677,51 @@ void uip_send(const void *data, int len);
  */
 #define uip_stopped(conn)   ((conn)->tcpstateflags & UIP_STOPPED)
 
+/**
+ * Allow several unacknowledged segments on the current connection.
+ *
+ * Must only be called while no data is outstanding, e.g. on
+ * uip_connected() or uip_acked().  Afterwards every uip_send() appends
+ * a new segment after the data already in flight, as long as uip_mss()
+ * is non-zero, and uip_acked_len() tells how much of the data an
+ * acknowledgement covers.  On uip_rexmit() all data in flight is
+ * discarded, the application has to send again starting at the first
+ * unacknowledged byte.  uip_close() is ignored until all data has been
+ * acknowledged.  uip_window_disable() goes back to a single segment,
+ * again only while no data is outstanding.
+ *
+ * \hideinitializer
+ */
+#ifdef TCP_WINDOW_SUPPORT
+#define uip_window_enable() do {					\
+    uip_conn->snd_max[0] = uip_conn->snd_nxt[0];			\
+    uip_conn->snd_max[1] = uip_conn->snd_nxt[1];			\
+    uip_conn->snd_max[2] = uip_conn->snd_nxt[2];			\
+    uip_conn->snd_max[3] = uip_conn->snd_nxt[3];			\
+    uip_conn->tcpstateflags |= UIP_WINDOWED | UIP_WINDOW_POLL;		\
+  } while (0)
+#define uip_window_disable() \
+  (uip_conn->tcpstateflags &= ~(UIP_WINDOWED | UIP_WINDOW_POLL))
+#define uip_windowed(conn)  ((conn)->tcpstateflags & UIP_WINDOWED)
+#else
+#define uip_window_enable()
+#define uip_window_disable()
+#define uip_windowed(conn)  0
+#endif
+
+/**
+ * Hand back the last n bytes of the new data.
+ *
+ * The bytes are not acknowledged, the remote host will send them
+ * again.  This lets an application, that can't take all of the
+ * incoming data right now, leave the rest with the sender; it should
+ * call uip_stop() as well, until it is ready again.
+ *
+ * Must only be called if uip_newdata() is true and n is not larger
+ * than uip_datalen().
+ */
+void uip_unread(u16_t n);
+
 /**
  * Restart the current connection, if is has previously been stopped
  * with uip_stop().
@@ -677,6 +771,13 @@ void uip_send(const void *data, int len);
  */
 #define uip_acked()   (uip_flags & UIP_ACKDATA)
 
+/**
+ * The number of bytes acknowledged, if uip_acked() is set.
+ *
+ * \hideinitializer
+ */
+#define uip_acked_len() (uip_ackedlen)
+
 /**
  * Has the connection just been connected?
  *
@@ -1201,6 +1302,7 @@ extern void *uip_urgdata;
  */
 extern u16_t uip_len;
 extern u16_t uip_slen;
+extern u16_t uip_ackedlen;
 
 /** @} */
 
@@ -1235,6 +1337,11 @@ struct __uip_conn {
 			 connection. */
   u16_t initialmss;   /**< Initial maximum segment size for the
 			 connection. */
+#ifdef TCP_WINDOW_SUPPORT
+  u16_t snd_wnd;      /**< Window advertised by the remote host. */
+  u8_t snd_max[4];    /**< The highest sequence number sent so far,
+			 acknowledgements up to it are accepted. */
+#endif
   u8_t sa;            /**< Retransmission time-out calculation state
 			 variable. */
   u8_t sv;            /**< Retransmission time-out calculation state
@@ -1462,6 +1569,8 @@ void uip_process(u8_t flag);
 #define UIP_TS_MASK     15
 
 #define UIP_STOPPED      16
+#define UIP_WINDOWED     32     /* See uip_window_enable(). */
+#define UIP_WINDOW_POLL  64     /* Windowed connection may send more. */
 
 /* The TCP and IP headers. */
 struct uip_tcpip_hdr {
@@ -1622,6 +1731,21 @@ extern uip_ipaddr_t uip_lladdr;
 extern const uip_ipaddr_t all_ones_addr;
 extern const uip_ipaddr_t all_zeroes_addr;
 
+/**
+ * Incrementally update a checksum after len bytes of the checksummed
+ * data changed from oldval to newval (RFC 1624).  All values are
+ * expected in network byte order, len must be even.
+ */
+void uip_chksum_adjust(u16_t *chksum, const void *oldval,
+		       const void *newval, u8_t len);
+
+/**
+ * Replace the source or destination address (addr) of the packet in
+ * uip_buf with newaddr, patching the IP and TCP/UDP checksums instead
+ * of recalculating them.
+ */
+void uip_rewrite_ipaddr(u16_t *addr, const u16_t *newaddr);
+
 extern struct uip_listen_port uip_listenports[UIP_LISTENPORTS];
 
 /**
@@ -110,8 +110,19 @@ struct ethip_hdr {
 struct arp_entry {
   u16_t ipaddr[2];
   struct uip_eth_addr ethaddr;
+  u8_t time;			/* last update, for aging */
+  u8_t used;			/* last lookup, for replacement */
+};
+
+#ifdef ARP_HOLD_SUPPORT
+/* An ip packet waiting for the ethernet address of its next hop. */
+struct arp_hold {
+  u16_t ipaddr[2];
+  u16_t len;			/* zero if unused */
   u8_t time;
+  u8_t buf[ARP_HOLD_SIZE];
 };
+#endif
 
 static const struct uip_eth_addr broadcast_ethaddr =
   {{0xff,0xff,0xff,0xff,0xff,0xff}};
@@ -119,11 +130,15 @@ static const u16_t broadcast_ipaddr[2] = {0xffff,0xffff};
 
 static struct arp_entry arp_table[UIP_ARPTAB_SIZE];
 static u16_t ipaddr[2];
-static u8_t i, c;
+static u8_t i;
 
 static u8_t arptime;
 static u8_t tmpage;
 
+#ifdef ARP_HOLD_SUPPORT
+static struct arp_hold arp_hold[ARP_HOLD_PACKETS];
+#endif
+
 #define BUF   ((struct arp_hdr *)&uip_buf[0])
 #define IPBUF ((struct ethip_hdr *)&uip_buf[0])
 /*-----------------------------------------------------------------------------------*/
@@ -138,6 +153,11 @@ uip_arp_init(void)
   for(i = 0; i < UIP_ARPTAB_SIZE; ++i) {
     memset(arp_table[i].ipaddr, 0, 4);
   }
+#ifdef ARP_HOLD_SUPPORT
+  for(i = 0; i < ARP_HOLD_PACKETS; ++i) {
+    arp_hold[i].len = 0;
+  }
+#endif
 }
 /*-----------------------------------------------------------------------------------*/
 /**
@@ -159,77 +179,146 @@ uip_arp_timer(void)
   for(i = 0; i < UIP_ARPTAB_SIZE; ++i) {
     tabptr = &arp_table[i];
     if((tabptr->ipaddr[0] | tabptr->ipaddr[1]) != 0 &&
-       arptime - tabptr->time >= UIP_ARP_MAXAGE) {
+       (u8_t)(arptime - tabptr->time) >= UIP_ARP_MAXAGE) {
       memset(tabptr->ipaddr, 0, 4);
     }
   }
 
+#ifdef ARP_HOLD_SUPPORT
+  /* Nobody answered within one or two timer periods, give up. */
+  for(i = 0; i < ARP_HOLD_PACKETS; ++i) {
+    if((u8_t)(arptime - arp_hold[i].time) >= 2) {
+      arp_hold[i].len = 0;
+    }
+  }
+#endif
+
 }
 #endif /* !BOOTLOADER_SUPPORT */
 /*-----------------------------------------------------------------------------------*/
-static void
-uip_arp_update(u16_t *ip, struct uip_eth_addr *ethaddr)
+/* The table is hashed by the last two octets of the address: entries
+   go to their home slot if it is free, lookups start there and probe
+   the following slots. */
+static u8_t
+uip_arp_hash(const u16_t *ip)
 {
-  register struct arp_entry *tabptr = NULL;
-  /* Walk through the ARP mapping table and try to find an entry to
-     update. If none is found, the IP -> MAC address mapping is
-     inserted in the ARP table. */
-  for(i = 0; i < UIP_ARPTAB_SIZE; ++i) {
-
-    tabptr = &arp_table[i];
-    /* Only check those entries that are actually in use. */
-    if(tabptr->ipaddr[0] != 0 &&
-       tabptr->ipaddr[1] != 0) {
-
-      /* Check if the source IP address of the incoming packet matches
-         the IP address in this ARP table entry. */
-      if(ip[0] == tabptr->ipaddr[0] &&
-	 ip[1] == tabptr->ipaddr[1]) {
-	 
-	/* An old entry found, update this and return. */
-	memcpy(tabptr->ethaddr.addr, ethaddr->addr, 6);
-	tabptr->time = arptime;
-
-	return;
-      }
-    }
-  }
+  return (((const u8_t *)ip)[2] ^ ((const u8_t *)ip)[3]) % UIP_ARPTAB_SIZE;
+}
 
-  /* If we get here, no existing ARP table entry was found, so we
-     create one. */
+struct arp_entry *
+uip_arp_lookup (uip_ipaddr_t ipaddr)
+{
+  u8_t slot = uip_arp_hash(ipaddr);
 
-  /* First, we try to find an unused entry in the ARP table. */
   for(i = 0; i < UIP_ARPTAB_SIZE; ++i) {
-    tabptr = &arp_table[i];
-    if(tabptr->ipaddr[0] == 0 &&
-       tabptr->ipaddr[1] == 0) {
-      break;
+    struct arp_entry *tabptr = &arp_table[slot];
+    if((tabptr->ipaddr[0] | tabptr->ipaddr[1]) != 0 &&
+       uip_ipaddr_cmp(ipaddr, tabptr->ipaddr)) {
+      tabptr->used = arptime;
+      return tabptr;
+    }
+
+    if(++slot == UIP_ARPTAB_SIZE) {
+      slot = 0;
     }
   }
 
-  /* If no unused entry is found, we try to find the oldest entry and
-     throw it away. */
-  if(i == UIP_ARPTAB_SIZE) {
+  return NULL;
+}
+/*-----------------------------------------------------------------------------------*/
+static void
+uip_arp_update(u16_t *ip, struct uip_eth_addr *ethaddr)
+{
+  register struct arp_entry *tabptr = uip_arp_lookup(ip);
+
+  if(tabptr == NULL) {
+    /* No entry for this address yet.  Take the first unused entry
+       from the home slot on or, if the table is full, throw away the
+       least recently used one. */
+    u8_t slot = uip_arp_hash(ip);
     tmpage = 0;
-    c = 0;
+
     for(i = 0; i < UIP_ARPTAB_SIZE; ++i) {
-      tabptr = &arp_table[i];
-      if(arptime - tabptr->time > tmpage) {
-	tmpage = arptime - tabptr->time;
-	c = i;
+      struct arp_entry *e = &arp_table[slot];
+      if((e->ipaddr[0] | e->ipaddr[1]) == 0) {
+	tabptr = e;
+	break;
+      }
+      if(tabptr == NULL || (u8_t)(arptime - e->used) > tmpage) {
+	tmpage = arptime - e->used;
+	tabptr = e;
+      }
+
+      if(++slot == UIP_ARPTAB_SIZE) {
+	slot = 0;
       }
     }
-    i = c;
-    tabptr = &arp_table[i];
+
+    memcpy(tabptr->ipaddr, ip, 4);
+    tabptr->used = arptime;
   }
 
-  /* Now, i is the ARP table entry which we will fill with the new
-     information. */
-  memcpy(tabptr->ipaddr, ip, 4);
   memcpy(tabptr->ethaddr.addr, ethaddr->addr, 6);
   tabptr->time = arptime;
 }
 /*-----------------------------------------------------------------------------------*/
+#ifdef ARP_HOLD_SUPPORT
+/* Keep a copy of the ip packet in uip_buf until the ethernet address
+   of ipaddr (its next hop) is known.  One packet per next hop, the
+   newest one wins; packets larger than ARP_HOLD_SIZE are dropped. */
+static void
+uip_arp_hold(void)
+{
+  struct arp_hold *h, *slot = NULL;
+
+  if(uip_len > ARP_HOLD_SIZE) {
+    return;
+  }
+
+  for(h = arp_hold; h < arp_hold + ARP_HOLD_PACKETS; ++h) {
+    if(h->len && uip_ipaddr_cmp(h->ipaddr, ipaddr)) {
+      slot = h;
+      break;
+    }
+    /* otherwise prefer unused, then the oldest */
+    if(slot == NULL || (slot->len && (h->len == 0 ||
+	(u8_t)(arptime - h->time) > (u8_t)(arptime - slot->time)))) {
+      slot = h;
+    }
+  }
+
+  uip_ipaddr_copy(slot->ipaddr, ipaddr);
+  slot->time = arptime;
+  slot->len = uip_len;
+  memcpy(slot->buf, &uip_buf[UIP_LLH_LEN], uip_len);
+}
+
+/* Put the packet held for ip into uip_buf, ready to be sent to
+   ethaddr.  Leaves uip_len untouched, if there is none. */
+static void
+uip_arp_release(u16_t *ip, struct uip_eth_addr *ethaddr)
+{
+  struct arp_hold *h;
+
+  for(h = arp_hold; h < arp_hold + ARP_HOLD_PACKETS; ++h) {
+    if(h->len && uip_ipaddr_cmp(h->ipaddr, ip)) {
+      /* ip and ethaddr point into uip_buf, save the address first */
+      struct uip_eth_addr dest;
+      memcpy(dest.addr, ethaddr->addr, 6);
+
+      memcpy(&uip_buf[UIP_LLH_LEN], h->buf, h->len);
+      memcpy(IPBUF->ethhdr.dest.addr, dest.addr, 6);
+      memcpy(IPBUF->ethhdr.src.addr, uip_ethaddr.addr, 6);
+      IPBUF->ethhdr.type = HTONS(UIP_ETHTYPE_IP);
+
+      uip_len = h->len + sizeof(struct uip_eth_hdr);
+      h->len = 0;
+      return;
+    }
+  }
+}
+#endif /* ARP_HOLD_SUPPORT */
+/*-----------------------------------------------------------------------------------*/
 /**
  * ARP processing for incoming IP packets
  *
@@ -347,6 +436,10 @@ uip_arp_arpin(void)
        for us. */
     if(uip_ipaddr_cmp(BUF->dipaddr, uip_hostaddr)) {
       uip_arp_update(BUF->sipaddr, &BUF->shwaddr);
+#ifdef ARP_HOLD_SUPPORT
+      /* Send the packet that waited for this reply, if any. */
+      uip_arp_release(BUF->sipaddr, &BUF->shwaddr);
+#endif
     }
     break;
   }
@@ -371,7 +464,9 @@ uip_arp_arpin(void)
  * destination IP address, the packet in the uip_buf[] is replaced by
  * an ARP request packet for the IP address. The IP packet is dropped
  * and it is assumed that they higher level protocols (e.g., TCP)
- * eventually will retransmit the dropped packet.
+ * eventually will retransmit the dropped packet.  With
+ * ARP_HOLD_SUPPORT a copy of the IP packet is kept instead and sent
+ * by uip_arp_arpin() once the ARP reply arrives.
  *
  * If the destination IP address is not on the local network, the IP
  * address of the default router is used instead.
@@ -431,6 +526,11 @@ uip_arp_out(void)
     struct arp_entry *tabptr = uip_arp_lookup (ipaddr);
 
     if(!tabptr) {
+#ifdef ARP_HOLD_SUPPORT
+      /* Keep the packet, it is sent as soon as the reply arrives. */
+      uip_arp_hold();
+#endif
+
       /* The destination address was not in our ARP table, so we
 	 overwrite the IP packet with an ARP request. */
 
@@ -470,20 +570,6 @@ uip_arp_out(void)
 /** @} */
 /** @} */
 
-struct arp_entry *
-uip_arp_lookup (uip_ipaddr_t ipaddr)
-{
-  uint8_t i;
-
-  for(i = 0; i < UIP_ARPTAB_SIZE; ++i) {
-    struct arp_entry *tabptr = &arp_table[i];
-    if(uip_ipaddr_cmp(ipaddr, tabptr->ipaddr))
-      return tabptr;
-  }
-
-  return NULL;
-}
-
 #endif /* !UIP_CONF_IPV6 */
 #endif /* ENC28J60_SUPPORT */
 
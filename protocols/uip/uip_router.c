@@ -45,35 +45,217 @@
 
 #define BUF ((struct uip_tcpip_hdr *)&uip_buf[UIP_LLH_LEN])
 
-uint8_t
-router_find_stack(uip_ipaddr_t *forwardip)
+/* The routing table holds the connected route of every stack, the
+   static routes and the default route (to the stack the default
+   router is connected to), ordered by prefix length, longest first.
+   It is rebuilt from the stacks' addresses whenever one of them has
+   been changed, lookups simply take the first matching entry. */
+static struct router_route router_table[ROUTER_TABLE_LEN];
+static uint8_t router_table_len;
+
+static struct router_route router_static[ROUTER_STATIC_ROUTES];
+
+/* host address of every stack */
+static uip_ipaddr_t router_hostaddr[STACK_LEN];
+u8_t router_table_dirty = 1;
+
+
+static uint8_t
+router_prefix_match(uip_ipaddr_t *addr, uip_ipaddr_t *prefix, uint8_t len)
+{
+  uint8_t *a = (uint8_t *) addr;
+  uint8_t *p = (uint8_t *) prefix;
+
+  for (; len >= 8; len -= 8)
+    if (*a++ != *p++)
+      return 0;
+
+  return len == 0 || ((*a ^ *p) & (uint8_t) (0xFF << (8 - len))) == 0;
+}
+
+
+static void
+router_prefix_mask(uip_ipaddr_t *prefix, uint8_t len)
 {
+  uint8_t *p = (uint8_t *) prefix;
+
+  for (uint8_t i = 0; i < sizeof(uip_ipaddr_t); i ++, p ++)
+    {
+      if (len >= 8)
+	len -= 8;
+      else
+	{
+	  *p &= (uint8_t) (0xFF << (8 - len));
+	  len = 0;
+	}
+    }
+}
+
+
+static void
+router_table_insert(struct router_route *route)
+{
+  /* Keep the table sorted, routes of equal length stay in the order
+     they are inserted. */
+  uint8_t i = router_table_len;
+  for (; i && router_table[i - 1].prefix_len < route->prefix_len; i --)
+    router_table[i] = router_table[i - 1];
+
+  router_table[i] = *route;
+  router_table_len ++;
+}
+
+
+static uint8_t
+router_table_lookup(uip_ipaddr_t *ip)
+{
+  for (uint8_t i = 0; i < router_table_len; i ++)
+    if (router_prefix_match(ip, &router_table[i].prefix,
+			    router_table[i].prefix_len))
+      return router_table[i].stack;
+
+  return 255;
+}
+
+
+static void
+router_table_rebuild(void)
+{
+  struct router_route route;
   uint8_t i;
-routing_input:
-  for (i = 0; i < STACK_LEN; i++) {
-    uip_stack_set_active(i);
-    if((! forwardip) && uip_ipaddr_cmp(BUF->destipaddr, uip_hostaddr))
-      return i;
+
+  struct uip_stack *active = uip_stack;
+
+  router_table_len = 0;
+  router_table_dirty = 0;
+
+  for (i = 0; i < STACK_LEN; i ++)
+    {
+      uip_stack_set_active(i);
+      uip_ipaddr_copy(router_hostaddr[i], uip_hostaddr);
+
+      uip_ipaddr_copy(route.prefix, uip_hostaddr);
 #ifdef IPV6_SUPPORT
-    if(forwardip && uip_ipaddr_prefixlencmp(*forwardip, uip_hostaddr,
-                                            uip_prefix_len))
-      return i;
-#else /* !UIP_CONF_IPV6 */
-    if(forwardip && uip_ipaddr_maskcmp(*forwardip, uip_hostaddr,
-                                       uip_netmask))
-       return i;
+      route.prefix_len = uip_prefix_len;
+#else
+      /* netmasks are contiguous, count the leading ones */
+      uint8_t *mask = (uint8_t *) uip_netmask;
+      route.prefix_len = 0;
+      while (route.prefix_len < 32
+	     && (mask[route.prefix_len / 8] & (0x80 >> (route.prefix_len % 8))))
+	route.prefix_len ++;
 #endif
-  }
-  /* we didn't find an interface for the forwadip, so try it again with the
-   * default router
-   */
-  if (forwardip && forwardip != &uip_draddr){
-    forwardip = &uip_draddr;
-    goto routing_input;
-  }
+      router_prefix_mask(&route.prefix, route.prefix_len);
+      route.stack = i;
+      route.flags = ROUTE_CONNECTED;
+      router_table_insert(&route);
+    }
 
-  /* Drop the packet */
-  return 255;
+  uip_stack = active;
+
+  for (i = 0; i < ROUTER_STATIC_ROUTES; i ++)
+    if (router_static[i].flags)
+      router_table_insert(&router_static[i]);
+
+  /* The default route leads wherever the default router is reached. */
+  route.stack = router_table_lookup(&uip_draddr);
+  if (route.stack != 255)
+    {
+      memset(route.prefix, 0, sizeof(uip_ipaddr_t));
+      route.prefix_len = 0;
+      route.flags = ROUTE_DEFAULT;
+      router_table_insert(&route);
+    }
+}
+
+
+uint8_t
+router_find_stack(uip_ipaddr_t *forwardip)
+{
+  if (router_table_dirty)
+    router_table_rebuild();
+
+  if (! forwardip)
+    {
+      for (uint8_t i = 0; i < STACK_LEN; i++)
+	if (uip_ipaddr_cmp(BUF->destipaddr, router_hostaddr[i]))
+	  return i;
+
+      return 255;
+    }
+
+  return router_table_lookup(forwardip);
+}
+
+
+int8_t
+router_route_add(uip_ipaddr_t *prefix, uint8_t prefix_len, uint8_t stack)
+{
+  struct router_route *slot = NULL;
+
+  if (stack >= STACK_LEN || prefix_len > sizeof(uip_ipaddr_t) * 8)
+    return -1;
+
+  router_prefix_mask(prefix, prefix_len);
+
+  for (uint8_t i = 0; i < ROUTER_STATIC_ROUTES; i ++)
+    {
+      struct router_route *r = &router_static[i];
+      if (! r->flags)
+	{
+	  if (! slot)
+	    slot = r;
+	}
+      else if (r->prefix_len == prefix_len
+	       && uip_ipaddr_cmp(r->prefix, *prefix))
+	{
+	  /* replace the existing route */
+	  slot = r;
+	  break;
+	}
+    }
+
+  if (! slot)
+    return -1;
+
+  uip_ipaddr_copy(slot->prefix, *prefix);
+  slot->prefix_len = prefix_len;
+  slot->stack = stack;
+  slot->flags = ROUTE_STATIC;
+
+  router_table_dirty = 1;
+  return 0;
+}
+
+
+int8_t
+router_route_del(uip_ipaddr_t *prefix, uint8_t prefix_len)
+{
+  router_prefix_mask(prefix, prefix_len);
+
+  for (uint8_t i = 0; i < ROUTER_STATIC_ROUTES; i ++)
+    {
+      struct router_route *r = &router_static[i];
+      if (r->flags && r->prefix_len == prefix_len
+	  && uip_ipaddr_cmp(r->prefix, *prefix))
+	{
+	  r->flags = 0;
+	  router_table_dirty = 1;
+	  return 0;
+	}
+    }
+
+  return -1;
+}
+
+
+struct router_route *
+router_route_get(uint8_t n)
+{
+  if (router_table_dirty)
+    router_table_rebuild();
+
+  return n < router_table_len ? &router_table[n] : NULL;
 }
 
 
@@ -121,6 +303,11 @@ router_input(uint8_t origin)
       if (origin == dest)
 	goto drop;
 
+#if !UIP_CONF_IPV6
+      /* TTL and protocol share one word of the header */
+      u16_t ttl_proto = *(u16_t *) &BUF->ttl;
+#endif
+
       if (-- BUF->ttl == 0)
 	{
 	  /* TODO send ICMP message */
@@ -135,11 +322,7 @@ router_input(uint8_t origin)
 
 #if !UIP_CONF_IPV6
       /* For IPv4 we must adjust the chksum */
-      if(BUF->ipchksum >= HTONS(0xffff - (1 << 8)))
-	BUF->ipchksum += HTONS(1 << 8) + 1;
-
-      else
-	BUF->ipchksum += HTONS(1 << 8);
+      uip_chksum_adjust(&BUF->ipchksum, &ttl_proto, &BUF->ttl, 2);
 #endif
 
       /* For router_output_to uip_len must be set to the number of
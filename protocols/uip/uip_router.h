@@ -31,8 +31,40 @@ void router_input(uint8_t stack);
    by an arp request.  0 otherwise. */
 uint8_t router_output_to (uint8_t stack);
 
+/* Find the stack a packet to FORWARDIP is routed to, using the
+   longest matching prefix.  If FORWARDIP is NULL, find the stack whose
+   host address is the destination of the packet in uip_buf.
+   Returns 255 if there is none. */
 uint8_t router_find_stack(uip_ipaddr_t *forwardip);
 
+#ifndef ROUTER_STATIC_ROUTES
+#define ROUTER_STATIC_ROUTES 0
+#endif
+
+/* connected routes, static routes and the default route */
+#define ROUTER_TABLE_LEN  (STACK_LEN + ROUTER_STATIC_ROUTES + 1)
+
+#define ROUTE_CONNECTED  1
+#define ROUTE_STATIC     2
+#define ROUTE_DEFAULT    3
+
+struct router_route {
+  uip_ipaddr_t prefix;
+  uint8_t prefix_len;
+  uint8_t stack;
+  uint8_t flags;		/* ROUTE_*, zero if unused */
+};
+
+/* Add (or replace) a static route of PREFIX/PREFIX_LEN via STACK,
+   respectively delete it.  Return -1 if the table is full or there
+   is no such route. */
+int8_t router_route_add(uip_ipaddr_t *prefix, uint8_t prefix_len,
+			uint8_t stack);
+int8_t router_route_del(uip_ipaddr_t *prefix, uint8_t prefix_len);
+
+/* Return the Nth entry of the routing table or NULL. */
+struct router_route *router_route_get(uint8_t n);
+
 /* Find a suitable stack to transmit the packet in uip_buf and finally
    send it.
    This function is only used by applications, not by the stack inputs 
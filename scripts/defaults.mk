@@ -21,13 +21,10 @@ export HOSTCC
 export MAKE
 
 # flags for the compiler
-CPPFLAGS += -mmcu=$(MCU) -I$(TOPDIR)
+CPPFLAGS += -I$(TOPDIR)
 CFLAGS ?= -Wall -W -Wno-unused-parameter -Wno-sign-compare
 CFLAGS += -g -Os -std=gnu99
 
-# flags for the linker
-LDFLAGS += -mmcu=$(MCU)
-
 ##############################################################################
 # include user's config.mk file
 
@@ -50,6 +47,21 @@ endif # MAKECMDGOALS!=menuconfig
 endif # MAKECMDGOALS!=mrproper
 endif # MAKECMDGOALS!=clean
 
+##############################################################################
+# host (Linux) build, the avr-libc headers are replaced by core/host/
+ifeq ($(ARCH_HOST),y)
+CC = $(HOSTCC)
+OBJCOPY = objcopy
+OBJDUMP = objdump
+SIZE = size
+CPPFLAGS += -DARCH_HOST -I$(TOPDIR)/core/host
+# avr-gcc puts tentative definitions into common, which some headers rely on
+CFLAGS += -fcommon
+else
+CPPFLAGS += -mmcu=$(MCU)
+LDFLAGS += -mmcu=$(MCU)
+endif
+
 ifeq ($(BOOTLOADER_SUPPORT),y)
 ifeq ($(atmega128),y)
 LDFLAGS += -Wl,--section-start=.text=0x1E000
@@ -8,6 +8,7 @@ ifneq ($(no_deps),t)
 ifneq ($(MAKECMDGOALS),clean)
 ifneq ($(MAKECMDGOALS),mrproper)
 ifneq ($(MAKECMDGOALS),menuconfig)
+ifneq ($(MAKECMDGOALS),host)
 
 # For each .o file we need a .dep file.
 sinclude $(foreach file,$(subst .o,.dep,$(filter %.o,$(OBJECTS))),$(TOPDIR)/${file})
@@ -16,6 +17,7 @@ endif
 endif
 endif
 endif
+endif
 
 # Here is how to build those dependency files
 
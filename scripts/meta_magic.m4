@@ -123,9 +123,13 @@ divert(timer_divert_base)
 void periodic_process(void)
 {
     static uint16_t counter = 0;
+#ifdef ARCH_HOST
+    if (periodic_host_expired ()) {
+#else
     if (_TIFR_TIMER1 & _BV(OCF1A)) {
         /* clear flag */
         _TIFR_TIMER1 = _BV(OCF1A);
+#endif
         counter++;
 #ifdef UIP_SUPPORT
         if (uip_buf_lock ()) {
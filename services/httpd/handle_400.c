@@ -25,15 +25,17 @@ void
 httpd_handle_400 (void)
 {
     if (uip_acked ()) {
-	uip_close ();
+	httpd_finish ();
 	return;
     }
 
     PASTE_RESET ();
     PASTE_P (httpd_header_400);
+    PASTE_CONNECTION ();
     PASTE_P (httpd_header_length);
     PASTE_LEN_P (httpd_body_400);
     PASTE_P (httpd_header_end);
-    PASTE_P (httpd_body_400);
+    if (!STATE->head)
+	PASTE_P (httpd_body_400);
     PASTE_SEND ();
 }
@@ -27,16 +27,18 @@ void
 httpd_handle_401 (void)
 {
     if (uip_acked ()) {
-	uip_close ();
+	httpd_finish ();
 	return;
     }
 
     PASTE_RESET ();
     PASTE_P (httpd_header_401);
+    PASTE_CONNECTION ();
     PASTE_P (httpd_header_length);
     PASTE_LEN_P (httpd_body_401);
     PASTE_P (httpd_header_end);
-    PASTE_P (httpd_body_401);
+    if (!STATE->head)
+	PASTE_P (httpd_body_401);
     PASTE_SEND ();
 }
 
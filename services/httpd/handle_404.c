@@ -25,15 +25,17 @@ void
 httpd_handle_404 (void)
 {
     if (uip_acked ()) {
-	uip_close ();
+	httpd_finish ();
 	return;
     }
 
     PASTE_RESET ();
     PASTE_P (httpd_header_404);
+    PASTE_CONNECTION ();
     PASTE_P (httpd_header_length);
     PASTE_LEN_P (httpd_body_404);
     PASTE_P (httpd_header_end);
-    PASTE_P (httpd_body_404);
+    if (!STATE->head)
+	PASTE_P (httpd_body_404);
     PASTE_SEND ();
 }
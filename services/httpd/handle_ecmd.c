@@ -18,6 +18,8 @@
  * http://www.gnu.org/copyleft/gpl.html
  */
 
+#include <string.h>
+
 #include "config.h"
 #include "protocols/ecmd/parser.h"
 #include "protocols/ecmd/ecmd-base.h"
@@ -31,39 +33,16 @@
 # define printf(...)   ((void)0)
 #endif
 
+/* CMD has been decoded by the request parser already. */
 void
-httpd_handle_ecmd_setup (char *encoded_cmd)
+httpd_handle_ecmd_setup (char *cmd)
 {
-    char *ptr = STATE->u.ecmd.input;
-    uint8_t maxlen = ECMD_INPUTBUF_LENGTH;
-
-    for (; *encoded_cmd && maxlen; maxlen --, ptr ++, encoded_cmd ++) {
-	uint8_t carry;
-
-	switch (*encoded_cmd) {
-	case '+':
-	    *ptr = ' ';
-	    break;
-
-	case '%':
-	    carry = encoded_cmd[3];
-	    encoded_cmd[3] = 0;
-	    *ptr = strtoul (encoded_cmd + 1, NULL, 16);
-	    encoded_cmd[3] = carry;
-	    encoded_cmd += 2;	/* Skip two extra bytes. */
-	    break;
-
-	default:
-	    *ptr = *encoded_cmd;
-	}
-    }
-
-    if (maxlen == 0) {
+    if (strlen (cmd) >= ECMD_INPUTBUF_LENGTH) {
 	printf ("httpd_ecmd: received ecmd too long.\n");
 	return;
     }
 
-    *ptr = 0;
+    strcpy (STATE->u.ecmd.input, cmd);
     STATE->handler = httpd_handle_ecmd;
 }
 
@@ -71,8 +50,12 @@ httpd_handle_ecmd_setup (char *encoded_cmd)
 static void
 httpd_handle_ecmd_send_header (void)
 {
+    /* No Content-Length, the end of the output is the close. */
+    STATE->keepalive = 0;
+
     PASTE_RESET ();
     PASTE_P (httpd_header_200);
+    PASTE_CONNECTION ();
     PASTE_P (httpd_header_ecmd);
     PASTE_SEND ();
 }
@@ -81,8 +64,13 @@ httpd_handle_ecmd_send_header (void)
 void
 httpd_handle_ecmd (void)
 {
-    if (uip_acked ())
+    if (uip_acked ()) {
+	if (STATE->header_acked == 0 && STATE->head) {
+	    httpd_finish ();
+	    return;
+	}
 	STATE->header_acked = 1;
+    }
 
     if (!STATE->header_acked) {
 	httpd_handle_ecmd_send_header ();
@@ -90,8 +78,10 @@ httpd_handle_ecmd (void)
     }
 
     if (!uip_rexmit ()) {
-	if (STATE->eof)
-	    uip_close ();
+	if (STATE->eof) {
+	    httpd_finish ();
+	    return;
+	}
 	else {
 	    int16_t len = ecmd_parse_command(STATE->u.ecmd.input,
 					     STATE->u.ecmd.output,
@@ -49,8 +49,12 @@ char PROGMEM httpd_header_301_redirect[] =
 static void
 httpd_handle_sd_dir_send_header (void)
 {
+    /* No Content-Length, the end of the listing is the close. */
+    STATE->keepalive = 0;
+
     PASTE_RESET ();
     PASTE_P (httpd_header_200);
+    PASTE_CONNECTION ();
     PASTE_P (httpd_header_ct_html);
     PASTE_PF (httpd_sd_dir_header, STATE->u.dir.dirname);
 
@@ -74,11 +78,16 @@ void
 httpd_handle_sd_dir (void)
 {
     if (uip_acked ()) {
-	if (!STATE->header_acked)
+	if (!STATE->header_acked) {
 	    STATE->header_acked = 1;
+	    if (STATE->head) {
+		httpd_finish ();
+		return;
+	    }
+	}
 
 	else if (STATE->eof) {
-	    uip_close ();
+	    httpd_finish ();
 	    return;
 	}
 	
@@ -124,12 +133,15 @@ httpd_handle_sd_dir (void)
 void
 httpd_handle_sd_dir_redirect (void)
 {
-    if (uip_acked ())
-	uip_close ();
+    if (uip_acked ()) {
+	httpd_finish ();
+	return;
+    }
 
     if (uip_poll ())
 	return;
 
+    STATE->keepalive = 0;
     PASTE_RESET ();
     PASTE_PF (httpd_header_301_redirect, STATE->u.dir.dirname);
     PASTE_SEND ();
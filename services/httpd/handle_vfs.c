@@ -27,59 +27,263 @@
 #define READ_AHEAD_LEN 2
 #endif
 
+#ifdef VFS_TEENSY
+#define VFS_CAN_SEEK(fd)	1
+#else
+#define VFS_CAN_SEEK(fd)	VFS_HAVE_FUNC (fd, fseek)
+#endif
+
+#ifdef VFS_INLINE_SUPPORT
+#define VFS_IS_INLINE(fd)	((fd)->fh_type == VFS_INLINE)
+#else
+#define VFS_IS_INLINE(fd)	0
+#endif
+
+/* Called once the file is opened, decides on the response.  The
+   request parser's state is gone afterwards. */
+void
+httpd_handle_vfs_setup (void)
+{
+    struct httpd_parser_t *p = &STATE->parse;
+    struct vfs_file_handle_t *fd = STATE->u.vfs.fd;
+    uint32_t mtime = vfs_mtime (fd);
+
+    STATE->handler = httpd_handle_vfs;
+    STATE->u.vfs.ident = vfs_ident (fd);
+#ifndef VFS_TEENSY
+    STATE->u.vfs.mtime = mtime;
+#endif
+    STATE->u.vfs.not_modified = 0;
+    STATE->u.vfs.partial = 0;
+    STATE->u.vfs.unsatisfiable = 0;
+    STATE->u.vfs.start = 0;
+    STATE->u.vfs.end = vfs_size (fd);
+
+#ifdef MIME_SUPPORT
+    STATE->u.vfs.mime = NULL;
+#endif
+
+    if (VFS_IS_INLINE (fd)) {
+#ifdef VFS_INLINE_SUPPORT
+	/* vfs-concat has told compression and content type already. */
+	STATE->u.vfs.gzip = (fd->u.il.flags & VFS_INLINE_GZIP) != 0;
+	STATE->u.vfs.content_type = fd->u.il.type;
+#endif
+    }
+#ifndef VFS_TEENSY
+    else {
+	/* Check whether the file is gzip compressed, the body is sent
+	   seeking anyway, so there's no need to rewind. */
+	unsigned char buf[READ_AHEAD_LEN];
+	STATE->u.vfs.gzip = 0;
+	if (VFS_CAN_SEEK (fd) && vfs_read (fd, buf, READ_AHEAD_LEN) >= 2) {
+	    STATE->u.vfs.gzip = buf[0] == 0x1f && buf[1] == 0x8b;
+#ifdef MIME_SUPPORT
+	    STATE->u.vfs.mime = httpd_mimetype_detect (buf);
+#endif
+	}
+
+	/* Only the xhtml and css name prefixes are a convention. */
+	if (STATE->u.vfs.content_type != 'X'
+	    && STATE->u.vfs.content_type != 'S')
+	    STATE->u.vfs.content_type = 0;
+    }
+#endif	/* not VFS_TEENSY */
+
+    uint8_t not_modified = p->none_match
+	&& (p->none_match_etag == 0 || p->none_match_etag == STATE->u.vfs.ident);
+
+#ifndef VFS_TEENSY
+    /* If-None-Match takes precedence over If-Modified-Since. */
+    if (!p->none_match && mtime && p->modified_since)
+	not_modified = mtime <= p->modified_since;
+#endif
+
+    if (not_modified) {
+	STATE->u.vfs.not_modified = 1;
+	STATE->head = 1;	/* Headers only. */
+	return;
+    }
+
+    /* Ranges need to know the size, If-Range makes us send the whole
+       file unless it is still the one the client has got a part of. */
+    vfs_size_t len = STATE->u.vfs.end;
+    if (!p->range || len == 0 || !VFS_CAN_SEEK (fd))
+	return;
+
+    if (p->if_range && (p->if_range_date
+			? mtime == 0 || p->if_range_etag != mtime
+			: STATE->u.vfs.ident == 0
+			  || p->if_range_etag != STATE->u.vfs.ident))
+	return;
+
+    if (p->range_suffix) {
+	if (p->range_start == 0)
+	    goto unsatisfiable;
+	STATE->u.vfs.start = p->range_start < len ? len - p->range_start : 0;
+    }
+    else {
+	if (p->range_start >= len)
+	    goto unsatisfiable;
+	STATE->u.vfs.start = p->range_start;
+	if (p->range_end < len)
+	    STATE->u.vfs.end = p->range_end + 1;
+    }
+
+    STATE->u.vfs.partial = 1;
+    return;
+
+  unsatisfiable:
+    STATE->u.vfs.unsatisfiable = 1;
+    STATE->head = 1;		/* Headers only. */
+}
+
+
+#ifndef VFS_TEENSY
+/* Paste the Last-Modified header for a time the way vfs_mtime has it.
+   FAT keeps local time, which has to do for GMT. */
+static void
+httpd_paste_last_modified (uint32_t mtime)
+{
+    static const uint8_t offsets[] PROGMEM = {0,3,2,5,0,3,5,1,4,6,2,4};
+    uint16_t year = 1980 + (mtime >> 25);
+    uint8_t month = (mtime >> 21) & 15;
+    uint8_t day = (mtime >> 16) & 31;
+
+    if (month < 1 || month > 12 || day < 1)
+	return;
+
+    /* Day of the week, 0 being sunday. */
+    uint16_t y = year - (month < 3);
+    uint8_t dow = (y + y / 4 - y / 100 + y / 400
+		   + pgm_read_byte (&offsets[month - 1]) + day) % 7;
+
+    PASTE_PF (PSTR ("Last-Modified: %.3S, %02u %.3S %u %02u:%02u:%02u GMT\n"),
+	      PSTR ("SunMonTueWedThuFriSat") + 3 * dow, day,
+	      httpd_months + 3 * (month - 1), year,
+	      (unsigned) (mtime >> 11) & 31, (unsigned) (mtime >> 5) & 63,
+	      (unsigned) (mtime & 31) * 2);
+}
+#endif	/* not VFS_TEENSY */
+
+
 static void
 httpd_handle_vfs_send_header (void)
 {
     PASTE_RESET ();
-    PASTE_P (httpd_header_200);
+    if (STATE->u.vfs.not_modified)
+	PASTE_P (httpd_header_304);
+    else if (STATE->u.vfs.unsatisfiable)
+	PASTE_P (httpd_header_416);
+    else if (STATE->u.vfs.partial)
+	PASTE_P (httpd_header_206);
+    else
+	PASTE_P (httpd_header_200);
+
+    if (STATE->u.vfs.ident)
+	PASTE_PF (PSTR ("ETag: \"%08lx\"\n"),
+		  (unsigned long) STATE->u.vfs.ident);
+
+#ifndef VFS_TEENSY
+    if (STATE->u.vfs.mtime)
+	httpd_paste_last_modified (STATE->u.vfs.mtime);
+#endif
+
+    if (STATE->u.vfs.unsatisfiable) {
+	PASTE_PF (PSTR ("Content-Range: bytes */%lu\n"),
+		  (unsigned long) STATE->u.vfs.end);
+	PASTE_P (httpd_header_length);
+	PASTE_LEN (0);
+    }
+
+    if (STATE->u.vfs.not_modified || STATE->u.vfs.unsatisfiable) {
+	PASTE_CONNECTION ();
+	PASTE_P (httpd_header_end);
+	PASTE_SEND ();
+	return;
+    }
 
-    vfs_size_t len = vfs_size (STATE->u.vfs.fd);
+    vfs_size_t len = STATE->u.vfs.end;
     if (len > 0) {
+	if (VFS_CAN_SEEK (STATE->u.vfs.fd))
+	    PASTE_P (httpd_header_ranges);
+	if (STATE->u.vfs.partial)
+	    PASTE_PF (PSTR ("Content-Range: bytes %lu-%lu/%lu\n"),
+		      (unsigned long) STATE->u.vfs.start,
+		      (unsigned long) len - 1,
+		      (unsigned long) vfs_size (STATE->u.vfs.fd));
+
 	/* send content-length header */
 	PASTE_P (httpd_header_length);
-	PASTE_LEN (len);
+	PASTE_LEN (len - STATE->u.vfs.start);
     }
+    else
+	STATE->keepalive = 0;	/* The end of the body is the close. */
+    PASTE_CONNECTION ();
 
-    /* Check whether the file is gzip compressed. */
-#ifndef VFS_TEENSY
-    unsigned char buf[READ_AHEAD_LEN];
-    if (VFS_HAVE_FUNC (STATE->u.vfs.fd, fseek)) {
-	/* Rewind stream first, might be a rexmit */
-	vfs_rewind (STATE->u.vfs.fd);
-
-	vfs_read (STATE->u.vfs.fd, buf, READ_AHEAD_LEN);
-	vfs_rewind (STATE->u.vfs.fd);
-    } else
-	goto no_gzip;
-
-    if (buf[0] == 0x1f && buf[1] == 0x8b)
-#endif	/* not VFS_TEENSY, inlined files are always gzip'd */
+    if (STATE->u.vfs.gzip)
 	PASTE_P (httpd_header_gzip);
 
-#ifndef VFS_TEENSY
 #ifdef MIME_SUPPORT
-    PASTE_PF (PSTR ("Content-Type: %S\n\n"), httpd_mimetype_detect (buf));
-    PASTE_SEND ();
-    return;
+    if (STATE->u.vfs.mime) {
+	PASTE_PF (PSTR ("Content-Type: %S\n\n"), STATE->u.vfs.mime);
+	PASTE_SEND ();
+	return;
+    }
 #endif	/* MIME_SUPPORT */
-no_gzip:
-#endif	/* not VFS_TEENSY, inlined files are always gzip'd */
-    if (STATE->u.vfs.content_type == 'X')
+
+    switch (STATE->u.vfs.content_type) {
+    case 'X':
 	PASTE_P (httpd_header_ct_xhtml);
-    else if (STATE->u.vfs.content_type == 'S')
+	break;
+    case 'S':
 	PASTE_P (httpd_header_ct_css);
-    else
+	break;
+#ifdef VFS_INLINE_SUPPORT
+    case VFS_INLINE_JS:
+	PASTE_P (PSTR ("Content-Type: application/javascript\n\n"));
+	break;
+    case VFS_INLINE_TEXT:
+	PASTE_P (PSTR ("Content-Type: text/plain; charset=utf-8\n\n"));
+	break;
+    case VFS_INLINE_GIF:
+	PASTE_P (PSTR ("Content-Type: image/gif\n\n"));
+	break;
+    case VFS_INLINE_PNG:
+	PASTE_P (PSTR ("Content-Type: image/png\n\n"));
+	break;
+    case VFS_INLINE_JPEG:
+	PASTE_P (PSTR ("Content-Type: image/jpeg\n\n"));
+	break;
+#endif	/* VFS_INLINE_SUPPORT */
+    default:
 	PASTE_P (httpd_header_ct_html);
+    }
 
     PASTE_SEND ();
 }
 
-
 void
 httpd_handle_vfs_send_body (void)
 {
-    vfs_fseek (STATE->u.vfs.fd, STATE->u.vfs.acked, SEEK_SET);
-    vfs_size_t len = vfs_read (STATE->u.vfs.fd, uip_appdata, uip_mss ());
+    /* Windowed connections send after the data in flight, all others
+       (and retransmissions) start at the first unacknowledged byte. */
+    if (uip_rexmit () || !uip_windowed (uip_conn)) {
+	STATE->u.vfs.sent = STATE->u.vfs.acked;
+	STATE->eof = 0;
+    }
+
+    if (uip_mss () == 0)
+	return;			/* window full */
+
+    vfs_size_t want = uip_mss ();
+    if (STATE->u.vfs.end && STATE->u.vfs.end - STATE->u.vfs.sent < want)
+	want = STATE->u.vfs.end - STATE->u.vfs.sent;
+
+    /* Fill the segment right from the file, no matter where the
+       previous one ended. */
+    vfs_size_t len = vfs_pread (STATE->u.vfs.fd, uip_appdata,
+				STATE->u.vfs.sent, want);
 
     if (len <= 0) {
 	uip_abort ();
@@ -87,10 +291,11 @@ httpd_handle_vfs_send_body (void)
 	return;
     }
 
-    if (len < uip_mss ())	/* Short read -> EOF */
+    /* Short read or end of the range -> EOF */
+    if (len < want || STATE->u.vfs.sent + len == STATE->u.vfs.end)
 	STATE->eof = 1;
 
-    STATE->u.vfs.sent = STATE->u.vfs.acked + len;
+    STATE->u.vfs.sent += len;
     uip_send (uip_appdata, len);
 }
 
@@ -98,19 +303,38 @@ void
 httpd_handle_vfs (void)
 {
     if (uip_acked ()) {
-	if (STATE->header_acked)
-	    STATE->u.vfs.acked = STATE->u.vfs.sent;
+	if (STATE->header_acked) {
+	    STATE->u.vfs.acked += uip_acked_len ();
+
+	    /* After a retransmission the peer may acknowledge the
+	       segments it kept, continue behind them. */
+	    if (STATE->u.vfs.sent < STATE->u.vfs.acked) {
+		STATE->u.vfs.sent = STATE->u.vfs.acked;
+		STATE->eof = STATE->u.vfs.sent == STATE->u.vfs.end;
+	    }
+	}
 	else {
 	    STATE->header_acked = 1;
-	    STATE->u.vfs.acked = 0;
+	    STATE->u.vfs.acked = STATE->u.vfs.start;
+	    STATE->u.vfs.sent = STATE->u.vfs.start;
+
+	    if (STATE->head) {
+		httpd_finish ();
+		return;
+	    }
+
+	    /* The body may use several segments in flight. */
+	    uip_window_enable ();
 	}
     }
 
     if (!STATE->header_acked)
 	httpd_handle_vfs_send_header ();
 
-    else if (STATE->eof && !uip_rexmit())
-	uip_close ();
+    else if (STATE->eof && !uip_rexmit()) {
+	if (!uip_outstanding (uip_conn))
+	    httpd_finish ();
+    }
 
     else
 	httpd_handle_vfs_send_body ();
@@ -24,10 +24,41 @@
 
 
 char PROGMEM httpd_header_200[] =
-"HTTP/1.1 200 OK\n"
+"HTTP/1.1 200 OK\n";
+
+
+#ifdef VFS_SUPPORT
+char PROGMEM httpd_header_206[] =
+"HTTP/1.1 206 Partial Content\n";
+
+
+char PROGMEM httpd_header_304[] =
+"HTTP/1.1 304 Not Modified\n";
+
+
+char PROGMEM httpd_header_416[] =
+"HTTP/1.1 416 Requested Range Not Satisfiable\n";
+
+
+#ifndef VFS_TEENSY
+/* Month names of HTTP dates, three letters each. */
+char PROGMEM httpd_months[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
+#endif
+
+
+char PROGMEM httpd_header_ranges[] =
+"Accept-Ranges: bytes\n";
+#endif	/* VFS_SUPPORT */
+
+
+char PROGMEM httpd_header_close[] =
 "Connection: close\n";
 
 
+char PROGMEM httpd_header_keepalive[] =
+"Connection: keep-alive\n";
+
+
 char PROGMEM httpd_header_ct_css[] =
 "Content-Type: text/css; charset=utf-8\n\n";
 
@@ -50,7 +81,6 @@ char PROGMEM httpd_header_ecmd[] =
 
 char PROGMEM httpd_header_400[] =
 "HTTP/1.1 400 Bad Request\n"
-"Connection: close\n"
 "Content-Type: text/plain; charset=utf-8\n";
 
 
@@ -61,7 +91,6 @@ char PROGMEM httpd_header_gzip[] =
 #ifdef HTTPD_AUTH_SUPPORT
 char PROGMEM httpd_header_401[] =
 "HTTP/1.1 401 UNAUTHORIZED\n"
-"Connection: close\n"
 "WWW-Authenticate: Basic realm=\"Secure Area\"\n"
 "Content-Type: text/plain; charset=utf-8\n";
 
@@ -77,7 +106,6 @@ char PROGMEM httpd_body_400[] =
 
 char PROGMEM httpd_header_404[] =
 "HTTP/1.1 404 File Not Found\n"
-"Connection: close\n"
 "Content-Type: text/plain; charset=utf-8\n";
 
 
@@ -22,6 +22,7 @@
 #include <avr/pgmspace.h>
 #include <avr/eeprom.h>
 
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -45,7 +46,9 @@ void
 httpd_init(void)
 {
     uip_listen(HTONS(HTTPD_PORT), httpd_main);
+    uip_listen_window(HTONS(HTTPD_PORT), HTTPD_REQUEST_LEN - 1);
     uip_listen(HTONS(HTTPD_ALTERNATE_PORT), httpd_main);
+    uip_listen_window(HTONS(HTTPD_ALTERNATE_PORT), HTTPD_REQUEST_LEN - 1);
 }
 
 
@@ -72,126 +75,410 @@ httpd_cleanup (void)
 }
 
 
-static void
-httpd_handle_input (void)
+#ifdef HTTPD_AUTH_SUPPORT
+/* Check the credentials of an `Authorization' header value. */
+static uint8_t
+httpd_check_auth (char *ptr)
 {
-    char *ptr = (char *) uip_appdata;
+    while (*ptr == ' ')
+	ptr ++;
 
-#ifdef HTTPD_AUTH_SUPPORT
-    char *start_ptr;
-    if (STATE->header_reparse) {
-      printf("reparse next part of the header\n");
-      goto start_auth;
+    if (strncmp_P(ptr, PSTR("Basic "), 6)) {
+	printf ("auth: method is not basic.\n");
+	return 0;
+    }
+    ptr += 6;			/* Skip `Basic ' string. */
+
+    base64_str_decode (ptr);
+    printf ("auth: decoded auth string: '%s'.\n", ptr);
+
+    if (strncmp_P (ptr, PSTR(CONF_HTTPD_USERNAME ":"),
+		   strlen (CONF_HTTPD_USERNAME ":")) != 0) {
+	printf ("auth: username mismatch!\n");
+	return 0;
+    }
+
+    char pwd[sizeof(((struct eeprom_config_t *) 0)->httpd_auth_password) + 1];
+    eeprom_restore(httpd_auth_password, pwd, sizeof(pwd));
+
+    if (strncmp(pwd, ptr + strlen(CONF_HTTPD_USERNAME ":"), strlen(pwd))) {
+	printf ("auth: wrong passphrase, %s != %s.\n",
+		pwd, ptr + strlen(CONF_HTTPD_USERNAME ":"));
+	return 0;
     }
+
+    return 1;
+}
 #endif	/* HTTPD_AUTH_SUPPORT */
 
-    if (uip_len < 6) {
-	printf ("httpd: received request to short (%d bytes).\n", uip_len);
-	STATE->handler = httpd_handle_400;
-	return;
+
+#ifdef VFS_SUPPORT
+/* Extract the first entity tag of an If-None-Match or If-Range value,
+   the wildcard is returned as zero.  Returns 0 if there is none. */
+static uint8_t
+httpd_parse_etag (char *ptr, uint32_t *etag)
+{
+    while (*ptr == ' ')
+	ptr ++;
+
+    if (*ptr == '*') {
+	*etag = 0;
+	return 1;
     }
 
-    if (strncasecmp_P (uip_appdata, PSTR ("GET /"), 5)) {
-	printf ("httpd: received request is not GET.\n");
-	STATE->handler = httpd_handle_400;
+    /* Weak tags (W/"...") are fine, we only have to compare them. */
+    ptr = strchr (ptr, '"');
+    if (ptr == NULL)
+	return 0;		/* A date. */
+
+    *etag = strtoul (ptr + 1, NULL, 16);
+    return 1;
+}
+
+
+#ifndef VFS_TEENSY
+/* Parse an HTTP date like "Sun, 06 Nov 1994 08:49:37 GMT" into the form
+   vfs_mtime has.  The other (obsolete) formats and dates a FAT entry
+   can't hold give zero. */
+static uint32_t
+httpd_parse_date (char *ptr)
+{
+    uint8_t day, month, hour, min, sec;
+    uint16_t year;
+
+    ptr = strchr (ptr, ',');
+    if (ptr == NULL)
+	return 0;
+
+    day = strtoul (ptr + 1, &ptr, 10);
+    while (*ptr == ' ')
+	ptr ++;
+
+    for (month = 0; month < 12; month ++)
+	if (strncasecmp_P (ptr, httpd_months + 3 * month, 3) == 0)
+	    break;
+    ptr += 3;
+
+    year = strtoul (ptr, &ptr, 10);
+    hour = strtoul (ptr, &ptr, 10);
+    if (*ptr != ':')
+	return 0;
+    min = strtoul (ptr + 1, &ptr, 10);
+    if (*ptr != ':')
+	return 0;
+    sec = strtoul (ptr + 1, &ptr, 10);
+
+    if (month == 12 || day < 1 || day > 31 || year < 1980 || year > 2107
+	|| hour > 23 || min > 59 || sec > 59)
+	return 0;
+
+    return ((uint32_t) (year - 1980) << 25) | ((uint32_t) (month + 1) << 21)
+	| ((uint32_t) day << 16) | ((uint16_t) hour << 11) | (min << 5)
+	| (sec >> 1);
+}
+#endif	/* not VFS_TEENSY */
+
+
+/* Parse a single byte range of a `Range' header value.  Anything
+   else is ignored, the whole file is sent then. */
+static void
+httpd_parse_range (struct httpd_parser_t *p, char *ptr)
+{
+    char *end;
+
+    while (*ptr == ' ')
+	ptr ++;
+
+    if (strncmp_P (ptr, PSTR ("bytes="), 6))
 	return;
+    ptr += 6;
+
+    if (strchr (ptr, ','))
+	return;			/* Multiple ranges. */
+
+    if (*ptr == '-') {
+	/* Suffix range, the last N bytes. */
+	p->range_start = strtoul (++ ptr, &end, 10);
+	if (end == ptr || *end)
+	    return;
+	p->range_suffix = 1;
+    }
+    else {
+	p->range_start = strtoul (ptr, &end, 10);
+	if (end == ptr || *end != '-')
+	    return;
+
+	ptr = end + 1;
+	p->range_end = (vfs_size_t) -1;	/* Up to the end. */
+	if (*ptr) {
+	    p->range_end = strtoul (ptr, &end, 10);
+	    if (end == ptr || *end || p->range_end < p->range_start)
+		return;
+	}
     }
 
-    char *filename = uip_appdata + 5; /* beyond slash */
-    ptr = strchr (filename, ' ');
+    p->range = 1;
+}
+#endif	/* VFS_SUPPORT */
 
-    if (ptr == NULL) {
-	printf ("httpd: space after filename not found.\n");
-	STATE->handler = httpd_handle_400;
+
+/* Tell the header lines we look at by their name. */
+static uint8_t
+httpd_header (const char *name)
+{
+    if (strcasecmp_P (name, PSTR ("Connection")) == 0)
+	return HTTPD_HEADER_CONNECTION;
+#ifdef HTTPD_AUTH_SUPPORT
+    if (strcasecmp_P (name, PSTR ("Authorization")) == 0)
+	return HTTPD_HEADER_AUTHORIZATION;
+#endif
+#ifdef VFS_SUPPORT
+    if (strcasecmp_P (name, PSTR ("If-None-Match")) == 0)
+	return HTTPD_HEADER_IF_NONE_MATCH;
+#ifndef VFS_TEENSY
+    if (strcasecmp_P (name, PSTR ("If-Modified-Since")) == 0)
+	return HTTPD_HEADER_IF_MODIFIED_SINCE;
+#endif
+    if (strcasecmp_P (name, PSTR ("If-Range")) == 0)
+	return HTTPD_HEADER_IF_RANGE;
+    if (strcasecmp_P (name, PSTR ("Range")) == 0)
+	return HTTPD_HEADER_RANGE;
+#endif	/* VFS_SUPPORT */
+    return HTTPD_HEADER_OTHER;
+}
+
+
+/* A complete line of the request is in the parser's buffer. */
+static void
+httpd_parse_line (struct httpd_parser_t *p)
+{
+    char *line = p->buf + p->line;
+    p->buf[p->pos] = 0;
+
+    if (p->state == HTTPD_PARSE_REQUEST) {
+	if (*line == 0)
+	    return;		/* Empty lines before the request are ok. */
+
+	char *uri;
+	if (strncasecmp_P (line, PSTR ("GET /"), 5) == 0)
+	    uri = line + 4;
+	else if (strncasecmp_P (line, PSTR ("HEAD /"), 6) == 0) {
+	    uri = line + 5;
+	    p->head = 1;
+	}
+	else {
+	    printf ("httpd: received request is not GET or HEAD.\n");
+	    goto bad;
+	}
+
+	/* The decoded query of an ecmd request may contain spaces, the
+	   version was located by httpd_parse. */
+	if (p->version == 0) {
+	    printf ("httpd: space after filename not found.\n");
+	    goto bad;
+	}
+	char *version = p->buf + p->version;
+	version[-1] = 0;
+
+	/* HTTP/1.1 connections are persistent by default. */
+	p->keepalive = strcmp_P (version, PSTR ("HTTP/1.1")) == 0;
+
+	/* Move the uri to the front, header lines go after it. */
+	p->line = version - uri;
+	memmove (p->buf, uri, p->line);
+	p->pos = p->line;
+	p->state = HTTPD_PARSE_HEADER;
 	return;
     }
 
-    *ptr = 0;			/* Terminate filename. */
+    if (!p->value) {
+	/* The empty line ends the request, lines without a colon are
+	   ignored. */
+	if (p->pos == p->line)
+	    p->state = HTTPD_PARSE_DONE;
+	p->pos = p->line;
+	return;
+    }
+    p->value = 0;
 
-    /*
-     * Successfully parsed the GET request,
-     * possibly check authentication.
-     */
+    switch (p->header) {
+    case HTTPD_HEADER_CONNECTION:
+	while (*line == ' ')
+	    line ++;
 
+	if (strncasecmp_P (line, PSTR ("close"), 5) == 0)
+	    p->keepalive = 0;
+	else if (strncasecmp_P (line, PSTR ("keep-alive"), 10) == 0)
+	    p->keepalive = 1;
+	break;
 
 #ifdef HTTPD_AUTH_SUPPORT
-    ptr ++;			/* Increment pointer to the end of
-				   the GET */
-start_auth:
-    start_ptr = ptr;
-    ptr = strstr_P(ptr, PSTR("Authorization: "));
-
-    if (ptr == NULL) {
-        if (strstr_P(start_ptr, PSTR("\r\n\r\n"))) {
-          printf ("Authorization-header not found.\n");
-          printf("%s\n", start_ptr);
-	  goto auth_failed;
-        } else {
-          ptr = start_ptr;
-          /* Skip all Lines before the last one */
-          while (1) {
-            ptr = strstr_P(start_ptr, PSTR("\r\n"));
-            if (ptr) start_ptr = ptr + 2;
-            else break;
-          }
-          if (!strncmp(start_ptr, PSTR("Authorization: "), strlen(start_ptr))) {
-            printf("Authorization header is split over two packages, damn");
-            printf("%s\n", start_ptr);
-            goto auth_failed;
-          } else {
-            STATE->header_reparse = 1;
-            goto after_auth;
-          }
-        }
-    }
-    ptr += 15;			/* Skip `Authorization: ' header. */
+    case HTTPD_HEADER_AUTHORIZATION:
+	p->auth = httpd_check_auth (line);
+	break;
+#endif	/* HTTPD_AUTH_SUPPORT */
 
-    if (strncmp_P(ptr, PSTR("Basic "), 6)) {
-	printf ("auth: method is not basic.\n");
-	goto auth_failed;
+#ifdef VFS_SUPPORT
+    case HTTPD_HEADER_IF_NONE_MATCH:
+	p->none_match = httpd_parse_etag (line, &p->none_match_etag);
+	break;
+
+    case HTTPD_HEADER_IF_RANGE:
+	p->if_range = 1;
+	if (!httpd_parse_etag (line, &p->if_range_etag)) {
+	    /* Without a date we can compare, the whole file is sent. */
+	    p->if_range_date = 1;
+#ifndef VFS_TEENSY
+	    p->if_range_etag = httpd_parse_date (line);
+#endif
+	}
+	break;
+
+#ifndef VFS_TEENSY
+    case HTTPD_HEADER_IF_MODIFIED_SINCE:
+	if (!p->none_match)
+	    p->modified_since = httpd_parse_date (line);
+	break;
+#endif
+
+    case HTTPD_HEADER_RANGE:
+	httpd_parse_range (p, line);
+	break;
+#endif	/* VFS_SUPPORT */
     }
-    ptr += 6;			/* Skip `Basic ' string. */
 
-    char *nl = strchr (ptr, '\n');
-    if (nl == NULL) {
-	printf ("auth: newline not found.\n");
-	goto auth_failed;
+    p->pos = p->line;
+    return;
+
+  bad:
+    p->bad = 1;
+    p->state = HTTPD_PARSE_DONE;
+    p->pos = p->line;
+}
+
+
+/* Feed one byte of the request to the parser. */
+static void
+httpd_parse (char c)
+{
+    struct httpd_parser_t *p = &STATE->parse;
+
+    if (c == '\r')
+	return;
+
+    if (c == '\n') {
+	httpd_parse_line (p);
+	return;
     }
 
-    *nl = 0;			/* Zero-terminate BASE64-string. */
+    if (p->state == HTTPD_PARSE_REQUEST) {
+	if (c == ' ') {
+	    p->esc = 0;
+	    if (p->spaces < 2 && ++ p->spaces == 2
+		&& p->pos < HTTPD_REQUEST_LEN - 1)
+		p->version = p->pos + 1;
+	}
 
-    base64_str_decode (ptr);
-    printf ("auth: decoded auth string: '%s'.\n", ptr);
+	else if (p->spaces == 1) {
+	    /* Keep room for the version, the rest of an overlong uri is
+	       cut (the old parser was limited by the packet size). */
+	    if (p->pos >= HTTPD_REQUEST_LEN - sizeof (" HTTP/1.1")) {
+		p->cut = 1;
+		return;
+	    }
 
-    if (strncmp_P (ptr, PSTR(CONF_HTTPD_USERNAME ":"),
-		   strlen (CONF_HTTPD_USERNAME ":")) != 0) {
-	printf ("auth: username mismatch!\n");
-	goto auth_failed;
+#ifdef ECMD_PARSER_SUPPORT
+	    /* Decode ecmd queries as they come in, encoded they could
+	       need thrice the room. */
+	    if (p->ecmd) {
+		if (p->esc) {
+		    p->buf[p->pos] = (p->buf[p->pos] << 4)
+			| (((c <= '9') ? c - '0' : (c | 0x20) - 'a' + 10) & 15);
+		    if (++ p->esc == 3) {
+			p->esc = 0;
+			p->pos ++;
+		    }
+		    return;
+		}
+
+		if (c == '%') {
+		    p->buf[p->pos] = 0;
+		    p->esc = 1;
+		    return;
+		}
+
+		if (c == '+')
+		    c = ' ';
+	    }
+
+	    else if (c == '?') {
+		char *uri = memchr (p->buf, ' ', p->pos);
+		p->ecmd = p->buf + p->pos - uri == sizeof ("/" ECMD_INDEX)
+		    && strncmp_P (uri + 1, PSTR ("/" ECMD_INDEX),
+				  sizeof ("/" ECMD_INDEX) - 1) == 0;
+	    }
+#endif  /* ECMD_PARSER_SUPPORT */
+	}
     }
 
-    char pwd[sizeof(((struct eeprom_config_t *) 0)->httpd_auth_password) + 1];
-    eeprom_restore(httpd_auth_password, pwd, sizeof(pwd));
+    else if (!p->value) {
+	if (c == ':') {
+	    /* Keep the value only, if it is one we look at. */
+	    p->buf[p->pos] = 0;
+	    p->header = httpd_header (p->buf + p->line);
+	    p->value = 1;
+	    p->pos = p->line;
+	    return;
+	}
+    }
 
-    if (strncmp(pwd, ptr + strlen(CONF_HTTPD_USERNAME ":"), strlen(pwd))) {
-	printf ("auth: wrong passphrase, %s != %s.\n",
-		pwd, ptr + strlen(CONF_HTTPD_USERNAME ":"));
-      auth_failed:
-        httpd_cleanup();
-	STATE->handler = httpd_handle_401;
-        STATE->header_reparse = 0;
+    else if (p->header == HTTPD_HEADER_OTHER
+	     || (c == ' ' && p->pos == p->line))
 	return;
+
+    /* Overlong header values are cut, none of the interesting ones
+       is that long. */
+    if (p->pos < HTTPD_REQUEST_LEN - 1)
+	p->buf[p->pos ++] = c;
+}
+
+
+/* Set up the handler for the request the parser has read. */
+static void
+httpd_dispatch (void)
+{
+    char path[HTTPD_REQUEST_LEN + sizeof (HTTPD_INDEX) + 1];
+    char *filename = path + 1;	/* beyond slash */
+
+    STATE->head = STATE->parse.head;
+    STATE->keepalive = STATE->parse.keepalive;
+    STATE->header_acked = 0;
+    STATE->eof = 0;
+
+    if (STATE->parse.bad) {
+	/* We can't tell where the next request starts. */
+	STATE->keepalive = 0;
+	STATE->handler = httpd_handle_400;
+	goto out;
     }
-    if (STATE->header_reparse) {
-      STATE->header_reparse = 0;
-      return; /* We musn't open the file once again */
+
+#ifdef HTTPD_AUTH_SUPPORT
+    if (!STATE->parse.auth) {
+	printf ("Authorization-header not found.\n");
+	STATE->handler = httpd_handle_401;
+	goto out;
     }
+#endif	/* HTTPD_AUTH_SUPPORT */
 
-after_auth:
-    /* Dummy statement, to keep GCC happy, if HTTP_SD_DIR_SUPPORT is enabled
-       and thus the uint8_t definition the next statement in code. */
-    (void) 0;
+    strcpy (path, STATE->parse.buf);
 
-#endif	/* HTTPD_AUTH_SUPPORT */
+    if (STATE->parse.cut) {
+	/* Header lines got little room after it, don't rely on them. */
+	printf ("httpd: uri too long.\n");
+	STATE->keepalive = 0;
+	STATE->handler = httpd_handle_404;
+	goto out;
+    }
 
     /*
      * Authentication is okay, now fulfill request for file
@@ -206,7 +493,7 @@ after_auth:
     uint8_t offset = strlen_P(PSTR(ECMD_INDEX "?"));
     if (strncmp_P (filename, PSTR(ECMD_INDEX "?"), offset) == 0) {
 	httpd_handle_ecmd_setup (filename + offset);
-	return;
+	goto out;
     }
 #endif  /* ECMD_PARSER_SUPPORT */
 
@@ -216,12 +503,12 @@ after_auth:
 
     STATE->u.vfs.fd = vfs_open (filename);
     if (STATE->u.vfs.fd) {
-      STATE->handler = httpd_handle_vfs;
-      return;
+      httpd_handle_vfs_setup ();
+      goto out;
     }
 
     /* Now try appending the index.html document name */
-    ptr = filename + strlen (filename);
+    char *ptr = filename + strlen (filename);
 #ifdef HTTP_SD_DIR_SUPPORT
     uint8_t lastchar = ptr[-1];
 #endif
@@ -231,8 +518,8 @@ after_auth:
     strcpy_P (ptr, PSTR (HTTPD_INDEX));
     STATE->u.vfs.fd = vfs_open (filename);
     if (STATE->u.vfs.fd) {
-      STATE->handler = httpd_handle_vfs;
-      return;
+      httpd_handle_vfs_setup ();
+      goto out;
     }
 
     if (ptr == filename)	/* Make sure not to strip initial slash. */
@@ -252,15 +539,112 @@ after_auth:
 	}
 	else
 	    STATE->handler = httpd_handle_sd_dir;
-	return;
+	goto out;
     }
 #endif	/* HTTP_SD_DIR_SUPPORT */
 
     /* Fallback, send 404. */
     STATE->handler = httpd_handle_404;
+
+  out:
+    memset (&STATE->parse, 0, offsetof (struct httpd_parser_t, buf));
 }
 
 
+/* Feed request data to the parser.  Data following a complete request
+   while the previous response is still being sent is kept in the
+   parser's buffer, the window httpd_window advertised lets it fit. */
+static void
+httpd_feed (char *data, uint16_t len)
+{
+    struct httpd_parser_t *p = &STATE->parse;
+
+    for (; len; len --) {
+	if (p->state == HTTPD_PARSE_DONE) {
+	    if (STATE->handler) {
+		uint8_t room = HTTPD_REQUEST_LEN - 1 - p->pos;
+		if (len > room) {
+		    /* The client sent more than our window, hand back
+		       the rest. */
+		    printf ("httpd: holding back %u bytes.\n", len - room);
+		    uip_unread (len - room);
+		    uip_stop ();
+		    len = room;
+		}
+
+		memmove (p->buf + p->pos, data, len);
+		p->pos += len;
+		return;
+	    }
+	    httpd_dispatch ();
+	}
+
+	httpd_parse (*(data ++));
+    }
+
+    if (p->state == HTTPD_PARSE_DONE && !STATE->handler)
+	httpd_dispatch ();
+}
+
+
+/* Only let the client send what the parser is sure to take, even if a
+   request ends within the data: the room after the uri read so far
+   (an overlong one is cut), or after the pipelined data of a complete
+   request. */
+static void
+httpd_window (void)
+{
+    struct httpd_parser_t *p = &STATE->parse;
+    uint8_t used = p->pos;
+
+    if (p->state == HTTPD_PARSE_HEADER)
+	used = p->line;
+    else if (p->state == HTTPD_PARSE_REQUEST
+	     && used > HTTPD_REQUEST_LEN - sizeof (" HTTP/1.1"))
+	used = HTTPD_REQUEST_LEN - sizeof (" HTTP/1.1");
+
+    uint8_t room = HTTPD_REQUEST_LEN - 1 - used;
+
+    if (room) {
+	uip_conn->wnd = room;
+	if (uip_stopped (uip_conn))
+	    uip_restart ();	/* tell the client about the new window */
+    }
+    else
+	uip_stop ();
+}
+
+
+void
+httpd_finish (void)
+{
+    httpd_cleanup ();
+
+    if (!STATE->keepalive) {
+	uip_close ();
+	return;
+    }
+
+    printf ("httpd: response done, keeping connection.\n");
+    STATE->handler = NULL;
+    STATE->idle = 0;
+    uip_window_disable ();
+
+    if (STATE->parse.state == HTTPD_PARSE_DONE) {
+	/* Pipelined data goes through the parser once the request is
+	   set up, dispatching leaves the buffer alone. */
+	char *data = STATE->parse.buf + STATE->parse.line;
+	uint8_t len = STATE->parse.pos - STATE->parse.line;
+
+	httpd_dispatch ();
+	httpd_feed (data, len);
+
+	/* The acknowledgement was for the previous response. */
+	uip_flags &= ~UIP_ACKDATA;
+	STATE->handler ();
+    }
+}
+
 
 void
 httpd_main(void)
@@ -268,11 +652,13 @@ httpd_main(void)
     if (uip_aborted() || uip_timedout()) {
 	httpd_cleanup ();
 	printf ("httpd: connection aborted\n");
+	return;
     }
 
     if (uip_closed()) {
 	httpd_cleanup ();
 	printf ("httpd: connection closed\n");
+	return;
     }
 
     if (uip_connected()) {
@@ -280,25 +666,35 @@ httpd_main(void)
 
 	/* initialize struct */
 	STATE->handler = NULL;
-	STATE->header_acked = 0;
-	STATE->eof = 0;
-	STATE->header_reparse = 0;
+	STATE->idle = 0;
+	memset (&STATE->parse, 0, sizeof (STATE->parse));
     }
 
-    if (uip_newdata() && (!STATE->handler || STATE->header_reparse)) {
+    if (uip_newdata()) {
 	printf ("httpd: new data\n");
-	httpd_handle_input ();
+	STATE->idle = 0;
+	httpd_feed ((char *) uip_appdata, uip_datalen ());
     }
 
     if(uip_rexmit() ||
        uip_newdata() ||
        uip_acked() ||
-       uip_connected()) {
+       uip_connected() ||
+       (uip_poll() && uip_windowed(uip_conn))) {
 
 	/* Call associated handler, if set already. */
-	if (STATE->handler && (!STATE->header_reparse))
+	if (STATE->handler)
 	    STATE->handler ();
     }
+
+    else if (uip_poll() && !STATE->handler
+	     && ++ STATE->idle >= HTTPD_KEEPALIVE_TIMEOUT * 5) {
+	/* uip_poll comes every 200ms */
+	printf ("httpd: closing idle connection\n");
+	uip_close ();
+    }
+
+    httpd_window ();
 }
 
 /*
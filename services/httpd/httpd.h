@@ -23,8 +23,9 @@
 #define _HTTPD_H
 
 #include <stdint.h>
+#include <avr/pgmspace.h>
 
-#ifdef AVR
+#if defined(AVR) || defined(ARCH_HOST)
 #include "protocols/uip/uip.h"
 #endif
 
@@ -39,22 +40,31 @@
 void httpd_init (void);
 void httpd_main (void);
 void httpd_cleanup (void);
+void httpd_finish (void);
 
 void httpd_handle_400 (void);
 void httpd_handle_401 (void);
 void httpd_handle_404 (void);
 
+void httpd_handle_vfs_setup (void);
 void httpd_handle_vfs (void);
 void httpd_handle_sd_dir (void);
 void httpd_handle_sd_dir_redirect (void);
 
-void httpd_handle_ecmd_setup (char *encoded_cmd);
+void httpd_handle_ecmd_setup (char *cmd);
 void httpd_handle_ecmd (void);
 
 const PGM_P httpd_mimetype_detect (const uint8_t *);
 
 /* headers */
 extern char httpd_header_200[];
+extern char httpd_header_206[];
+extern char httpd_header_304[];
+extern char httpd_header_416[];
+extern char httpd_months[];
+extern char httpd_header_ranges[];
+extern char httpd_header_close[];
+extern char httpd_header_keepalive[];
 extern char httpd_header_ct_css[];
 extern char httpd_header_ct_html[];
 extern char httpd_header_ct_xhtml[];
@@ -82,11 +92,16 @@ extern char httpd_header_end[];
 				    PSTR ("%u\n"), a)
 #else
 #  define PASTE_LEN(a)    sprintf_P(uip_appdata + strlen(uip_appdata),	\
-				    PSTR ("%lu\n"), a)
+				    PSTR ("%lu\n"), (unsigned long) (a))
 #endif
 
 #define PASTE_LEN_P(a)    sprintf_P(uip_appdata + strlen(uip_appdata),	\
-				    PSTR ("%u\n"), strlen_P(a))
+				    PSTR ("%u\n"), (unsigned) strlen_P(a))
+
+/* Connection header, after the status line.  Responses without a
+   Content-Length have to clear STATE->keepalive first. */
+#define PASTE_CONNECTION()						\
+    PASTE_P (STATE->keepalive ? httpd_header_keepalive : httpd_header_close)
 
 /* FIXME maybe check uip_mss and emit warning on debugging console. */
 #define PASTE_SEND()    uip_send(uip_appdata, strlen(uip_appdata))
@@ -48,7 +48,7 @@ display_password:
       new_pass[sizeof(new_pass) - 1] = 0;
 
       eeprom_save(httpd_auth_password, new_pass, sizeof(new_pass));
-      eeprom_update_chksum();
+      eeprom_commit();
 
       goto display_password;
     }
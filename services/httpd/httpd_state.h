@@ -33,10 +33,91 @@ typedef enum {
 
 #define SD_DIR_MAX_DIRNAME_LEN 75
 
+/* HTTPD_REQUEST_LEN bytes hold the request uri and the value of the
+   current header line, or pipelined data while a response is sent. */
+#if HTTPD_REQUEST_LEN < 32 || HTTPD_REQUEST_LEN > 255
+#error "HTTPD_REQUEST_LEN must be between 32 and 255"
+#endif
+
+typedef enum {
+    HTTPD_PARSE_REQUEST = 0,	/* waiting for the request line */
+    HTTPD_PARSE_HEADER,		/* reading header lines */
+    HTTPD_PARSE_DONE,		/* complete request waiting for dispatch */
+} httpd_parse_state_t;
+
+/* The header lines we look at, known by name once the colon is read. */
+typedef enum {
+    HTTPD_HEADER_OTHER = 0,
+    HTTPD_HEADER_CONNECTION,
+    HTTPD_HEADER_AUTHORIZATION,
+    HTTPD_HEADER_IF_NONE_MATCH,
+    HTTPD_HEADER_IF_MODIFIED_SINCE,
+    HTTPD_HEADER_IF_RANGE,
+    HTTPD_HEADER_RANGE,
+} httpd_header_t;
+
+/* The request parser, consumes the request a byte at a time,
+   independent of how it is split into segments.  It is kept apart
+   from the response state, so a pipelined request can be read while
+   the previous response is still being sent. */
+struct httpd_parser_t {
+    unsigned state			: 2;
+    unsigned head			: 1;
+    unsigned keepalive			: 1;
+    unsigned auth			: 1;
+    unsigned bad			: 1;
+
+    /* The request line is taken apart while it streams in: spaces seen
+       so far, whether the uri had to be cut and the percent-escape
+       state while decoding the query of an ecmd request. */
+    unsigned spaces			: 2;
+    unsigned cut			: 1;
+    unsigned ecmd			: 1;
+    unsigned esc			: 2;
+
+    /* Only the value of a header line is kept, after the colon. */
+    unsigned value			: 1;
+    unsigned header			: 3;
+
+#ifdef VFS_SUPPORT
+    /* Conditional and partial requests, see httpd_handle_vfs_setup. */
+    unsigned none_match			: 1;
+    unsigned if_range			: 1;
+    unsigned if_range_date		: 1;
+    unsigned range			: 1;
+    unsigned range_suffix		: 1;
+
+    /* If-Range holds an entity tag or, with if_range_date, a date.
+       Dates are kept like vfs_mtime has them, zero if there is none.
+       If-Modified-Since only counts without If-None-Match, they share
+       their room. */
+    uint32_t if_range_etag;
+    union {
+	uint32_t none_match_etag;
+	uint32_t modified_since;
+    };
+    vfs_size_t range_start, range_end;
+#endif	/* VFS_SUPPORT */
+
+    /* The uri is kept at the start of buf, header values follow it.
+       Once the request is complete, pipelined data that came with it
+       goes there (up to pos), our window makes sure it fits.  While
+       reading the request line, version is where the http version
+       starts (zero until it is found). */
+    uint8_t line, pos, version;
+    char buf[HTTPD_REQUEST_LEN];
+};
+
 struct httpd_connection_state_t {
     unsigned header_acked		: 1;
-    unsigned header_reparse		: 1;
     unsigned eof			: 1;
+    unsigned head			: 1;
+    unsigned keepalive			: 1;
+
+    /* Polls without a request, to time out idle connections. */
+    uint8_t idle;
+
+    struct httpd_parser_t parse;
 
     /* The associated connection handler function */
     void (* handler)();
@@ -50,7 +131,26 @@ struct httpd_connection_state_t {
 	    /* Content-type identifier char. */
 	    unsigned char content_type;
 
-	    vfs_size_t acked, sent;
+	    unsigned gzip		: 1;
+	    unsigned not_modified	: 1;
+	    unsigned partial		: 1;
+	    unsigned unsatisfiable	: 1;
+
+#ifdef MIME_SUPPORT
+	    /* Sniffed content type, NULL if the file can't seek. */
+	    PGM_P mime;
+#endif
+
+	    /* ETag source, zero if the VFS module can't tell. */
+	    uint32_t ident;
+
+#ifndef VFS_TEENSY
+	    /* Last-Modified, see vfs_mtime. */
+	    uint32_t mtime;
+#endif
+
+	    /* The range to send, END is zero if the size is unknown. */
+	    vfs_size_t start, end, acked, sent;
 	} vfs;
 #endif	/* VFS_SUPPORT */
 
@@ -204,6 +204,7 @@ void
 stella_storeToEEROM()
 {
 	eeprom_save(stella_channel_values, stella_brightness, 8);
+	eeprom_commit();
 }
 
 /* How to use:
@@ -26,6 +26,7 @@
 #include <stdlib.h>
 
 #include "protocols/uip/uip.h"
+#include "protocols/uip/uip_router.h"
 #include "core/eeprom.h"
 #include "tftp.h"
 #include "tftp_net.h"
@@ -93,6 +94,8 @@ flash_page(uint32_t page, uint8_t *buf)
 void
 tftp_handle_packet(void)
 {
+    struct tftp_connection_state_t *state = &uip_udp_conn->appstate.tftp;
+
     /*
      * overwrite udp connection information (i.e. take from incoming packet)
      */
@@ -102,8 +105,12 @@ tftp_handle_packet(void)
     /*
      * care for incoming tftp packet now ...
      */
-    uint16_t i, base;
+    uint16_t i;
+    uint32_t base;
     struct tftp_hdr *pk = uip_appdata;
+#ifdef TFTP_OPTIONS_SUPPORT
+    uint16_t len;
+#endif
 
     switch(HTONS(pk->type)) {
 #ifndef TFTP_UPLOAD_ONLY
@@ -111,54 +118,68 @@ tftp_handle_packet(void)
      * streaming data back to the client (download) ...
      */
     case 1: /* read request */
-	uip_udp_conn->appstate.tftp.download = 1;
-	uip_udp_conn->appstate.tftp.transfered = 0;
-	uip_udp_conn->appstate.tftp.finished = 0;
+	state->download = 1;
+	state->transfered = 0;
+	state->sent = 0;
+	state->finished = 0;
 
         bootload_delay = 0;                      /* Stop bootloader. */
 
+#ifdef TFTP_OPTIONS_SUPPORT
+	if((len = tftp_options(state, pk, uip_datalen()))) {
+	    uip_udp_send(len);                   /* client acks block 0 */
+	    break;
+	}
+#endif
+
 	goto send_data;
 
     case 4: /* acknowledgement */
-	if(uip_udp_conn->appstate.tftp.download != 1)
+	if(state->download != 1)
 	    goto error_out;
 
-	if(HTONS(pk->u.ack.block) < uip_udp_conn->appstate.tftp.transfered
-	   || (HTONS(pk->u.ack.block) >
-	       uip_udp_conn->appstate.tftp.transfered + 1))
+	if(HTONS(pk->u.ack.block) < state->transfered)
+	    break;                               /* stale ack */
+
+	if(HTONS(pk->u.ack.block) > state->sent)
 	    goto error_out; /* ack out of order */
 
-	uip_udp_conn->appstate.tftp.transfered = HTONS(pk->u.ack.block);
+	state->transfered = HTONS(pk->u.ack.block);
 
-    send_data:
-	if(uip_udp_conn->appstate.tftp.finished) {
+	if(state->finished && state->transfered == state->sent) {
             bootload_delay = CONF_BOOTLOAD_DELAY;    /* Restart bootloader. */
 	    return;                                  /* nothing more to do */
 	}
 
-	pk->type = HTONS(3); /* data packet */
-	pk->u.data.block = HTONS(uip_udp_conn->appstate.tftp.transfered + 1);
+    send_data:
+	/* send the window following the acknowledged block */
+	state->finished = 0;
+	state->sent = state->transfered;
 
-	base = 512 * uip_udp_conn->appstate.tftp.transfered;
+	for(;;) {
+	    state->sent ++;
+	    pk->type = HTONS(3); /* data packet */
+	    pk->u.data.block = HTONS(state->sent);
 
-#if FLASHEND == 0xFFFF
-	if(uip_udp_conn->appstate.tftp.transfered
-	   && base == 0)     /* base overflowed ! */
-#else
-	if(base > FLASHEND)
-#endif
-	{
-	    uip_udp_send(4); /* send empty packet to finish transfer */
-	    uip_udp_conn->appstate.tftp.finished = 1;
-	    return;
-	}
+	    base = (uint32_t) TFTP_BLKSIZE(state) * (state->sent - 1);
+
+	    for(i = 0; i < TFTP_BLKSIZE(state) && base + i <= FLASHEND; i ++)
+		pk->u.data.data[i] = pgm_read_byte_near(base + i);
 
-	for(i = 0; i < 512; i ++)
-	    pk->u.data.data[i] =
-              pgm_read_byte_near(base + i);
+	    uip_udp_send(4 + i);
 
-	uip_udp_send(4 + 512);
-	uip_udp_conn->appstate.tftp.transfered ++;
+	    if(i < TFTP_BLKSIZE(state)) {
+		state->finished = 1;             /* end of flash reached */
+		break;
+	    }
+
+	    if(state->sent - state->transfered >= TFTP_WINDOWSIZE(state))
+		break;
+
+	    uip_process(UIP_UDP_SEND_CONN);      /* push it out */
+	    router_output();
+	    uip_slen = 0;
+	}
 	break;
 #endif /* not TFTP_UPLOAD_ONLY */
 
@@ -166,39 +187,70 @@ tftp_handle_packet(void)
      * streaming data from the client (firmware upload) ...
      */
     case 2: /* write request */
-	uip_udp_conn->appstate.tftp.download = 0;
-	uip_udp_conn->appstate.tftp.transfered = 0;
-	uip_udp_conn->appstate.tftp.finished = 0;
+	state->download = 0;
+	state->transfered = 0;
+	state->unacked = 0;
+	state->finished = 0;
+
+#ifdef TFTP_OPTIONS_SUPPORT
+	if((len = tftp_options(state, pk, uip_datalen()))) {
+	    uip_udp_send(len);                   /* client sends block 1 */
+	    break;
+	}
+#endif
+
+	pk->u.ack.block = HTONS(0);
+	goto send_ack;
+
+#ifdef TFTP_OPTIONS_SUPPORT
+    case 6: /* option acknowledgement (TFTP-o-matic) */
+	if(state->download != 0 || state->transfered != 0)
+	    goto error_out;
+
+	/* the server decides, give up if we can't flash its blocks */
+	if(tftp_parse_options(state, pk->u.raw, (char *) pk + uip_datalen())
+	   & TFTP_OPTION_CHANGED)
+	    goto error_out;
 
 	pk->u.ack.block = HTONS(0);
 	goto send_ack;
+#endif
 
     case 3: /* data packet */
         bootload_delay = 0;                      /* Stop bootloader. */
 
-	if(uip_udp_conn->appstate.tftp.download != 0)
+	if(state->download != 0)
 	    goto error_out;
 
-	if(HTONS(pk->u.ack.block) < uip_udp_conn->appstate.tftp.transfered)
-	    goto error_out;                     /* too early */
+	if(uip_datalen() > TFTP_BLKSIZE(state) + 4)
+	    goto error_out;			/* not the agreed block size */
 
-	if(HTONS(pk->u.ack.block) == uip_udp_conn->appstate.tftp.transfered)
+	if(HTONS(pk->u.ack.block) == state->transfered)
 	    goto send_ack;			/* already handled */
 
-	if(HTONS(pk->u.ack.block) > uip_udp_conn->appstate.tftp.transfered + 1)
-	    goto error_out;			/* too late */
+	if(HTONS(pk->u.ack.block) < state->transfered)
+	    break;                              /* retransmitted window */
 
-	base = 512 * (HTONS(pk->u.ack.block) - 1);
+	if(HTONS(pk->u.ack.block) > state->transfered + 1) {
+	    if(state->unacked == TFTP_UNACKED_GAP)
+		break;                          /* already told the client */
 
-	for(i = uip_datalen() - 4; i < 512; i ++)
+	    state->unacked = TFTP_UNACKED_GAP;  /* go on after the last one */
+	    pk->u.ack.block = HTONS(state->transfered);
+	    goto send_ack;
+	}
+
+	base = (uint32_t) TFTP_BLKSIZE(state) * (HTONS(pk->u.ack.block) - 1);
+
+	for(i = uip_datalen() - 4; i < TFTP_BLKSIZE(state); i ++)
 	    pk->u.data.data[i] = 0xFF;	        /* EOF reached, init rest */
 
-	for(i = 0; i < 512 / SPM_PAGESIZE; i ++)
-	    flash_page(base + i * SPM_PAGESIZE,
-		       pk->u.data.data + i * SPM_PAGESIZE);
+	/* blocks are made of whole pages, program them right away */
+	for(i = 0; i < TFTP_BLKSIZE(state); i += SPM_PAGESIZE)
+	    flash_page(base + i, pk->u.data.data + i);
 
-	if(uip_datalen() < 512 + 4) {
-	    uip_udp_conn->appstate.tftp.finished = 1;
+	if(uip_datalen() < TFTP_BLKSIZE(state) + 4) {
+	    state->finished = 1;
 
 #           ifdef TFTPOMATIC_SUPPORT
             bootload_delay = 1;                      /* ack, then start app */
@@ -207,7 +259,15 @@ tftp_handle_packet(void)
 #           endif
 	}
 
-	uip_udp_conn->appstate.tftp.transfered = HTONS(pk->u.ack.block);
+	state->transfered = HTONS(pk->u.ack.block);
+
+	/* ack once per window */
+	if(state->unacked == TFTP_UNACKED_GAP)
+	    state->unacked = 0;
+	if(! state->finished
+	   && ++ state->unacked < TFTP_WINDOWSIZE(state))
+	    break;
+	state->unacked = 0;
 
     send_ack:
 	pk->type = HTONS(4);
@@ -53,6 +53,9 @@ tftp_handle_packet(void)
      * care for incoming tftp packet now ...
      */
     struct tftp_hdr *pk = uip_appdata;
+#ifdef TFTP_OPTIONS_SUPPORT
+    uint16_t len;
+#endif
 
     switch(HTONS(pk->type)) {
     /*
@@ -61,49 +64,80 @@ tftp_handle_packet(void)
     case 1:			/* read request */
 	state->download = 1;
 	state->transfered = 0;
+	state->sent = 0;
 	state->finished = 0;
 
 	state->fh = vfs_open (pk->u.raw);
 	if (state->fh == NULL) goto error_out;
 
+#ifdef TFTP_OPTIONS_SUPPORT
+	if ((len = tftp_options (state, pk, uip_datalen ()))) {
+	    uip_udp_send (len);	/* client acks block 0 */
+	    break;
+	}
+#endif
+
 	goto send_data;
 
     case 4:			/* acknowledgement */
 	if(state->download != 1)
 	    goto error_out;
 
-	if(HTONS(pk->u.ack.block) < state->transfered
-	   || (HTONS(pk->u.ack.block) >
-	       state->transfered + 1))
+	if(HTONS(pk->u.ack.block) < state->transfered)
+	    break;		/* stale, a later ack got here first */
+
+	if(HTONS(pk->u.ack.block) > state->sent)
 	    goto error_out;	/* ack out of order */
 
 	state->transfered = HTONS(pk->u.ack.block);
 
-    send_data:
-	if(state->finished)
+	if(state->finished && state->transfered == state->sent)
 	    goto close_connection;
 
-	pk->type = HTONS(3);	/* data packet */
-	pk->u.data.block = HTONS(state->transfered + 1);
+    send_data:
+	/* Send the window following the acknowledged block.  If the ack
+	   is for a block before the end of the last window, the client
+	   missed some, they are read again from there. */
+	state->finished = 0;
+	state->sent = state->transfered;
+
+	for (;;) {
+	    state->sent ++;
+	    pk->type = HTONS(3);	/* data packet */
+	    pk->u.data.block = HTONS(state->sent);
 
-	fs_size_t ret = vfs_read (state->fh, pk->u.data.data, 512);
+	    fs_size_t ret = vfs_pread (state->fh, pk->u.data.data,
+				       (vfs_size_t) (state->sent - 1)
+				       * TFTP_BLKSIZE(state),
+				       TFTP_BLKSIZE(state));
+	    if (ret < 0)
+		goto error_out;
 
-	if (ret < 0)
-	    goto error_out;
+	    uip_udp_send (4 + ret);
 
-	if (ret < 512)
-	    state->finished = 1;
+	    if (ret < TFTP_BLKSIZE(state)) {
+		state->finished = 1;
+		break;
+	    }
+
+	    if (state->sent - state->transfered >= TFTP_WINDOWSIZE(state))
+		break;
 
-	uip_udp_send (4 + ret);
-	state->transfered ++;
+	    /* push this block out, the buffer is needed for the next one */
+	    uip_process(UIP_UDP_SEND_CONN);
+	    router_output();
+	    uip_slen = 0;
+	}
 	break;
 
+#ifndef VFS_TEENSY
     /*
      * streaming data from the client (firmware upload) ...
      */
     case 2:			/* write request */
 	state->download = 0;
 	state->transfered = 0;
+	state->unacked = 0;
 	state->finished = 0;
 
 	/* try to create the file, shouldn't hurt if it already exists */
@@ -112,6 +146,13 @@ tftp_handle_packet(void)
 
 	if (state->fh == NULL) goto error_out;
 
+#ifdef TFTP_OPTIONS_SUPPORT
+	if ((len = tftp_options (state, pk, uip_datalen ()))) {
+	    uip_udp_send (len);	/* client goes on with block 1 */
+	    break;
+	}
+#endif
+
 	pk->u.ack.block = HTONS(0);
 	goto send_ack;
 
@@ -119,23 +160,40 @@ tftp_handle_packet(void)
 	if (state->download != 0)
 	    goto error_out;
 
+	if (HTONS (pk->u.ack.block) == state->transfered)
+	    goto send_ack;	/* already handled, our ack got lost */
+
 	if (HTONS (pk->u.ack.block) < state->transfered)
-	    goto error_out;	/* too early */
+	    break;		/* retransmitted window, wait for its end */
 
-	if (HTONS (pk->u.ack.block) == state->transfered)
-	    goto send_ack;	/* already handled */
+	if (HTONS (pk->u.ack.block) > state->transfered + 1) {
+	    /* a block got lost, have the client go on after the last
+	       one we got (once per gap) */
+	    if (state->unacked == TFTP_UNACKED_GAP)
+		break;
 
-	if (HTONS (pk->u.ack.block) > state->transfered + 1)
-	    goto error_out;	/* too late */
+	    state->unacked = TFTP_UNACKED_GAP;
+	    pk->u.ack.block = HTONS (state->transfered);
+	    goto send_ack;
+	}
 
-	if (vfs_write (state->fh, pk->u.data.data, uip_datalen () - 4) <= 0)
+	if (uip_datalen () > 4
+	    && vfs_write (state->fh, pk->u.data.data, uip_datalen () - 4) <= 0)
 	    goto error_out;
 
-	if (uip_datalen () < 512 + 4)
+	if (uip_datalen () < TFTP_BLKSIZE(state) + 4)
 	    state->finished = 1;
 
 	state->transfered = HTONS (pk->u.ack.block);
 
+	/* ack once per window */
+	if (state->unacked == TFTP_UNACKED_GAP)
+	    state->unacked = 0;
+	if (! state->finished
+	    && ++ state->unacked < TFTP_WINDOWSIZE(state))
+	    break;
+	state->unacked = 0;
+
     send_ack:
 	pk->type = HTONS (4);
 	uip_udp_send (4);	/* send ack */
@@ -144,6 +202,7 @@ tftp_handle_packet(void)
 	    goto close_connection;
 
 	break;
+#endif	/* not VFS_TEENSY, inlined files are read-only */
 
     /*
      * protocol errors
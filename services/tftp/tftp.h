@@ -51,9 +51,50 @@ struct tftp_hdr {
 };
 
 
+/* largest block that fits the packet buffer */
+#define TFTP_BLKSIZE_LIMIT (UIP_BUFSIZE - UIP_LLH_LEN - UIP_IPUDPH_LEN - 4)
+
+#ifdef BOOTLOADER_SUPPORT
+/* every block is programmed to flash right away, keep it to whole pages */
+#define TFTP_BLKSIZE_ALIGN SPM_PAGESIZE
+#else
+#define TFTP_BLKSIZE_ALIGN 1
+#endif
+
+#ifdef TFTP_OPTIONS_SUPPORT
+#define TFTP_BLKSIZE(state)    ((state)->blksize)
+#define TFTP_WINDOWSIZE(state) ((state)->windowsize)
+#else
+#define TFTP_BLKSIZE(state)    512
+#define TFTP_WINDOWSIZE(state) 1
+#endif
+
+
 /* prototypes */
 void tftp_handle_packet(void);
 
+#ifdef TFTP_OPTIONS_SUPPORT
+struct tftp_connection_state_t;
+
+#define TFTP_OPTION_BLKSIZE     0x01
+#define TFTP_OPTION_WINDOWSIZE  0x02
+#define TFTP_OPTION_CHANGED     0x80	/* a value isn't usable as it is */
+
+/* Parse the blksize and windowsize options between p and end into state,
+   return a bit mask of the options found.  Values we can't use are
+   lowered (or ignored) and flagged with TFTP_OPTION_CHANGED, which is
+   fine for answering a request, but a client has to use what the OACK
+   says or give up (RFC 2348). */
+uint8_t tftp_parse_options(struct tftp_connection_state_t *state,
+			   char *p, char *end);
+
+/* Parse the options of the request in pk (len bytes) and replace it by
+   the OACK answering them.  Returns the length of the OACK or 0 if the
+   request has no options we know of. */
+uint16_t tftp_options(struct tftp_connection_state_t *state,
+		      struct tftp_hdr *pk, uint16_t len);
+#endif
+
 
 #if defined(BOOTLOADER_SUPPORT)  \
   && (defined(TFTPOMATIC_SUPPORT) || defined(BOOTP_SUPPORT))
@@ -84,6 +125,11 @@ tftp_fire_tftpomatic(uip_ipaddr_t *ip, const unsigned char *filename) {
   tftp_recv_conn->appstate.tftp.transfered = 0;
   tftp_recv_conn->appstate.tftp.finished = 0;
   tftp_recv_conn->appstate.tftp.bootp_image = 1;
+  tftp_recv_conn->appstate.tftp.unacked = 0;
+#ifdef TFTP_OPTIONS_SUPPORT
+  tftp_recv_conn->appstate.tftp.blksize = 512;
+  tftp_recv_conn->appstate.tftp.windowsize = 1;
+#endif
 }
 #endif /* TFTPOMATIC_SUPPORT || BOOTP_SUPPORT */
 
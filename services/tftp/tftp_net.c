@@ -21,11 +21,94 @@
 
 #include <avr/pgmspace.h>
 
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
 #include "protocols/uip/uip.h"
 #include "tftp.h"
 #include "tftp_net.h"
 #include "tftp_state.h"
 
+#ifdef TFTP_OPTIONS_SUPPORT
+uint8_t
+tftp_parse_options(struct tftp_connection_state_t *state, char *p, char *end)
+{
+    uint8_t found = 0;
+
+    state->blksize = 512;
+    state->windowsize = 1;
+
+    while (p < end) {
+	char *name = p;
+	p += strnlen(p, end - p) + 1;
+	if (p >= end)
+	    break;
+
+	uint32_t value = strtoul(p, NULL, 10);
+	p += strnlen(p, end - p) + 1;
+
+	/* RFC 2348 allows 8 to 65464 bytes, we can't go beyond the
+	 * packet buffer, the server will use what we answer */
+	if (strcasecmp_P(name, PSTR("blksize")) == 0) {
+	    uint32_t usable = value;
+	    if (usable > TFTP_BLKSIZE_LIMIT)
+		usable = TFTP_BLKSIZE_LIMIT;
+	    usable -= usable % TFTP_BLKSIZE_ALIGN;
+	    if (usable != value || usable < 8)
+		found |= TFTP_OPTION_CHANGED;
+	    if (usable < 8 || usable < TFTP_BLKSIZE_ALIGN)
+		continue;		/* ignore the option */
+
+	    state->blksize = usable;
+	    found |= TFTP_OPTION_BLKSIZE;
+	}
+
+	/* RFC 7440 */
+	else if (strcasecmp_P(name, PSTR("windowsize")) == 0) {
+	    if (value < 1 || value > TFTP_WINDOWSIZE_MAX)
+		found |= TFTP_OPTION_CHANGED;
+	    if (value < 1)
+		continue;
+	    if (value > TFTP_WINDOWSIZE_MAX)
+		value = TFTP_WINDOWSIZE_MAX;
+
+	    state->windowsize = value;
+	    found |= TFTP_OPTION_WINDOWSIZE;
+	}
+    }
+
+    return found;
+}
+
+
+uint16_t
+tftp_options(struct tftp_connection_state_t *state, struct tftp_hdr *pk,
+	     uint16_t len)
+{
+    char *p = pk->u.raw, *end = (char *) pk + len;
+
+    /* skip filename and mode */
+    p += strnlen(p, end - p) + 1;
+    if (p < end)
+	p += strnlen(p, end - p) + 1;
+
+    uint8_t found = tftp_parse_options(state, p, end);
+    if (! (found & (TFTP_OPTION_BLKSIZE | TFTP_OPTION_WINDOWSIZE)))
+	return 0;
+
+    pk->type = HTONS(6);	/* option acknowledgement */
+    p = pk->u.raw;
+
+    if (found & TFTP_OPTION_BLKSIZE)
+	p += sprintf_P(p, PSTR("blksize%c%u"), 0, state->blksize) + 1;
+    if (found & TFTP_OPTION_WINDOWSIZE)
+	p += sprintf_P(p, PSTR("windowsize%c%u"), 0, state->windowsize) + 1;
+
+    return p - (char *) pk;
+}
+#endif /* TFTP_OPTIONS_SUPPORT */
+
 void
 tftp_net_init(void)
 {
@@ -97,7 +180,18 @@ tftp_net_main(void)
     int l = strlen(uip_udp_conn->appstate.tftp.filename);
     memcpy(tftp_pk->u.raw, uip_udp_conn->appstate.tftp.filename, l + 1);
     memcpy_P(&tftp_pk->u.raw[l + 1], PSTR("octet"), 6);
-    uip_udp_send(l + 9);
+    l += 9;
+
+#ifdef TFTP_OPTIONS_SUPPORT
+    /* ask for big blocks and a window, the server answers with OACK */
+    l += sprintf_P((char *) tftp_pk + l, PSTR("blksize%c%u"),
+		   0, TFTP_BLKSIZE_LIMIT - TFTP_BLKSIZE_LIMIT % TFTP_BLKSIZE_ALIGN)
+      + 1;
+    l += sprintf_P((char *) tftp_pk + l, PSTR("windowsize%c%u"),
+		   0, TFTP_WINDOWSIZE_MAX) + 1;
+#endif
+
+    uip_udp_send(l);
 
     /* uip_udp_conn->appstate.tftp.fire_req = 0; */
     uip_udp_conn->appstate.tftp.transfered = 5; /* retransmit in 2.5 seconds */
@@ -42,6 +42,15 @@ struct tftp_connection_state_t {
 #endif
 
     uint16_t       transfered;			/* also retry countdown */
+
+    uint16_t       sent;			/* last block of the window */
+    uint8_t        unacked;			/* blocks received since the
+						 * last ack */
+#define TFTP_UNACKED_GAP 0xff			/* lost block already acked */
+#ifdef TFTP_OPTIONS_SUPPORT
+    uint16_t       blksize;
+    uint8_t        windowsize;
+#endif
 };
 
 #endif /* TFTP_STATE_H */